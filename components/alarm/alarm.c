@@ -0,0 +1,208 @@
+// ESP-IDF Components
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "alarm.h"
+
+#define DEBUG_ALARM 0
+
+#define NVS_NAMESPACE "alarm"
+
+static const char *TAG = "alarm";
+static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+static const char *metric_suffix[ALARM_METRIC_CNT] = {
+    "Active",
+    "Setpoint",
+    "Deadband",
+    "Delay On",
+    "Delay Off",
+    "Enabled",
+};
+static const esp_tahu_metric_type_t metric_type[ALARM_METRIC_CNT] = {
+    ESP_TAHU_METRIC_TYPE_BOOLEAN,
+    ESP_TAHU_METRIC_TYPE_FLOAT,
+    ESP_TAHU_METRIC_TYPE_FLOAT,
+    ESP_TAHU_METRIC_TYPE_UINT32,
+    ESP_TAHU_METRIC_TYPE_UINT32,
+    ESP_TAHU_METRIC_TYPE_BOOLEAN,
+};
+
+static esp_err_t load_rule(alarm_t *alarm) {
+    nvs_handle_t handle;
+    esp_err_t result = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (result != ESP_OK)
+        return result;
+
+    // A blob saved before fields were appended is shorter. The missing fields keep their defaults
+    alarm_rule_t rule = alarm->rule;
+    size_t length = sizeof(rule);
+    result = nvs_get_blob(handle, alarm->nvs_key, &rule, &length);
+    nvs_close(handle);
+    if (result != ESP_OK)
+        return result;
+
+    alarm->rule = rule;
+    return ESP_OK;
+}
+
+static esp_err_t save_rule(alarm_t *alarm) {
+    nvs_handle_t handle;
+    esp_err_t result = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (result != ESP_OK)
+        return result;
+
+    result = nvs_set_blob(handle, alarm->nvs_key, &alarm->rule, sizeof(alarm->rule));
+    if (result == ESP_OK)
+        result = nvs_commit(handle);
+    nvs_close(handle);
+    return result;
+}
+
+static void set_rule_metrics(alarm_t *alarm) {
+    esp_tahu_set_metric_data(alarm->metrics + ALARM_METRIC_SETPOINT, false, &alarm->rule.setpoint);
+    esp_tahu_set_metric_data(alarm->metrics + ALARM_METRIC_DEADBAND, false, &alarm->rule.deadband);
+    esp_tahu_set_metric_data(alarm->metrics + ALARM_METRIC_DELAY_ON, false, &alarm->rule.delay_on_ms);
+    esp_tahu_set_metric_data(alarm->metrics + ALARM_METRIC_DELAY_OFF, false, &alarm->rule.delay_off_ms);
+    esp_tahu_set_metric_data(alarm->metrics + ALARM_METRIC_ENABLED, false, &alarm->rule.enabled);
+}
+
+/**
+ * @brief Adopt rule parameters written to the alarm metrics by DCMD and persist them
+ *
+ *  Writes are picked up on the next evaluation, so no change callbacks are needed.
+*/
+static void sync_rule(alarm_t *alarm) {
+    alarm_rule_t rule = {
+        .setpoint = *(float *)esp_tahu_get_metric_data(alarm->metrics + ALARM_METRIC_SETPOINT),
+        .deadband = *(float *)esp_tahu_get_metric_data(alarm->metrics + ALARM_METRIC_DEADBAND),
+        .delay_on_ms = *(uint32_t *)esp_tahu_get_metric_data(alarm->metrics + ALARM_METRIC_DELAY_ON),
+        .delay_off_ms = *(uint32_t *)esp_tahu_get_metric_data(alarm->metrics + ALARM_METRIC_DELAY_OFF),
+        .enabled = *(bool *)esp_tahu_get_metric_data(alarm->metrics + ALARM_METRIC_ENABLED),
+    };
+    if (rule.setpoint == alarm->rule.setpoint && rule.deadband == alarm->rule.deadband
+            && rule.delay_on_ms == alarm->rule.delay_on_ms && rule.delay_off_ms == alarm->rule.delay_off_ms
+            && rule.enabled == alarm->rule.enabled)
+        return;
+
+    alarm->rule = rule;
+    alarm->pending_since = 0;
+    esp_err_t result = save_rule(alarm);
+    if (result != ESP_OK)
+        ESP_LOGW(TAG, "Failed to persist rule '%s': %s", alarm->nvs_key, esp_err_to_name(result));
+    else
+        ESP_LOGI(TAG, "Rule '%s' updated. Setpoint: %f, deadband: %f, delay on: %d ms, delay off: %d ms, enabled: %d",
+                        alarm->nvs_key, rule.setpoint, rule.deadband, rule.delay_on_ms, rule.delay_off_ms, rule.enabled);
+}
+
+/**
+ * @brief Create the metrics of an alarm in a metric buffer and load its rule from NVS
+ *
+ *  Metrics are named <name>/<Active|Setpoint|Deadband|Delay On|Delay Off|Enabled> and must be
+ *  part of the device's birth. All but Active are rule parameters that can be written by DCMD.
+ *
+ * @param nvs_key Key the rule is persisted under. At most 15 characters
+ * @param default_rule Rule used until one has been written
+ * @param metric_buffer Buffer for ALARM_METRIC_CNT metrics
+*/
+esp_err_t alarm_init(alarm_t *alarm, char *device_id, const char *name, const char *nvs_key, alarm_direction_t direction,
+                        const alarm_rule_t *default_rule, esp_tahu_metric_t *metric_buffer) {
+#if DEBUG_ALARM
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+#else
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+#endif
+
+    *alarm = (alarm_t) {
+        .nvs_key = nvs_key,
+        .direction = direction,
+        .rule = *default_rule,
+        .metrics = metric_buffer,
+    };
+    esp_err_t result = load_rule(alarm);
+    if (result == ESP_OK)
+        ESP_LOGI(TAG, "Loaded rule '%s'", nvs_key);
+    else if (result != ESP_ERR_NVS_NOT_FOUND)
+        ESP_LOGW(TAG, "Failed to load rule '%s': %s. Using defaults", nvs_key, esp_err_to_name(result));
+
+    for (int i = 0; i < ALARM_METRIC_CNT; i++) {
+        char *metric_name = alarm->metric_names[i];
+        snprintf(metric_name, ALARM_METRIC_NAME_MAX, "%s/%s", name, metric_suffix[i]);
+        esp_tahu_metric_t new_metric = { 0 };
+        esp_tahu_create_metric(device_id, &new_metric, metric_name, metric_type[i], NULL);
+        metric_buffer[i] = new_metric;
+    }
+    esp_tahu_set_metric_data(metric_buffer + ALARM_METRIC_ACTIVE, false, &alarm->active);
+    set_rule_metrics(alarm);
+    return ESP_OK;
+}
+
+/**
+ * @brief Evaluate the alarm rule against a new sample
+ *
+ *  The alarm activates once its value has been beyond the setpoint for the delay on time, and
+ *  clears once it has been back inside the setpoint by the deadband for the delay off time.
+ *  Disabling an active alarm clears it immediately.
+ *
+ * @return True if the alarm state changed. The change is also flagged for alarm_take_pending()
+*/
+bool alarm_evaluate(alarm_t *alarm, float value) {
+    sync_rule(alarm);
+
+    alarm_rule_t *rule = &alarm->rule;
+    bool toggle;
+    uint32_t delay_ms;
+    if (!alarm->active) {
+        toggle = rule->enabled && (alarm->direction == ALARM_DIRECTION_HIGH ? value > rule->setpoint : value < rule->setpoint);
+        delay_ms = rule->delay_on_ms;
+    } else {
+        toggle = alarm->direction == ALARM_DIRECTION_HIGH ? value < rule->setpoint - rule->deadband : value > rule->setpoint + rule->deadband;
+        delay_ms = rule->delay_off_ms;
+        if (!rule->enabled) {
+            toggle = true;
+            delay_ms = 0;
+        }
+    }
+
+    if (!toggle) {
+        alarm->pending_since = 0;
+        return false;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (!alarm->pending_since)
+        alarm->pending_since = now;
+    if (now - alarm->pending_since < (int64_t)delay_ms * 1000)
+        return false;
+
+    alarm->pending_since = 0;
+    alarm->active = !alarm->active;
+    esp_tahu_set_metric_data(alarm->metrics + ALARM_METRIC_ACTIVE, false, &alarm->active);
+    ESP_LOGI(TAG, "Alarm '%s' %s. Value: %f", alarm->nvs_key, alarm->active ? "active" : "cleared", value);
+
+    portENTER_CRITICAL(&mux);
+    alarm->detection_time = now;
+    alarm->publish_pending = true;
+    portEXIT_CRITICAL(&mux);
+    return true;
+}
+
+/**
+ * @brief Clear the alarm's pending publish flag
+ *
+ * @param out_detection_time Set to the time the state change was detected, if one was pending
+ * @return True if the alarm state changed since the last call
+*/
+bool alarm_take_pending(alarm_t *alarm, int64_t *out_detection_time) {
+    portENTER_CRITICAL(&mux);
+    bool pending = alarm->publish_pending;
+    alarm->publish_pending = false;
+    *out_detection_time = alarm->detection_time;
+    portEXIT_CRITICAL(&mux);
+    return pending;
+}
@@ -0,0 +1,58 @@
+/**! @file alarm.h
+ * 
+*/
+#pragma once
+
+#include "esp_tahu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ALARM_METRIC_NAME_MAX 64
+
+typedef enum {
+    ALARM_DIRECTION_HIGH,
+    ALARM_DIRECTION_LOW,
+} alarm_direction_t;
+
+typedef enum {
+    ALARM_METRIC_ACTIVE,
+    ALARM_METRIC_SETPOINT,
+    ALARM_METRIC_DEADBAND,
+    ALARM_METRIC_DELAY_ON,
+    ALARM_METRIC_DELAY_OFF,
+    ALARM_METRIC_ENABLED,
+    ALARM_METRIC_CNT
+} alarm_metric_t;
+
+// Persisted in NVS as a blob. Append fields only, past the trailing padding of the previous layout.
+// Fields missing from an older, shorter blob are loaded with their defaults
+typedef struct {
+    float setpoint;
+    float deadband;
+    uint32_t delay_on_ms;
+    uint32_t delay_off_ms;
+    bool enabled;
+} alarm_rule_t;
+
+typedef struct {
+    const char *nvs_key;
+    alarm_direction_t direction;
+    alarm_rule_t rule;
+    esp_tahu_metric_t *metrics;     // ALARM_METRIC_CNT metrics, in the metric array of the device
+    char metric_names[ALARM_METRIC_CNT][ALARM_METRIC_NAME_MAX];
+    bool active;
+    bool publish_pending;           // State changed since the last alarm_take_pending()
+    int64_t pending_since;          // µs since boot the condition for the opposite state began. 0 if it doesn't hold
+    int64_t detection_time;         // µs since boot of the last state change
+} alarm_t;
+
+esp_err_t alarm_init(alarm_t *alarm, char *device_id, const char *name, const char *nvs_key, alarm_direction_t direction,
+                        const alarm_rule_t *default_rule, esp_tahu_metric_t *metric_buffer);
+bool alarm_evaluate(alarm_t *alarm, float value);
+bool alarm_take_pending(alarm_t *alarm, int64_t *out_detection_time);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,277 @@
+// ESP-IDF Components
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "app_tasks.h"
+
+#define DEBUG_APP_TASKS 0
+
+static const char *TAG = "app-tasks";
+
+// The MQTT task is created and pinned by esp-mqtt. Its entry mirrors CONFIG_MQTT_USE_CORE_x
+#if CONFIG_MQTT_TASK_CORE_SELECTION_ENABLED && CONFIG_MQTT_USE_CORE_1
+#define MQTT_TASK_CORE 1
+#elif CONFIG_MQTT_TASK_CORE_SELECTION_ENABLED
+#define MQTT_TASK_CORE 0
+#else
+#define MQTT_TASK_CORE tskNO_AFFINITY
+#endif
+
+// Sensing and control are pinned to APP_CPU (1), networking to PRO_CPU (0) alongside the Wi-Fi stack
+static const app_task_config_t task_config[APP_TASK_COUNT] = {
+    [APP_TASK_SENSOR_READ] = {
+        .name = "sensor_read_task",
+        .stack_size = CONFIG_APP_TASK_SENSOR_READ_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_SENSOR_READ_PRIORITY,
+        .core_id = CONFIG_APP_TASK_SENSOR_READ_CORE,
+    },
+    [APP_TASK_TEMP_CONTROLLER] = {
+        .name = "temp_controller_task",
+        .stack_size = CONFIG_APP_TASK_TEMP_CONTROLLER_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_TEMP_CONTROLLER_PRIORITY,
+        .core_id = CONFIG_APP_TASK_TEMP_CONTROLLER_CORE,
+    },
+    [APP_TASK_WAKE_WINDOW] = {
+        .name = "wake_window_task",
+        .stack_size = CONFIG_APP_TASK_WAKE_WINDOW_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_WAKE_WINDOW_PRIORITY,
+        .core_id = CONFIG_APP_TASK_WAKE_WINDOW_CORE,
+    },
+    [APP_TASK_TAHU_PUBLISH] = {
+        .name = "tahu_data_publish_task",
+        .stack_size = CONFIG_APP_TASK_TAHU_PUBLISH_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_TAHU_PUBLISH_PRIORITY,
+        .core_id = CONFIG_APP_TASK_TAHU_PUBLISH_CORE,
+    },
+#if CONFIG_ALARM_ENABLE
+    [APP_TASK_ALARM_PUBLISH] = {
+        .name = "alarm_publish_task",
+        .stack_size = CONFIG_APP_TASK_ALARM_PUBLISH_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_ALARM_PUBLISH_PRIORITY,
+        .core_id = CONFIG_APP_TASK_ALARM_PUBLISH_CORE,
+    },
+#endif
+#if CONFIG_TS_LOG_ENABLE
+    [APP_TASK_HISTORY_BACKFILL] = {
+        .name = "history_backfill_task",
+        .stack_size = CONFIG_APP_TASK_HISTORY_BACKFILL_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_HISTORY_BACKFILL_PRIORITY,
+        .core_id = CONFIG_APP_TASK_HISTORY_BACKFILL_CORE,
+    },
+#endif
+    [APP_TASK_MQTT] = {
+        .name = "mqtt_task",    // Created by esp-mqtt
+        .stack_size = CONFIG_APP_TASK_MQTT_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_MQTT_PRIORITY,
+        .core_id = MQTT_TASK_CORE,
+    },
+    [APP_TASK_MQTT_INBOUND] = {
+        .name = "mqtt_inbound_task",
+        .stack_size = CONFIG_APP_TASK_MQTT_INBOUND_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_MQTT_INBOUND_PRIORITY,
+        .core_id = CONFIG_APP_TASK_MQTT_INBOUND_CORE,
+    },
+    [APP_TASK_STACK_MONITOR] = {
+        .name = "stack_monitor_task",
+        .stack_size = CONFIG_APP_TASK_STACK_MONITOR_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_STACK_MONITOR_PRIORITY,
+        .core_id = CONFIG_APP_TASK_STACK_MONITOR_CORE,
+    },
+#if CONFIG_APP_TASK_JITTER_STRESS
+    [APP_TASK_JITTER_STRESS] = {
+        .name = "jitter_stress_task",
+        .stack_size = CONFIG_APP_TASK_JITTER_STRESS_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_JITTER_STRESS_PRIORITY,
+        .core_id = 0,
+    },
+#endif
+#if CONFIG_DLOG_ENABLE
+    [APP_TASK_DLOG_DRAIN] = {
+        .name = "dlog_drain_task",
+        .stack_size = CONFIG_APP_TASK_DLOG_DRAIN_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_DLOG_DRAIN_PRIORITY,
+        .core_id = CONFIG_APP_TASK_DLOG_DRAIN_CORE,
+    },
+#endif
+#if CONFIG_OTA_ENABLE
+    [APP_TASK_OTA] = {
+        .name = "ota_task",
+        .stack_size = CONFIG_APP_TASK_OTA_STACK_SIZE,
+        .priority = CONFIG_APP_TASK_OTA_PRIORITY,
+        .core_id = CONFIG_APP_TASK_OTA_CORE,
+    },
+#endif
+};
+
+static TaskHandle_t task_handles[APP_TASK_COUNT];
+
+#if CONFIG_APP_STATIC_ALLOCATION
+// Stacks of the tasks that can be created in this configuration. The MQTT task is created by esp-mqtt
+static struct {
+#if !CONFIG_POWER_MGMT_ENABLE && !CONFIG_APP_IMPL_DEEP_SLEEP_BATCH
+    StackType_t sensor_read[CONFIG_APP_TASK_SENSOR_READ_STACK_SIZE];
+    StackType_t tahu_publish[CONFIG_APP_TASK_TAHU_PUBLISH_STACK_SIZE];
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+    StackType_t temp_controller[CONFIG_APP_TASK_TEMP_CONTROLLER_STACK_SIZE];
+#endif
+#endif
+#if CONFIG_POWER_MGMT_ENABLE
+    StackType_t wake_window[CONFIG_APP_TASK_WAKE_WINDOW_STACK_SIZE];
+#endif
+#if CONFIG_ALARM_ENABLE
+    StackType_t alarm_publish[CONFIG_APP_TASK_ALARM_PUBLISH_STACK_SIZE];
+#endif
+#if CONFIG_TS_LOG_ENABLE
+    StackType_t history_backfill[CONFIG_APP_TASK_HISTORY_BACKFILL_STACK_SIZE];
+#endif
+    StackType_t mqtt_inbound[CONFIG_APP_TASK_MQTT_INBOUND_STACK_SIZE];
+#if !CONFIG_APP_IMPL_DEEP_SLEEP_BATCH
+    StackType_t stack_monitor[CONFIG_APP_TASK_STACK_MONITOR_STACK_SIZE];
+#endif
+#if CONFIG_APP_TASK_JITTER_STRESS
+    StackType_t jitter_stress[CONFIG_APP_TASK_JITTER_STRESS_STACK_SIZE];
+#endif
+#if CONFIG_DLOG_ENABLE
+    StackType_t dlog_drain[CONFIG_APP_TASK_DLOG_DRAIN_STACK_SIZE];
+#endif
+#if CONFIG_OTA_ENABLE
+    StackType_t ota[CONFIG_APP_TASK_OTA_STACK_SIZE];
+#endif
+} task_stacks;
+
+static StackType_t *const task_stack[APP_TASK_COUNT] = {
+#if !CONFIG_POWER_MGMT_ENABLE && !CONFIG_APP_IMPL_DEEP_SLEEP_BATCH
+    [APP_TASK_SENSOR_READ] = task_stacks.sensor_read,
+    [APP_TASK_TAHU_PUBLISH] = task_stacks.tahu_publish,
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+    [APP_TASK_TEMP_CONTROLLER] = task_stacks.temp_controller,
+#endif
+#endif
+#if CONFIG_POWER_MGMT_ENABLE
+    [APP_TASK_WAKE_WINDOW] = task_stacks.wake_window,
+#endif
+#if CONFIG_ALARM_ENABLE
+    [APP_TASK_ALARM_PUBLISH] = task_stacks.alarm_publish,
+#endif
+#if CONFIG_TS_LOG_ENABLE
+    [APP_TASK_HISTORY_BACKFILL] = task_stacks.history_backfill,
+#endif
+    [APP_TASK_MQTT_INBOUND] = task_stacks.mqtt_inbound,
+#if !CONFIG_APP_IMPL_DEEP_SLEEP_BATCH
+    [APP_TASK_STACK_MONITOR] = task_stacks.stack_monitor,
+#endif
+#if CONFIG_APP_TASK_JITTER_STRESS
+    [APP_TASK_JITTER_STRESS] = task_stacks.jitter_stress,
+#endif
+#if CONFIG_DLOG_ENABLE
+    [APP_TASK_DLOG_DRAIN] = task_stacks.dlog_drain,
+#endif
+#if CONFIG_OTA_ENABLE
+    [APP_TASK_OTA] = task_stacks.ota,
+#endif
+};
+static StaticTask_t task_buffers[APP_TASK_COUNT];
+#endif
+
+static void stack_monitor_task() {
+    for ( ;; ) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_APP_TASK_STACK_CHECK_PERIOD * 1000));
+        app_task_check_stacks();
+    }
+}
+
+const app_task_config_t *app_task_get_config(app_task_id_t task_id) {
+    if (task_id >= APP_TASK_COUNT)
+        return NULL;
+    return &task_config[task_id];
+}
+
+/**
+ * @brief Create a task pinned to the core and with the priority and stack size from the task configuration table
+*/
+esp_err_t app_task_create(app_task_id_t task_id, TaskFunction_t task_function, void *arg, TaskHandle_t *out_handle) {
+#if DEBUG_APP_TASKS
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+#else
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+#endif
+
+    const app_task_config_t *config = app_task_get_config(task_id);
+    if (!config)
+        return ESP_ERR_INVALID_ARG;
+
+#if CONFIG_APP_STATIC_ALLOCATION
+    if (!task_stack[task_id]) {
+        ESP_LOGE(TAG, "No static stack for task '%s' in this configuration", config->name);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    // The stack of a running task can't be handed to a second instance
+    if (task_handles[task_id])
+        return ESP_ERR_INVALID_STATE;
+    task_handles[task_id] = xTaskCreateStaticPinnedToCore(task_function, config->name, config->stack_size, arg,
+                                                config->priority, task_stack[task_id], &task_buffers[task_id], config->core_id);
+    BaseType_t result = task_handles[task_id] ? pdPASS : pdFAIL;
+#else
+    BaseType_t result = xTaskCreatePinnedToCore(task_function, config->name, config->stack_size, arg,
+                                                config->priority, &task_handles[task_id], config->core_id);
+#endif
+    if (result != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task '%s'", config->name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGD(TAG, "Created task '%s'. Core: %d, Priority: %d, Stack: %d", config->name, config->core_id,
+                    config->priority, config->stack_size);
+    if (out_handle)
+        *out_handle = task_handles[task_id];
+    return ESP_OK;
+}
+
+void app_task_delete(app_task_id_t task_id) {
+    if (task_id >= APP_TASK_COUNT || !task_handles[task_id])
+        return;
+
+    TaskHandle_t handle = task_handles[task_id];
+    task_handles[task_id] = NULL;
+    vTaskDelete(handle);
+}
+
+/**
+ * @brief Log a warning for every running task whose unused stack is below the configured headroom
+*/
+void app_task_check_stacks() {
+    for (int i = 0; i < APP_TASK_COUNT; i++) {
+        TaskHandle_t handle = task_handles[i];
+        // Tasks created outside of app_task_create are looked up by name
+        if (!handle)
+            handle = xTaskGetHandle(task_config[i].name);
+        if (!handle)
+            continue;
+
+        UBaseType_t headroom = uxTaskGetStackHighWaterMark(handle);
+        if (headroom < CONFIG_APP_TASK_STACK_HEADROOM_MIN)
+            ESP_LOGW(TAG, "Task '%s' stack headroom low: %d of %d bytes unused", task_config[i].name, headroom,
+                            task_config[i].stack_size);
+        else
+            ESP_LOGD(TAG, "Task '%s' stack headroom: %d of %d bytes unused", task_config[i].name, headroom,
+                            task_config[i].stack_size);
+    }
+}
+
+void app_task_monitor_start() {
+    app_task_create(APP_TASK_STACK_MONITOR, stack_monitor_task, NULL, NULL);
+}
+
+#if CONFIG_APP_STATIC_ALLOCATION
+/**
+ * @brief Get the size of the statically allocated task stacks and control blocks
+*/
+size_t app_task_get_static_size() {
+    return sizeof(task_stacks) + sizeof(task_buffers);
+}
+#endif
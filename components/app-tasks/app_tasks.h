@@ -0,0 +1,58 @@
+/**! @file app_tasks.h
+ * 
+*/
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    APP_TASK_SENSOR_READ,
+    APP_TASK_TEMP_CONTROLLER,
+    APP_TASK_WAKE_WINDOW,
+    APP_TASK_TAHU_PUBLISH,
+#if CONFIG_ALARM_ENABLE
+    APP_TASK_ALARM_PUBLISH,
+#endif
+#if CONFIG_TS_LOG_ENABLE
+    APP_TASK_HISTORY_BACKFILL,
+#endif
+    APP_TASK_MQTT,
+    APP_TASK_MQTT_INBOUND,
+    APP_TASK_STACK_MONITOR,
+#if CONFIG_APP_TASK_JITTER_STRESS
+    APP_TASK_JITTER_STRESS,
+#endif
+#if CONFIG_DLOG_ENABLE
+    APP_TASK_DLOG_DRAIN,
+#endif
+#if CONFIG_OTA_ENABLE
+    APP_TASK_OTA,
+#endif
+    APP_TASK_COUNT
+} app_task_id_t;
+
+typedef struct {
+    const char *name;
+    uint32_t stack_size;
+    UBaseType_t priority;
+    BaseType_t core_id;
+} app_task_config_t;
+
+const app_task_config_t *app_task_get_config(app_task_id_t task_id);
+esp_err_t app_task_create(app_task_id_t task_id, TaskFunction_t task_function, void *arg, TaskHandle_t *out_handle);
+void app_task_delete(app_task_id_t task_id);
+void app_task_check_stacks();
+void app_task_monitor_start();
+#if CONFIG_APP_STATIC_ALLOCATION
+size_t app_task_get_static_size();
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,234 @@
+// ESP-IDF Components
+#include <sys/time.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Project Components
+#include "sensor.h"
+
+// Project Files
+#include "batch_node.h"
+
+#define DEBUG_BATCH_NODE 0
+
+#define SAMPLES_PER_PAYLOAD 8       // Samples per historical DDATA call. Bounds the stack used for the history metrics
+#define SNTP_SYNC_TIMEOUT_MS 10000
+
+typedef struct {
+    uint64_t timestamp;     // ms since epoch
+    float temperature;
+    float humidity;
+    bool time_synced;       // False if the RTC had not been synchronized when the sample was taken
+} batch_sample_t;
+
+typedef struct {
+    uint16_t head;          // Index of the oldest sample
+    uint16_t count;
+    bool time_synced;
+    uint32_t last_upload_wake_ms;
+    uint32_t last_sample_wake_ms;
+    batch_sample_t samples[CONFIG_BATCH_NODE_RING_SIZE];
+} batch_ring_t;
+
+static const char *TAG = "batch-node";
+
+// Updated from the MQTT task as the history payloads are acknowledged
+static volatile int history_acked;
+static volatile bool history_lost;
+
+// Retained across deep sleep. Initialized to zero on power-on
+RTC_DATA_ATTR static batch_ring_t ring;
+
+static uint64_t get_time_ms() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static batch_sample_t *get_sample(int index) {
+    return &ring.samples[(ring.head + index) % CONFIG_BATCH_NODE_RING_SIZE];
+}
+
+/**
+ * @brief Read the sensor and append the sample to the RTC memory ring
+ *
+ *  The oldest sample is overwritten once the ring is full.
+*/
+esp_err_t batch_node_record_sample() {
+#if DEBUG_BATCH_NODE
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+#else
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+#endif
+
+    esp_err_t read_result = sensor_read();
+    uint32_t required = SENSOR_CHANNEL_BIT(SENSOR_CHANNEL_TEMPERATURE) | SENSOR_CHANNEL_BIT(SENSOR_CHANNEL_HUMIDITY);
+    if (read_result == ESP_OK && (sensor_get_sample()->updated & required) != required)
+        read_result = ESP_ERR_INVALID_RESPONSE;
+    if (read_result != ESP_OK) {
+        ESP_LOGW(TAG, "Sensor read failed: %s", esp_err_to_name(read_result));
+        return read_result;
+    }
+
+    if (ring.count == CONFIG_BATCH_NODE_RING_SIZE) {
+        ring.head = (ring.head + 1) % CONFIG_BATCH_NODE_RING_SIZE;
+        ring.count--;
+    }
+
+    batch_sample_t *sample = get_sample(ring.count);
+    sample->timestamp = get_time_ms();
+    sample->temperature = sensor_get_value(SENSOR_CHANNEL_TEMPERATURE);
+    sample->humidity = sensor_get_value(SENSOR_CHANNEL_HUMIDITY);
+    sample->time_synced = ring.time_synced;
+    ring.count++;
+
+    ESP_LOGD(TAG, "Recorded sample %d: temperature=%f, humidity=%f", ring.count, sample->temperature, sample->humidity);
+    return ESP_OK;
+}
+
+bool batch_node_upload_due() {
+    return ring.count >= CONFIG_BATCH_NODE_SAMPLES_PER_UPLOAD;
+}
+
+/**
+ * @brief Synchronize the RTC with SNTP if it hasn't been since power-on
+ *
+ *  Samples taken before the first synchronization are shifted by the measured clock correction.
+*/
+void batch_node_sync_time() {
+    if (ring.time_synced)
+        return;
+
+    uint64_t time_before = get_time_ms();
+    int64_t timer_before = esp_timer_get_time();
+
+    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    sntp_setservername(0, CONFIG_BATCH_NODE_SNTP_SERVER);
+    sntp_init();
+
+    int waited = 0;
+    while (sntp_get_sync_status() != SNTP_SYNC_STATUS_COMPLETED && waited < SNTP_SYNC_TIMEOUT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+        waited += 100;
+    }
+    sntp_stop();
+
+    if (sntp_get_sync_status() != SNTP_SYNC_STATUS_COMPLETED) {
+        ESP_LOGW(TAG, "Time synchronization timed out");
+        return;
+    }
+
+    int64_t elapsed_ms = (esp_timer_get_time() - timer_before) / 1000;
+    int64_t correction = (int64_t)get_time_ms() - (int64_t)(time_before + elapsed_ms);
+    for (int i = 0; i < ring.count; i++) {
+        batch_sample_t *sample = get_sample(i);
+        if (!sample->time_synced) {
+            sample->timestamp += correction;
+            sample->time_synced = true;
+        }
+    }
+    ring.time_synced = true;
+    ESP_LOGI(TAG, "Time synchronized. Correction: %lld ms", correction);
+}
+
+static void history_ack_handler(int msg_id, bool acked, void *ctx) {
+    if (acked)
+        history_acked++;
+    else
+        history_lost = true;
+}
+
+/**
+ * @brief Publish all retained samples as historical DDATA with QoS 1
+ *
+ *  Each payload must be acknowledged before the next one is sent, so the in-flight table never
+ *  overflows. The samples are only safe to clear once this returns ESP_OK.
+ *
+ * @param temperature_metric Device metric the temperature samples are published as
+ * @param humidity_metric Device metric the humidity samples are published as
+ * @return ESP_ERR_TIMEOUT if the acknowledgements did not arrive within BATCH_NODE_ACK_TIMEOUT,
+ * ESP_FAIL if a payload could not be published or was reported lost
+*/
+esp_err_t batch_node_publish_history(esp_tahu_metric_t *temperature_metric, esp_tahu_metric_t *humidity_metric) {
+    esp_tahu_metric_t history[SAMPLES_PER_PAYLOAD * 2];
+    int sample_index = 0;
+    int published = 0;
+    int waited = 0;
+    history_acked = 0;
+    history_lost = false;
+
+    while (sample_index < ring.count) {
+        size_t metrics_count = 0;
+        for (int i = 0; i < SAMPLES_PER_PAYLOAD && sample_index < ring.count; i++, sample_index++) {
+            batch_sample_t *sample = get_sample(sample_index);
+
+            history[metrics_count] = *temperature_metric;
+            esp_tahu_set_metric_data(&history[metrics_count], false, &sample->temperature);
+            history[metrics_count].is_historical = true;
+            history[metrics_count].timestamp = sample->timestamp;
+            metrics_count++;
+
+            history[metrics_count] = *humidity_metric;
+            esp_tahu_set_metric_data(&history[metrics_count], false, &sample->humidity);
+            history[metrics_count].is_historical = true;
+            history[metrics_count].timestamp = sample->timestamp;
+            metrics_count++;
+        }
+
+        int payload_count = esp_tahu_publish_ddata_acked(history, metrics_count, history_ack_handler, NULL);
+        if (payload_count < 0)
+            return ESP_FAIL;
+        published += payload_count;
+
+        while (history_acked < published && !history_lost && waited < CONFIG_BATCH_NODE_ACK_TIMEOUT * 1000) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+            waited += 100;
+        }
+        if (history_lost)
+            return ESP_FAIL;
+        if (history_acked < published)
+            return ESP_ERR_TIMEOUT;
+    }
+    ESP_LOGI(TAG, "Published %d historical samples", ring.count);
+    return ESP_OK;
+}
+
+void batch_node_clear() {
+    ring.head = 0;
+    ring.count = 0;
+}
+
+uint32_t batch_node_get_last_upload_wake_ms() {
+    return ring.last_upload_wake_ms;
+}
+
+uint32_t batch_node_get_last_sample_wake_ms() {
+    return ring.last_sample_wake_ms;
+}
+
+/**
+ * @brief Record the wake duration and enter deep sleep until the next sample is due
+ *
+ * @param uploaded True if this wake cycle connected to upload samples
+*/
+void batch_node_sleep(bool uploaded) {
+    uint32_t wake_ms = esp_timer_get_time() / 1000;
+    if (uploaded)
+        ring.last_upload_wake_ms = wake_ms;
+    else
+        ring.last_sample_wake_ms = wake_ms;
+
+    // Subtract the time spent awake so samples stay on a fixed period
+    uint64_t sleep_ms = (uint64_t)CONFIG_BATCH_NODE_SAMPLE_INTERVAL * 1000;
+    if (wake_ms < sleep_ms)
+        sleep_ms -= wake_ms;
+
+    ESP_LOGI(TAG, "Awake for %d ms. Sleeping for %lld ms", wake_ms, sleep_ms);
+    esp_sleep_enable_timer_wakeup(sleep_ms * 1000);
+    esp_deep_sleep_start();
+}
@@ -0,0 +1,23 @@
+/**! @file batch_node.h
+ * 
+*/
+#pragma once
+
+#include "esp_tahu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t batch_node_record_sample();
+bool batch_node_upload_due();
+void batch_node_sync_time();
+esp_err_t batch_node_publish_history(esp_tahu_metric_t *temperature_metric, esp_tahu_metric_t *humidity_metric);
+void batch_node_clear();
+uint32_t batch_node_get_last_upload_wake_ms();
+uint32_t batch_node_get_last_sample_wake_ms();
+void batch_node_sleep(bool uploaded);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
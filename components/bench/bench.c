@@ -0,0 +1,359 @@
+// ESP-IDF Components
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+// Project Components
+#include "dht.h"
+#include "esp_tahu.h"
+
+// Project Files
+#include "bench.h"
+
+#define DEBUG_BENCH 0
+
+#define NVS_NAMESPACE "bench"
+#define BATCH_MAX 1024              // Operations between clock reads, so the clock read doesn't dominate fast cases
+#define ENCODE_BUFFER_SIZE 32768
+#define ALIAS_BASE 1000             // Clear of the aliases of the application's metrics
+#define FRAME_BYTES 5
+
+typedef enum {
+    BENCH_ENCODE,
+    BENCH_DECODE,
+    BENCH_SET_FLOAT,
+    BENCH_SET_UINT32,
+    BENCH_SET_STRING,
+    BENCH_DHT_FRAME,
+} bench_kind_t;
+
+typedef struct {
+    const char *name;
+    const char *nvs_key;        // NVS keys are limited to 15 characters
+    bench_kind_t kind;
+    size_t size;                // Metrics per payload
+} bench_case_t;
+
+// Persisted in NVS as a blob. Append fields only: a shorter blob stored by an older build is still loaded
+typedef struct {
+    uint32_t ns_per_op;
+    uint32_t allocs_per_op_x10; // Allocations per operation, in tenths
+    uint32_t bytes_per_op;
+} bench_result_t;
+
+static const char *TAG = "bench";
+static const bench_case_t cases[] = {
+    { "encode 1 metric",     "enc_1",     BENCH_ENCODE,     1 },
+    { "encode 10 metrics",   "enc_10",    BENCH_ENCODE,     10 },
+    { "encode 100 metrics",  "enc_100",   BENCH_ENCODE,     100 },
+    { "encode 1000 metrics", "enc_1000",  BENCH_ENCODE,     1000 },
+    { "decode 1 metric",     "dec_1",     BENCH_DECODE,     1 },
+    { "decode 10 metrics",   "dec_10",    BENCH_DECODE,     10 },
+    { "decode 30 metrics",   "dec_30",    BENCH_DECODE,     30 },   // About the most that fit the default SPARKPLUG_CMD_MAX_PAYLOAD_SIZE
+    { "set float metric",    "set_float", BENCH_SET_FLOAT,  1 },
+    { "set uint32 metric",   "set_u32",   BENCH_SET_UINT32, 1 },
+    { "set string metric",   "set_str",   BENCH_SET_STRING, 1 },
+    { "decode DHT frame",    "dht_frame", BENCH_DHT_FRAME,  1 },
+};
+
+// Frames recorded from a DHT22. Humidity, temperature and checksum bytes
+static const uint8_t dht_frames[][FRAME_BYTES] = {
+    { 0x02, 0x8C, 0x01, 0x5F, 0xEE },   // 65.2 %, 35.1 C
+    { 0x01, 0xF4, 0x80, 0x65, 0xDA },   // 50.0 %, -10.1 C
+    { 0x03, 0x52, 0x00, 0xE6, 0x3B },   // 85.0 %, 23.0 C
+};
+#define DHT_FRAME_COUNT (sizeof(dht_frames) / sizeof(dht_frames[0]))
+
+#if CONFIG_BENCH_UPDATE_BASELINE
+static const bool update_baseline = true;
+#else
+static const bool update_baseline = false;
+#endif
+
+static volatile bool counting = false;
+static uint32_t alloc_count;
+static uint64_t alloc_bytes;
+static esp_tahu_metric_t *metrics;
+static uint8_t *encode_buffer;
+static ssize_t encode_length;
+static uint32_t frame_cycles[DHT_FRAME_COUNT][DHT_FRAME_PULSES];
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    if (counting) {
+        alloc_count++;
+        alloc_bytes += size;
+    }
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    if (counting) {
+        alloc_count++;
+        alloc_bytes += count * size;
+    }
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    if (counting && size) {
+        alloc_count++;
+        alloc_bytes += size;
+    }
+    return __real_realloc(ptr, size);
+}
+
+#ifdef _NEWLIB_VERSION
+// newlib's own allocations, such as strdup(), call the reentrant functions rather than malloc
+void *__real__malloc_r(struct _reent *reent, size_t size);
+void *__real__calloc_r(struct _reent *reent, size_t count, size_t size);
+void *__real__realloc_r(struct _reent *reent, void *ptr, size_t size);
+
+void *__wrap__malloc_r(struct _reent *reent, size_t size) {
+    if (counting) {
+        alloc_count++;
+        alloc_bytes += size;
+    }
+    return __real__malloc_r(reent, size);
+}
+
+void *__wrap__calloc_r(struct _reent *reent, size_t count, size_t size) {
+    if (counting) {
+        alloc_count++;
+        alloc_bytes += count * size;
+    }
+    return __real__calloc_r(reent, count, size);
+}
+
+void *__wrap__realloc_r(struct _reent *reent, void *ptr, size_t size) {
+    if (counting && size) {
+        alloc_count++;
+        alloc_bytes += size;
+    }
+    return __real__realloc_r(reent, ptr, size);
+}
+#endif
+
+/**
+ * @brief Expand the recorded frames into the pulse cycle counts the DHT driver measures
+ *
+ *  A 0 bit's high pulse is shorter than its low pulse and a 1 bit's is longer. Counts vary from
+ *  pulse to pulse as they do on hardware.
+*/
+static void init_frame_cycles() {
+    for (int frame = 0; frame < DHT_FRAME_COUNT; frame++) {
+        for (int bit = 0; bit < DHT_FRAME_PULSES / 2; bit++) {
+            bool one = dht_frames[frame][bit / 8] & (0x80 >> (bit % 8));
+            uint32_t jitter = (bit * 7 + frame * 13) % 16;
+            frame_cycles[frame][2 * bit] = 400 + jitter;
+            frame_cycles[frame][2 * bit + 1] = (one ? 560 : 220) + jitter;
+        }
+    }
+}
+
+static esp_err_t init_metrics(size_t count, esp_tahu_metric_type_t data_type) {
+    metrics = calloc(count, sizeof(esp_tahu_metric_t));
+    if (!metrics)
+        return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < count; i++) {
+        // Readback is disabled so applying decoded writes doesn't publish
+        metrics[i] = (esp_tahu_metric_t) {
+            .metric_name = "bench",
+            .has_alias = true,
+            .alias = ALIAS_BASE + i,
+            .data_type = data_type,
+        };
+        float value = 20.0 + i * 0.1;
+        esp_tahu_set_metric_data(metrics + i, data_type == ESP_TAHU_METRIC_TYPE_STRING, &value);
+    }
+    return ESP_OK;
+}
+
+static void free_metrics(size_t count) {
+    for (int i = 0; i < count; i++) {
+        if (metrics[i].data_type == ESP_TAHU_METRIC_TYPE_STRING)
+            free(metrics[i].value.string_value);
+    }
+    free(metrics);
+    metrics = NULL;
+}
+
+static esp_err_t setup(const bench_case_t *bench_case) {
+    switch (bench_case->kind) {
+        case BENCH_ENCODE:
+            return init_metrics(bench_case->size, ESP_TAHU_METRIC_TYPE_FLOAT);
+        case BENCH_DECODE: {
+            esp_err_t result = init_metrics(bench_case->size, ESP_TAHU_METRIC_TYPE_FLOAT);
+            if (result != ESP_OK)
+                return result;
+            // A DCMD carries the same metrics message as the data payloads
+            encode_length = esp_tahu_encode_data(metrics, bench_case->size, encode_buffer, CONFIG_SPARKPLUG_CMD_MAX_PAYLOAD_SIZE);
+            if (encode_length < 0) {
+                free_metrics(bench_case->size);
+                return ESP_ERR_INVALID_SIZE;
+            }
+            return ESP_OK;
+        }
+        case BENCH_SET_FLOAT:
+            return init_metrics(1, ESP_TAHU_METRIC_TYPE_FLOAT);
+        case BENCH_SET_UINT32:
+            return init_metrics(1, ESP_TAHU_METRIC_TYPE_UINT32);
+        case BENCH_SET_STRING:
+            return init_metrics(1, ESP_TAHU_METRIC_TYPE_STRING);
+        default:
+            return ESP_OK;
+    }
+}
+
+static void teardown(const bench_case_t *bench_case) {
+    if (bench_case->kind == BENCH_DECODE)
+        esp_tahu_apply_pending();
+    if (metrics)
+        free_metrics(bench_case->size);
+}
+
+static void run_once(const bench_case_t *bench_case, uint32_t iteration) {
+    switch (bench_case->kind) {
+        case BENCH_ENCODE:
+            esp_tahu_encode_data(metrics, bench_case->size, encode_buffer, ENCODE_BUFFER_SIZE);
+            break;
+        case BENCH_DECODE:
+            esp_tahu_decode_command((char *)encode_buffer, encode_length, metrics, bench_case->size);
+            break;
+        case BENCH_SET_FLOAT: {
+            float value = iteration * 0.1;
+            esp_tahu_set_metric_data(metrics, false, &value);
+            break;
+        }
+        case BENCH_SET_UINT32:
+            esp_tahu_set_metric_data(metrics, false, &iteration);
+            break;
+        case BENCH_SET_STRING:
+            esp_tahu_set_metric_data(metrics, false, iteration & 1 ? "on" : "off");
+            break;
+        case BENCH_DHT_FRAME: {
+            dht_data_t sample;
+            dht_decode_frame(frame_cycles[iteration % DHT_FRAME_COUNT], &sample);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Repeat a case for at least CONFIG_BENCH_DURATION ms, in growing batches between clock reads
+*/
+static esp_err_t measure(const bench_case_t *bench_case, bench_result_t *out_result) {
+    esp_err_t result = setup(bench_case);
+    if (result != ESP_OK)
+        return result;
+
+    uint32_t iterations = 0;
+    uint32_t batch = 1;
+    int64_t elapsed;
+    alloc_count = 0;
+    alloc_bytes = 0;
+    counting = true;
+    int64_t start = esp_timer_get_time();
+    do {
+        for (uint32_t i = 0; i < batch; i++)
+            run_once(bench_case, iterations++);
+        if (batch < BATCH_MAX)
+            batch *= 2;
+        elapsed = esp_timer_get_time() - start;
+    } while (elapsed < CONFIG_BENCH_DURATION * 1000LL);
+    counting = false;
+    teardown(bench_case);
+
+    out_result->ns_per_op = elapsed * 1000 / iterations;
+    out_result->allocs_per_op_x10 = (uint64_t)alloc_count * 10 / iterations;
+    out_result->bytes_per_op = alloc_bytes / iterations;
+    return ESP_OK;
+}
+
+static bool regressed(uint32_t value, uint32_t baseline) {
+    return (uint64_t)value * 100 > (uint64_t)baseline * (100 + CONFIG_BENCH_REGRESSION_THRESHOLD);
+}
+
+/**
+ * @brief Run every benchmark case and compare the results against the baseline stored in NVS
+ *
+ *  Run before any other task is started, so measurements aren't disturbed and only the allocations
+ *  of the measured code are counted. A case without a stored baseline stores its results as the baseline.
+ *
+ * @return ESP_FAIL if any case regressed by more than CONFIG_BENCH_REGRESSION_THRESHOLD percent
+*/
+esp_err_t bench_run() {
+#if DEBUG_BENCH
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+#else
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+#endif
+
+    nvs_handle_t handle;
+    bool nvs_available = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK;
+    if (!nvs_available)
+        ESP_LOGW(TAG, "NVS unavailable. Results are not compared against a baseline");
+
+    encode_buffer = malloc(ENCODE_BUFFER_SIZE);
+    if (!encode_buffer) {
+        if (nvs_available)
+            nvs_close(handle);
+        return ESP_ERR_NO_MEM;
+    }
+    init_frame_cycles();
+
+    int regression_count = 0;
+    ESP_LOGI(TAG, "%-20s %10s %10s %10s  %s", "Case", "ns/op", "allocs/op", "bytes/op", "Baseline ns/op");
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const bench_case_t *bench_case = &cases[i];
+        bench_result_t result;
+        esp_err_t measure_result = measure(bench_case, &result);
+        if (measure_result != ESP_OK) {
+            ESP_LOGW(TAG, "%-20s skipped: %s", bench_case->name, esp_err_to_name(measure_result));
+            continue;
+        }
+
+        // Fields missing from an older, shorter baseline are never reported as regressed
+        bench_result_t baseline;
+        memset(&baseline, 0xFF, sizeof(baseline));
+        size_t length = sizeof(baseline);
+        bool has_baseline = nvs_available && nvs_get_blob(handle, bench_case->nvs_key, &baseline, &length) == ESP_OK;
+        bool case_regressed = has_baseline && (regressed(result.ns_per_op, baseline.ns_per_op)
+                                || regressed(result.allocs_per_op_x10, baseline.allocs_per_op_x10)
+                                || regressed(result.bytes_per_op, baseline.bytes_per_op));
+        if (case_regressed) {
+            regression_count++;
+            ESP_LOGE(TAG, "%-20s %10u %8u.%u %10u  %u REGRESSED (allocs/op %u.%u, bytes/op %u)", bench_case->name,
+                            result.ns_per_op, result.allocs_per_op_x10 / 10, result.allocs_per_op_x10 % 10, result.bytes_per_op,
+                            baseline.ns_per_op, baseline.allocs_per_op_x10 / 10, baseline.allocs_per_op_x10 % 10, baseline.bytes_per_op);
+        } else if (has_baseline) {
+            ESP_LOGI(TAG, "%-20s %10u %8u.%u %10u  %u", bench_case->name, result.ns_per_op,
+                            result.allocs_per_op_x10 / 10, result.allocs_per_op_x10 % 10, result.bytes_per_op, baseline.ns_per_op);
+        } else {
+            ESP_LOGI(TAG, "%-20s %10u %8u.%u %10u  none", bench_case->name, result.ns_per_op,
+                            result.allocs_per_op_x10 / 10, result.allocs_per_op_x10 % 10, result.bytes_per_op);
+        }
+
+        if (nvs_available && (!has_baseline || update_baseline))
+            nvs_set_blob(handle, bench_case->nvs_key, &result, sizeof(result));
+    }
+
+    free(encode_buffer);
+    encode_buffer = NULL;
+    if (nvs_available) {
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    if (regression_count) {
+        ESP_LOGE(TAG, "%d cases regressed by more than %d%%", regression_count, CONFIG_BENCH_REGRESSION_THRESHOLD);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
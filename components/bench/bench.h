@@ -0,0 +1,16 @@
+/**! @file bench.h
+ * 
+*/
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t bench_run();
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,176 @@
+// ESP-IDF Components
+#include <math.h>
+#include <string.h>
+#include "esp_log.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "derived.h"
+
+#define DEBUG_DERIVED 0
+
+#define LOG2_E 1.44269504f
+#define LN_2_HI 0.693145752f        // ln(2) split so that n * LN_2_HI is exact for the reduction
+#define LN_2_LO 1.42860677e-06f
+#define SQRT_2 1.41421356f
+#define LN_FLT_MIN -87.3365448f     // Smallest x with a normal e^x
+#define LN_FLT_MAX 88.7228394f
+#define MAGNUS_A 17.62f             // Magnus coefficients over water, -45 to 60 C
+#define MAGNUS_B 243.12f
+
+typedef union {
+    float value;
+    int32_t bits;
+} float_bits_t;
+
+static const char *TAG = "derived";
+
+/**
+ * @brief Bind a derived metric to its output metric and source metrics
+ *
+ * @param metric FLOAT metric the result is set on. Must be part of the device's birth
+ * @param inputs FLOAT source metrics, in the order the formula expects
+*/
+esp_err_t derived_init(derived_metric_t *derived, esp_tahu_metric_t *metric, derived_formula_t formula, esp_tahu_metric_t **inputs, size_t inputs_count) {
+#if DEBUG_DERIVED
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+#else
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+#endif
+
+    if (inputs_count > DERIVED_MAX_INPUTS)
+        return ESP_ERR_INVALID_ARG;
+
+    *derived = (derived_metric_t) {
+        .metric = metric,
+        .formula = formula,
+        .inputs_count = inputs_count,
+        .evaluated = false,
+    };
+    memcpy(derived->inputs, inputs, sizeof(esp_tahu_metric_t *) * inputs_count);
+    return ESP_OK;
+}
+
+/**
+ * @brief Recompute a derived metric if any of its inputs changed since the last evaluation
+ *
+ *  The metric is null while any input is null.
+ *
+ * @return True if the metric was recomputed
+*/
+bool derived_update(derived_metric_t *derived) {
+    float input_values[DERIVED_MAX_INPUTS];
+    bool dirty = !derived->evaluated;
+    bool is_null = false;
+    for (int i = 0; i < derived->inputs_count; i++) {
+        input_values[i] = derived->inputs[i]->value.float_value;
+        dirty |= input_values[i] != derived->input_values[i];
+        is_null |= derived->inputs[i]->is_null;
+    }
+    if (is_null) {
+        derived->metric->is_null = true;
+        derived->evaluated = false;
+        return false;
+    }
+    if (!dirty)
+        return false;
+
+    float value = derived->formula(input_values);
+    esp_tahu_set_metric_data(derived->metric, false, &value);
+    memcpy(derived->input_values, input_values, sizeof(float) * derived->inputs_count);
+    derived->evaluated = true;
+    ESP_LOGD(TAG, "%s = %f", derived->metric->metric_name, value);
+    return true;
+}
+
+/**
+ * @brief Dew point in C from temperature in C and relative humidity in %, using the Magnus formula
+*/
+float derived_dew_point(const float *inputs) {
+    float temperature = inputs[0];
+    float humidity = inputs[1];
+    if (humidity <= 0)
+        return NAN;
+
+    float gamma = derived_fast_log(humidity / 100) + MAGNUS_A * temperature / (MAGNUS_B + temperature);
+    return MAGNUS_B * gamma / (MAGNUS_A - gamma);
+}
+
+/**
+ * @brief Heat index in C from temperature in C and relative humidity in %, using the NWS Rothfusz regression
+*/
+float derived_heat_index(const float *inputs) {
+    float t = inputs[0] * 1.8f + 32;
+    float rh = inputs[1];
+
+    // The simple formula is used below 80 F, where the regression doesn't apply
+    float index = 0.5f * (t + 61 + (t - 68) * 1.2f + rh * 0.094f);
+    if ((index + t) / 2 >= 80) {
+        index = -42.379f + 2.04901523f * t + 10.14333127f * rh - 0.22475541f * t * rh - 0.00683783f * t * t
+                    - 0.05481717f * rh * rh + 0.00122874f * t * t * rh + 0.00085282f * t * rh * rh - 0.00000199f * t * t * rh * rh;
+        if (rh < 13 && t >= 80 && t <= 112)
+            index -= (13 - rh) / 4 * sqrtf((17 - fabsf(t - 95)) / 17);
+        else if (rh > 85 && t >= 80 && t <= 87)
+            index += (rh - 85) / 10 * (87 - t) / 5;
+    }
+    return (index - 32) / 1.8f;
+}
+
+/**
+ * @brief Absolute humidity in g/m3 from temperature in C and relative humidity in %
+*/
+float derived_absolute_humidity(const float *inputs) {
+    float temperature = inputs[0];
+    float humidity = inputs[1];
+    float saturation_pressure = 6.112f * derived_fast_exp(17.67f * temperature / (temperature + 243.5f));
+    return saturation_pressure * humidity * 2.1674f / (273.15f + temperature);
+}
+
+/**
+ * @brief exp() within 3 ulp of the correctly rounded result. Results below FLT_MIN flush to 0
+ *
+ *  x is reduced to r = x - n * ln(2) with |r| <= ln(2) / 2, e^r is a degree 6 polynomial
+ *  and 2^n is added to the exponent bits.
+*/
+float derived_fast_exp(float x) {
+    if (x > LN_FLT_MAX)
+        return INFINITY;
+    if (x < LN_FLT_MIN)
+        return 0;
+
+    float n = rintf(x * LOG2_E);
+    float r = (x - n * LN_2_HI) - n * LN_2_LO;
+    float p = 1 + r * (1 + r * (0.5f + r * (1.0f / 6 + r * (1.0f / 24 + r * (1.0f / 120 + r * (1.0f / 720))))));
+
+    float_bits_t result = { .value = p };
+    result.bits += (int32_t)n * (1 << 23);
+    return result.value;
+}
+
+/**
+ * @brief log() within 3 ulp of the correctly rounded result for normal positive x
+ *
+ *  x is split into 2^e * m with m in [sqrt(2)/2, sqrt(2)) and ln(m) is the atanh series of (m - 1) / (m + 1).
+*/
+float derived_fast_log(float x) {
+    if (x <= 0)
+        return x == 0 ? -INFINITY : NAN;
+    if (isinf(x))
+        return x;
+
+    float_bits_t bits = { .value = x };
+    int32_t exponent = ((bits.bits >> 23) & 0xFF) - 127;
+    bits.bits = (bits.bits & 0x007FFFFF) | 0x3F800000;
+    float m = bits.value;
+    if (m > SQRT_2) {
+        m *= 0.5f;
+        exponent++;
+    }
+
+    float s = (m - 1) / (m + 1);
+    float s2 = s * s;
+    float ln_m = 2 * s * (1 + s2 * (1.0f / 3 + s2 * (1.0f / 5 + s2 * (1.0f / 7 + s2 * (1.0f / 9)))));
+    return exponent * LN_2_HI + (exponent * LN_2_LO + ln_m);
+}
@@ -0,0 +1,35 @@
+/**! @file derived.h
+ * 
+*/
+#pragma once
+
+#include "esp_tahu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DERIVED_MAX_INPUTS 4
+
+typedef float (*derived_formula_t)(const float *inputs);
+
+typedef struct {
+    esp_tahu_metric_t *metric;                      // FLOAT output metric
+    derived_formula_t formula;
+    esp_tahu_metric_t *inputs[DERIVED_MAX_INPUTS];  // FLOAT source metrics, in the order the formula expects
+    size_t inputs_count;
+    float input_values[DERIVED_MAX_INPUTS];         // Input values of the last evaluation
+    bool evaluated;
+} derived_metric_t;
+
+esp_err_t derived_init(derived_metric_t *derived, esp_tahu_metric_t *metric, derived_formula_t formula, esp_tahu_metric_t **inputs, size_t inputs_count);
+bool derived_update(derived_metric_t *derived);
+float derived_dew_point(const float *inputs);
+float derived_heat_index(const float *inputs);
+float derived_absolute_humidity(const float *inputs);
+float derived_fast_exp(float x);
+float derived_fast_log(float x);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -29,14 +29,12 @@ static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
         } \
     } while (0)
 
-#define DHT_DATA_BITS 40
+#define DHT_DATA_BITS (DHT_FRAME_PULSES / 2)
 #define DHT_DATA_BYTES (DHT_DATA_BITS / 8)
 #define DHT_PIN_MASKED (1ULL<<CONFIG_DHT_GPIO)
-#define MIN_INTERVAL 2000
 
 static const char *TAG = "dht";
 static uint32_t max_cycles;
-static uint32_t last_read_time;
 static uint32_t pulse_cycles[DHT_DATA_BITS*2];
 static uint8_t data[DHT_DATA_BYTES];
 static dht_config_t dht_config = {
@@ -53,10 +51,6 @@ static dht_config_t dht_config = {
     .sensor_type = DHT_TYPE_AM2301,
 #endif
 };
-static dht_data_t dht_data = {
-    .humidity = 0.0,
-    .temperature = -99.0,
-};
 
 static gpio_config_t gpio_config_input_pu = {
     .mode = GPIO_MODE_INPUT,
@@ -72,10 +66,9 @@ static gpio_config_t gpio_config_output = {
 };
 
 // Function prototypes
-static void dht_read_task();
 static esp_err_t fetch_data();
 static esp_err_t wait_while_level(int level, uint32_t *duration);
-static void convert_data();
+static void convert_data(dht_data_t *out_data);
 static void convert_temperature(float *temperature);
 static void convert_humidity(float *humidity);
 
@@ -107,16 +100,10 @@ static void convert_humidity(float *humidity);
  *
  */
 
-dht_data_t *dht_get_data() { return &dht_data; }
-
-esp_err_t dht_read() {
-    // Check if sensor was read less than two seconds ago
-    uint32_t current_time = esp_timer_get_time();
-    if ((current_time - last_read_time) < MIN_INTERVAL) {
-        return ESP_ERR_INVALID_STATE;
-    }
-    last_read_time = current_time;
-
+/**
+ * @brief Capture and decode a frame. The caller keeps reads at least DHT_MIN_INTERVAL_MS apart
+*/
+esp_err_t dht_read(dht_data_t *out_data) {
     // Send start signal.  See DHT datasheet for full signal diagram:
     //   http://www.adafruit.com/datasheets/Digital%20humidity%20and%20temperature%20sensor%20AM2302.pdf
 
@@ -144,15 +131,24 @@ esp_err_t dht_read() {
     esp_err_t fetch_result = fetch_data();
     if (fetch_result != ESP_OK)
         return fetch_result;
-    
+
+    return dht_decode_frame(pulse_cycles, out_data);
+}
+
+/**
+ * @brief Decode the pulse cycle counts of a frame into a sample of the configured sensor type
+ *
+ * @param cycles Low and high cycle count of each data bit, DHT_FRAME_PULSES in total
+*/
+esp_err_t dht_decode_frame(const uint32_t *cycles, dht_data_t *out_data) {
     // Reset 40 bits of received data to zero.
     data[0] = data[1] = data[2] = data[3] = data[4] = 0;
     
     // Inspect pulses and determine which ones are 0 (high state cycle count < low
     // state cycle count), or 1 (high state cycle count > low state cycle count).
     for (int i = 0; i < DHT_DATA_BITS; ++i) {
-        uint32_t low_cycles = pulse_cycles[2 * i];
-        uint32_t high_cycles = pulse_cycles[2 * i + 1];
+        uint32_t low_cycles = cycles[2 * i];
+        uint32_t high_cycles = cycles[2 * i + 1];
         data[i / 8] <<= 1;
 
         // Now compare the low and high cycle times to see if the bit is a 0 or 1.
@@ -176,7 +172,7 @@ esp_err_t dht_read() {
         return ESP_ERR_INVALID_CRC;
     }
 
-    convert_data();
+    convert_data(out_data);
     return ESP_OK;
 }
 
@@ -187,23 +183,12 @@ esp_err_t dht_init() {
     esp_log_level_set(TAG, ESP_LOG_INFO);
 #endif
     max_cycles = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000; // 1000 us (1 ms) in cycles
-    last_read_time = esp_timer_get_time() - MIN_INTERVAL;
     gpio_config(&gpio_config_input_pu);
-    xTaskCreate(dht_read_task, "dht_read_task", 2048, NULL, 2, NULL);
     ESP_LOGD(TAG, "DHT Sensor Initialized. Max Cycles: %d", max_cycles);
 
     return ESP_OK;
 }
 
-static void dht_read_task() {
-    for ( ;; ) {
-        vTaskDelay(pdMS_TO_TICKS(CONFIG_DHT_READ_RATE));
-        esp_err_t read_result = dht_read();
-        if (read_result == ESP_OK)
-            ESP_LOGD(TAG, "Sensor data: humidity=%f, temperature=%f", dht_data.humidity, dht_data.temperature);
-    }
-}
-
 static esp_err_t fetch_data() {
     PORT_ENTER_CRITICAL();
     // Start reading the data line to get the value from the DHT sensor.
@@ -241,9 +226,9 @@ static esp_err_t wait_while_level(int level, uint32_t *duration) {
     return ESP_OK;
 }
 
-static void convert_data() {
-    convert_temperature(&dht_data.temperature);
-    convert_humidity(&dht_data.humidity);
+static void convert_data(dht_data_t *out_data) {
+    convert_temperature(&out_data->temperature);
+    convert_humidity(&out_data->humidity);
 }
 
 static void convert_temperature(float *temperature) {
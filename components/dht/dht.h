@@ -9,6 +9,9 @@
 extern "C" {
 #endif
 
+#define DHT_FRAME_PULSES 80     // A low and a high pulse for each of the 40 data bits
+#define DHT_MIN_INTERVAL_MS 2000
+
 typedef enum {
     DHT_TYPE_11 = 11,
     DHT_TYPE_12 = 12,
@@ -27,8 +30,8 @@ typedef struct {
     float temperature;
 } dht_data_t;
 
-dht_data_t *dht_get_data();
-esp_err_t dht_read();
+esp_err_t dht_read(dht_data_t *out_data);
+esp_err_t dht_decode_frame(const uint32_t *cycles, dht_data_t *out_data);
 esp_err_t dht_init();
 
 #ifdef __cplusplus
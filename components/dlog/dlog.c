@@ -0,0 +1,542 @@
+// ESP-IDF Components
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "soc/soc_memory_layout.h"
+
+// Project Components
+#include "app_tasks.h"
+
+// Project Files
+#include "dlog.h"
+
+#define DEBUG_DLOG 0
+
+#define RETAINED_MAGIC 0x31474C44   // "DLG1"
+#define RING_MASK (CONFIG_DLOG_RING_SIZE - 1)
+#define APP_ID_SIZE 8               // Leading bytes of the ELF SHA-256 the retained records were written by
+#define LINE_MAX 192
+#define SPEC_MAX 32
+#define STRING_MAX 64               // Precision applied to %s arguments without one
+#define TAG_MAX 24
+#define TAG_LEVELS_MAX 16
+#define LEVEL_SPEC_MAX 128
+
+_Static_assert((CONFIG_DLOG_RING_SIZE & RING_MASK) == 0, "DLOG_RING_SIZE must be a power of two");
+
+typedef struct {
+    volatile uint32_t seq;  // Index + 1 once the record is complete. 0 while it is written
+    uint8_t level;
+    uint8_t arg_count;
+    uint16_t boot;          // Boot the record was written in
+    const char *tag;
+    const char *format;
+    int64_t timestamp;      // us since boot
+    uint64_t args[DLOG_ARGS_MAX];
+} dlog_record_t;
+
+/**
+ * @brief Per-core record rings. Not initialized on boot, so the records written before a panic,
+ * watchdog or software reset are drained after it
+ *
+ *  Each core reserves records in its own ring with an atomic increment of the head, so writers
+ *  never wait on a lock and tasks on different cores don't contend. A reader copies a record and
+ *  keeps it only if its seq was the expected value before and after the copy.
+*/
+typedef struct {
+    uint32_t magic;
+    uint8_t app_id[APP_ID_SIZE];
+    uint16_t boot;
+    uint32_t head[portNUM_PROCESSORS];     // Index of the next record written on each core
+    dlog_record_t records[portNUM_PROCESSORS][CONFIG_DLOG_RING_SIZE];
+} dlog_retained_t;
+
+typedef struct {
+    char tag[TAG_MAX];
+    esp_log_level_t level;
+} tag_level_t;
+
+typedef enum {
+    READ_VALID,
+    READ_PENDING,           // Not yet complete
+    READ_INVALID,           // Overwritten, or not written by this firmware
+} read_result_t;
+
+static const char *TAG = "dlog";
+static const char level_letter[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+static __NOINIT_ATTR dlog_retained_t retained;
+static bool initialized = false;
+static uint32_t tail[portNUM_PROCESSORS];           // Index of the next record drained to serial
+static uint32_t stalled_index[portNUM_PROCESSORS];  // Index + 1 of a record found incomplete
+static uint32_t stalled_flush[portNUM_PROCESSORS];  // Flush it was first found incomplete in
+static uint32_t flush_count;
+static SemaphoreHandle_t drain_lock;
+#if CONFIG_APP_STATIC_ALLOCATION
+static StaticSemaphore_t drain_lock_buffer;
+#endif
+static portMUX_TYPE level_lock = portMUX_INITIALIZER_UNLOCKED;
+static tag_level_t tag_levels[TAG_LEVELS_MAX];
+static esp_log_level_t default_level = CONFIG_DLOG_DEFAULT_LEVEL;
+volatile uint32_t dlog_level_generation = 1;
+
+/**
+ * @brief Whether a pointer stored in a record can still be dereferenced
+ *
+ *  Records of earlier boots may reference RAM that has been reused since, so only strings in
+ *  flash are trusted for them.
+*/
+static bool pointer_valid(const void *pointer, bool earlier_boot) {
+    if (esp_ptr_in_drom(pointer))
+        return true;
+    return !earlier_boot && esp_ptr_byte_accessible(pointer);
+}
+
+static bool earlier_boot(const dlog_record_t *record) {
+    return record->boot != retained.boot;
+}
+
+static read_result_t read_record(int core, uint32_t index, dlog_record_t *out) {
+    dlog_record_t *record = &retained.records[core][index & RING_MASK];
+    uint32_t seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+    if (seq != index + 1)
+        return (seq == 0 || (int32_t)(seq - (index + 1)) < 0) ? READ_PENDING : READ_INVALID;
+
+    memcpy(out, record, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&record->seq, __ATOMIC_RELAXED) != seq)
+        return READ_INVALID;
+
+    if (out->arg_count > DLOG_ARGS_MAX || out->level > ESP_LOG_VERBOSE
+            || !pointer_valid(out->tag, earlier_boot(out)) || !pointer_valid(out->format, earlier_boot(out)))
+        return READ_INVALID;
+    return READ_VALID;
+}
+
+/**
+ * @brief Whether record a was written before record b. Records of earlier boots come first
+*/
+static bool record_before(const dlog_record_t *a, const dlog_record_t *b) {
+    uint16_t age_a = retained.boot - a->boot;
+    uint16_t age_b = retained.boot - b->boot;
+    if (age_a != age_b)
+        return age_a > age_b;
+    return a->timestamp < b->timestamp;
+}
+
+static void append(char *buffer, size_t size, size_t *length, const char *format, ...) {
+    if (*length + 1 >= size)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + *length, size - *length, format, args);
+    va_end(args);
+    if (written > 0)
+        *length += written < size - *length ? written : size - *length - 1;
+}
+
+/**
+ * @brief Format the message of a record. Each conversion is formatted with its own argument
+ *
+ *  Supports the conversions of printf except %n. A '*' width or precision is taken from the
+ *  arguments like printf does.
+*/
+static size_t format_message(const dlog_record_t *record, char *buffer, size_t size) {
+    const char *format = record->format;
+    size_t length = 0;
+    int arg = 0;
+    buffer[0] = '\0';
+
+    while (*format && length + 1 < size) {
+        if (*format != '%') {
+            const char *next = strchr(format, '%');
+            size_t literal = next ? next - format : strlen(format);
+            append(buffer, size, &length, "%.*s", literal, format);
+            format += literal;
+            continue;
+        }
+        if (format[1] == '%') {
+            append(buffer, size, &length, "%%");
+            format += 2;
+            continue;
+        }
+
+        // Copy the conversion specification, replacing '*' with the value of its argument
+        char spec[SPEC_MAX];
+        size_t spec_length = 0;
+        bool has_precision = false;
+        spec[spec_length++] = *format++;
+        while (*format && strchr("-+ #0123456789.*hljztL", *format) && spec_length < SPEC_MAX - 16) {
+            if (*format == '.')
+                has_precision = true;
+            if (*format == '*') {
+                int value = arg < record->arg_count ? (int)(uint32_t)record->args[arg++] : 0;
+                spec_length += snprintf(spec + spec_length, SPEC_MAX - spec_length, "%d", value);
+            } else {
+                spec[spec_length++] = *format;
+            }
+            format++;
+        }
+        spec[spec_length] = '\0';
+        char conversion = *format;
+        if (!conversion)
+            break;
+        format++;
+
+        if (!strchr("diouxXcfFeEgGaAsp", conversion) || arg >= record->arg_count) {
+            append(buffer, size, &length, "?");
+            continue;
+        }
+        uint64_t value = record->args[arg++];
+        bool wide = strstr(spec, "ll") || strchr(spec, 'j');
+        bool long_double = strchr(spec, 'L');
+
+        switch (conversion) {
+            case 's': {
+                const char *string = (const char *)(uintptr_t)value;
+                if (!string || !pointer_valid(string, earlier_boot(record))) {
+                    append(buffer, size, &length, "<?>");
+                    break;
+                }
+                if (!has_precision)
+                    spec_length += snprintf(spec + spec_length, SPEC_MAX - spec_length, ".%d", STRING_MAX);
+                spec[spec_length++] = 's';
+                spec[spec_length] = '\0';
+                append(buffer, size, &length, spec, string);
+                break;
+            }
+            case 'p':
+                spec[spec_length++] = 'p';
+                spec[spec_length] = '\0';
+                append(buffer, size, &length, spec, (void *)(uintptr_t)value);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                union {
+                    uint64_t u;
+                    double d;
+                } bits = { .u = value };
+                spec[spec_length++] = conversion;
+                spec[spec_length] = '\0';
+                if (long_double)
+                    append(buffer, size, &length, spec, (long double)bits.d);
+                else
+                    append(buffer, size, &length, spec, bits.d);
+                break;
+            }
+            default:
+                spec[spec_length++] = conversion;
+                spec[spec_length] = '\0';
+                if (wide)
+                    append(buffer, size, &length, spec, (long long)value);
+                else
+                    append(buffer, size, &length, spec, (int)(uint32_t)value);
+                break;
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief Format a record as a line in the layout of ESP_LOG. Records of earlier boots are marked
+ * with how many boots ago they were written
+*/
+static size_t format_line(const dlog_record_t *record, char *buffer, size_t size) {
+    size_t length = 0;
+    uint16_t age = retained.boot - record->boot;
+    if (age)
+        append(buffer, size, &length, "%c (%lld, boot -%d) %s: ", level_letter[record->level],
+                    record->timestamp / 1000, age, record->tag);
+    else
+        append(buffer, size, &length, "%c (%lld) %s: ", level_letter[record->level], record->timestamp / 1000,
+                    record->tag);
+    length += format_message(record, buffer + length, size - length);
+    append(buffer, size, &length, "\n");
+    return length;
+}
+
+/**
+ * @brief Get the next record of a core that hasn't been drained
+ *
+ *  A record found incomplete is waited for until the next flush, then skipped. Its writer may
+ *  have been interrupted by a reset.
+*/
+static bool next_pending(int core, dlog_record_t *record, uint32_t *lost) {
+    for ( ;; ) {
+        uint32_t head = __atomic_load_n(&retained.head[core], __ATOMIC_ACQUIRE);
+        if (tail[core] == head)
+            return false;
+        if (head - tail[core] > CONFIG_DLOG_RING_SIZE) {
+            *lost += head - CONFIG_DLOG_RING_SIZE - tail[core];
+            tail[core] = head - CONFIG_DLOG_RING_SIZE;
+        }
+
+        read_result_t result = read_record(core, tail[core], record);
+        if (result == READ_VALID)
+            return true;
+        if (result == READ_PENDING) {
+            if (stalled_index[core] != tail[core] + 1) {
+                stalled_index[core] = tail[core] + 1;
+                stalled_flush[core] = flush_count;
+            }
+            if (stalled_flush[core] == flush_count)
+                return false;
+        }
+        (*lost)++;
+        tail[core]++;
+    }
+}
+
+/**
+ * @brief Record a message. Safe to call from any task or ISR on either core
+ *
+ *  Called through the DLOGx macros, which filter the message by the level of its tag first.
+*/
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, const uint64_t *args, uint8_t arg_count) {
+    if (!initialized)
+        return;
+
+    int core = xPortGetCoreID();
+    uint32_t index = __atomic_fetch_add(&retained.head[core], 1, __ATOMIC_RELAXED);
+    dlog_record_t *record = &retained.records[core][index & RING_MASK];
+    __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->level = level;
+    record->arg_count = arg_count < DLOG_ARGS_MAX ? arg_count : DLOG_ARGS_MAX;
+    record->boot = retained.boot;
+    record->tag = tag;
+    record->format = format;
+    record->timestamp = esp_timer_get_time();
+    memcpy(record->args, args, record->arg_count * sizeof(args[0]));
+    __atomic_store_n(&record->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+esp_log_level_t dlog_level_get(const char *tag) {
+    esp_log_level_t level = default_level;
+    portENTER_CRITICAL_SAFE(&level_lock);
+    for (int i = 0; i < TAG_LEVELS_MAX && tag_levels[i].tag[0]; i++) {
+        if (strcmp(tag_levels[i].tag, tag) == 0) {
+            level = tag_levels[i].level;
+            break;
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&level_lock);
+    return level;
+}
+
+/**
+ * @brief Set the level of a tag for both deferred and ESP_LOG messages
+ *
+ * @param tag Tag to set the level of. "*" sets the level of tags that haven't been set
+*/
+esp_err_t dlog_level_set(const char *tag, esp_log_level_t level) {
+    if (!tag || level > ESP_LOG_VERBOSE || strlen(tag) >= TAG_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t result = ESP_OK;
+    portENTER_CRITICAL_SAFE(&level_lock);
+    if (strcmp(tag, "*") == 0) {
+        default_level = level;
+    } else {
+        int i = 0;
+        while (i < TAG_LEVELS_MAX && tag_levels[i].tag[0] && strcmp(tag_levels[i].tag, tag) != 0)
+            i++;
+        if (i < TAG_LEVELS_MAX) {
+            strcpy(tag_levels[i].tag, tag);
+            tag_levels[i].level = level;
+        } else {
+            result = ESP_ERR_NO_MEM;
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&level_lock);
+    if (result != ESP_OK)
+        return result;
+
+    esp_log_level_set(tag, level);
+    // Makes every DLOGx call site look its level up again
+    dlog_level_generation++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Set the levels of several tags from a list such as "mqtt-app=D,esp-tahu=W,*=I"
+ *
+ *  Levels are N(one), E(rror), W(arn), I(nfo), D(ebug) or V(erbose). Valid entries are applied
+ *  even if others are invalid.
+*/
+esp_err_t dlog_level_parse(const char *levels) {
+    if (!levels || strlen(levels) >= LEVEL_SPEC_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    char copy[LEVEL_SPEC_MAX];
+    strcpy(copy, levels);
+    esp_err_t result = ESP_OK;
+    char *save = NULL;
+    for (char *entry = strtok_r(copy, ", ", &save); entry; entry = strtok_r(NULL, ", ", &save)) {
+        char *separator = strchr(entry, '=');
+        const char *letter = separator ? strchr(level_letter, separator[1]) : NULL;
+        if (!letter || !separator[1] || separator[2]) {
+            result = ESP_ERR_INVALID_ARG;
+            continue;
+        }
+        *separator = '\0';
+        esp_err_t set_result = dlog_level_set(entry, (esp_log_level_t)(letter - level_letter));
+        if (set_result != ESP_OK)
+            result = set_result;
+    }
+    return result;
+}
+
+/**
+ * @brief Format and print every record that hasn't been drained, oldest first
+*/
+void dlog_flush() {
+    if (!initialized)
+        return;
+
+    xSemaphoreTake(drain_lock, portMAX_DELAY);
+    flush_count++;
+    uint32_t lost = 0;
+    char line[LINE_MAX];
+    for ( ;; ) {
+        int next_core = -1;
+        dlog_record_t next, record;
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            if (!next_pending(core, &record, &lost))
+                continue;
+            if (next_core < 0 || record_before(&record, &next)) {
+                next = record;
+                next_core = core;
+            }
+        }
+        if (next_core < 0)
+            break;
+
+        tail[next_core]++;
+        format_line(&next, line, sizeof(line));
+        fputs(line, stdout);
+    }
+    if (lost)
+        printf("W (%u) %s: %u records lost\n", esp_log_timestamp(), TAG, lost);
+    xSemaphoreGive(drain_lock);
+}
+
+/**
+ * @brief Format the most recent records, drained or not, oldest first
+ *
+ *  Records are added newest first until the next one doesn't fit, so the buffer holds as much
+ *  of the latest history as possible. Doesn't affect the serial drain.
+ *
+ * @return Length of the string written to the buffer
+*/
+size_t dlog_dump(char *buffer, size_t buffer_size) {
+    if (!buffer || !buffer_size)
+        return 0;
+    buffer[0] = '\0';
+    if (!initialized)
+        return 0;
+
+    uint32_t cursor[portNUM_PROCESSORS];
+    uint32_t oldest[portNUM_PROCESSORS];
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        cursor[core] = __atomic_load_n(&retained.head[core], __ATOMIC_ACQUIRE);
+        oldest[core] = cursor[core] > CONFIG_DLOG_RING_SIZE ? cursor[core] - CONFIG_DLOG_RING_SIZE : 0;
+    }
+
+    // Lines are written backwards from the end of the buffer, then moved to its start
+    char line[LINE_MAX];
+    size_t start = buffer_size - 1;
+    for ( ;; ) {
+        int next_core = -1;
+        dlog_record_t next, record;
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            while (cursor[core] > oldest[core] && read_record(core, cursor[core] - 1, &record) != READ_VALID)
+                cursor[core]--;
+            if (cursor[core] == oldest[core])
+                continue;
+            if (next_core < 0 || record_before(&next, &record)) {
+                next = record;
+                next_core = core;
+            }
+        }
+        if (next_core < 0)
+            break;
+
+        size_t length = format_line(&next, line, sizeof(line));
+        if (length > start)
+            break;
+        start -= length;
+        memcpy(buffer + start, line, length);
+        cursor[next_core]--;
+    }
+
+    size_t length = buffer_size - 1 - start;
+    memmove(buffer, buffer + start, length);
+    buffer[length] = '\0';
+    return length;
+}
+
+static void dlog_drain_task() {
+    for ( ;; ) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_DLOG_DRAIN_PERIOD));
+        dlog_flush();
+    }
+}
+
+/**
+ * @brief Validate the records retained across the reset and start recording
+ *
+ *  Records survive panic, watchdog and software resets of the same firmware. They are drained
+ *  ahead of the records of this boot.
+ *
+ * @param start_task Start the task draining the records to serial every CONFIG_DLOG_DRAIN_PERIOD ms
+*/
+esp_err_t dlog_init(bool start_task) {
+#if DEBUG_DLOG
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+#else
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+#endif
+
+    if (initialized)
+        return ESP_OK;
+
+#if CONFIG_APP_STATIC_ALLOCATION
+    drain_lock = xSemaphoreCreateMutexStatic(&drain_lock_buffer);
+#else
+    drain_lock = xSemaphoreCreateMutex();
+#endif
+    if (!drain_lock)
+        return ESP_ERR_NO_MEM;
+
+    // RAM is only retained across resets that don't power down the chip
+    const uint8_t *app_id = esp_ota_get_app_description()->app_elf_sha256;
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool retained_reset = reason == ESP_RST_SW || reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT
+                            || reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT;
+    if (retained_reset && retained.magic == RETAINED_MAGIC && memcmp(retained.app_id, app_id, APP_ID_SIZE) == 0) {
+        retained.boot++;
+        uint32_t count = 0;
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            tail[core] = retained.head[core] > CONFIG_DLOG_RING_SIZE ? retained.head[core] - CONFIG_DLOG_RING_SIZE : 0;
+            count += retained.head[core] - tail[core];
+        }
+        ESP_LOGI(TAG, "%d records retained from before the reset", count);
+    } else {
+        memset(&retained, 0, sizeof(retained));
+        memcpy(retained.app_id, app_id, APP_ID_SIZE);
+        retained.magic = RETAINED_MAGIC;
+    }
+    initialized = true;
+
+    if (start_task)
+        return app_task_create(APP_TASK_DLOG_DRAIN, dlog_drain_task, NULL, NULL);
+    return ESP_OK;
+}
@@ -0,0 +1,116 @@
+/**! @file dlog.h
+ *
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if CONFIG_DLOG_ENABLE
+
+#define DLOG_ARGS_MAX 6
+
+/**
+ * @brief Raw arguments of a record. Integers up to 32 bits, 64-bit integers, floats and doubles
+ * and pointers are supported
+ *
+ *  %s arguments are formatted when the record is drained, so they must point to strings that
+ *  outlive the record, such as literals, metric names and other static strings.
+*/
+#define DLOG_ARG(x) _Generic((x),                                                   \
+        float: dlog_arg_double, double: dlog_arg_double,                            \
+        long long: dlog_arg_64, unsigned long long: dlog_arg_64,                    \
+        char *: dlog_arg_ptr, const char *: dlog_arg_ptr,                           \
+        void *: dlog_arg_ptr, const void *: dlog_arg_ptr,                           \
+        default: dlog_arg_32)(x)
+
+#define DLOG_CAT_(a, b) a##b
+#define DLOG_CAT(a, b) DLOG_CAT_(a, b)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_EACH_0()
+#define DLOG_EACH_1(a) , DLOG_ARG(a)
+#define DLOG_EACH_2(a, ...) , DLOG_ARG(a) DLOG_EACH_1(__VA_ARGS__)
+#define DLOG_EACH_3(a, ...) , DLOG_ARG(a) DLOG_EACH_2(__VA_ARGS__)
+#define DLOG_EACH_4(a, ...) , DLOG_ARG(a) DLOG_EACH_3(__VA_ARGS__)
+#define DLOG_EACH_5(a, ...) , DLOG_ARG(a) DLOG_EACH_4(__VA_ARGS__)
+#define DLOG_EACH_6(a, ...) , DLOG_ARG(a) DLOG_EACH_5(__VA_ARGS__)
+
+/**
+ * @brief Record a message without formatting it
+ *
+ *  The level of the tag is looked up again only after dlog_level_set() changed a level, so a
+ *  filtered message costs a compare. A recorded message costs a timestamp and a copy of the raw
+ *  arguments. The leading 0 keeps the argument array non-empty.
+*/
+#define DLOG_WRITE(level, tag, format, ...) do {                                    \
+        static uint32_t dlog_generation_;                                           \
+        static esp_log_level_t dlog_level_;                                         \
+        if (dlog_generation_ != dlog_level_generation) {                            \
+            dlog_level_ = dlog_level_get(tag);                                      \
+            dlog_generation_ = dlog_level_generation;                               \
+        }                                                                           \
+        if (level <= dlog_level_) {                                                 \
+            const uint64_t dlog_args_[] = { 0 DLOG_CAT(DLOG_EACH_, DLOG_NARGS(__VA_ARGS__))(__VA_ARGS__) }; \
+            dlog_write(level, tag, format, dlog_args_ + 1, DLOG_NARGS(__VA_ARGS__)); \
+        }                                                                           \
+    } while (0)
+
+#define DLOGE(tag, format, ...) DLOG_WRITE(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define DLOGW(tag, format, ...) DLOG_WRITE(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...) DLOG_WRITE(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...) DLOG_WRITE(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define DLOGV(tag, format, ...) DLOG_WRITE(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+extern volatile uint32_t dlog_level_generation;
+
+static inline uint64_t dlog_arg_32(uint32_t value) {
+    return value;
+}
+
+static inline uint64_t dlog_arg_64(uint64_t value) {
+    return value;
+}
+
+static inline uint64_t dlog_arg_double(double value) {
+    union {
+        double d;
+        uint64_t u;
+    } bits = { .d = value };
+    return bits.u;
+}
+
+static inline uint64_t dlog_arg_ptr(const void *value) {
+    return (uintptr_t)value;
+}
+
+esp_err_t dlog_init(bool start_task);
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, const uint64_t *args, uint8_t arg_count);
+esp_log_level_t dlog_level_get(const char *tag);
+esp_err_t dlog_level_set(const char *tag, esp_log_level_t level);
+esp_err_t dlog_level_parse(const char *levels);
+void dlog_flush();
+size_t dlog_dump(char *buffer, size_t buffer_size);
+
+#else
+
+// Without the deferred logger, messages are formatted immediately
+#define DLOGE(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
+#define DLOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+#define DLOGV(tag, format, ...) ESP_LOGV(tag, format, ##__VA_ARGS__)
+#define dlog_level_set(tag, level) esp_log_level_set(tag, level)
+
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
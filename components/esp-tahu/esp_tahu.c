@@ -1,15 +1,31 @@
 // ESP-IDF Components
+#include "esp_attr.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 
 // Project Components
+#include "dlog.h"
 #include "mqtt_util.h"
 
 // Project Files
 #include "esp_tahu.h"
+#include "esp_tahu_buffer.h"
+#include "esp_tahu_compress.h"
+#include "esp_tahu_heap.h"
+#include "pb_decode.h"
+#include "pb_encode.h"
 #include "tahu.h"
 
 #define DEBUG_SPARKPLUG 0
+#define READBACK_MAX_ATTEMPTS 3
+#define TOPIC_MAX 64
+#define TOPIC_ROOT_MAX 32
+#define CMD_NAME_MAX 64         // Longer metric names in a command can't match a known metric and are skipped
+#define CMD_STRING_MAX 128
+#define PAYLOAD_HEADER_MAX_SIZE 16  // Encoded timestamp and seq fields, which are added after data payloads are sized
+#define COMPRESSED_UUID "SPBV1.0_COMPRESSED"
+#define COMPRESSION_ALGORITHM_METRIC "algorithm"
 
 typedef enum {
     MSG_TYPE_NBIRTH,
@@ -24,6 +40,16 @@ typedef enum {
     MSG_TYPE_CNT
 } msg_type_t;
 
+typedef enum {
+    QOS_CLASS_BIRTH,
+    QOS_CLASS_DEATH,
+    QOS_CLASS_DATA,
+    QOS_CLASS_READBACK,
+    QOS_CLASS_ALARM,
+    QOS_CLASS_COMMAND,
+    QOS_CLASS_CNT
+} qos_class_t;
+
 typedef enum {
     NCMD_NEXT_SERVER,
     NCMD_REBIRTH,
@@ -31,15 +57,79 @@ typedef enum {
     NCMD_COUNT
 } ncmd_t;
 
+typedef union {
+    uint32_t int_value;
+    uint64_t long_value;
+    float float_value;
+    double double_value;
+    bool boolean_value;
+} cmd_value_t;
+
+// A single metric of an inbound command. Decoded without heap allocation
+typedef struct {
+    char name[CMD_NAME_MAX];
+    bool has_alias;
+    uint64_t alias;
+    uint32_t value_tag;     // Field tag of the value. 0 if the metric has no supported value
+    cmd_value_t value;
+    char string_value[CMD_STRING_MAX];
+} cmd_metric_t;
+
+// A metric write staged until the inbound queue is drained. Repeated writes to a metric overwrite the value
+typedef struct {
+    esp_tahu_metric_t *metric;  // NULL when the slot is free
+    uint32_t write_count;
+    cmd_value_t value;
+    char *string_value;
+} pending_write_t;
+
+// Metric set that commands for a device are applied to
+typedef struct {
+    char *device_id;            // NULL when the slot is free
+    size_t device_id_len;
+    esp_tahu_metric_t *metrics;
+    size_t metrics_count;
+} device_route_t;
+
 
 static const char *TAG = "esp-tahu";
 static esp_tahu_rebirth_callback_handler_t next_server_callback;
 static esp_tahu_rebirth_callback_handler_t rebirth_callback;
 static esp_tahu_rebirth_callback_handler_t reboot_callback;
-static int bdSeq = 0;
+// Retained across deep sleep so an NBIRTH after wakeup doesn't reuse the bdSeq of a session the host already closed
+RTC_DATA_ATTR static int bdSeq = 0;            // bdSeq of the next MQTT session
+RTC_DATA_ATTR static int session_bdSeq = 0;    // bdSeq of the NDEATH registered as the LWT of the current session
 static char *node_id;
-static char *topic_root;
+static size_t node_id_len;
+static char topic_root[TOPIC_ROOT_MAX];
+static size_t topic_root_len;
+static esp_tahu_metric_t *node_metrics;
+static size_t node_metrics_count;
+static device_route_t device_routes[CONFIG_SPARKPLUG_MAX_DEVICES];
+RTC_DATA_ATTR static bool commands_subscribed = false;    // Retained across deep sleep for persistent sessions
+static char host_state_topic[TOPIC_MAX];     // Empty if no primary host is configured
+static bool host_online = true;
+static uint64_t host_state_timestamp = 0;
+static bool rebirth_pending = false;
+static int64_t rebirth_due_time = 0;
+static int64_t last_birth_time = 0;
 static uint64_t alias_num = NCMD_COUNT;
+static pending_write_t pending_writes[CONFIG_SPARKPLUG_PENDING_WRITES_MAX];
+static bool control_pending[NCMD_COUNT];
+static int64_t control_request_time;
+static const int qos_policy[QOS_CLASS_CNT] = {
+    [QOS_CLASS_BIRTH] = CONFIG_SPARKPLUG_QOS_BIRTH,
+    [QOS_CLASS_DEATH] = CONFIG_SPARKPLUG_QOS_DEATH,
+    [QOS_CLASS_DATA] = CONFIG_SPARKPLUG_QOS_DATA,
+    [QOS_CLASS_READBACK] = CONFIG_SPARKPLUG_QOS_READBACK,
+    [QOS_CLASS_ALARM] = CONFIG_SPARKPLUG_QOS_ALARM,
+    [QOS_CLASS_COMMAND] = CONFIG_SPARKPLUG_QOS_COMMAND,
+};
+static const char *ncmd_metric_name[NCMD_COUNT] = {
+    "Node Control/Next Server",
+    "Node Control/Rebirth",
+    "Node Control/Reboot"
+};
 static const char *msg_type_topic[MSG_TYPE_CNT] = {
     "NBIRTH",
     "NDEATH",
@@ -63,200 +153,942 @@ static uint64_t get_alias() {
     return ++alias_num;
 }
 
-static ssize_t get_nbirth_payload(uint8_t *payload_buffer, size_t buffer_length) {
+/**
+ * @brief Get the size of a value in a dataset column of the given type
+ *
+ * @return 0 if the type can't be stored in a dataset
+*/
+static size_t dataset_value_size(esp_tahu_metric_type_t type) {
+    switch(type) {
+        case ESP_TAHU_METRIC_TYPE_INT8:
+        case ESP_TAHU_METRIC_TYPE_INT16:
+        case ESP_TAHU_METRIC_TYPE_INT32:
+        case ESP_TAHU_METRIC_TYPE_UINT8:
+        case ESP_TAHU_METRIC_TYPE_UINT16:
+        case ESP_TAHU_METRIC_TYPE_UINT32:
+            return sizeof(uint32_t);
+        case ESP_TAHU_METRIC_TYPE_INT64:
+        case ESP_TAHU_METRIC_TYPE_UINT64:
+        case ESP_TAHU_METRIC_TYPE_DATETIME:
+            return sizeof(uint64_t);
+        case ESP_TAHU_METRIC_TYPE_FLOAT:
+            return sizeof(float);
+        case ESP_TAHU_METRIC_TYPE_DOUBLE:
+            return sizeof(double);
+        case ESP_TAHU_METRIC_TYPE_BOOLEAN:
+            return sizeof(bool);
+        case ESP_TAHU_METRIC_TYPE_STRING:
+            return sizeof(char *);
+        default:
+            return 0;
+    }
+}
+
+static void set_dataset_value(org_eclipse_tahu_protobuf_Payload_DataSet_DataSetValue *element, esp_tahu_metric_type_t type, void *column, size_t row) {
+    switch(type) {
+        case ESP_TAHU_METRIC_TYPE_INT64:
+        case ESP_TAHU_METRIC_TYPE_UINT64:
+        case ESP_TAHU_METRIC_TYPE_DATETIME:
+            element->which_value = org_eclipse_tahu_protobuf_Payload_DataSet_DataSetValue_long_value_tag;
+            element->value.long_value = ((uint64_t *)column)[row];
+            break;
+        case ESP_TAHU_METRIC_TYPE_FLOAT:
+            element->which_value = org_eclipse_tahu_protobuf_Payload_DataSet_DataSetValue_float_value_tag;
+            element->value.float_value = ((float *)column)[row];
+            break;
+        case ESP_TAHU_METRIC_TYPE_DOUBLE:
+            element->which_value = org_eclipse_tahu_protobuf_Payload_DataSet_DataSetValue_double_value_tag;
+            element->value.double_value = ((double *)column)[row];
+            break;
+        case ESP_TAHU_METRIC_TYPE_BOOLEAN:
+            element->which_value = org_eclipse_tahu_protobuf_Payload_DataSet_DataSetValue_boolean_value_tag;
+            element->value.boolean_value = ((bool *)column)[row];
+            break;
+        case ESP_TAHU_METRIC_TYPE_STRING: {
+            char *string = ((char **)column)[row];
+            element->which_value = org_eclipse_tahu_protobuf_Payload_DataSet_DataSetValue_string_value_tag;
+            element->value.string_value = esp_tahu_heap_strdup(string ? string : "");
+            break;
+        }
+        default:
+            element->which_value = org_eclipse_tahu_protobuf_Payload_DataSet_DataSetValue_int_value_tag;
+            element->value.int_value = ((uint32_t *)column)[row];
+            break;
+    }
+}
+
+/**
+ * @brief Transpose a columnar dataset into the row oriented protobuf DataSet
+ *
+ * @return False if out of memory. The partially built DataSet is released
+*/
+static bool build_dataset_value(org_eclipse_tahu_protobuf_Payload_DataSet *out, esp_tahu_dataset_t *dataset) {
+    memset(out, 0, sizeof(*out));
+    out->has_num_of_columns = true;
+    out->num_of_columns = dataset->num_of_columns;
+    out->columns = (char **)esp_tahu_heap_calloc(dataset->num_of_columns, sizeof(char *));
+    out->types = (uint32_t *)esp_tahu_heap_calloc(dataset->num_of_columns, sizeof(uint32_t));
+    out->rows = (org_eclipse_tahu_protobuf_Payload_DataSet_Row *)esp_tahu_heap_calloc(dataset->num_of_rows, sizeof(org_eclipse_tahu_protobuf_Payload_DataSet_Row));
+    if (!out->columns || !out->types || (dataset->num_of_rows && !out->rows))
+        goto fail;
+    out->columns_count = dataset->num_of_columns;
+    out->types_count = dataset->num_of_columns;
+    out->rows_count = dataset->num_of_rows;
+
+    for (size_t column = 0; column < dataset->num_of_columns; column++) {
+        out->columns[column] = esp_tahu_heap_strdup(dataset->columns[column]);
+        out->types[column] = dataset->types[column];
+    }
+    for (size_t row = 0; row < dataset->num_of_rows; row++) {
+        org_eclipse_tahu_protobuf_Payload_DataSet_Row *out_row = &out->rows[row];
+        out_row->elements = (org_eclipse_tahu_protobuf_Payload_DataSet_DataSetValue *)esp_tahu_heap_calloc(dataset->num_of_columns,
+                                sizeof(org_eclipse_tahu_protobuf_Payload_DataSet_DataSetValue));
+        if (!out_row->elements)
+            goto fail;
+        out_row->elements_count = dataset->num_of_columns;
+        for (size_t column = 0; column < dataset->num_of_columns; column++)
+            set_dataset_value(&out_row->elements[column], dataset->types[column], dataset->column_values[column], row);
+    }
+    return true;
+
+fail:
+    pb_release(org_eclipse_tahu_protobuf_Payload_DataSet_fields, out);
+    return false;
+}
+
+static void init_payload_metric(org_eclipse_tahu_protobuf_Payload_Metric *new_metric, esp_tahu_metric_t *metric);
+
+static bool build_template_value(org_eclipse_tahu_protobuf_Payload_Template *out, esp_tahu_template_t *template) {
+    memset(out, 0, sizeof(*out));
+    out->metrics = (org_eclipse_tahu_protobuf_Payload_Metric *)esp_tahu_heap_calloc(template->members_count, sizeof(org_eclipse_tahu_protobuf_Payload_Metric));
+    if (template->members_count && !out->metrics)
+        return false;
+    out->metrics_count = template->members_count;
+    if (template->version)
+        out->version = esp_tahu_heap_strdup(template->version);
+    if (template->template_ref)
+        out->template_ref = esp_tahu_heap_strdup(template->template_ref);
+    out->has_is_definition = true;
+    out->is_definition = template->is_definition;
+
+    for (size_t i = 0; i < template->members_count; i++)
+        init_payload_metric(&out->metrics[i], &template->members[i]);
+    return true;
+}
+
+/**
+ * @brief Convert a metric to its protobuf form
+ *
+ *  Scalar values are set by init_metric. DATETIME, BYTES, DATASET and TEMPLATE values are set directly
+ *  on the protobuf metric. Metrics marked is_null and those whose value can't be built are published as null.
+*/
+static void init_payload_metric(org_eclipse_tahu_protobuf_Payload_Metric *new_metric, esp_tahu_metric_t *metric) {
+    DLOGD(TAG, "Creating metric: '%s'", metric->metric_name);
+    void *metric_value;
+    switch(metric->data_type) {
+        case ESP_TAHU_METRIC_TYPE_STRING:
+            metric_value = metric->value.string_value;
+            break;
+        case ESP_TAHU_METRIC_TYPE_DATETIME:
+        case ESP_TAHU_METRIC_TYPE_BYTES:
+        case ESP_TAHU_METRIC_TYPE_DATASET:
+        case ESP_TAHU_METRIC_TYPE_TEMPLATE:
+            metric_value = NULL;
+            break;
+        default:
+            metric_value = esp_tahu_get_metric_data(metric);
+            break;
+    }
+    init_metric(new_metric, metric->metric_name, metric->has_alias, metric->alias, metric->data_type,
+                    metric->is_historical, metric->is_transient, metric->is_null ? NULL : metric_value, sizeof(*metric_value));
+    // Metrics without an explicit timestamp are stamped with the current time by init_metric
+    if (metric->timestamp)
+        new_metric->timestamp = metric->timestamp;
+    if (metric->is_null) {
+        new_metric->has_is_null = true;
+        new_metric->is_null = true;
+        return;
+    }
+
+    bool has_value = false;
+    switch(metric->data_type) {
+        case ESP_TAHU_METRIC_TYPE_DATETIME:
+            new_metric->which_value = org_eclipse_tahu_protobuf_Payload_Metric_long_value_tag;
+            new_metric->value.long_value = metric->value.long_value;
+            has_value = true;
+            break;
+        case ESP_TAHU_METRIC_TYPE_BYTES: {
+            size_t size = metric->value.bytes_value.size;
+            pb_bytes_array_t *bytes = (pb_bytes_array_t *)esp_tahu_heap_malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(size));
+            if (bytes) {
+                bytes->size = size;
+                if (size)
+                    memcpy(bytes->bytes, metric->value.bytes_value.bytes, size);
+                new_metric->which_value = org_eclipse_tahu_protobuf_Payload_Metric_bytes_value_tag;
+                new_metric->value.bytes_value = bytes;
+                has_value = true;
+            }
+            break;
+        }
+        case ESP_TAHU_METRIC_TYPE_DATASET:
+            if (metric->value.dataset_value && build_dataset_value(&new_metric->value.dataset_value, metric->value.dataset_value)) {
+                new_metric->which_value = org_eclipse_tahu_protobuf_Payload_Metric_dataset_value_tag;
+                has_value = true;
+            }
+            break;
+        case ESP_TAHU_METRIC_TYPE_TEMPLATE:
+            if (metric->value.template_value && build_template_value(&new_metric->value.template_value, metric->value.template_value)) {
+                new_metric->which_value = org_eclipse_tahu_protobuf_Payload_Metric_template_value_tag;
+                has_value = true;
+            }
+            break;
+        default:
+            return;
+    }
+    new_metric->has_is_null = !has_value;
+    new_metric->is_null = !has_value;
+    if (!has_value)
+        ESP_LOGW(TAG, "Publishing metric '%s' as null.", metric->metric_name);
+}
+
+static void add_metrics_to_payload(org_eclipse_tahu_protobuf_Payload *payload, esp_tahu_metric_t *metrics, size_t metrics_count) {
+    for(int i = 0; i < metrics_count; i++) {
+        org_eclipse_tahu_protobuf_Payload_Metric new_metric;
+        init_payload_metric(&new_metric, &metrics[i]);
+        add_metric_to_payload(payload, &new_metric);
+    }
+}
+
+static void build_nbirth_payload(org_eclipse_tahu_protobuf_Payload *payload, esp_tahu_metric_t *metrics, size_t metrics_count) {
     ESP_LOGD(TAG, "Creating NBIRTH payload.");
-    org_eclipse_tahu_protobuf_Payload payload;
     reset_sparkplug_sequence();
-    get_next_payload(&payload);
+    get_next_payload(payload);
 
-    add_simple_metric(&payload, "bdSeq", false, 0, METRIC_DATA_TYPE_INT32, false, false, &bdSeq, sizeof(bdSeq));
+    add_simple_metric(payload, "bdSeq", false, 0, METRIC_DATA_TYPE_INT32, false, false, &session_bdSeq, sizeof(session_bdSeq));
     
     // Add node control metrics
     ESP_LOGD(TAG, "Adding node control metric: 'Node Control/Next Server");
     uint64_t next_server_alias = (uint64_t)NCMD_NEXT_SERVER;
     bool next_server_value = false;
-    add_simple_metric(&payload, "Node Control/Next Server", true, next_server_alias, ESP_TAHU_METRIC_TYPE_BOOLEAN, false, false, &next_server_value, sizeof(next_server_value));
+    add_simple_metric(payload, ncmd_metric_name[NCMD_NEXT_SERVER], true, next_server_alias, ESP_TAHU_METRIC_TYPE_BOOLEAN, false, false, &next_server_value, sizeof(next_server_value));
     
     ESP_LOGD(TAG, "Adding node control metric: 'Node Control/Rebirth'");
     uint64_t rebirth_alias = (uint64_t)NCMD_REBIRTH;
     bool rebirth_value = false;
-    add_simple_metric(&payload, "Node Control/Rebirth", true, rebirth_alias, ESP_TAHU_METRIC_TYPE_BOOLEAN, false, false, &rebirth_value, sizeof(rebirth_value));
+    add_simple_metric(payload, ncmd_metric_name[NCMD_REBIRTH], true, rebirth_alias, ESP_TAHU_METRIC_TYPE_BOOLEAN, false, false, &rebirth_value, sizeof(rebirth_value));
     
     ESP_LOGD(TAG, "Adding node control metric: 'Node Control/Reboot'");
     uint64_t reboot_alias = (uint64_t)NCMD_REBOOT;
     bool reboot_value = false;
-    add_simple_metric(&payload, "Node Control/Reboot", true, reboot_alias, ESP_TAHU_METRIC_TYPE_BOOLEAN, false, false, &reboot_value, sizeof(reboot_value));
-    
-    ssize_t msg_len = encode_payload(payload_buffer, buffer_length, &payload);
-    bdSeq++;
+    add_simple_metric(payload, ncmd_metric_name[NCMD_REBOOT], true, reboot_alias, ESP_TAHU_METRIC_TYPE_BOOLEAN, false, false, &reboot_value, sizeof(reboot_value));
 
-#if DEBUG_SPARKPLUG
-    ESP_LOGD(TAG, "NBIRTH payload constructed.");
-    print_payload(&payload);
-#endif
+    // Add application node metrics
+    add_metrics_to_payload(payload, metrics, metrics_count);
+}
 
-    free_payload(&payload);
+static void build_ndeath_payload(org_eclipse_tahu_protobuf_Payload *payload, int death_bdSeq) {
+    ESP_LOGD(TAG, "Creating NDEATH payload.");
+    *payload = (org_eclipse_tahu_protobuf_Payload) org_eclipse_tahu_protobuf_Payload_init_zero;
+    add_simple_metric(payload, "bdSeq", false, 0, ESP_TAHU_METRIC_TYPE_INT32, false, false, &death_bdSeq, sizeof(death_bdSeq));
+}
+
+/**
+ * @brief Stamp a payload with the current time and the next sequence number
+ *
+ *  Done only once a payload is known to be published, so sizing passes don't consume sequence numbers.
+*/
+static void set_payload_header(org_eclipse_tahu_protobuf_Payload *payload) {
+    org_eclipse_tahu_protobuf_Payload header;
+    get_next_payload(&header);
+    payload->has_timestamp = header.has_timestamp;
+    payload->timestamp = header.timestamp;
+    payload->has_seq = header.has_seq;
+    payload->seq = header.seq;
+}
+
+/**
+ * @brief Encode a payload into a pooled buffer of the exact size computed by a dry encoding pass
+ *
+ * @return Encoded length, or -1 if the payload exceeds SPARKPLUG_PAYLOAD_MAX_SIZE or fails to encode
+*/
+static ssize_t encode_pooled(org_eclipse_tahu_protobuf_Payload *payload, uint8_t **out_buffer) {
+    size_t size;
+    *out_buffer = NULL;
+    if (!pb_get_encoded_size(&size, org_eclipse_tahu_protobuf_Payload_fields, payload)) {
+        ESP_LOGE(TAG, "Failed to compute payload size.");
+        return -1;
+    }
+    if (size > CONFIG_SPARKPLUG_PAYLOAD_MAX_SIZE) {
+        ESP_LOGE(TAG, "Payload of %d bytes exceeds maximum of %d bytes.", size, CONFIG_SPARKPLUG_PAYLOAD_MAX_SIZE);
+        return -1;
+    }
+
+    *out_buffer = esp_tahu_buffer_get(size);
+    if (!*out_buffer) {
+        ESP_LOGE(TAG, "No buffer for payload of %d bytes.", size);
+        return -1;
+    }
+
+    ssize_t msg_len = encode_payload(*out_buffer, size, payload);
+    if (msg_len < 0) {
+        ESP_LOGE(TAG, "Failed to encode payload.");
+        esp_tahu_buffer_release(*out_buffer);
+        *out_buffer = NULL;
+    }
     return msg_len;
 }
 
-static ssize_t get_ndeath_payload(uint8_t *payload_buffer, size_t buffer_length) {
-    ESP_LOGD(TAG, "Creating NDEATH payload.");
+#if CONFIG_SPARKPLUG_COMPRESSION_ENABLE
+#if CONFIG_SPARKPLUG_COMPRESSION_GZIP
+static const esp_tahu_compression_t compression_algorithm = ESP_TAHU_COMPRESSION_GZIP;
+static const char *compression_algorithm_name = "GZIP";
+#else
+static const esp_tahu_compression_t compression_algorithm = ESP_TAHU_COMPRESSION_DEFLATE;
+static const char *compression_algorithm_name = "DEFLATE";
+#endif
+
+/**
+ * @brief Replace an encoded payload above SPARKPLUG_COMPRESSION_THRESHOLD with a compressed Sparkplug payload
+ *
+ *  The compressed payload carries the encoded payload in its body, the uuid SPBV1.0_COMPRESSED and an
+ *  algorithm metric. The original is kept if compression doesn't make it smaller.
+*/
+static void compress_encoded(uint8_t **payload_buffer, ssize_t *msg_len) {
+    if (*msg_len < CONFIG_SPARKPLUG_COMPRESSION_THRESHOLD)
+        return;
+
+    pb_bytes_array_t *body = (pb_bytes_array_t *)esp_tahu_buffer_get(PB_BYTES_ARRAY_T_ALLOCSIZE(*msg_len));
+    if (!body)
+        return;
+    ssize_t body_len = esp_tahu_compress(*payload_buffer, *msg_len, body->bytes, *msg_len, compression_algorithm);
+    if (body_len < 0) {
+        DLOGD(TAG, "Payload of %d bytes is not compressible.", *msg_len);
+        esp_tahu_buffer_release((uint8_t *)body);
+        return;
+    }
+    body->size = body_len;
+
     org_eclipse_tahu_protobuf_Payload payload = org_eclipse_tahu_protobuf_Payload_init_zero;
+    payload.uuid = esp_tahu_heap_strdup(COMPRESSED_UUID);
+    payload.body = body;
+    add_simple_metric(&payload, COMPRESSION_ALGORITHM_METRIC, false, 0, ESP_TAHU_METRIC_TYPE_STRING, false, false,
+                        compression_algorithm_name, strlen(compression_algorithm_name) + 1);
 
-    add_simple_metric(&payload, "bdSeq", false, 0, ESP_TAHU_METRIC_TYPE_INT32, false, false, &bdSeq, sizeof(bdSeq));
-    ssize_t msg_len = encode_payload(payload_buffer, buffer_length, &payload);
+    uint8_t *compressed_buffer;
+    ssize_t compressed_len = encode_pooled(&payload, &compressed_buffer);
+    // The body is pooled, so it must not be freed with the rest of the payload
+    payload.body = NULL;
+    free_payload(&payload);
+    esp_tahu_buffer_release((uint8_t *)body);
+    if (compressed_len < 0)
+        return;
+    if (compressed_len >= *msg_len) {
+        esp_tahu_buffer_release(compressed_buffer);
+        return;
+    }
 
+    DLOGD(TAG, "Compressed payload from %d to %d bytes.", *msg_len, compressed_len);
+    esp_tahu_buffer_release(*payload_buffer);
+    *payload_buffer = compressed_buffer;
+    *msg_len = compressed_len;
+}
+#endif
+
+/**
+ * @brief Encode and publish a payload, then free it
+ *
+ * @param ack_callback If set, the publish is tracked until acknowledged
+*/
+static esp_err_t publish_payload(msg_type_t msg_type, char *device_id, org_eclipse_tahu_protobuf_Payload *payload, int qos,
+                                    mqtt_app_ack_callback_handler_t ack_callback, void *ctx) {
 #if DEBUG_SPARKPLUG
-    ESP_LOGD(TAG, "NDEATH payload constructed.");
-    print_payload(&payload);
+    ESP_LOGD(TAG, "%s payload constructed.", msg_type_topic[msg_type]);
+    print_payload(payload);
 #endif
-    
+
+    uint8_t *payload_buffer;
+    ssize_t msg_len = encode_pooled(payload, &payload_buffer);
+    free_payload(payload);
+    if (msg_len < 0) {
+        ESP_LOGE(TAG, "%s not published.", msg_type_topic[msg_type]);
+        return ESP_FAIL;
+    }
+#if CONFIG_SPARKPLUG_COMPRESSION_ENABLE
+    compress_encoded(&payload_buffer, &msg_len);
+#endif
+
+    char topic[TOPIC_MAX];
+    get_topic(topic, msg_type, device_id);
+    int msg_id;
+    if (ack_callback)
+        msg_id = mqtt_util_publish_tracked(topic, (char *)payload_buffer, msg_len, qos, 0, ack_callback, ctx);
+    else
+        msg_id = mqtt_util_publish(topic, (char *)payload_buffer, msg_len, qos, 0);
+
+    esp_tahu_buffer_release(payload_buffer);
+    // A tracked publish that fell back to QoS 0 will never be acknowledged
+    if (msg_id < 0 || (ack_callback && qos > 0 && msg_id == 0)) {
+        ESP_LOGE(TAG, "%s not published.", msg_type_topic[msg_type]);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Encode metrics as a data payload into a caller supplied buffer, without publishing
+ *
+ *  The payload has no timestamp or seq, so the Sparkplug sequence is not advanced.
+ *
+ * @return Encoded length, or -1 if the payload doesn't fit the buffer
+*/
+ssize_t esp_tahu_encode_data(esp_tahu_metric_t *metrics, size_t metrics_count, uint8_t *buffer, size_t buffer_length) {
+    org_eclipse_tahu_protobuf_Payload payload = org_eclipse_tahu_protobuf_Payload_init_zero;
+    add_metrics_to_payload(&payload, metrics, metrics_count);
+    ssize_t msg_len = encode_payload(buffer, buffer_length, &payload);
     free_payload(&payload);
     return msg_len;
 }
 
-static ssize_t get_device_payload(uint8_t *payload_buffer, size_t buffer_length, char *device_id, esp_tahu_metric_t *metrics, size_t metrics_count) {
-    ESP_LOGD(TAG, "Creating Device payload.");
-    org_eclipse_tahu_protobuf_Payload payload;
-    get_next_payload(&payload);
+/**
+ * @brief Publish NDATA/DDATA, splitting the metrics over several payloads if the encoded size
+ * exceeds SPARKPLUG_DATA_SPLIT_SIZE
+ *
+ * @param ack_callback If set, every payload is tracked until acknowledged
+ * @return Number of payloads published, -1 if any of them failed
+*/
+static int publish_data(msg_type_t msg_type, char *device_id, esp_tahu_metric_t *metrics, size_t metrics_count, int qos,
+                            mqtt_app_ack_callback_handler_t ack_callback, void *ctx) {
+    org_eclipse_tahu_protobuf_Payload payload = org_eclipse_tahu_protobuf_Payload_init_zero;
+    add_metrics_to_payload(&payload, metrics, metrics_count);
 
-    for(int i = 0; i < metrics_count; i++) {
-        ESP_LOGD(TAG, "Creating metric: '%s'", metrics[i].metric_name);
-        void *metric_value = esp_tahu_get_metric_data(&metrics[i]);
-        add_simple_metric(&payload, metrics[i].metric_name, metrics[i].has_alias, metrics[i].alias, metrics[i].data_type, 
-                            metrics[i].is_historical, metrics[i].is_transient, metric_value, sizeof(*metric_value));
+    size_t size;
+    if (metrics_count > 1 && pb_get_encoded_size(&size, org_eclipse_tahu_protobuf_Payload_fields, &payload)
+            && size + PAYLOAD_HEADER_MAX_SIZE > CONFIG_SPARKPLUG_DATA_SPLIT_SIZE) {
+        free_payload(&payload);
+        DLOGD(TAG, "Splitting %s of %d bytes.", msg_type_topic[msg_type], size);
+        size_t first_count = metrics_count / 2;
+        int first_published = publish_data(msg_type, device_id, metrics, first_count, qos, ack_callback, ctx);
+        int second_published = publish_data(msg_type, device_id, metrics + first_count, metrics_count - first_count,
+                                                qos, ack_callback, ctx);
+        return first_published < 0 || second_published < 0 ? -1 : first_published + second_published;
     }
 
-#if DEBUG_SPARKPLUG
-    ESP_LOGD(TAG, "Device payload constructed.");
-    print_payload(&payload);
-#endif
+    set_payload_header(&payload);
+    return publish_payload(msg_type, device_id, &payload, qos, ack_callback, ctx) == ESP_OK ? 1 : -1;
+}
 
-    // Encode the payload into a binary format so it can be published in the MQTT message.
-    // The binary_buffer must be large enough to hold the contents of the binary payload
-    ssize_t msg_len = encode_payload(payload_buffer, buffer_length, &payload);
-    free_payload(&payload);
-    return msg_len;
+static void publish_readback(esp_tahu_metric_t *metric);
+
+/**
+ * @brief Republish a readback that was not acknowledged, up to READBACK_MAX_ATTEMPTS times
+*/
+static void readback_ack_handler(int msg_id, bool acked, void *ctx) {
+    esp_tahu_metric_t *metric = (esp_tahu_metric_t *) ctx;
+    if (acked) {
+        ESP_LOGI(TAG, "Readback of '%s' confirmed", metric->metric_name);
+        metric->readback_attempts = 0;
+        return;
+    }
+
+    if (++metric->readback_attempts >= READBACK_MAX_ATTEMPTS) {
+        ESP_LOGW(TAG, "Readback of '%s' unconfirmed after %d attempts", metric->metric_name, READBACK_MAX_ATTEMPTS);
+        metric->readback_attempts = 0;
+        return;
+    }
+    ESP_LOGW(TAG, "Readback of '%s' unconfirmed. Retrying", metric->metric_name);
+    publish_readback(metric);
 }
 
-static ssize_t get_ddeath_payload(uint8_t *payload_buffer, size_t buffer_length) {
-    ESP_LOGD(TAG, "Creating DDEATH payload.");
+/**
+ * @brief Publish the current value of a metric changed by a command as DDATA, or NDATA for a node metric,
+ * tracking its acknowledgement
+*/
+static void publish_readback(esp_tahu_metric_t *metric) {
     org_eclipse_tahu_protobuf_Payload payload;
     get_next_payload(&payload);
-
-    ssize_t msg_len = encode_payload(payload_buffer, buffer_length, &payload);
-    free_payload(&payload);
-    return msg_len;
+    add_metrics_to_payload(&payload, metric, 1);
+    msg_type_t msg_type = metric->device_id ? MSG_TYPE_DDATA : MSG_TYPE_NDATA;
+    publish_payload(msg_type, metric->device_id, &payload, qos_policy[QOS_CLASS_READBACK], readback_ack_handler, metric);
 }
 
 void esp_tahu_configure(char *sp_node_id) {
 #if DEBUG_SPARKPLUG
-    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+    dlog_level_set(TAG, ESP_LOG_DEBUG);
 #else
-    esp_log_level_set(TAG, ESP_LOG_INFO);
+    dlog_level_set(TAG, ESP_LOG_INFO);
 #endif
 
     node_id = sp_node_id;
-    topic_root = (char *)calloc(1, 32);
-    sprintf(topic_root, "spBv1.0/%s", CONFIG_SPARKPLUG_GROUP_ID);
+    node_id_len = strlen(node_id);
+    snprintf(topic_root, sizeof(topic_root), "spBv1.0/%s", CONFIG_SPARKPLUG_GROUP_ID);
+    topic_root_len = strlen(topic_root);
+
+    if (strlen(CONFIG_SPARKPLUG_PRIMARY_HOST_ID) > 0) {
+#if CONFIG_SPARKPLUG_STATE_LEGACY_TOPIC
+        snprintf(host_state_topic, sizeof(host_state_topic), "STATE/%s", CONFIG_SPARKPLUG_PRIMARY_HOST_ID);
+#else
+        snprintf(host_state_topic, sizeof(host_state_topic), "spBv1.0/STATE/%s", CONFIG_SPARKPLUG_PRIMARY_HOST_ID);
+#endif
+        host_online = false;
+    }
+
+#if CONFIG_SPARKPLUG_COMPRESSION_ENABLE
+    if (esp_tahu_compress_init() != ESP_OK)
+        ESP_LOGE(TAG, "Failed to initialize payload compression.");
+#endif
 }
 
-void esp_tahu_init_node() {
-    char *topic = (char *)malloc(sizeof(char) * 64);
+/**
+ * @brief Subscribe to NCMD and, with a single wildcard, to DCMD for all devices of the node
+ *
+ *  Subscriptions persist across rebirths and are only renewed after a reconnect.
+*/
+static void subscribe_commands(char *topic) {
+    if (commands_subscribed)
+        return;
+
     get_topic(topic, MSG_TYPE_NCMD, NULL);
-    mqtt_util_subscribe(topic, 0);
-    
-    uint8_t *nbirth_buffer = (uint8_t *) malloc(sizeof(uint8_t) * 1024);
-    ssize_t nbirth_len = get_nbirth_payload(nbirth_buffer, 1024);
+    mqtt_util_subscribe(topic, qos_policy[QOS_CLASS_COMMAND]);
+    get_topic(topic, MSG_TYPE_DCMD, "+");
+    mqtt_util_subscribe(topic, qos_policy[QOS_CLASS_COMMAND]);
+    commands_subscribed = true;
+}
+
+void esp_tahu_init_node(esp_tahu_metric_t *metrics, size_t metrics_count) {
+    char topic[TOPIC_MAX];
+    node_metrics = metrics;
+    node_metrics_count = metrics_count;
+    subscribe_commands(topic);
     
-    get_topic(topic, MSG_TYPE_NBIRTH, NULL);
-    mqtt_util_publish(topic, (char *)nbirth_buffer, nbirth_len, 0, 0);
-    free(topic);
-    free(nbirth_buffer);
+    org_eclipse_tahu_protobuf_Payload payload;
+    build_nbirth_payload(&payload, metrics, metrics_count);
+    publish_payload(MSG_TYPE_NBIRTH, NULL, &payload, qos_policy[QOS_CLASS_BIRTH], NULL, NULL);
+
+    last_birth_time = esp_timer_get_time();
+    rebirth_pending = false;
+}
+
+/**
+ * @brief Publish NDEATH for the current session ahead of an intentional disconnect
+ *
+ *  The broker does not deliver the LWT on a clean disconnect, so the NDEATH must be sent explicitly.
+*/
+void esp_tahu_deinit_node() {
+    org_eclipse_tahu_protobuf_Payload payload;
+    build_ndeath_payload(&payload, session_bdSeq);
+    publish_payload(MSG_TYPE_NDEATH, NULL, &payload, qos_policy[QOS_CLASS_DEATH], NULL, NULL);
+
+#if !CONFIG_MQTT_PERSISTENT_SESSION
+    // With a persistent session the subscriptions are kept, so commands sent while the node is
+    // disconnected are queued by the broker and delivered on the next connection
+    char topic[TOPIC_MAX];
+    get_topic(topic, MSG_TYPE_NCMD, NULL);
+    mqtt_util_unsubscribe(topic);
+    get_topic(topic, MSG_TYPE_DCMD, "+");
+    mqtt_util_unsubscribe(topic);
+    commands_subscribed = false;
+#endif
+}
+
+static device_route_t *find_device_route(char *device_id, size_t device_id_len) {
+    for (int i = 0; i < CONFIG_SPARKPLUG_MAX_DEVICES; i++) {
+        device_route_t *route = &device_routes[i];
+        if (route->device_id && route->device_id_len == device_id_len && memcmp(route->device_id, device_id, device_id_len) == 0)
+            return route;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Route DCMDs for a device to its metric set. Replaces the route of a device that is reborn
+*/
+static void add_device_route(char *device_id, esp_tahu_metric_t *metrics, size_t metrics_count) {
+    size_t device_id_len = strlen(device_id);
+    device_route_t *route = find_device_route(device_id, device_id_len);
+    for (int i = 0; !route && i < CONFIG_SPARKPLUG_MAX_DEVICES; i++) {
+        if (!device_routes[i].device_id)
+            route = &device_routes[i];
+    }
+    if (!route) {
+        ESP_LOGW(TAG, "Device table full. Commands for '%s' will be ignored", device_id);
+        return;
+    }
+
+    *route = (device_route_t) {
+        .device_id = device_id,
+        .device_id_len = device_id_len,
+        .metrics = metrics,
+        .metrics_count = metrics_count,
+    };
 }
 
 void esp_tahu_init_device(char *device_id, esp_tahu_metric_t *metrics, size_t metrics_count) {
-    char *topic = (char *)malloc(sizeof(char) * 64);
-    get_topic(topic, MSG_TYPE_DCMD, device_id);
-    mqtt_util_subscribe(topic, 0);
-    
-    uint8_t *dbirth_buffer = (uint8_t *) malloc(sizeof(uint8_t) * 1024);
-    ssize_t dbirth_len = get_device_payload(dbirth_buffer, 1024, device_id, metrics, metrics_count);
+    add_device_route(device_id, metrics, metrics_count);
     
-    get_topic(topic, MSG_TYPE_DBIRTH, device_id);
-    mqtt_util_publish(topic, (char *)dbirth_buffer, dbirth_len, 0, 0);
-    free(topic);
-    free(dbirth_buffer);
+    // A DBIRTH must carry all device metrics, so it is never split
+    ESP_LOGD(TAG, "Creating DBIRTH payload.");
+    org_eclipse_tahu_protobuf_Payload payload;
+    get_next_payload(&payload);
+    add_metrics_to_payload(&payload, metrics, metrics_count);
+    publish_payload(MSG_TYPE_DBIRTH, device_id, &payload, qos_policy[QOS_CLASS_BIRTH], NULL, NULL);
 }
 
 void esp_tahu_deinit_device(char *device_id) {
-    uint8_t *ddeath_buffer = (uint8_t *) malloc(sizeof(uint8_t) * 1024);
-    ssize_t ddeath_len = get_ddeath_payload(ddeath_buffer, 1024);
-    char *topic = (char *)malloc(sizeof(char) * 64);
-    get_topic(topic, MSG_TYPE_DDEATH, device_id);
+    ESP_LOGD(TAG, "Creating DDEATH payload.");
+    org_eclipse_tahu_protobuf_Payload payload;
+    get_next_payload(&payload);
+    publish_payload(MSG_TYPE_DDEATH, device_id, &payload, qos_policy[QOS_CLASS_DEATH], NULL, NULL);
 
-    mqtt_util_publish(topic, (char *)ddeath_buffer, ddeath_len, 0, 0);
-    free(ddeath_buffer);
+    device_route_t *route = find_device_route(device_id, strlen(device_id));
+    if (route)
+        *route = (device_route_t) { 0 };
+}
 
-    get_topic(topic, MSG_TYPE_DCMD, device_id);
-    mqtt_util_unsubscribe(topic);
+void esp_tahu_publish_ddata(esp_tahu_metric_t *metrics, size_t metrics_count) {
+    if (!host_online) {
+        DLOGD(TAG, "Primary host offline. DDATA publish skipped");
+        return;
+    }
 
-    free(topic);
+    publish_data(MSG_TYPE_DDATA, metrics->device_id, metrics, metrics_count, qos_policy[QOS_CLASS_DATA], NULL, NULL);
 }
 
-void esp_tahu_publish_ddata(esp_tahu_metric_t *metrics, size_t metrics_count) {
-    uint8_t *ddata_buffer = (uint8_t *) malloc(sizeof(uint8_t) * 1024);
-    ssize_t ddata_len = get_device_payload(ddata_buffer, 1024, metrics->device_id, metrics, metrics_count);
-    char *topic = (char *)malloc(sizeof(char) * 64);
-    get_topic(topic, MSG_TYPE_DDATA, metrics->device_id);
+/**
+ * @brief Publish DDATA with QoS 1, tracking every payload until the broker acknowledges it
+ *
+ *  Meant for data that is discarded once delivered, such as historical samples. ack_callback is
+ *  called once per payload, with acked=false if no PUBACK arrives within MQTT_INFLIGHT_TIMEOUT.
+ *
+ * @return Number of payloads awaiting acknowledgement, -1 if the host is offline or a payload
+ * could not be published or tracked
+*/
+int esp_tahu_publish_ddata_acked(esp_tahu_metric_t *metrics, size_t metrics_count,
+                                    esp_tahu_ack_callback_handler_t ack_callback, void *ctx) {
+    if (!host_online) {
+        DLOGD(TAG, "Primary host offline. DDATA publish skipped");
+        return -1;
+    }
 
-    mqtt_util_publish(topic, (char *)ddata_buffer, ddata_len, 0, 0);
-    free(ddata_buffer);
-    free(topic);
+    return publish_data(MSG_TYPE_DDATA, metrics->device_id, metrics, metrics_count, 1, ack_callback, ctx);
 }
 
-esp_err_t esp_tahu_data_received(char *payload_buffer, size_t payload_length, esp_tahu_metric_t *metrics, size_t metrics_count) {
-    // Decode the payload
-    org_eclipse_tahu_protobuf_Payload inbound_payload = org_eclipse_tahu_protobuf_Payload_init_zero;
-    if (decode_payload(&inbound_payload, (uint8_t *)payload_buffer, payload_length) == -1) {
-        ESP_LOGW(TAG, "Failed to decode payload.");
-        return ESP_ERR_INVALID_RESPONSE;
+/**
+ * @brief Publish alarm state changes as DDATA right away, from the calling task
+ *
+ *  Alarm payloads are small so they are never split, and they use the alarm QoS rather than the
+ *  data QoS. Calling this from a task of higher priority than the periodic publisher puts the
+ *  alarm on the wire ahead of any queued data.
+*/
+void esp_tahu_publish_alarm(esp_tahu_metric_t *metrics, size_t metrics_count) {
+    if (!host_online) {
+        DLOGD(TAG, "Primary host offline. Alarm publish skipped");
+        return;
     }
 
-    // Get the number of metrics in the payload and iterate over them handling them as needed
-    bool known_command = false;
-    for (int i = 0; i < inbound_payload.metrics_count; i++) {
-        ESP_LOGD(TAG, "Received metric alias: %lld.", inbound_payload.metrics[i].alias);
-        switch (inbound_payload.metrics[i].alias) {
-            case NCMD_NEXT_SERVER:  // Next Server
-                if(next_server_callback)
-                    next_server_callback();
-                known_command = true;
+    org_eclipse_tahu_protobuf_Payload payload;
+    get_next_payload(&payload);
+    add_metrics_to_payload(&payload, metrics, metrics_count);
+    publish_payload(MSG_TYPE_DDATA, metrics->device_id, &payload, qos_policy[QOS_CLASS_ALARM], NULL, NULL);
+}
+
+void esp_tahu_publish_ndata(esp_tahu_metric_t *metrics, size_t metrics_count) {
+    if (!host_online) {
+        DLOGD(TAG, "Primary host offline. NDATA publish skipped");
+        return;
+    }
+
+    publish_data(MSG_TYPE_NDATA, NULL, metrics, metrics_count, qos_policy[QOS_CLASS_DATA], NULL, NULL);
+}
+
+/**
+ * @brief Read a length delimited string field into a fixed buffer
+ *
+ *  Strings that don't fit are skipped and left empty.
+*/
+static bool decode_cmd_string(pb_istream_t *stream, char *buffer, size_t buffer_length) {
+    uint32_t length;
+    if (!pb_decode_varint32(stream, &length))
+        return false;
+
+    buffer[0] = '\0';
+    if (length >= buffer_length)
+        return pb_read(stream, NULL, length);
+
+    if (!pb_read(stream, (uint8_t *)buffer, length))
+        return false;
+    buffer[length] = '\0';
+    return true;
+}
+
+/**
+ * @brief Decode the fields of a single command metric, skipping everything that can't be applied
+*/
+static bool decode_cmd_metric(pb_istream_t *stream, cmd_metric_t *metric) {
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof;
+    uint64_t varint;
+
+    while (pb_decode_tag(stream, &wire_type, &tag, &eof)) {
+        bool ok = true;
+        switch (tag) {
+            case org_eclipse_tahu_protobuf_Payload_Metric_name_tag:
+                ok = wire_type == PB_WT_STRING && decode_cmd_string(stream, metric->name, sizeof(metric->name));
+                break;
+            case org_eclipse_tahu_protobuf_Payload_Metric_alias_tag:
+                ok = wire_type == PB_WT_VARINT && pb_decode_varint(stream, &metric->alias);
+                metric->has_alias = ok;
+                break;
+            case org_eclipse_tahu_protobuf_Payload_Metric_int_value_tag:
+                ok = wire_type == PB_WT_VARINT && pb_decode_varint(stream, &varint);
+                metric->value.int_value = (uint32_t)varint;
+                metric->value_tag = tag;
                 break;
-            case NCMD_REBIRTH:  // Rebirth
-                if(rebirth_callback)
-                    rebirth_callback();
-                known_command = true;
+            case org_eclipse_tahu_protobuf_Payload_Metric_long_value_tag:
+                ok = wire_type == PB_WT_VARINT && pb_decode_varint(stream, &metric->value.long_value);
+                metric->value_tag = tag;
                 break;
-            case NCMD_REBOOT:  // Reboot
-                if(reboot_callback)
-                    reboot_callback();
-                known_command = true;
+            case org_eclipse_tahu_protobuf_Payload_Metric_float_value_tag:
+                ok = wire_type == PB_WT_32BIT && pb_decode_fixed32(stream, &metric->value.float_value);
+                metric->value_tag = tag;
+                break;
+            case org_eclipse_tahu_protobuf_Payload_Metric_double_value_tag:
+                ok = wire_type == PB_WT_64BIT && pb_decode_fixed64(stream, &metric->value.double_value);
+                metric->value_tag = tag;
+                break;
+            case org_eclipse_tahu_protobuf_Payload_Metric_boolean_value_tag:
+                ok = wire_type == PB_WT_VARINT && pb_decode_varint(stream, &varint);
+                metric->value.boolean_value = varint != 0;
+                metric->value_tag = tag;
+                break;
+            case org_eclipse_tahu_protobuf_Payload_Metric_string_value_tag:
+                ok = wire_type == PB_WT_STRING && decode_cmd_string(stream, metric->string_value, sizeof(metric->string_value));
+                metric->value_tag = tag;
                 break;
             default:
-                for(int j = 0; j < metrics_count; j++) {
-                    if ((metrics+j)->alias == inbound_payload.metrics[i].alias) {
-                        ESP_LOGD(TAG, "Metric found.");
-                        esp_tahu_set_metric_data(metrics+j, false, &inbound_payload.metrics[i].value);
-                        if ((metrics+j)->readback_value_change)
-                            esp_tahu_publish_ddata(metrics+j, 1);
-                        known_command = true;
-                    }
-                }
+                ok = pb_skip_field(stream, wire_type);
                 break;
-            }
+        }
+        if (!ok)
+            return false;
+    }
+    return eof;
+}
+
+/**
+ * @brief Get a pointer to the decoded value if its type matches the data type of the target metric
+*/
+static void *get_cmd_value(cmd_metric_t *cmd, esp_tahu_metric_type_t data_type) {
+    switch(data_type) {
+        case ESP_TAHU_METRIC_TYPE_INT8:
+        case ESP_TAHU_METRIC_TYPE_INT16:
+        case ESP_TAHU_METRIC_TYPE_INT32:
+        case ESP_TAHU_METRIC_TYPE_UINT8:
+        case ESP_TAHU_METRIC_TYPE_UINT16:
+        case ESP_TAHU_METRIC_TYPE_UINT32:
+            return cmd->value_tag == org_eclipse_tahu_protobuf_Payload_Metric_int_value_tag ? &cmd->value.int_value : NULL;
+        case ESP_TAHU_METRIC_TYPE_INT64:
+        case ESP_TAHU_METRIC_TYPE_UINT64:
+        case ESP_TAHU_METRIC_TYPE_DATETIME:
+            return cmd->value_tag == org_eclipse_tahu_protobuf_Payload_Metric_long_value_tag ? &cmd->value.long_value : NULL;
+        case ESP_TAHU_METRIC_TYPE_FLOAT:
+            return cmd->value_tag == org_eclipse_tahu_protobuf_Payload_Metric_float_value_tag ? &cmd->value.float_value : NULL;
+        case ESP_TAHU_METRIC_TYPE_DOUBLE:
+            return cmd->value_tag == org_eclipse_tahu_protobuf_Payload_Metric_double_value_tag ? &cmd->value.double_value : NULL;
+        case ESP_TAHU_METRIC_TYPE_BOOLEAN:
+            return cmd->value_tag == org_eclipse_tahu_protobuf_Payload_Metric_boolean_value_tag ? &cmd->value.boolean_value : NULL;
+        case ESP_TAHU_METRIC_TYPE_STRING:
+            return cmd->value_tag == org_eclipse_tahu_protobuf_Payload_Metric_string_value_tag ? cmd->string_value : NULL;
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * @brief Queue a node control command. Controls are only triggered by a true value
+ *
+ *  Controls run from esp_tahu_apply_pending() once in-flight publishes have drained.
+*/
+static bool stage_node_control(cmd_metric_t *cmd) {
+    ncmd_t control = NCMD_COUNT;
+    for (int i = 0; i < NCMD_COUNT; i++) {
+        if ((cmd->has_alias && cmd->alias == i) || (!cmd->has_alias && strcmp(cmd->name, ncmd_metric_name[i]) == 0))
+            control = (ncmd_t)i;
+    }
+    if (control == NCMD_COUNT)
+        return false;
+
+    if (cmd->value_tag != org_eclipse_tahu_protobuf_Payload_Metric_boolean_value_tag || !cmd->value.boolean_value)
+        return true;
+
+    if (!control_pending[control])
+        control_request_time = esp_timer_get_time();
+    control_pending[control] = true;
+    return true;
+}
+
+static void run_node_control(ncmd_t control) {
+    switch (control) {
+        case NCMD_NEXT_SERVER:
+            if(next_server_callback)
+                next_server_callback();
+            break;
+        case NCMD_REBIRTH:
+            if(rebirth_callback)
+                rebirth_callback();
+            break;
+        case NCMD_REBOOT:
+            if(reboot_callback)
+                reboot_callback();
+            break;
+        default:
+            break;
+    }
+}
+
+static void apply_write(pending_write_t *write) {
+    esp_tahu_metric_t *metric = write->metric;
+    void *value = metric->data_type == ESP_TAHU_METRIC_TYPE_STRING ? (void *)write->string_value : (void *)&write->value;
+    if (write->write_count > 1)
+        DLOGD(TAG, "Coalesced %d writes to '%s'", write->write_count, metric->metric_name);
+
+    esp_tahu_set_metric_data(metric, false, value);
+    if (metric->readback_value_change) {
+        metric->readback_attempts = 0;
+        publish_readback(metric);
+    }
+
+    esp_tahu_heap_free(write->string_value);
+    *write = (pending_write_t) { 0 };
+}
+
+/**
+ * @brief Stage a metric write, replacing the value of an earlier write to the same metric
+ *
+ *  If all slots are in use the write is applied immediately.
+*/
+static void stage_write(esp_tahu_metric_t *metric, cmd_metric_t *cmd) {
+    pending_write_t *slot = NULL;
+    for (int i = 0; i < CONFIG_SPARKPLUG_PENDING_WRITES_MAX; i++) {
+        if (pending_writes[i].metric == metric) {
+            slot = &pending_writes[i];
+            break;
+        }
+        if (!slot && !pending_writes[i].metric)
+            slot = &pending_writes[i];
+    }
+
+    pending_write_t write = { .metric = metric, .write_count = 1, .value = cmd->value };
+    if (slot && slot->metric) {
+        write.write_count = slot->write_count + 1;
+        esp_tahu_heap_free(slot->string_value);
+    }
+    if (metric->data_type == ESP_TAHU_METRIC_TYPE_STRING)
+        write.string_value = esp_tahu_heap_strdup(cmd->string_value);
+
+    if (slot) {
+        *slot = write;
+    } else {
+        ESP_LOGD(TAG, "Pending write table full. Applying '%s' immediately", metric->metric_name);
+        apply_write(&write);
+    }
+}
+
+static bool apply_cmd_metric(cmd_metric_t *cmd, bool node_command, esp_tahu_metric_t *metrics, size_t metrics_count) {
+    ESP_LOGD(TAG, "Received metric alias: %lld, name: '%s'.", cmd->alias, cmd->name);
+    if (node_command && stage_node_control(cmd))
+        return true;
+
+    for (int j = 0; j < metrics_count; j++) {
+        esp_tahu_metric_t *metric = metrics + j;
+        bool match = cmd->has_alias ? (metric->has_alias && metric->alias == cmd->alias) 
+                                    : (cmd->name[0] && strcmp(metric->metric_name, cmd->name) == 0);
+        if (!match)
+            continue;
+
+        if (!get_cmd_value(cmd, metric->data_type)) {
+            ESP_LOGW(TAG, "Command for '%s' has no value of type %d", metric->metric_name, metric->data_type);
+            return false;
+        }
+        DLOGD(TAG, "Metric found.");
+        stage_write(metric, cmd);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Apply staged metric writes and run node controls once in-flight publishes have drained
+ *
+ *  Call once the inbound message queue is empty. Each staged metric is written and read back once,
+ *  regardless of how many writes were received for it.
+ *
+ * @return True if node controls are still waiting for publishes to drain
+*/
+bool esp_tahu_apply_pending() {
+    for (int i = 0; i < CONFIG_SPARKPLUG_PENDING_WRITES_MAX; i++) {
+        if (pending_writes[i].metric)
+            apply_write(&pending_writes[i]);
+    }
+
+    bool controls_waiting = false;
+    for (int i = 0; i < NCMD_COUNT; i++)
+        controls_waiting |= control_pending[i];
+    if (!controls_waiting)
+        return false;
+
+    bool timed_out = (esp_timer_get_time() - control_request_time) > (int64_t)CONFIG_SPARKPLUG_CONTROL_DRAIN_TIMEOUT * 1000;
+    if (!mqtt_app_outbox_empty() && !timed_out)
+        return true;
+    if (timed_out)
+        ESP_LOGW(TAG, "Publishes not drained within %d ms. Running node control", CONFIG_SPARKPLUG_CONTROL_DRAIN_TIMEOUT);
+
+    for (int i = 0; i < NCMD_COUNT; i++) {
+        if (control_pending[i]) {
+            control_pending[i] = false;
+            run_node_control((ncmd_t)i);
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Decode the metrics of a command payload and stage them for the matching known metrics
+ *
+ *  The payload is walked field by field. Each metric is matched by alias, or by name if it has no alias,
+ *  as soon as it is decoded. Unknown metrics and fields are skipped without allocating.
+ *  Staged writes and node controls are applied by esp_tahu_apply_pending().
+*/
+static esp_err_t decode_command_metrics(const uint8_t *payload_buffer, size_t payload_length, bool node_command, esp_tahu_metric_t *metrics, size_t metrics_count) {
+    pb_istream_t stream = pb_istream_from_buffer(payload_buffer, payload_length);
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof;
+    bool known_command = false;
+
+    while (pb_decode_tag(&stream, &wire_type, &tag, &eof)) {
+        if (tag != org_eclipse_tahu_protobuf_Payload_metrics_tag || wire_type != PB_WT_STRING) {
+            if (!pb_skip_field(&stream, wire_type))
+                break;
+            continue;
+        }
+
+        pb_istream_t metric_stream;
+        if (!pb_make_string_substream(&stream, &metric_stream))
+            break;
+        cmd_metric_t cmd = { 0 };
+        bool decoded = decode_cmd_metric(&metric_stream, &cmd);
+        if (!pb_close_string_substream(&stream, &metric_stream) || !decoded)
+            break;
+
+        if (apply_cmd_metric(&cmd, node_command, metrics, metrics_count))
+            known_command = true;
+    }
+
+    if (!eof) {
+        ESP_LOGW(TAG, "Failed to decode payload: %s", PB_GET_ERROR(&stream));
+        return ESP_ERR_INVALID_RESPONSE;
     }
-    free_payload(&inbound_payload);
 
     if(known_command)
         return ESP_OK;
@@ -264,9 +1096,316 @@ esp_err_t esp_tahu_data_received(char *payload_buffer, size_t payload_length, es
         return ESP_ERR_INVALID_ARG;
 }
 
-void esp_tahu_get_lwt_data(char *lwt_topic_buffer, char *lwt_msg_buffer, size_t lwt_msg_buffer_len, ssize_t *out_msg_len) {
+#if CONFIG_SPARKPLUG_COMPRESSION_ENABLE
+/**
+ * @brief Find the body and algorithm of a compressed payload
+ *
+ * @return False if the payload is not compressed
+*/
+static bool find_compressed_body(const uint8_t *payload_buffer, size_t payload_length, const uint8_t **body, size_t *body_length,
+                                    esp_tahu_compression_t *algorithm) {
+    pb_istream_t stream = pb_istream_from_buffer(payload_buffer, payload_length);
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof;
+    bool compressed = false;
+    *body = NULL;
+    *algorithm = ESP_TAHU_COMPRESSION_DEFLATE;     // Default if there is no algorithm metric
+
+    while (pb_decode_tag(&stream, &wire_type, &tag, &eof)) {
+        bool ok = true;
+        if (wire_type != PB_WT_STRING) {
+            ok = pb_skip_field(&stream, wire_type);
+        } else if (tag == org_eclipse_tahu_protobuf_Payload_uuid_tag) {
+            char uuid[sizeof(COMPRESSED_UUID)];
+            ok = decode_cmd_string(&stream, uuid, sizeof(uuid));
+            compressed = strcmp(uuid, COMPRESSED_UUID) == 0;
+        } else if (tag == org_eclipse_tahu_protobuf_Payload_body_tag) {
+            uint32_t length;
+            ok = pb_decode_varint32(&stream, &length);
+            *body = payload_buffer + payload_length - stream.bytes_left;
+            *body_length = length;
+            ok = ok && pb_read(&stream, NULL, length);
+        } else if (tag == org_eclipse_tahu_protobuf_Payload_metrics_tag) {
+            pb_istream_t metric_stream;
+            cmd_metric_t metric = { 0 };
+            ok = pb_make_string_substream(&stream, &metric_stream);
+            bool decoded = ok && decode_cmd_metric(&metric_stream, &metric);
+            ok = ok && pb_close_string_substream(&stream, &metric_stream) && decoded;
+            if (ok && strcmp(metric.name, COMPRESSION_ALGORITHM_METRIC) == 0
+                    && metric.value_tag == org_eclipse_tahu_protobuf_Payload_Metric_string_value_tag
+                    && strcasecmp(metric.string_value, "GZIP") == 0)
+                *algorithm = ESP_TAHU_COMPRESSION_GZIP;
+        } else {
+            ok = pb_skip_field(&stream, wire_type);
+        }
+        if (!ok)
+            return false;
+    }
+    return eof && compressed && *body;
+}
+#endif
+
+/**
+ * @brief Decode an inbound NCMD/DCMD, decompressing it first if it is a compressed payload
+*/
+static esp_err_t decode_command(char *payload_buffer, size_t payload_length, bool node_command, esp_tahu_metric_t *metrics, size_t metrics_count) {
+    if (payload_length > CONFIG_SPARKPLUG_CMD_MAX_PAYLOAD_SIZE) {
+        ESP_LOGW(TAG, "Command payload of %d bytes exceeds limit of %d bytes.", payload_length, CONFIG_SPARKPLUG_CMD_MAX_PAYLOAD_SIZE);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+#if CONFIG_SPARKPLUG_COMPRESSION_ENABLE
+    const uint8_t *body;
+    size_t body_length;
+    esp_tahu_compression_t algorithm;
+    if (find_compressed_body((const uint8_t *)payload_buffer, payload_length, &body, &body_length, &algorithm)) {
+        uint8_t *decompressed = esp_tahu_buffer_get(CONFIG_SPARKPLUG_CMD_MAX_PAYLOAD_SIZE);
+        if (!decompressed)
+            return ESP_ERR_NO_MEM;
+
+        esp_err_t result;
+        ssize_t decompressed_length = esp_tahu_decompress(body, body_length, decompressed, CONFIG_SPARKPLUG_CMD_MAX_PAYLOAD_SIZE, algorithm);
+        if (decompressed_length < 0) {
+            ESP_LOGW(TAG, "Failed to decompress command payload.");
+            result = ESP_ERR_INVALID_RESPONSE;
+        } else {
+            // Compressed payloads nested in the body are not decompressed again
+            result = decode_command_metrics(decompressed, decompressed_length, node_command, metrics, metrics_count);
+        }
+        esp_tahu_buffer_release(decompressed);
+        return result;
+    }
+#endif
+
+    return decode_command_metrics((const uint8_t *)payload_buffer, payload_length, node_command, metrics, metrics_count);
+}
+
+/**
+ * @brief Decode a DCMD payload and stage its writes to the given metrics, as if received for their device
+ *
+ *  Staged writes are applied by esp_tahu_apply_pending().
+*/
+esp_err_t esp_tahu_decode_command(char *payload_buffer, size_t payload_length, esp_tahu_metric_t *metrics, size_t metrics_count) {
+    return decode_command(payload_buffer, payload_length, false, metrics, metrics_count);
+}
+
+/**
+ * @brief Parse a primary host STATE payload
+ *
+ *  Sparkplug 3.0 hosts publish JSON: {"online":true,"timestamp":<ms>}. Legacy hosts publish ONLINE/OFFLINE.
+*/
+static esp_err_t parse_host_state(char *payload_buffer, size_t payload_length, bool *online, uint64_t *timestamp) {
+    char state[128];
+    if (payload_length >= sizeof(state))
+        return ESP_ERR_INVALID_SIZE;
+    memcpy(state, payload_buffer, payload_length);
+    state[payload_length] = '\0';
+
+    *timestamp = 0;
+    if (strcmp(state, "ONLINE") == 0) {
+        *online = true;
+        return ESP_OK;
+    }
+    if (strcmp(state, "OFFLINE") == 0) {
+        *online = false;
+        return ESP_OK;
+    }
+
+    char *value = strstr(state, "\"online\"");
+    if (!value)
+        return ESP_ERR_INVALID_RESPONSE;
+    value += strlen("\"online\"");
+    value += strspn(value, " \t:");
+    if (strncmp(value, "true", 4) == 0)
+        *online = true;
+    else if (strncmp(value, "false", 5) == 0)
+        *online = false;
+    else
+        return ESP_ERR_INVALID_RESPONSE;
+
+    value = strstr(state, "\"timestamp\"");
+    if (value) {
+        value += strlen("\"timestamp\"");
+        value += strspn(value, " \t:");
+        *timestamp = strtoull(value, NULL, 10);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Schedule a rebirth after a random delay, no sooner than the minimum interval since the last NBIRTH
+ *
+ *  Spreads the BIRTHs of all nodes out when the primary host comes back online.
+*/
+static void schedule_rebirth() {
+    int64_t now = esp_timer_get_time();
+    int64_t due_time = now + (int64_t)(esp_random() % (CONFIG_SPARKPLUG_REBIRTH_JITTER_MAX + 1)) * 1000;
+    int64_t earliest_time = last_birth_time + (int64_t)CONFIG_SPARKPLUG_REBIRTH_MIN_INTERVAL * 1000;
+    if (last_birth_time && due_time < earliest_time)
+        due_time = earliest_time;
+
+    rebirth_due_time = due_time;
+    rebirth_pending = true;
+    ESP_LOGI(TAG, "Rebirth scheduled in %lld ms", (due_time - now) / 1000);
+}
+
+/**
+ * @brief Reset the session state after the MQTT client (re)connected
+ *
+ * @param session_present True if the broker resumed a persistent session. Command subscriptions made
+ * in that session are kept. The host STATE topic is always resubscribed to get its retained state
+*/
+void esp_tahu_connected(bool session_present) {
+    if (!session_present)
+        commands_subscribed = false;
+    if (!host_state_topic[0])
+        return;
+
+    host_online = false;
+    rebirth_pending = false;
+    mqtt_util_subscribe(host_state_topic, 1);
+}
+
+bool esp_tahu_is_host_state_topic(char *topic, int topic_len) {
+    return host_state_topic[0] && strlen(host_state_topic) == topic_len && strncmp(host_state_topic, topic, topic_len) == 0;
+}
+
+/**
+ * @brief Check if data may be published. Always true if no primary host is configured
+*/
+bool esp_tahu_host_online() {
+    return host_online;
+}
+
+esp_err_t esp_tahu_host_state_received(char *payload_buffer, size_t payload_length) {
+    bool online;
+    uint64_t timestamp;
+    esp_err_t result = parse_host_state(payload_buffer, payload_length, &online, &timestamp);
+    if (result != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to parse primary host STATE: %.*s", payload_length, payload_buffer);
+        return result;
+    }
+
+    // Ignore a stale STATE delivered out of order
+    if (timestamp && timestamp < host_state_timestamp) {
+        ESP_LOGD(TAG, "Stale primary host STATE ignored");
+        return ESP_OK;
+    }
+    host_state_timestamp = timestamp;
+
+    if (online == host_online)
+        return ESP_OK;
+
+    host_online = online;
+    if (online) {
+        ESP_LOGI(TAG, "Primary host '%s' online", CONFIG_SPARKPLUG_PRIMARY_HOST_ID);
+        schedule_rebirth();
+    } else {
+        ESP_LOGW(TAG, "Primary host '%s' offline. Publishing paused", CONFIG_SPARKPLUG_PRIMARY_HOST_ID);
+        rebirth_pending = false;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Route a received message by topic to the primary host state or the target metric set
+ *
+ *  Topics are matched in a single pass: <topic_root>/<NCMD|DCMD>/<node_id>[/<device_id>].
+ *
+ * @return ESP_ERR_NOT_FOUND if the topic isn't addressed to this node or one of its devices
+*/
+esp_err_t esp_tahu_message_received(char *topic, int topic_len, char *payload_buffer, size_t payload_length) {
+    if (esp_tahu_is_host_state_topic(topic, topic_len))
+        return esp_tahu_host_state_received(payload_buffer, payload_length);
+
+    char *end = topic + topic_len;
+    if (topic_len <= topic_root_len + 1 || memcmp(topic, topic_root, topic_root_len) != 0 || topic[topic_root_len] != '/')
+        return ESP_ERR_NOT_FOUND;
+
+    char *msg_type = topic + topic_root_len + 1;
+    bool node_command;
+    if (end - msg_type > 5 && memcmp(msg_type, "NCMD/", 5) == 0)
+        node_command = true;
+    else if (end - msg_type > 5 && memcmp(msg_type, "DCMD/", 5) == 0)
+        node_command = false;
+    else
+        return ESP_ERR_NOT_FOUND;
+
+    char *node = msg_type + 5;
+    if (end - node < node_id_len || memcmp(node, node_id, node_id_len) != 0)
+        return ESP_ERR_NOT_FOUND;
+
+    char *device = node + node_id_len;
+    if (node_command) {
+        if (device != end)
+            return ESP_ERR_NOT_FOUND;
+        return decode_command(payload_buffer, payload_length, true, node_metrics, node_metrics_count);
+    }
+
+    if (device == end || *device != '/')
+        return ESP_ERR_NOT_FOUND;
+    device++;
+    device_route_t *route = find_device_route(device, end - device);
+    if (!route)
+        return ESP_ERR_NOT_FOUND;
+    return decode_command(payload_buffer, payload_length, false, route->metrics, route->metrics_count);
+}
+
+/**
+ * @brief Run a scheduled rebirth once it is due. Call periodically from a task
+*/
+void esp_tahu_service() {
+    if (!rebirth_pending || esp_timer_get_time() < rebirth_due_time)
+        return;
+
+    rebirth_pending = false;
+    if (rebirth_callback)
+        rebirth_callback();
+}
+
+static void encode_lwt(int lwt_bdSeq, char *lwt_topic_buffer, char *lwt_msg_buffer, size_t lwt_msg_buffer_len, ssize_t *out_msg_len) {
     get_topic(lwt_topic_buffer, MSG_TYPE_NDEATH, NULL);
-    *out_msg_len = get_ndeath_payload((uint8_t *) lwt_msg_buffer, lwt_msg_buffer_len);
+    org_eclipse_tahu_protobuf_Payload payload;
+    build_ndeath_payload(&payload, lwt_bdSeq);
+    *out_msg_len = encode_payload((uint8_t *) lwt_msg_buffer, lwt_msg_buffer_len, &payload);
+    free_payload(&payload);
+    if (*out_msg_len < 0)
+        ESP_LOGE(TAG, "Failed to encode NDEATH for LWT.");
+}
+
+/**
+ * @brief Build the NDEATH to register as the LWT of the next session
+ *
+ * @return bdSeq of the NDEATH
+*/
+int esp_tahu_get_lwt_data(char *lwt_topic_buffer, char *lwt_msg_buffer, size_t lwt_msg_buffer_len, ssize_t *out_msg_len) {
+    // Every NBIRTH until the next LWT update, including rebirths, must carry the bdSeq of this NDEATH
+    session_bdSeq = bdSeq++;
+    encode_lwt(session_bdSeq, lwt_topic_buffer, lwt_msg_buffer, lwt_msg_buffer_len, out_msg_len);
+    return session_bdSeq;
+}
+
+/**
+ * @brief Build the NDEATH to register as the LWT of a standby connection
+ *
+ *  The bdSeq is reserved without changing the bdSeq of the current session. If the standby takes
+ *  over, pass the returned bdSeq to esp_tahu_set_session_bdseq() before the NBIRTH.
+ *
+ * @return bdSeq of the NDEATH
+*/
+int esp_tahu_get_standby_lwt_data(char *lwt_topic_buffer, char *lwt_msg_buffer, size_t lwt_msg_buffer_len, ssize_t *out_msg_len) {
+    int standby_bdSeq = bdSeq++;
+    encode_lwt(standby_bdSeq, lwt_topic_buffer, lwt_msg_buffer, lwt_msg_buffer_len, out_msg_len);
+    return standby_bdSeq;
+}
+
+/**
+ * @brief Set the bdSeq carried by NBIRTHs and explicit NDEATHs to that of the LWT registered by the
+ * connection in use
+*/
+void esp_tahu_set_session_bdseq(int session_bdseq) {
+    session_bdSeq = session_bdseq;
 }
 
 esp_err_t esp_tahu_create_metric(char *device_id, esp_tahu_metric_t *metric_buffer, char *metric_name, esp_tahu_metric_type_t data_type, esp_tahu_metric_change_callback_t on_change_callback) {
@@ -298,8 +1437,8 @@ void *esp_tahu_get_metric_data(esp_tahu_metric_t *metric) {
             return &metric->value.int_value;
         case ESP_TAHU_METRIC_TYPE_INT64:
         case ESP_TAHU_METRIC_TYPE_UINT64:
+        case ESP_TAHU_METRIC_TYPE_DATETIME:
             return &metric->value.long_value;
-            break;
         case ESP_TAHU_METRIC_TYPE_FLOAT:
             return &metric->value.float_value;
         case ESP_TAHU_METRIC_TYPE_DOUBLE:
@@ -308,13 +1447,15 @@ void *esp_tahu_get_metric_data(esp_tahu_metric_t *metric) {
             return &metric->value.boolean_value;
         case ESP_TAHU_METRIC_TYPE_STRING:
             return &metric->value.string_value;
-        case ESP_TAHU_METRIC_TYPE_DATETIME:
+        case ESP_TAHU_METRIC_TYPE_BYTES:
+            return &metric->value.bytes_value;
+        case ESP_TAHU_METRIC_TYPE_DATASET:
+            return metric->value.dataset_value;
+        case ESP_TAHU_METRIC_TYPE_TEMPLATE:
+            return metric->value.template_value;
         case ESP_TAHU_METRIC_TYPE_TEXT:
         case ESP_TAHU_METRIC_TYPE_UUID:
-        case ESP_TAHU_METRIC_TYPE_DATASET:
-        case ESP_TAHU_METRIC_TYPE_BYTES:
         case ESP_TAHU_METRIC_TYPE_FILE:
-        case ESP_TAHU_METRIC_TYPE_TEMPLATE:
         default:
             ESP_LOGW(TAG, "Unable to retrieve metric value for metric `%s` of type %d", metric->metric_name, metric->data_type);
             return NULL;
@@ -338,6 +1479,7 @@ esp_err_t esp_tahu_set_metric_data(esp_tahu_metric_t *metric, bool zero_value, v
             break;
         case ESP_TAHU_METRIC_TYPE_INT64:
         case ESP_TAHU_METRIC_TYPE_UINT64:
+        case ESP_TAHU_METRIC_TYPE_DATETIME:
             if (zero_value)
                 metric->value.long_value = 0;
             else if (new_value)
@@ -370,30 +1512,106 @@ esp_err_t esp_tahu_set_metric_data(esp_tahu_metric_t *metric, bool zero_value, v
                 return ESP_ERR_INVALID_ARG;
             break;
         case ESP_TAHU_METRIC_TYPE_STRING:
-            if (zero_value)
-                metric->value.string_value = strdup("");
-            else if (new_value)
-                metric->value.string_value = (char *) new_value;
-            else
+            // The metric owns a copy of its string value
+            if (!zero_value && !new_value)
                 return ESP_ERR_INVALID_ARG;
+            esp_tahu_heap_free(metric->value.string_value);
+            metric->value.string_value = esp_tahu_heap_strdup(zero_value ? "" : (char *) new_value);
+            break;
+        case ESP_TAHU_METRIC_TYPE_BYTES: {
+            // The metric owns a copy of its bytes value
+            if (!zero_value && !new_value)
+                return ESP_ERR_INVALID_ARG;
+            esp_tahu_bytes_t *bytes = (esp_tahu_bytes_t *) new_value;
+            uint8_t *copy = NULL;
+            if (!zero_value && bytes->size) {
+                copy = (uint8_t *)esp_tahu_heap_malloc(bytes->size);
+                if (!copy)
+                    return ESP_ERR_NO_MEM;
+                memcpy(copy, bytes->bytes, bytes->size);
+            }
+            esp_tahu_heap_free(metric->value.bytes_value.bytes);
+            metric->value.bytes_value.bytes = copy;
+            metric->value.bytes_value.size = copy ? bytes->size : 0;
+            break;
+        }
+        case ESP_TAHU_METRIC_TYPE_DATASET:
+            // Datasets are referenced, so values updated in the dataset are published without setting it again
+            metric->value.dataset_value = zero_value ? NULL : (esp_tahu_dataset_t *) new_value;
+            break;
+        case ESP_TAHU_METRIC_TYPE_TEMPLATE:
+            metric->value.template_value = zero_value ? NULL : (esp_tahu_template_t *) new_value;
             break;
-        case ESP_TAHU_METRIC_TYPE_DATETIME:
         case ESP_TAHU_METRIC_TYPE_TEXT:
         case ESP_TAHU_METRIC_TYPE_UUID:
-        case ESP_TAHU_METRIC_TYPE_DATASET:
-        case ESP_TAHU_METRIC_TYPE_BYTES:
         case ESP_TAHU_METRIC_TYPE_FILE:
-        case ESP_TAHU_METRIC_TYPE_TEMPLATE:
         default:
             return ESP_ERR_NOT_SUPPORTED;
     }
 
+    metric->is_null = false;
     if(metric->on_change_callback)
-        metric->on_change_callback(new_value);
+        metric->on_change_callback(new_value, metric);
     
     return ESP_OK;
 }
 
+/**
+ * @brief Allocate the column arrays of a dataset in a single block
+ *
+ * @param columns Column names. Must outlive the dataset
+ * @param types Column types. Must outlive the dataset
+*/
+esp_err_t esp_tahu_dataset_init(esp_tahu_dataset_t *dataset, size_t num_of_columns, const char **columns, const esp_tahu_metric_type_t *types, size_t row_capacity) {
+    if (!num_of_columns)
+        return ESP_ERR_INVALID_ARG;
+
+    size_t block_size = 0;
+    for (size_t column = 0; column < num_of_columns; column++) {
+        size_t value_size = dataset_value_size(types[column]);
+        if (!value_size) {
+            ESP_LOGE(TAG, "Dataset column '%s' has unsupported type %d", columns[column], types[column]);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        // Keep every column aligned for 64 bit values
+        block_size += (value_size * row_capacity + 7) & ~7;
+    }
+
+    void **column_values = (void **)esp_tahu_heap_calloc(num_of_columns, sizeof(void *));
+    uint8_t *block = (uint8_t *)esp_tahu_heap_calloc(1, block_size);
+    if (!column_values || !block) {
+        esp_tahu_heap_free(column_values);
+        esp_tahu_heap_free(block);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t column = 0; column < num_of_columns; column++) {
+        column_values[column] = block;
+        block += (dataset_value_size(types[column]) * row_capacity + 7) & ~7;
+    }
+    *dataset = (esp_tahu_dataset_t) {
+        .num_of_columns = num_of_columns,
+        .columns = columns,
+        .types = types,
+        .num_of_rows = 0,
+        .row_capacity = row_capacity,
+        .column_values = column_values,
+    };
+    return ESP_OK;
+}
+
+/**
+ * @brief Free the column arrays of a dataset. Strings stored in STRING columns are owned by the application
+*/
+void esp_tahu_dataset_free(esp_tahu_dataset_t *dataset) {
+    if (dataset->column_values)
+        esp_tahu_heap_free(dataset->column_values[0]);
+    esp_tahu_heap_free(dataset->column_values);
+    dataset->column_values = NULL;
+    dataset->num_of_rows = 0;
+    dataset->row_capacity = 0;
+}
+
 void esp_tahu_register_next_server_callback_handler(esp_tahu_next_server_callback_handler_t callback_handler) {
     next_server_callback = callback_handler;
 }
@@ -405,3 +1623,24 @@ void esp_tahu_register_rebirth_callback_handler(esp_tahu_rebirth_callback_handle
 void esp_tahu_register_reboot_callback_handler(esp_tahu_reboot_callback_handler_t callback_handler) {
     reboot_callback = callback_handler;
 }
+
+#if CONFIG_APP_STATIC_ALLOCATION
+/**
+ * @brief Get the size of the static topic, routing, staged write and encode buffers, including the payload heap
+*/
+size_t esp_tahu_get_static_size() {
+    size_t size = sizeof(topic_root) + sizeof(host_state_topic) + sizeof(device_routes) + sizeof(pending_writes)
+                    + esp_tahu_buffer_get_static_size() + CONFIG_SPARKPLUG_HEAP_SIZE;
+#if CONFIG_SPARKPLUG_COMPRESSION_ENABLE
+    size += esp_tahu_compress_get_static_size();
+#endif
+    return size;
+}
+
+/**
+ * @brief Get the most of the payload heap in use at once since boot, including allocator overhead
+*/
+size_t esp_tahu_get_heap_peak() {
+    return CONFIG_SPARKPLUG_HEAP_SIZE - esp_tahu_heap_get_minimum_free();
+}
+#endif
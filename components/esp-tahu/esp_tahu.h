@@ -32,9 +32,45 @@ typedef enum {
     ESP_TAHU_METRIC_TYPE_TEMPLATE =  METRIC_DATA_TYPE_TEMPLATE
 } esp_tahu_metric_type_t;
 
-typedef void (*esp_tahu_metric_change_callback_t)(void *new_value);
+struct esp_tahu_metric;
+
+// Called after a value is set, with the value and the metric it was set on
+typedef void (*esp_tahu_metric_change_callback_t)(void *new_value, struct esp_tahu_metric *metric);
 
 typedef struct {
+    uint8_t *bytes;
+    size_t size;
+} esp_tahu_bytes_t;
+
+/**
+ * @brief Table of values stored by column
+ *
+ *  Each column is a contiguous array of row_capacity values of its type: uint32_t for 8-32 bit integers,
+ *  uint64_t for 64 bit integers and DATETIME, float, double, bool or char * for STRING.
+*/
+typedef struct {
+    size_t num_of_columns;
+    const char **columns;
+    const esp_tahu_metric_type_t *types;
+    size_t num_of_rows;         // Rows currently holding values
+    size_t row_capacity;
+    void **column_values;
+} esp_tahu_dataset_t;
+
+/**
+ * @brief Template definition or instance
+ *
+ *  Members are metrics without device_id or alias. Definitions belong in the NBIRTH.
+*/
+typedef struct {
+    char *template_ref;         // Name of the definition of an instance. NULL for a definition
+    char *version;
+    bool is_definition;
+    struct esp_tahu_metric *members;
+    size_t members_count;
+} esp_tahu_template_t;
+
+typedef struct esp_tahu_metric {
     char *device_id;
     char *metric_name;
     bool has_alias;
@@ -43,6 +79,9 @@ typedef struct {
     bool is_historical;
     bool is_transient;
     bool readback_value_change;
+    uint64_t timestamp;     // Sample time in ms since epoch. 0 to stamp with the current time on publish
+    uint8_t readback_attempts;
+    bool is_null;           // Published as null, such as before the first sample. Cleared by esp_tahu_set_metric_data
     esp_tahu_metric_change_callback_t on_change_callback;
     union {
         uint32_t int_value;
@@ -51,26 +90,51 @@ typedef struct {
         double double_value;
         bool boolean_value;
         char *string_value;
+        esp_tahu_bytes_t bytes_value;               // Owned by the metric
+        esp_tahu_dataset_t *dataset_value;          // Owned by the application, updated in place
+        esp_tahu_template_t *template_value;        // Owned by the application, updated in place
     } value;
 } esp_tahu_metric_t;
 
 typedef void (*esp_tahu_next_server_callback_handler_t)(void);
 typedef void (*esp_tahu_rebirth_callback_handler_t)(void);
 typedef void (*esp_tahu_reboot_callback_handler_t)(void);
+typedef void (*esp_tahu_ack_callback_handler_t)(int msg_id, bool acked, void *ctx);
 
 void esp_tahu_configure(char *sp_node_id);
-void esp_tahu_init_node();
+void esp_tahu_init_node(esp_tahu_metric_t *metrics, size_t metrics_count);
+void esp_tahu_deinit_node();
 void esp_tahu_init_device(char *device_id, esp_tahu_metric_t *metrics, size_t metrics_count);
 void esp_tahu_deinit_device(char *device_id);
 esp_err_t esp_tahu_create_metric(char *device_id, esp_tahu_metric_t *metric_buffer, char *metric_name, esp_tahu_metric_type_t data_type, esp_tahu_metric_change_callback_t on_change_callback);
 void *esp_tahu_get_metric_data(esp_tahu_metric_t *metric);
 esp_err_t esp_tahu_set_metric_data(esp_tahu_metric_t *metric, bool zero_value, void *new_value);
+esp_err_t esp_tahu_dataset_init(esp_tahu_dataset_t *dataset, size_t num_of_columns, const char **columns, const esp_tahu_metric_type_t *types, size_t row_capacity);
+void esp_tahu_dataset_free(esp_tahu_dataset_t *dataset);
+ssize_t esp_tahu_encode_data(esp_tahu_metric_t *metrics, size_t metrics_count, uint8_t *buffer, size_t buffer_length);
 void esp_tahu_publish_ddata(esp_tahu_metric_t *metrics, size_t metrics_count);
-esp_err_t esp_tahu_data_received(char *payload_buffer, size_t payload_length, esp_tahu_metric_t *metrics, size_t metrics_count);
-void esp_tahu_get_lwt_data(char *lwt_topic_buffer, char *lwt_msg_buffer, size_t lwt_msg_buffer_len, ssize_t *out_msg_len);
+int esp_tahu_publish_ddata_acked(esp_tahu_metric_t *metrics, size_t metrics_count,
+                                    esp_tahu_ack_callback_handler_t ack_callback, void *ctx);
+void esp_tahu_publish_alarm(esp_tahu_metric_t *metrics, size_t metrics_count);
+void esp_tahu_publish_ndata(esp_tahu_metric_t *metrics, size_t metrics_count);
+esp_err_t esp_tahu_message_received(char *topic, int topic_len, char *payload_buffer, size_t payload_length);
+esp_err_t esp_tahu_decode_command(char *payload_buffer, size_t payload_length, esp_tahu_metric_t *metrics, size_t metrics_count);
+bool esp_tahu_apply_pending();
+void esp_tahu_connected(bool session_present);
+bool esp_tahu_is_host_state_topic(char *topic, int topic_len);
+bool esp_tahu_host_online();
+esp_err_t esp_tahu_host_state_received(char *payload_buffer, size_t payload_length);
+void esp_tahu_service();
+int esp_tahu_get_lwt_data(char *lwt_topic_buffer, char *lwt_msg_buffer, size_t lwt_msg_buffer_len, ssize_t *out_msg_len);
+int esp_tahu_get_standby_lwt_data(char *lwt_topic_buffer, char *lwt_msg_buffer, size_t lwt_msg_buffer_len, ssize_t *out_msg_len);
+void esp_tahu_set_session_bdseq(int session_bdseq);
 void esp_tahu_register_next_server_callback_handler(esp_tahu_next_server_callback_handler_t callback_handler);
 void esp_tahu_register_rebirth_callback_handler(esp_tahu_rebirth_callback_handler_t callback_handler);
 void esp_tahu_register_reboot_callback_handler(esp_tahu_reboot_callback_handler_t callback_handler);
+#if CONFIG_APP_STATIC_ALLOCATION
+size_t esp_tahu_get_static_size();
+size_t esp_tahu_get_heap_peak();
+#endif
 
 #ifdef __cplusplus
 } /* extern "C" */
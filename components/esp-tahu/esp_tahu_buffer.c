@@ -0,0 +1,92 @@
+// ESP-IDF Components
+#include <stdlib.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "esp_tahu_buffer.h"
+#include "esp_tahu_heap.h"
+
+#define BUFFERS_PER_CLASS 2
+
+static const char *TAG = "esp-tahu-buffer";
+static const size_t class_size[] = { 256, 1024, CONFIG_SPARKPLUG_PAYLOAD_MAX_SIZE };
+#define CLASS_COUNT (sizeof(class_size) / sizeof(class_size[0]))
+
+// Buffers are allocated on first use and kept for the lifetime of the application
+static uint8_t *buffers[CLASS_COUNT][BUFFERS_PER_CLASS];
+#if CONFIG_APP_STATIC_ALLOCATION
+static struct {
+    uint8_t small[BUFFERS_PER_CLASS][256];
+    uint8_t medium[BUFFERS_PER_CLASS][1024];
+    uint8_t large[BUFFERS_PER_CLASS][CONFIG_SPARKPLUG_PAYLOAD_MAX_SIZE];
+} pool_storage;
+#endif
+static bool in_use[CLASS_COUNT][BUFFERS_PER_CLASS];
+static portMUX_TYPE pool_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t *pool_alloc(int size_class, int index) {
+#if CONFIG_APP_STATIC_ALLOCATION
+    uint8_t *class_storage[CLASS_COUNT] = { pool_storage.small[0], pool_storage.medium[0], pool_storage.large[0] };
+    return class_storage[size_class] + index * class_size[size_class];
+#else
+    return (uint8_t *) esp_tahu_heap_malloc(class_size[size_class]);
+#endif
+}
+
+/**
+ * @brief Get an encode buffer of at least the requested size from the smallest size class with a free buffer
+ *
+ *  Falls back to a heap allocation if every suitable pool buffer is in use. With static allocation
+ *  the pool buffers are static and the fallback comes from the payload heap.
+ *
+ * @return Buffer to pass to esp_tahu_buffer_release(), or NULL if out of memory
+*/
+uint8_t *esp_tahu_buffer_get(size_t size) {
+    for (int c = 0; c < CLASS_COUNT; c++) {
+        if (class_size[c] < size)
+            continue;
+
+        for (int i = 0; i < BUFFERS_PER_CLASS; i++) {
+            bool claimed = false;
+            portENTER_CRITICAL(&pool_mux);
+            if (!in_use[c][i]) {
+                in_use[c][i] = true;
+                claimed = true;
+            }
+            portEXIT_CRITICAL(&pool_mux);
+            if (!claimed)
+                continue;
+
+            if (!buffers[c][i])
+                buffers[c][i] = pool_alloc(c, i);
+            if (!buffers[c][i])
+                in_use[c][i] = false;
+            return buffers[c][i];
+        }
+    }
+
+    ESP_LOGD(TAG, "No free pool buffer for %d bytes. Allocating", size);
+    return (uint8_t *) esp_tahu_heap_malloc(size);
+}
+
+void esp_tahu_buffer_release(uint8_t *buffer) {
+    for (int c = 0; c < CLASS_COUNT; c++) {
+        for (int i = 0; i < BUFFERS_PER_CLASS; i++) {
+            if (buffers[c][i] == buffer) {
+                in_use[c][i] = false;
+                return;
+            }
+        }
+    }
+    esp_tahu_heap_free(buffer);
+}
+
+#if CONFIG_APP_STATIC_ALLOCATION
+size_t esp_tahu_buffer_get_static_size() {
+    return sizeof(pool_storage);
+}
+#endif
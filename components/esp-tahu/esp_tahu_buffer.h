@@ -0,0 +1,21 @@
+/**! @file esp_tahu_buffer.h
+ * 
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint8_t *esp_tahu_buffer_get(size_t size);
+void esp_tahu_buffer_release(uint8_t *buffer);
+#if CONFIG_APP_STATIC_ALLOCATION
+size_t esp_tahu_buffer_get_static_size();
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,338 @@
+// ESP-IDF Components
+#include <string.h>
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp32/rom/miniz.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "esp_tahu_compress.h"
+
+#if CONFIG_SPARKPLUG_COMPRESSION_ENABLE
+
+#define HASH_BITS 10
+#define HASH_SIZE (1 << HASH_BITS)
+#define WINDOW_SIZE 4096            // Match distance limit. Bounds the size of the hash chain table
+#define WINDOW_MASK (WINDOW_SIZE - 1)
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define MAX_INPUT 65535             // Positions are stored as uint16_t offset by one
+#define END_OF_BLOCK 256
+#define GZIP_HEADER_SIZE 10
+#define GZIP_FLAG_FHCRC 0x02
+#define GZIP_FLAG_FEXTRA 0x04
+#define GZIP_FLAG_FNAME 0x08
+#define GZIP_FLAG_FCOMMENT 0x10
+
+typedef struct {
+    uint8_t *out;
+    size_t out_len;
+    size_t out_pos;
+    uint32_t bit_buffer;
+    int bit_count;
+    bool overflow;
+} bit_writer_t;
+
+// Compressor and decompressor state is static so compression never allocates
+typedef struct {
+    uint16_t head[HASH_SIZE];       // Most recent position + 1 for each hash. 0 if none
+    uint16_t prev[WINDOW_SIZE];     // Previous position + 1 with the same hash
+    tinfl_decompressor inflator;
+} compress_state_t;
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const char *TAG = "esp-tahu-compress";
+static compress_state_t state;
+static SemaphoreHandle_t state_mutex;
+#if CONFIG_APP_STATIC_ALLOCATION
+static StaticSemaphore_t state_mutex_buffer;
+#endif
+
+static void put_byte(bit_writer_t *writer, uint8_t value) {
+    if (writer->out_pos >= writer->out_len) {
+        writer->overflow = true;
+        return;
+    }
+    writer->out[writer->out_pos++] = value;
+}
+
+/**
+ * @brief Write bits LSB first, as DEFLATE requires for everything but Huffman codes
+*/
+static void put_bits(bit_writer_t *writer, uint32_t value, int count) {
+    writer->bit_buffer |= value << writer->bit_count;
+    writer->bit_count += count;
+    while (writer->bit_count >= 8) {
+        put_byte(writer, writer->bit_buffer & 0xFF);
+        writer->bit_buffer >>= 8;
+        writer->bit_count -= 8;
+    }
+}
+
+static void flush_bits(bit_writer_t *writer) {
+    if (writer->bit_count > 0)
+        put_byte(writer, writer->bit_buffer & 0xFF);
+    writer->bit_buffer = 0;
+    writer->bit_count = 0;
+}
+
+/**
+ * @brief Write a Huffman code, which is packed MSB first
+*/
+static void put_code(bit_writer_t *writer, uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    put_bits(writer, reversed, length);
+}
+
+/**
+ * @brief Write a literal/length symbol with the fixed Huffman code of RFC 1951 3.2.6
+*/
+static void put_symbol(bit_writer_t *writer, int symbol) {
+    if (symbol < 144)
+        put_code(writer, 0x30 + symbol, 8);
+    else if (symbol < 256)
+        put_code(writer, 0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        put_code(writer, symbol - 256, 7);
+    else
+        put_code(writer, 0xC0 + symbol - 280, 8);
+}
+
+static void put_match(bit_writer_t *writer, int length, int distance) {
+    int code = 0;
+    while (code < 28 && length_base[code + 1] <= length)
+        code++;
+    put_symbol(writer, 257 + code);
+    put_bits(writer, length - length_base[code], length_extra[code]);
+
+    code = 0;
+    while (code < 29 && dist_base[code + 1] <= distance)
+        code++;
+    put_code(writer, code, 5);
+    put_bits(writer, distance - dist_base[code], dist_extra[code]);
+}
+
+static uint32_t hash(const uint8_t *data) {
+    return ((data[0] << 10) ^ (data[1] << 5) ^ data[2]) & (HASH_SIZE - 1);
+}
+
+static void insert_position(const uint8_t *in, size_t pos) {
+    uint32_t h = hash(in + pos);
+    state.prev[pos & WINDOW_MASK] = state.head[h];
+    state.head[h] = pos + 1;
+}
+
+/**
+ * @brief Compress into a single fixed Huffman DEFLATE block using hash chain LZ77 matching
+*/
+static void deflate_block(const uint8_t *in, size_t in_len, bit_writer_t *writer) {
+    memset(state.head, 0, sizeof(state.head));
+    put_bits(writer, 1, 1);     // BFINAL
+    put_bits(writer, 1, 2);     // BTYPE 01, fixed Huffman codes
+
+    size_t pos = 0;
+    while (pos < in_len && !writer->overflow) {
+        int best_length = 0;
+        int best_distance = 0;
+        if (pos + MIN_MATCH <= in_len) {
+            size_t max_length = in_len - pos < MAX_MATCH ? in_len - pos : MAX_MATCH;
+            uint32_t candidate = state.head[hash(in + pos)];
+            int depth = CONFIG_SPARKPLUG_COMPRESSION_CHAIN_DEPTH;
+            size_t last = pos;
+            while (candidate && depth--) {
+                size_t match_pos = candidate - 1;
+                // Chain entries are overwritten once they leave the window
+                if (match_pos >= last || pos - match_pos > WINDOW_SIZE)
+                    break;
+                int length = 0;
+                while (length < max_length && in[match_pos + length] == in[pos + length])
+                    length++;
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = pos - match_pos;
+                    if (length == max_length)
+                        break;
+                }
+                last = match_pos;
+                candidate = state.prev[match_pos & WINDOW_MASK];
+            }
+            insert_position(in, pos);
+        }
+
+        if (best_length >= MIN_MATCH) {
+            put_match(writer, best_length, best_distance);
+            for (size_t i = pos + 1; i < pos + best_length && i + MIN_MATCH <= in_len; i++)
+                insert_position(in, i);
+            pos += best_length;
+        } else {
+            put_symbol(writer, in[pos]);
+            pos++;
+        }
+    }
+    put_symbol(writer, END_OF_BLOCK);
+    flush_bits(writer);
+}
+
+static uint32_t adler32(const uint8_t *data, size_t len) {
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < len; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+esp_err_t esp_tahu_compress_init() {
+    if (!state_mutex) {
+#if CONFIG_APP_STATIC_ALLOCATION
+        state_mutex = xSemaphoreCreateMutexStatic(&state_mutex_buffer);
+#else
+        state_mutex = xSemaphoreCreateMutex();
+#endif
+    }
+    return state_mutex ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+#if CONFIG_APP_STATIC_ALLOCATION
+size_t esp_tahu_compress_get_static_size() {
+    return sizeof(state) + sizeof(state_mutex_buffer);
+}
+#endif
+
+/**
+ * @brief Compress a buffer as a zlib (DEFLATE) or GZIP stream
+ *
+ * @return Compressed length, or -1 if it doesn't fit in the output buffer
+*/
+ssize_t esp_tahu_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len, esp_tahu_compression_t algorithm) {
+    if (!state_mutex || in_len > MAX_INPUT)
+        return -1;
+
+    bit_writer_t writer = { .out = out, .out_len = out_len };
+    if (algorithm == ESP_TAHU_COMPRESSION_GZIP) {
+        const uint8_t header[GZIP_HEADER_SIZE] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+        for (int i = 0; i < GZIP_HEADER_SIZE; i++)
+            put_byte(&writer, header[i]);
+    } else {
+        put_byte(&writer, 0x78);    // 32K window, deflate
+        put_byte(&writer, 0x01);    // Fastest compression level, check bits
+    }
+
+    xSemaphoreTake(state_mutex, portMAX_DELAY);
+    deflate_block(in, in_len, &writer);
+    xSemaphoreGive(state_mutex);
+
+    if (algorithm == ESP_TAHU_COMPRESSION_GZIP) {
+        uint32_t crc = esp_rom_crc32_le(0, in, in_len);
+        for (int i = 0; i < 4; i++)
+            put_byte(&writer, (crc >> (8 * i)) & 0xFF);
+        for (int i = 0; i < 4; i++)
+            put_byte(&writer, (in_len >> (8 * i)) & 0xFF);
+    } else {
+        uint32_t checksum = adler32(in, in_len);
+        for (int i = 3; i >= 0; i--)
+            put_byte(&writer, (checksum >> (8 * i)) & 0xFF);
+    }
+
+    if (writer.overflow)
+        return -1;
+    return writer.out_pos;
+}
+
+/**
+ * @brief Get the offset of the DEFLATE data in a GZIP stream
+*/
+static ssize_t gzip_data_offset(const uint8_t *in, size_t in_len) {
+    if (in_len < GZIP_HEADER_SIZE + 8 || in[0] != 0x1F || in[1] != 0x8B || in[2] != 8)
+        return -1;
+
+    uint8_t flags = in[3];
+    size_t offset = GZIP_HEADER_SIZE;
+    if (flags & GZIP_FLAG_FEXTRA) {
+        if (offset + 2 > in_len)
+            return -1;
+        offset += 2 + (in[offset] | (in[offset + 1] << 8));
+    }
+    for (int field = GZIP_FLAG_FNAME; field <= GZIP_FLAG_FCOMMENT; field <<= 1) {
+        if (!(flags & field))
+            continue;
+        while (offset < in_len && in[offset])
+            offset++;
+        offset++;
+    }
+    if (flags & GZIP_FLAG_FHCRC)
+        offset += 2;
+    return offset + 8 <= in_len ? offset : -1;
+}
+
+/**
+ * @brief Decompress a zlib (DEFLATE) or GZIP stream with the ROM inflater
+ *
+ * @return Decompressed length, or -1 if the stream is invalid, fails its checksum or doesn't fit
+*/
+ssize_t esp_tahu_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len, esp_tahu_compression_t algorithm) {
+    if (!state_mutex)
+        return -1;
+
+    size_t data_offset = 0;
+    int flags = TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF;
+    if (algorithm == ESP_TAHU_COMPRESSION_GZIP) {
+        ssize_t offset = gzip_data_offset(in, in_len);
+        if (offset < 0)
+            return -1;
+        data_offset = offset;
+    } else {
+        flags |= TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32;
+    }
+
+    size_t in_bytes = in_len - data_offset;
+    size_t out_bytes = out_len;
+    xSemaphoreTake(state_mutex, portMAX_DELAY);
+    tinfl_init(&state.inflator);
+    tinfl_status status = tinfl_decompress(&state.inflator, in + data_offset, &in_bytes, out, out, &out_bytes, flags);
+    xSemaphoreGive(state_mutex);
+
+    if (status != TINFL_STATUS_DONE) {
+        ESP_LOGW(TAG, "Inflate failed: %d", status);
+        return -1;
+    }
+
+    if (algorithm == ESP_TAHU_COMPRESSION_GZIP) {
+        const uint8_t *trailer = in + data_offset + in_bytes;
+        if (trailer + 8 > in + in_len)
+            return -1;
+        uint32_t crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+        uint32_t size = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+        if (crc != esp_rom_crc32_le(0, out, out_bytes) || size != out_bytes) {
+            ESP_LOGW(TAG, "GZIP checksum mismatch");
+            return -1;
+        }
+    }
+    return out_bytes;
+}
+
+#endif
@@ -0,0 +1,29 @@
+/**! @file esp_tahu_compress.h
+ * 
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ESP_TAHU_COMPRESSION_DEFLATE,   // zlib stream, as produced by java.util.zip.Deflater
+    ESP_TAHU_COMPRESSION_GZIP
+} esp_tahu_compression_t;
+
+esp_err_t esp_tahu_compress_init();
+ssize_t esp_tahu_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len, esp_tahu_compression_t algorithm);
+ssize_t esp_tahu_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len, esp_tahu_compression_t algorithm);
+#if CONFIG_APP_STATIC_ALLOCATION
+size_t esp_tahu_compress_get_static_size();
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,98 @@
+// ESP-IDF Components
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "multi_heap.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "esp_tahu_heap.h"
+
+#if CONFIG_APP_STATIC_ALLOCATION
+
+// With static allocation, every allocation of this component, Tahu and nanopb comes from this region.
+// Payloads are built and freed within a publish, so the heap only holds metric strings and staged writes
+// between publishes
+static uint8_t heap_region[CONFIG_SPARKPLUG_HEAP_SIZE] __attribute__((aligned(4)));
+static multi_heap_handle_t heap = NULL;
+static portMUX_TYPE heap_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Get the heap, registering it on first use. Metrics can be created before esp_tahu_configure()
+*/
+static multi_heap_handle_t get_heap() {
+    if (!heap) {
+        portENTER_CRITICAL(&heap_mux);
+        if (!heap) {
+            heap = multi_heap_register(heap_region, sizeof(heap_region));
+            multi_heap_set_lock(heap, &heap_mux);
+        }
+        portEXIT_CRITICAL(&heap_mux);
+    }
+    return heap;
+}
+
+void *esp_tahu_heap_malloc(size_t size) {
+    return multi_heap_malloc(get_heap(), size);
+}
+
+void *esp_tahu_heap_calloc(size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size)
+        return NULL;
+    void *ptr = multi_heap_malloc(get_heap(), count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void *esp_tahu_heap_realloc(void *ptr, size_t size) {
+    return multi_heap_realloc(get_heap(), ptr, size);
+}
+
+void esp_tahu_heap_free(void *ptr) {
+    if (ptr)
+        multi_heap_free(get_heap(), ptr);
+}
+
+char *esp_tahu_heap_strdup(const char *string) {
+    size_t size = strlen(string) + 1;
+    char *copy = multi_heap_malloc(get_heap(), size);
+    if (copy)
+        memcpy(copy, string, size);
+    return copy;
+}
+
+/**
+ * @brief Get the least free space the heap has had since boot
+*/
+size_t esp_tahu_heap_get_minimum_free() {
+    return multi_heap_minimum_free_size(get_heap());
+}
+
+#else
+
+// Without static allocation the payload heap is the system heap
+void *esp_tahu_heap_malloc(size_t size) {
+    return malloc(size);
+}
+
+void *esp_tahu_heap_calloc(size_t count, size_t size) {
+    return calloc(count, size);
+}
+
+void *esp_tahu_heap_realloc(void *ptr, size_t size) {
+    return realloc(ptr, size);
+}
+
+void esp_tahu_heap_free(void *ptr) {
+    free(ptr);
+}
+
+char *esp_tahu_heap_strdup(const char *string) {
+    return strdup(string);
+}
+
+#endif
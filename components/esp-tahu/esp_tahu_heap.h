@@ -0,0 +1,21 @@
+/**! @file esp_tahu_heap.h
+ * 
+*/
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void *esp_tahu_heap_malloc(size_t size);
+void *esp_tahu_heap_calloc(size_t count, size_t size);
+void *esp_tahu_heap_realloc(void *ptr, size_t size);
+void esp_tahu_heap_free(void *ptr);
+char *esp_tahu_heap_strdup(const char *string);
+size_t esp_tahu_heap_get_minimum_free();
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
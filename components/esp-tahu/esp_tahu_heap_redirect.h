@@ -0,0 +1,17 @@
+/**! @file esp_tahu_heap_redirect.h
+ *
+ * Force-included into the Tahu sources only, which allocate metrics and names with the C library
+ * directly. The system headers are included first, so only the calls in Tahu are redirected to the
+ * payload heap. Everything it allocates is released by nanopb's pb_free()
+*/
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_tahu_heap.h"
+
+#define malloc(size) esp_tahu_heap_malloc(size)
+#define calloc(count, size) esp_tahu_heap_calloc(count, size)
+#define realloc(ptr, size) esp_tahu_heap_realloc(ptr, size)
+#define free(ptr) esp_tahu_heap_free(ptr)
+#define strdup(string) esp_tahu_heap_strdup(string)
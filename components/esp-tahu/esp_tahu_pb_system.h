@@ -0,0 +1,17 @@
+/**! @file esp_tahu_pb_system.h
+ *
+ * nanopb's system header, selected with PB_SYSTEM_HEADER. Includes what pb.h includes by default and
+ * points nanopb's pb_realloc()/pb_free() hooks at the payload heap
+*/
+#pragma once
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_tahu_heap.h"
+
+#define pb_realloc(ptr, size) esp_tahu_heap_realloc(ptr, size)
+#define pb_free(ptr) esp_tahu_heap_free(ptr)
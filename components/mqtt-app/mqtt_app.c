@@ -1,33 +1,394 @@
 // ESP-IDF Components
+#include <string.h>
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "mqtt_client.h"
 
 // Project Components
+#include "app_tasks.h"
+#include "dlog.h"
 
 // Project Files
 #include "mqtt_app.h"
 
-#define DEBUG_MQTT 1
+#define DEBUG_MQTT 0
+
+#define EARLY_ACK_COUNT 4   // Acks that may arrive before the publishing task has registered the msg id
+#define BROKER_MAX 4
+#define BROKER_HEALTH_MAX 100
+#define INBOUND_IDLE_RETRY_MS 100
+
+typedef struct {
+    char *topic;
+    int topic_len;
+    char *data;
+    int data_len;
+} inbound_msg_t;
+
+#if CONFIG_APP_STATIC_ALLOCATION
+#define INBOUND_SLOT_COUNT (CONFIG_MQTT_INBOUND_QUEUE_LEN + 2)  // Queued, being processed and being reassembled
+#define INBOUND_TOPIC_MAX 128
+
+typedef struct {
+    inbound_msg_t msg;
+    char buffer[INBOUND_TOPIC_MAX + 1 + CONFIG_MQTT_INBOUND_MAX_SIZE];  // Topic and data
+} inbound_slot_t;
+#endif
+
+typedef struct {
+    const char *uri;
+    uint8_t health;         // Smoothed connection success rate, 0 to BROKER_HEALTH_MAX
+} broker_t;
+
+typedef struct {
+    int msg_id;             // 0 when the slot is free
+    int64_t sent_time;
+    mqtt_app_ack_callback_handler_t callback_handler;
+    void *ctx;
+} inflight_entry_t;
 
 static const char *TAG = "mqtt-app";
 static int connection_attempts = 0; // Connection attempt count. Reset on successful connection
+static bool stopping = false;       // Set while the client is being stopped to suppress reconnects
+static bool started = false;        // Set once the client task has been started by mqtt_app_start()
 static esp_mqtt_client_config_t client_cfg;
 static mqtt_app_connected_callback_handler_t connected_callback_handler = NULL;
 static mqtt_app_disconnected_callback_handler_t disconnected_callback_handler = NULL;
 static mqtt_app_data_callback_handler_t data_callback_handler = NULL;
+static mqtt_app_idle_callback_handler_t idle_callback_handler = NULL;
+static QueueHandle_t inbound_queue = NULL;
+static inbound_msg_t *inbound_partial = NULL;  // Message being reassembled from multiple MQTT_EVENT_DATA
+static uint32_t inbound_dropped = 0;
+static portMUX_TYPE inflight_mux = portMUX_INITIALIZER_UNLOCKED;
+static inflight_entry_t inflight[CONFIG_MQTT_INFLIGHT_MAX];
+static int early_acks[EARLY_ACK_COUNT];
+static int early_ack_index = 0;
+static uint32_t ack_rtt_ms = 0;     // Smoothed publish to PUBACK round trip time
+static uint32_t ack_rtt_max_ms = 0;
+static int64_t connect_start_time = 0;
+static uint32_t connect_time_ms = 0;   // BEFORE_CONNECT to CONNECTED of the last connection. Includes the TLS handshake
+static uint32_t connect_count = 0;
+static bool session_present = false;
+static broker_t brokers[BROKER_MAX];
+static char failover_uris[] = CONFIG_MQTT_BROKER_FAILOVER_URIS;   // Tokenized in place. Brokers point into it
+static int broker_count = 0;
+static int primary_broker = 0;      // Broker of mqtt_app_client
+static int failovers = 0;           // Broker switches since the last successful connection
+static int primary_lwt_id;          // Id of the LWT registered by the current primary connection
+static esp_timer_handle_t reconnect_timer = NULL;   // Delays the reconnect of the primary client
+#if CONFIG_MQTT_WARM_STANDBY
+static esp_mqtt_client_handle_t standby_client = NULL;
+static esp_mqtt_client_config_t standby_cfg;
+static mqtt_app_lwt_info_t standby_lwt_info;
+static mqtt_app_standby_lwt_callback_handler_t standby_lwt_callback_handler = NULL;
+static int standby_broker = 0;
+static int standby_lwt_id;
+static bool standby_started = false;
+static bool standby_connected = false;
+static esp_timer_handle_t standby_reconnect_timer = NULL;
+#endif
+
+#if CONFIG_APP_STATIC_ALLOCATION
+static inbound_slot_t inbound_slots[INBOUND_SLOT_COUNT];
+static QueueHandle_t inbound_free_queue = NULL;   // Slots not holding a message
+static StaticQueue_t inbound_queue_buffer;
+static StaticQueue_t inbound_free_queue_buffer;
+static uint8_t inbound_queue_storage[CONFIG_MQTT_INBOUND_QUEUE_LEN * sizeof(inbound_msg_t *)];
+static uint8_t inbound_free_queue_storage[INBOUND_SLOT_COUNT * sizeof(inbound_msg_t *)];
+#endif
 
 #ifdef CONFIG_MQTT_USE_SSL
 extern const uint8_t ssl_cert_pem_start[]   asm("_binary_mqtt_broker_pem_start");
 extern const uint8_t ssl_cert_pem_end[]   asm("_binary_mqtt_broker_pem_end");
 #endif
 
-static void set_lwt_config() {
+static void init_brokers() {
+    brokers[0] = (broker_t) { .uri = CONFIG_MQTT_BROKER_URI, .health = BROKER_HEALTH_MAX };
+    broker_count = 1;
+
+    char *save_ptr;
+    for (char *uri = strtok_r(failover_uris, ", ", &save_ptr); uri; uri = strtok_r(NULL, ", ", &save_ptr)) {
+        if (broker_count == BROKER_MAX) {
+            ESP_LOGW(TAG, "Only %d brokers supported. Ignoring %s", BROKER_MAX, uri);
+            continue;
+        }
+        brokers[broker_count++] = (broker_t) { .uri = uri, .health = BROKER_HEALTH_MAX };
+    }
+}
+
+static void update_health(int broker, bool connected) {
+    brokers[broker].health = (brokers[broker].health * 3 + (connected ? BROKER_HEALTH_MAX : 0)) / 4;
+}
+
+/**
+ * @brief Get the healthiest broker other than the excluded one. Ties go to the broker listed first
+ *
+ * @return The excluded broker if it's the only one
+*/
+static int select_broker(int exclude) {
+    int selected = exclude;
+    for (int i = 0; i < broker_count; i++) {
+        if (i != exclude && (selected == exclude || brokers[i].health > brokers[selected].health))
+            selected = i;
+    }
+    return selected;
+}
+
+static void reconnect_timer_callback(void *arg) {
+    if (started && !stopping && !mqtt_app_connected)
+        esp_mqtt_client_reconnect(mqtt_app_client);
+}
+
+#if CONFIG_MQTT_WARM_STANDBY
+static void standby_reconnect_timer_callback(void *arg) {
+    if (standby_client && standby_started && !stopping && !standby_connected)
+        esp_mqtt_client_reconnect(standby_client);
+}
+#endif
+
+/**
+ * @brief Reconnect a client after MQTT_RECONNECT_DELAY, according to its role when the timer fires
+ *
+ *  Delaying in the event handler would block the client task, so an esp_timer is used instead.
+*/
+static void schedule_reconnect(esp_mqtt_client_handle_t client) {
+    esp_timer_handle_t timer = reconnect_timer;
+#if CONFIG_MQTT_WARM_STANDBY
+    if (client == standby_client)
+        timer = standby_reconnect_timer;
+#endif
+    esp_timer_stop(timer);
+    esp_timer_start_once(timer, (uint64_t)CONFIG_MQTT_RECONNECT_DELAY * 1000 * 1000);
+}
+
+static void cancel_reconnects() {
+    if (reconnect_timer)
+        esp_timer_stop(reconnect_timer);
+#if CONFIG_MQTT_WARM_STANDBY
+    if (standby_reconnect_timer)
+        esp_timer_stop(standby_reconnect_timer);
+#endif
+}
+
+/**
+ * @brief Set the broker and LWT of a client about to connect, according to its current role
+*/
+static void set_connect_config(esp_mqtt_client_handle_t client) {
+#if CONFIG_MQTT_WARM_STANDBY
+    if (client == standby_client) {
+        standby_broker = select_broker(primary_broker);
+        if (standby_lwt_callback_handler)
+            standby_lwt_callback_handler(&standby_lwt_info);
+        standby_lwt_id = standby_lwt_info.id;
+        standby_cfg = client_cfg;
+        standby_cfg.uri = brokers[standby_broker].uri;
+        standby_cfg.lwt_topic = standby_lwt_info.topic;
+        standby_cfg.lwt_msg = standby_lwt_info.msg;
+        standby_cfg.lwt_msg_len = standby_lwt_info.msg_len;
+        esp_mqtt_set_config(client, &standby_cfg);
+        return;
+    }
+#endif
+    client_cfg.uri = brokers[primary_broker].uri;
     client_cfg.lwt_topic = mqtt_app_lwt_info.topic;
     client_cfg.lwt_msg = mqtt_app_lwt_info.msg;
     client_cfg.lwt_msg_len = mqtt_app_lwt_info.msg_len;
-    ESP_LOGD(TAG, "LWT Topic: %s", client_cfg.lwt_topic);
-    esp_mqtt_set_config(mqtt_app_client, &client_cfg);
+    primary_lwt_id = mqtt_app_lwt_info.id;
+    ESP_LOGD(TAG, "Broker: %s. LWT Topic: %s", client_cfg.uri, client_cfg.lwt_topic);
+    esp_mqtt_set_config(client, &client_cfg);
+}
+
+#if CONFIG_MQTT_WARM_STANDBY
+/**
+ * @brief Make the connected standby the primary client. The old primary becomes the standby
+ *
+ *  The standby registered its own LWT when it connected, so the session continues under that LWT.
+ *  No handshake is needed, so the connect time of a promotion is 0.
+*/
+static void promote_standby() {
+    esp_mqtt_client_handle_t old_primary = mqtt_app_client;
+    bool old_primary_started = started;
+    mqtt_app_client = standby_client;
+    started = standby_started;
+    primary_broker = standby_broker;
+    primary_lwt_id = standby_lwt_id;
+    standby_client = old_primary;
+    standby_started = old_primary_started;
+    standby_connected = false;
+
+    ESP_LOGW(TAG, "Promoted standby connection to %s", brokers[primary_broker].uri);
+    connection_attempts = 0;
+    failovers = 0;
+    connect_time_ms = 0;
+    connect_count++;
+    session_present = false;    // Any resumed session was on the other broker
+    mqtt_app_connected = true;
+    if(connected_callback_handler)
+        connected_callback_handler();
+}
+
+/**
+ * @brief Keep the standby connected to the healthiest broker other than the primary's. It never
+ * subscribes or publishes, so the broker only holds its LWT
+*/
+static void standby_event_handler(int32_t event_id, esp_mqtt_event_handle_t event) {
+    switch ((esp_mqtt_event_id_t)event_id) {
+        case MQTT_EVENT_BEFORE_CONNECT:
+            set_connect_config(event->client);
+            break;
+        case MQTT_EVENT_CONNECTED:
+            ESP_LOGI(TAG, "Standby connected to %s", brokers[standby_broker].uri);
+            update_health(standby_broker, true);
+            standby_connected = true;
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            ESP_LOGI(TAG, "Standby disconnected");
+            standby_connected = false;
+            if (stopping)
+                break;
+            update_health(standby_broker, false);
+            schedule_reconnect(event->client);
+            break;
+        default:
+            break;
+    }
+}
+#endif
+
+static void update_ack_rtt(int64_t sent_time) {
+    uint32_t rtt = (esp_timer_get_time() - sent_time) / 1000;
+    ack_rtt_ms = ack_rtt_ms ? (ack_rtt_ms * 7 + rtt) / 8 : rtt;
+    if (rtt > ack_rtt_max_ms)
+        ack_rtt_max_ms = rtt;
+}
+
+/**
+ * @brief Release the in-flight entry for an acknowledged publish and notify its owner
+*/
+static void inflight_ack(int msg_id) {
+    inflight_entry_t entry = { 0 };
+    portENTER_CRITICAL(&inflight_mux);
+    for (int i = 0; i < CONFIG_MQTT_INFLIGHT_MAX; i++) {
+        if (inflight[i].msg_id == msg_id) {
+            entry = inflight[i];
+            inflight[i].msg_id = 0;
+            break;
+        }
+    }
+    if (!entry.msg_id) {
+        early_acks[early_ack_index] = msg_id;
+        early_ack_index = (early_ack_index + 1) % EARLY_ACK_COUNT;
+    }
+    portEXIT_CRITICAL(&inflight_mux);
+
+    if (!entry.msg_id)
+        return;
+
+    update_ack_rtt(entry.sent_time);
+    DLOGD(TAG, "Publish %d acknowledged. RTT: %d ms", msg_id, ack_rtt_ms);
+    if (entry.callback_handler)
+        entry.callback_handler(msg_id, true, entry.ctx);
+}
+
+/**
+ * @brief Get an inbound message buffer for a topic and data of the given lengths
+ *
+ *  With static allocation the message is taken from a fixed set of slots.
+ *
+ * @return NULL if out of memory, no slot is free or the topic is too long for a slot
+*/
+static inbound_msg_t *inbound_msg_alloc(int topic_len, int data_len) {
+#if CONFIG_APP_STATIC_ALLOCATION
+    inbound_msg_t *msg;
+    if (topic_len > INBOUND_TOPIC_MAX || xQueueReceive(inbound_free_queue, &msg, 0) != pdTRUE)
+        return NULL;
+    return msg;
+#else
+    // Topic and data are stored after the message header in a single allocation
+    return (inbound_msg_t *) malloc(sizeof(inbound_msg_t) + topic_len + 1 + data_len);
+#endif
+}
+
+static void inbound_msg_free(inbound_msg_t *msg) {
+#if CONFIG_APP_STATIC_ALLOCATION
+    xQueueSend(inbound_free_queue, &msg, 0);
+#else
+    free(msg);
+#endif
+}
+
+/**
+ * @brief Copy received data into an inbound message and queue it once complete
+ *
+ *  Messages larger than the client buffer are delivered in several events and are reassembled here.
+ *  Messages are dropped if they exceed MQTT_INBOUND_MAX_SIZE or the queue is full.
+*/
+static void inbound_enqueue(esp_mqtt_event_handle_t event) {
+    if (event->current_data_offset == 0) {
+        if (inbound_partial) {
+            inbound_msg_free(inbound_partial);
+            inbound_partial = NULL;
+        }
+        if (event->total_data_len > CONFIG_MQTT_INBOUND_MAX_SIZE) {
+            ESP_LOGW(TAG, "Inbound message of %d bytes exceeds limit. Dropped", event->total_data_len);
+            inbound_dropped++;
+            return;
+        }
+
+        inbound_msg_t *msg = inbound_msg_alloc(event->topic_len, event->total_data_len);
+        if (!msg) {
+            ESP_LOGW(TAG, "No memory for inbound message. Dropped");
+            inbound_dropped++;
+            return;
+        }
+        msg->topic = (char *)(msg + 1);
+        msg->topic_len = event->topic_len;
+        memcpy(msg->topic, event->topic, event->topic_len);
+        msg->topic[event->topic_len] = '\0';
+        msg->data = msg->topic + event->topic_len + 1;
+        msg->data_len = event->total_data_len;
+        inbound_partial = msg;
+    }
+
+    if (!inbound_partial)
+        return;
+    memcpy(inbound_partial->data + event->current_data_offset, event->data, event->data_len);
+    if (event->current_data_offset + event->data_len < event->total_data_len)
+        return;
+
+    if (xQueueSend(inbound_queue, &inbound_partial, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Inbound queue full. Message on %s dropped", inbound_partial->topic);
+        inbound_msg_free(inbound_partial);
+        inbound_dropped++;
+    }
+    inbound_partial = NULL;
+}
+
+/**
+ * @brief Process queued inbound messages outside of the MQTT client task
+ *
+ *  The idle callback runs once the queue has been drained and is repeated every INBOUND_IDLE_RETRY_MS
+ *  while it reports pending work.
+*/
+static void inbound_worker_task() {
+    bool idle_pending = false;
+    for ( ;; ) {
+        inbound_msg_t *msg;
+        TickType_t wait = idle_pending ? pdMS_TO_TICKS(INBOUND_IDLE_RETRY_MS) : portMAX_DELAY;
+        if (xQueueReceive(inbound_queue, &msg, wait) == pdTRUE) {
+            if(data_callback_handler)
+                data_callback_handler(msg->topic, msg->topic_len, msg->data, msg->data_len);
+            inbound_msg_free(msg);
+            idle_pending = true;
+            if (uxQueueMessagesWaiting(inbound_queue) > 0)
+                continue;
+        }
+
+        idle_pending = idle_callback_handler ? idle_callback_handler() : false;
+    }
 }
 
 /*
@@ -42,36 +403,67 @@ static void set_lwt_config() {
  */
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data) {
     esp_mqtt_event_handle_t event = event_data;
+#if CONFIG_MQTT_WARM_STANDBY
+    if (event->client == standby_client) {
+        standby_event_handler(event_id, event);
+        return;
+    }
+#endif
     switch ((esp_mqtt_event_id_t)event_id) {
         case MQTT_EVENT_CONNECTED:
-            ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
+            DLOGI(TAG, "MQTT_EVENT_CONNECTED");
             connection_attempts = 0;
+            failovers = 0;
+            update_health(primary_broker, true);
+            connect_time_ms = (esp_timer_get_time() - connect_start_time) / 1000;
+            connect_count++;
+            session_present = event->session_present;
+            DLOGI(TAG, "Connected in %d ms. Session present: %d", connect_time_ms, session_present);
             mqtt_app_connected = true;
             if(connected_callback_handler)
                 connected_callback_handler();
             break;
         case MQTT_EVENT_DISCONNECTED:
-            ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+            DLOGI(TAG, "MQTT_EVENT_DISCONNECTED");
             mqtt_app_connected = false;
-            disconnected_callback_handler();
-            if (connection_attempts < CONFIG_MQTT_MAX_ATTEMPTS) {
-                vTaskDelay(pdMS_TO_TICKS(CONFIG_MQTT_RECONNECT_DELAY * 1000));
-                esp_mqtt_client_reconnect(event->client);
+            if(disconnected_callback_handler)
+                disconnected_callback_handler();
+            if (stopping)
+                break;
+
+            update_health(primary_broker, false);
+#if CONFIG_MQTT_WARM_STANDBY
+            if (standby_connected) {
+                // This client becomes the standby and reconnects below
+                promote_standby();
+            } else
+#endif
+            if (connection_attempts >= CONFIG_MQTT_MAX_ATTEMPTS) {
+                // Give up once every broker has had its attempts. Retried on the next mqtt_app_start()
+                if (++failovers >= broker_count)
+                    break;
+                primary_broker = select_broker(primary_broker);
+                connection_attempts = 0;
+                ESP_LOGW(TAG, "Failing over to %s", brokers[primary_broker].uri);
             }
+            schedule_reconnect(event->client);
             break;
         case MQTT_EVENT_SUBSCRIBED:
-            ESP_LOGD(TAG, "MQTT_EVENT_SUBSCRIBED");
+            DLOGD(TAG, "MQTT_EVENT_SUBSCRIBED");
             break;
         case MQTT_EVENT_UNSUBSCRIBED:
-            ESP_LOGD(TAG, "MQTT_EVENT_UNSUBSCRIBED");
+            DLOGD(TAG, "MQTT_EVENT_UNSUBSCRIBED");
             break;
         case MQTT_EVENT_PUBLISHED:
-            ESP_LOGD(TAG, "MQTT_EVENT_PUBLISHED");
+            DLOGD(TAG, "MQTT_EVENT_PUBLISHED. Msg id: %d", event->msg_id);
+            inflight_ack(event->msg_id);
+            mqtt_app_inflight_sweep();
             break;
         case MQTT_EVENT_DATA:
-            ESP_LOGD(TAG, "MQTT_EVENT_DATA. TOPIC=%.*s", event->topic_len, event->topic);
-            if(data_callback_handler)
-                data_callback_handler(event->topic, event->topic_len, event->data, event->data_len);
+            // The topic is only valid during the event, so its length is recorded instead
+            DLOGD(TAG, "MQTT_EVENT_DATA. Topic: %d bytes, data: %d of %d bytes", event->topic_len, event->data_len,
+                    event->total_data_len);
+            inbound_enqueue(event);
             break;
         case MQTT_EVENT_ERROR:
             ESP_LOGW(TAG, "MQTT_EVENT_ERROR");
@@ -87,9 +479,10 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
             }
             break;
         case MQTT_EVENT_BEFORE_CONNECT:
-            ESP_LOGD(TAG, "MQTT_EVENT_BEFORE_CONNECT");
+            DLOGD(TAG, "MQTT_EVENT_BEFORE_CONNECT");
             connection_attempts++;
-            set_lwt_config();
+            connect_start_time = esp_timer_get_time();
+            set_connect_config(event->client);
             break;
         default:
             ESP_LOGW(TAG, "Unknown MQTT event dispatched. Event ID:%d", event->event_id);
@@ -98,22 +491,60 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 }
 
 /**
- * @brief Init MQTT Application
+ * @brief Init MQTT Application. The client doesn't connect until mqtt_app_start() is called
 */
 void mqtt_app_init() {
 #if DEBUG_MQTT
-    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+    dlog_level_set(TAG, ESP_LOG_DEBUG);
 #else
-    esp_log_level_set(TAG, ESP_LOG_INFO);
+    dlog_level_set(TAG, ESP_LOG_INFO);
 #endif
     mqtt_app_connected = false;
+    stopping = false;
+    started = false;
+    if (!inbound_queue) {
+#if CONFIG_APP_STATIC_ALLOCATION
+        inbound_queue = xQueueCreateStatic(CONFIG_MQTT_INBOUND_QUEUE_LEN, sizeof(inbound_msg_t *), inbound_queue_storage,
+                                            &inbound_queue_buffer);
+        inbound_free_queue = xQueueCreateStatic(INBOUND_SLOT_COUNT, sizeof(inbound_msg_t *), inbound_free_queue_storage,
+                                            &inbound_free_queue_buffer);
+        for (int i = 0; i < INBOUND_SLOT_COUNT; i++) {
+            inbound_msg_t *msg = &inbound_slots[i].msg;
+            xQueueSend(inbound_free_queue, &msg, 0);
+        }
+#else
+        inbound_queue = xQueueCreate(CONFIG_MQTT_INBOUND_QUEUE_LEN, sizeof(inbound_msg_t *));
+#endif
+        app_task_create(APP_TASK_MQTT_INBOUND, inbound_worker_task, NULL, NULL);
+
+        esp_timer_create_args_t reconnect_timer_args = {
+            .callback = reconnect_timer_callback,
+            .name = "mqtt_reconnect",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&reconnect_timer_args, &reconnect_timer));
+#if CONFIG_MQTT_WARM_STANDBY
+        esp_timer_create_args_t standby_reconnect_timer_args = {
+            .callback = standby_reconnect_timer_callback,
+            .name = "mqtt_standby",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&standby_reconnect_timer_args, &standby_reconnect_timer));
+#endif
+    }
+    if (!broker_count)
+        init_brokers();
     client_cfg = (esp_mqtt_client_config_t) {};
-    client_cfg.uri = CONFIG_MQTT_BROKER_URI;
+    client_cfg.uri = brokers[primary_broker].uri;
     client_cfg.disable_auto_reconnect = true;
     client_cfg.keepalive = CONFIG_MQTT_KEEPALIVE_PERIOD;
     client_cfg.disable_keepalive = !CONFIG_MQTT_AUTO_KEEPALIVE_ENABLED;
     client_cfg.lwt_qos = 1;
     client_cfg.lwt_retain = true;
+    client_cfg.message_retransmit_timeout = CONFIG_MQTT_RETRANSMIT_TIMEOUT;
+    client_cfg.task_prio = app_task_get_config(APP_TASK_MQTT)->priority;
+    client_cfg.task_stack = app_task_get_config(APP_TASK_MQTT)->stack_size;
+#if CONFIG_MQTT_PERSISTENT_SESSION
+    client_cfg.disable_clean_session = true;
+#endif
 #ifdef CONFIG_MQTT_USE_SSL
     client_cfg.cert_pem = (const char *)ssl_cert_pem_start;
 #endif
@@ -126,14 +557,90 @@ void mqtt_app_init() {
     mqtt_app_client = esp_mqtt_client_init(&client_cfg);
     /* The last argument may be used to pass data to the event handler, in this example mqtt_event_handler */
     esp_mqtt_client_register_event(mqtt_app_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+#if CONFIG_MQTT_WARM_STANDBY
+    if (broker_count > 1) {
+        standby_started = false;
+        standby_connected = false;
+        standby_client = esp_mqtt_client_init(&client_cfg);
+        esp_mqtt_client_register_event(standby_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    }
+#endif
+}
+
+/**
+ * @brief Start connecting to the broker, or retry right away if the client was started but isn't connected
+ *
+ *  Call whenever the network comes up. Restarts the count of connection attempts.
+*/
+void mqtt_app_start() {
+    connection_attempts = 0;
+    if (!started) {
+        started = true;
+        esp_mqtt_client_start(mqtt_app_client);
+    } else if (!mqtt_app_connected) {
+        esp_timer_stop(reconnect_timer);
+        esp_mqtt_client_reconnect(mqtt_app_client);
+    }
+#if CONFIG_MQTT_WARM_STANDBY
+    if (standby_client && !standby_started) {
+        standby_started = true;
+        esp_mqtt_client_start(standby_client);
+    }
+#endif
+}
+
+/**
+ * @brief Move the session to another broker, as requested by a Sparkplug Next Server command
+ *
+ *  A connected standby is promoted right away. Otherwise the client reconnects to the healthiest
+ *  other broker, or to the same broker if it's the only one.
+*/
+void mqtt_app_next_server() {
+    if (!started)
+        return;
+
+    stopping = true;
+    esp_timer_stop(reconnect_timer);
+    esp_mqtt_client_stop(mqtt_app_client);
+    stopping = false;
+    started = false;
+    if (mqtt_app_connected) {
+        mqtt_app_connected = false;
+        if(disconnected_callback_handler)
+            disconnected_callback_handler();
+    }
+
+#if CONFIG_MQTT_WARM_STANDBY
+    if (standby_connected) {
+        promote_standby();
+        standby_started = true;
+        esp_mqtt_client_start(standby_client);
+        return;
+    }
+#endif
+    primary_broker = select_broker(primary_broker);
+    ESP_LOGI(TAG, "Next server: %s", brokers[primary_broker].uri);
+    connection_attempts = 0;
+    failovers = 0;
+    started = true;
     esp_mqtt_client_start(mqtt_app_client);
 }
 
 void mqtt_app_stop() {
+    stopping = true;
+    started = false;
+    cancel_reconnects();
     if(mqtt_app_connected)
         esp_mqtt_client_disconnect(mqtt_app_client);
 
     esp_mqtt_client_destroy(mqtt_app_client);
+#if CONFIG_MQTT_WARM_STANDBY
+    if (standby_client) {
+        standby_started = false;
+        esp_mqtt_client_destroy(standby_client);
+        standby_client = NULL;
+    }
+#endif
 }
 
 void mqtt_app_connected_callback_register(mqtt_app_connected_callback_handler_t callback_handler) {
@@ -144,6 +651,164 @@ void mqtt_app_disconnected_callback_register(mqtt_app_disconnected_callback_hand
     disconnected_callback_handler = callback_handler;
 }
 
+/**
+ * @brief Register the handler that provides the LWT of the warm standby connection each time it connects
+ *
+ *  The LWT must be valid for the session that continues on the standby if it's promoted. The id of
+ *  the LWT of the connection in use is available from mqtt_app_get_lwt_id().
+*/
+void mqtt_app_standby_lwt_callback_register(mqtt_app_standby_lwt_callback_handler_t callback_handler) {
+#if CONFIG_MQTT_WARM_STANDBY
+    standby_lwt_callback_handler = callback_handler;
+#endif
+}
+
+/**
+ * @brief Register the handler for received messages. It is called from the inbound worker task
+*/
 void mqtt_app_data_callback_register(mqtt_app_data_callback_handler_t callback_handler) {
     data_callback_handler = callback_handler;
 }
+
+/**
+ * @brief Register a handler called from the inbound worker task once all queued messages are processed
+ *
+ *  The handler returns true if it has deferred work, in which case it is called again shortly.
+*/
+void mqtt_app_idle_callback_register(mqtt_app_idle_callback_handler_t callback_handler) {
+    idle_callback_handler = callback_handler;
+}
+
+/**
+ * @brief Track a QoS 1 publish until it is acknowledged or times out
+ *
+ * @param msg_id Message id returned by the publish
+ * @param callback_handler Called with acked=true on PUBACK, or acked=false once MQTT_INFLIGHT_TIMEOUT elapses
+ * @param ctx User data passed to the callback
+*/
+esp_err_t mqtt_app_inflight_track(int msg_id, mqtt_app_ack_callback_handler_t callback_handler, void *ctx) {
+    if (msg_id <= 0)
+        return ESP_ERR_INVALID_ARG;
+
+    bool already_acked = false;
+    esp_err_t result = ESP_ERR_NO_MEM;
+    portENTER_CRITICAL(&inflight_mux);
+    for (int i = 0; i < EARLY_ACK_COUNT; i++) {
+        if (early_acks[i] == msg_id) {
+            early_acks[i] = 0;
+            already_acked = true;
+            result = ESP_OK;
+            break;
+        }
+    }
+    for (int i = 0; !already_acked && i < CONFIG_MQTT_INFLIGHT_MAX; i++) {
+        if (!inflight[i].msg_id) {
+            inflight[i] = (inflight_entry_t) {
+                .msg_id = msg_id,
+                .sent_time = esp_timer_get_time(),
+                .callback_handler = callback_handler,
+                .ctx = ctx,
+            };
+            result = ESP_OK;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&inflight_mux);
+
+    if (already_acked && callback_handler)
+        callback_handler(msg_id, true, ctx);
+    if (result != ESP_OK)
+        ESP_LOGW(TAG, "In-flight table full. Publish %d not tracked", msg_id);
+    return result;
+}
+
+/**
+ * @brief Expire in-flight publishes that have not been acknowledged within MQTT_INFLIGHT_TIMEOUT
+*/
+void mqtt_app_inflight_sweep() {
+    inflight_entry_t expired[CONFIG_MQTT_INFLIGHT_MAX];
+    int expired_count = 0;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&inflight_mux);
+    for (int i = 0; i < CONFIG_MQTT_INFLIGHT_MAX; i++) {
+        if (inflight[i].msg_id && (now - inflight[i].sent_time) > (int64_t)CONFIG_MQTT_INFLIGHT_TIMEOUT * 1000) {
+            expired[expired_count++] = inflight[i];
+            inflight[i].msg_id = 0;
+        }
+    }
+    portEXIT_CRITICAL(&inflight_mux);
+
+    for (int i = 0; i < expired_count; i++) {
+        ESP_LOGW(TAG, "Publish %d not acknowledged within %d ms", expired[i].msg_id, CONFIG_MQTT_INFLIGHT_TIMEOUT);
+        if (expired[i].callback_handler)
+            expired[i].callback_handler(expired[i].msg_id, false, expired[i].ctx);
+    }
+}
+
+int mqtt_app_inflight_count() {
+    int count = 0;
+    portENTER_CRITICAL(&inflight_mux);
+    for (int i = 0; i < CONFIG_MQTT_INFLIGHT_MAX; i++) {
+        if (inflight[i].msg_id)
+            count++;
+    }
+    portEXIT_CRITICAL(&inflight_mux);
+    return count;
+}
+
+/**
+ * @brief Check that no publish is waiting to be sent or acknowledged
+*/
+bool mqtt_app_outbox_empty() {
+    return mqtt_app_inflight_count() == 0 && esp_mqtt_client_get_outbox_size(mqtt_app_client) == 0;
+}
+
+uint32_t mqtt_app_get_inbound_dropped() {
+    return inbound_dropped;
+}
+
+uint32_t mqtt_app_get_ack_rtt_ms() {
+    return ack_rtt_ms;
+}
+
+uint32_t mqtt_app_get_ack_rtt_max_ms() {
+    return ack_rtt_max_ms;
+}
+
+uint32_t mqtt_app_get_connect_time_ms() {
+    return connect_time_ms;
+}
+
+uint32_t mqtt_app_get_connect_count() {
+    return connect_count;
+}
+
+/**
+ * @brief True if the broker resumed a persistent session on the last connection, along with its subscriptions
+*/
+bool mqtt_app_session_present() {
+    return session_present;
+}
+
+const char *mqtt_app_get_broker_uri() {
+    return brokers[primary_broker].uri;
+}
+
+/**
+ * @brief Get the id of the LWT registered by the connection in use
+*/
+int mqtt_app_get_lwt_id() {
+    return primary_lwt_id;
+}
+
+#if CONFIG_APP_STATIC_ALLOCATION
+/**
+ * @brief Get the size of the statically allocated inbound message slots, queues and publish tracking
+*/
+size_t mqtt_app_get_static_size() {
+    return sizeof(inbound_slots) + sizeof(inbound_queue_buffer) + sizeof(inbound_free_queue_buffer)
+            + sizeof(inbound_queue_storage) + sizeof(inbound_free_queue_storage) + sizeof(inflight)
+            + sizeof(brokers) + sizeof(failover_uris);
+}
+#endif
@@ -13,20 +13,43 @@ typedef struct {
     char* topic;
     char* msg;
     ssize_t msg_len;
+    int id;                 // Set by the owner of the LWT to identify the session it belongs to
 } mqtt_app_lwt_info_t;
 
 typedef void (*mqtt_app_connected_callback_handler_t)(void);
 typedef void (*mqtt_app_disconnected_callback_handler_t)(void);
 typedef void (*mqtt_app_data_callback_handler_t)(char *topic, int topic_len, char *data, int data_len);
+typedef bool (*mqtt_app_idle_callback_handler_t)(void);
+typedef void (*mqtt_app_ack_callback_handler_t)(int msg_id, bool acked, void *ctx);
+typedef void (*mqtt_app_standby_lwt_callback_handler_t)(mqtt_app_lwt_info_t *lwt_info);
 
 esp_mqtt_client_handle_t mqtt_app_client;
 mqtt_app_lwt_info_t mqtt_app_lwt_info;
 bool mqtt_app_connected;
 void mqtt_app_init();
+void mqtt_app_start();
+void mqtt_app_next_server();
 void mqtt_app_stop();
 void mqtt_app_connected_callback_register(mqtt_app_connected_callback_handler_t callback_handler);
 void mqtt_app_disconnected_callback_register(mqtt_app_disconnected_callback_handler_t callback_handler);
+void mqtt_app_standby_lwt_callback_register(mqtt_app_standby_lwt_callback_handler_t callback_handler);
 void mqtt_app_data_callback_register(mqtt_app_data_callback_handler_t callback_handler);
+void mqtt_app_idle_callback_register(mqtt_app_idle_callback_handler_t callback_handler);
+esp_err_t mqtt_app_inflight_track(int msg_id, mqtt_app_ack_callback_handler_t callback_handler, void *ctx);
+void mqtt_app_inflight_sweep();
+int mqtt_app_inflight_count();
+bool mqtt_app_outbox_empty();
+uint32_t mqtt_app_get_inbound_dropped();
+uint32_t mqtt_app_get_ack_rtt_ms();
+uint32_t mqtt_app_get_ack_rtt_max_ms();
+uint32_t mqtt_app_get_connect_time_ms();
+uint32_t mqtt_app_get_connect_count();
+bool mqtt_app_session_present();
+const char *mqtt_app_get_broker_uri();
+int mqtt_app_get_lwt_id();
+#if CONFIG_APP_STATIC_ALLOCATION
+size_t mqtt_app_get_static_size();
+#endif
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -6,8 +6,29 @@
 #include "mqtt_app.h"
 #include "mqtt_util.h"
 
-void mqtt_util_publish(char *topic, char *data, int data_len, int qos, int retain) {
-    esp_mqtt_client_publish(mqtt_app_client, topic, data, data_len, qos, retain);
+int mqtt_util_publish(char *topic, char *data, int data_len, int qos, int retain) {
+    return esp_mqtt_client_publish(mqtt_app_client, topic, data, data_len, qos, retain);
+}
+
+/**
+ * @brief Publish and track acknowledgement of a QoS 1 message
+ *
+ *  If the in-flight table is full the message is sent with QoS 0 and the callback is never invoked.
+ *
+ * @return Message id of the publish, 0 if it was sent untracked with QoS 0, -1 on failure
+*/
+int mqtt_util_publish_tracked(char *topic, char *data, int data_len, int qos, int retain,
+                                mqtt_app_ack_callback_handler_t callback_handler, void *ctx) {
+    if (qos > 0) {
+        mqtt_app_inflight_sweep();
+        if (mqtt_app_inflight_count() >= CONFIG_MQTT_INFLIGHT_MAX)
+            qos = 0;
+    }
+
+    int msg_id = mqtt_util_publish(topic, data, data_len, qos, retain);
+    if (msg_id > 0)
+        mqtt_app_inflight_track(msg_id, callback_handler, ctx);
+    return msg_id;
 }
 
 void mqtt_util_subscribe(char *topic, int qos) {
@@ -3,11 +3,15 @@
 */
 #pragma once
 
+#include "mqtt_app.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void mqtt_util_publish(char *topic, char *data, int data_len, int qos, int retain);
+int mqtt_util_publish(char *topic, char *data, int data_len, int qos, int retain);
+int mqtt_util_publish_tracked(char *topic, char *data, int data_len, int qos, int retain,
+                                mqtt_app_ack_callback_handler_t callback_handler, void *ctx);
 void mqtt_util_subscribe(char *topic, int qos);
 void mqtt_util_unsubscribe(char *topic);
 
@@ -0,0 +1,269 @@
+// ESP-IDF Components
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include "esp_crt_bundle.h"
+#endif
+
+// Project Components
+#include "app_tasks.h"
+
+// Project Files
+#include "ota.h"
+#include "ota_delta.h"
+
+#define DEBUG_OTA 0
+
+#define URL_MAX 256
+#define PROGRESS_STEP 10            // Percent of the download between status updates
+#define REBOOT_DELAY_MS 2000        // Lets the last status publish go out before the restart
+
+typedef struct {
+    const esp_partition_t *running;
+    esp_ota_handle_t handle;
+} ota_target_t;
+
+static const char *TAG = "ota";
+static ota_status_callback_handler_t status_callback;
+static TaskHandle_t task_handle;
+static esp_timer_handle_t verify_timer;
+static bool busy = false;
+static char url[URL_MAX];
+static char status[OTA_STATUS_MAX] = "Idle";
+static uint8_t download_buffer[CONFIG_OTA_BUFFER_SIZE];
+static ota_delta_t delta;
+
+static void set_status(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(status, sizeof(status), format, args);
+    va_end(args);
+
+    ESP_LOGI(TAG, "%s", status);
+    if (status_callback)
+        status_callback(status);
+}
+
+static esp_err_t read_running(void *ctx, size_t offset, void *buffer, size_t size) {
+    ota_target_t *target = (ota_target_t *) ctx;
+    if (offset + size > target->running->size)
+        return ESP_ERR_INVALID_SIZE;
+    return esp_partition_read(target->running, offset, buffer, size);
+}
+
+static esp_err_t write_update(void *ctx, const void *data, size_t size) {
+    ota_target_t *target = (ota_target_t *) ctx;
+    return esp_ota_write(target->handle, data, size);
+}
+
+/**
+ * @brief Roll back to the previous image if this one hasn't reached BIRTH in time
+*/
+static void verify_timeout(void *arg) {
+    ESP_LOGE(TAG, "Image not confirmed within %d s. Rolling back", CONFIG_OTA_VERIFY_TIMEOUT);
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+/**
+ * @brief Download an image or a delta and write the resulting image to the inactive partition
+ *
+ *  A delta is applied as it is received, reading the unchanged parts from the running partition,
+ *  so only the download buffer and the delta decoder are held in RAM.
+*/
+static esp_err_t download(const esp_partition_t *partition) {
+    esp_http_client_config_t config = {
+        .url = url,
+        .timeout_ms = CONFIG_OTA_HTTP_TIMEOUT,
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+        .crt_bundle_attach = esp_crt_bundle_attach,
+#endif
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (!client)
+        return ESP_ERR_NO_MEM;
+
+    esp_err_t result = esp_http_client_open(client, 0);
+    if (result != ESP_OK) {
+        esp_http_client_cleanup(client);
+        return result;
+    }
+    int content_length = esp_http_client_fetch_headers(client);
+    int status_code = esp_http_client_get_status_code(client);
+    if (status_code != 200) {
+        ESP_LOGW(TAG, "HTTP status %d", status_code);
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ota_target_t target = { .running = esp_ota_get_running_partition() };
+    result = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &target.handle);
+    if (result != ESP_OK) {
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+        return result;
+    }
+
+    bool is_delta = false;
+    int received = 0;
+    int next_progress = PROGRESS_STEP;
+    for ( ;; ) {
+        int length = esp_http_client_read(client, (char *) download_buffer, sizeof(download_buffer));
+        if (length < 0) {
+            result = ESP_FAIL;
+            break;
+        }
+        if (length == 0) {
+            result = esp_http_client_is_complete_data_received(client) ? ESP_OK : ESP_ERR_TIMEOUT;
+            break;
+        }
+
+        if (received == 0) {
+            is_delta = ota_delta_detect(download_buffer, length);
+            if (is_delta)
+                ota_delta_begin(&delta, read_running, write_update, &target);
+            ESP_LOGI(TAG, "Downloading %s", is_delta ? "delta" : "full image");
+        }
+        received += length;
+
+        result = is_delta ? ota_delta_feed(&delta, download_buffer, length)
+                          : esp_ota_write(target.handle, download_buffer, length);
+        if (result != ESP_OK)
+            break;
+
+        if (content_length > 0 && received * 100LL / content_length >= next_progress) {
+            set_status("Downloading %d%%", next_progress);
+            next_progress += PROGRESS_STEP;
+        }
+    }
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+
+    if (result == ESP_OK && is_delta)
+        result = ota_delta_finish(&delta);
+    if (result != ESP_OK) {
+        esp_ota_abort(target.handle);
+        return result;
+    }
+    ESP_LOGI(TAG, "Received %d bytes", received);
+
+    // Validates the image written before it can be booted
+    result = esp_ota_end(target.handle);
+    if (result != ESP_OK)
+        return result;
+    return esp_ota_set_boot_partition(partition);
+}
+
+static void ota_task() {
+    for ( ;; ) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+        if (!partition) {
+            set_status("Failed: no OTA partition");
+            busy = false;
+            continue;
+        }
+
+        set_status("Downloading");
+        esp_err_t result = download(partition);
+        if (result != ESP_OK) {
+            set_status("Failed: %s", esp_err_to_name(result));
+            busy = false;
+            continue;
+        }
+
+        set_status("Rebooting into %s", partition->label);
+        vTaskDelay(pdMS_TO_TICKS(REBOOT_DELAY_MS));
+        esp_restart();
+    }
+}
+
+/**
+ * @brief Start the update task and the rollback timer if this is the first boot of a new image
+ *
+ * @param status_callback_handler Called from the update task each time the status changes
+*/
+esp_err_t ota_init(ota_status_callback_handler_t status_callback_handler) {
+#if DEBUG_OTA
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+#else
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+#endif
+
+    status_callback = status_callback_handler;
+
+    esp_ota_img_states_t state;
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    if (esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+        esp_timer_create_args_t verify_timer_args = {
+            .callback = verify_timeout,
+            .name = "ota_verify",
+        };
+        esp_err_t result = esp_timer_create(&verify_timer_args, &verify_timer);
+        if (result != ESP_OK)
+            return result;
+        esp_timer_start_once(verify_timer, (uint64_t)CONFIG_OTA_VERIFY_TIMEOUT * 1000 * 1000);
+        snprintf(status, sizeof(status), "Verifying %s", ota_get_version());
+        ESP_LOGI(TAG, "%s. Rolled back unless BIRTH is reached within %d s", status, CONFIG_OTA_VERIFY_TIMEOUT);
+    }
+
+    return app_task_create(APP_TASK_OTA, ota_task, NULL, &task_handle);
+}
+
+/**
+ * @brief Download and apply the image or delta at a URL, then reboot into it
+ *
+ * @return ESP_ERR_INVALID_STATE if an update is already running or the running image hasn't
+ * been confirmed yet
+*/
+esp_err_t ota_start(const char *new_url) {
+    if (!new_url || !new_url[0] || strlen(new_url) >= sizeof(url))
+        return ESP_ERR_INVALID_ARG;
+    if (!task_handle || busy || verify_timer)
+        return ESP_ERR_INVALID_STATE;
+
+    busy = true;
+    strcpy(url, new_url);
+    xTaskNotifyGive(task_handle);
+    return ESP_OK;
+}
+
+/**
+ * @brief Mark the running image as good, cancelling the rollback. Call once the node has birthed
+*/
+void ota_confirm() {
+    if (!verify_timer)
+        return;
+
+    esp_timer_stop(verify_timer);
+    esp_timer_delete(verify_timer);
+    verify_timer = NULL;
+    esp_ota_mark_app_valid_cancel_rollback();
+    set_status("Confirmed %s", ota_get_version());
+}
+
+const char *ota_get_status() {
+    return status;
+}
+
+const char *ota_get_version() {
+    return esp_ota_get_app_description()->version;
+}
+
+#if CONFIG_APP_STATIC_ALLOCATION
+/**
+ * @brief Get the size of the download buffer and the delta decoder
+*/
+size_t ota_get_static_size() {
+    return sizeof(download_buffer) + sizeof(delta);
+}
+#endif
@@ -0,0 +1,27 @@
+/**! @file ota.h
+ *
+*/
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_STATUS_MAX 48
+
+typedef void (*ota_status_callback_handler_t)(const char *status);
+
+esp_err_t ota_init(ota_status_callback_handler_t status_callback_handler);
+esp_err_t ota_start(const char *url);
+void ota_confirm();
+const char *ota_get_status();
+const char *ota_get_version();
+#if CONFIG_APP_STATIC_ALLOCATION
+size_t ota_get_static_size();
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
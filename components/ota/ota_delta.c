@@ -0,0 +1,191 @@
+// ESP-IDF Components
+#include <string.h>
+#include "esp_rom_crc.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "ota_delta.h"
+
+#define OP_COPY 0x01
+#define OP_INSERT 0x02
+#define VARINT_MAX_SHIFT 63
+
+static uint32_t get_u32(const uint8_t *buffer) {
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+static esp_err_t write_target(ota_delta_t *delta, const uint8_t *data, size_t size) {
+    if (size > delta->header.target_size - delta->written)
+        return ESP_ERR_INVALID_SIZE;
+
+    esp_err_t result = delta->write(delta->ctx, data, size);
+    if (result != ESP_OK)
+        return result;
+    delta->crc = esp_rom_crc32_le(delta->crc, data, size);
+    delta->written += size;
+    return ESP_OK;
+}
+
+/**
+ * @brief Check that the source image is the one the delta was generated against
+*/
+static esp_err_t verify_source(ota_delta_t *delta) {
+    uint32_t crc = 0;
+    for (uint32_t offset = 0; offset < delta->header.source_size; offset += OTA_DELTA_COPY_CHUNK) {
+        size_t size = delta->header.source_size - offset;
+        if (size > OTA_DELTA_COPY_CHUNK)
+            size = OTA_DELTA_COPY_CHUNK;
+        esp_err_t result = delta->read(delta->ctx, offset, delta->copy_buffer, size);
+        if (result != ESP_OK)
+            return result;
+        crc = esp_rom_crc32_le(crc, delta->copy_buffer, size);
+    }
+    return crc == delta->header.source_crc ? ESP_OK : ESP_ERR_INVALID_VERSION;
+}
+
+static esp_err_t run_copy(ota_delta_t *delta, uint32_t length) {
+    int64_t start = (int64_t)delta->source_offset + delta->seek;
+    if (start < 0 || start + length > delta->header.source_size)
+        return ESP_ERR_INVALID_ARG;
+
+    uint32_t offset = start;
+    while (length) {
+        size_t size = length < OTA_DELTA_COPY_CHUNK ? length : OTA_DELTA_COPY_CHUNK;
+        esp_err_t result = delta->read(delta->ctx, offset, delta->copy_buffer, size);
+        if (result != ESP_OK)
+            return result;
+        result = write_target(delta, delta->copy_buffer, size);
+        if (result != ESP_OK)
+            return result;
+        offset += size;
+        length -= size;
+    }
+    delta->source_offset = offset;
+    return ESP_OK;
+}
+
+/**
+ * @brief Handle a decoded varint field of the current op
+*/
+static esp_err_t end_field(ota_delta_t *delta) {
+    uint64_t value = delta->varint;
+    delta->varint = 0;
+    delta->varint_shift = 0;
+
+    if (delta->op == OP_COPY && delta->field == 0) {
+        delta->seek = (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+        delta->field++;
+        return ESP_OK;
+    }
+    if (value > UINT32_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    if (delta->op == OP_COPY) {
+        delta->op = 0;
+        return run_copy(delta, value);
+    }
+    delta->length = value;
+    delta->field++;
+    if (!delta->length)
+        delta->op = 0;
+    return ESP_OK;
+}
+
+/**
+ * @brief Whether a downloaded image starts with a delta header rather than being a full image
+*/
+bool ota_delta_detect(const uint8_t *data, size_t size) {
+    return size >= 4 && get_u32(data) == OTA_DELTA_MAGIC;
+}
+
+void ota_delta_begin(ota_delta_t *delta, ota_delta_read_t read, ota_delta_write_t write, void *ctx) {
+    memset(delta, 0, sizeof(*delta));
+    delta->read = read;
+    delta->write = write;
+    delta->ctx = ctx;
+}
+
+/**
+ * @brief Decode the next chunk of a delta, writing the target image as it is produced
+ *
+ *  Chunks can be split anywhere. The source is verified against the header once it is complete.
+ *
+ * @return ESP_ERR_INVALID_VERSION if the source isn't the image the delta was generated against,
+ * ESP_ERR_INVALID_ARG or ESP_ERR_INVALID_SIZE if the delta is malformed
+*/
+esp_err_t ota_delta_feed(ota_delta_t *delta, const uint8_t *data, size_t size) {
+    while (size) {
+        if (delta->header_length < OTA_DELTA_HEADER_SIZE) {
+            delta->header_buffer[delta->header_length++] = *data++;
+            size--;
+            if (delta->header_length < OTA_DELTA_HEADER_SIZE)
+                continue;
+
+            if (get_u32(delta->header_buffer) != OTA_DELTA_MAGIC)
+                return ESP_ERR_INVALID_ARG;
+            delta->header = (ota_delta_header_t) {
+                .source_size = get_u32(delta->header_buffer + 4),
+                .source_crc = get_u32(delta->header_buffer + 8),
+                .target_size = get_u32(delta->header_buffer + 12),
+                .target_crc = get_u32(delta->header_buffer + 16),
+            };
+            esp_err_t result = verify_source(delta);
+            if (result != ESP_OK)
+                return result;
+            continue;
+        }
+
+        // Literal bytes of an INSERT are passed through without copying
+        if (delta->op == OP_INSERT && delta->field == 1) {
+            size_t chunk = size < delta->length ? size : delta->length;
+            esp_err_t result = write_target(delta, data, chunk);
+            if (result != ESP_OK)
+                return result;
+            data += chunk;
+            size -= chunk;
+            delta->length -= chunk;
+            if (!delta->length)
+                delta->op = 0;
+            continue;
+        }
+
+        uint8_t byte = *data++;
+        size--;
+        if (!delta->op) {
+            if (byte != OP_COPY && byte != OP_INSERT)
+                return ESP_ERR_INVALID_ARG;
+            delta->op = byte;
+            delta->field = 0;
+            continue;
+        }
+
+        if (delta->varint_shift > VARINT_MAX_SHIFT)
+            return ESP_ERR_INVALID_ARG;
+        delta->varint |= (uint64_t)(byte & 0x7F) << delta->varint_shift;
+        delta->varint_shift += 7;
+        if (!(byte & 0x80)) {
+            esp_err_t result = end_field(delta);
+            if (result != ESP_OK)
+                return result;
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Get the header of the delta. Only valid once the first OTA_DELTA_HEADER_SIZE bytes have been fed
+*/
+const ota_delta_header_t *ota_delta_get_header(const ota_delta_t *delta) {
+    return delta->header_length == OTA_DELTA_HEADER_SIZE ? &delta->header : NULL;
+}
+
+/**
+ * @brief Check that the whole target image was produced and matches the CRC-32 of the header
+*/
+esp_err_t ota_delta_finish(ota_delta_t *delta) {
+    if (delta->header_length < OTA_DELTA_HEADER_SIZE || delta->op || delta->written != delta->header.target_size)
+        return ESP_ERR_INVALID_SIZE;
+    return delta->crc == delta->header.target_crc ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
@@ -0,0 +1,76 @@
+/**! @file ota_delta.h
+ *
+ * Streaming decoder of binary deltas between two firmware images, generated by tools/ota_delta.py.
+ * Has no dependency on the flash or the network, so it can be exercised on a host with a file
+ * standing in for each partition.
+ *
+ * Format, little endian:
+ *  Header: magic "ODL1", source size, source CRC-32, target size, target CRC-32 (u32 each)
+ *  Ops, until target size bytes have been produced:
+ *   0x01 COPY: zigzag varint seek, varint length. Copies length bytes of the source, starting seek
+ *              bytes from the end of the previous copy
+ *   0x02 INSERT: varint length, then length literal bytes
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_DELTA_MAGIC 0x314C444F  // "ODL1"
+#define OTA_DELTA_HEADER_SIZE 20
+#define OTA_DELTA_COPY_CHUNK 256
+
+/**
+ * @brief Read size bytes of the source image at offset
+*/
+typedef esp_err_t (*ota_delta_read_t)(void *ctx, size_t offset, void *buffer, size_t size);
+/**
+ * @brief Append size bytes to the target image
+*/
+typedef esp_err_t (*ota_delta_write_t)(void *ctx, const void *data, size_t size);
+
+typedef struct {
+    uint32_t source_size;
+    uint32_t source_crc;
+    uint32_t target_size;
+    uint32_t target_crc;
+} ota_delta_header_t;
+
+/**
+ * @brief Decoder state. Holds everything needed between calls, so the RAM used doesn't depend on
+ * the size of the images or of the fed chunks
+*/
+typedef struct {
+    ota_delta_read_t read;
+    ota_delta_write_t write;
+    void *ctx;
+    ota_delta_header_t header;
+    uint8_t header_buffer[OTA_DELTA_HEADER_SIZE];
+    uint32_t header_length;
+    uint8_t op;                 // Op being decoded. 0 between ops
+    uint8_t field;              // Varint field of the op being decoded
+    uint8_t varint_shift;
+    uint64_t varint;
+    int64_t seek;
+    uint32_t length;            // Literal bytes of an INSERT still to come
+    uint32_t source_offset;     // End of the previous copy
+    uint32_t written;
+    uint32_t crc;               // CRC-32 of the bytes written
+    uint8_t copy_buffer[OTA_DELTA_COPY_CHUNK];
+} ota_delta_t;
+
+bool ota_delta_detect(const uint8_t *data, size_t size);
+void ota_delta_begin(ota_delta_t *delta, ota_delta_read_t read, ota_delta_write_t write, void *ctx);
+esp_err_t ota_delta_feed(ota_delta_t *delta, const uint8_t *data, size_t size);
+const ota_delta_header_t *ota_delta_get_header(const ota_delta_t *delta);
+esp_err_t ota_delta_finish(ota_delta_t *delta);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
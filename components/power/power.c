@@ -0,0 +1,133 @@
+// ESP-IDF Components
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "power.h"
+
+#define DEBUG_POWER 0
+
+#define US_PER_HOUR (3600ULL * 1000 * 1000)
+
+static const char *TAG = "power";
+static esp_pm_lock_handle_t wake_window_lock;
+static int64_t window_start_time;
+static int64_t hour_start_time;
+static int64_t hour_start_sleep_us;     // Light sleep time since boot when the current hour started
+static uint32_t last_hour_awake_ms;     // Awake time of the last completed hour
+static bool hour_completed = false;
+
+/**
+ * @brief Get the time spent in light sleep since boot in us, or -1 if it isn't available
+ *
+ *  The power management profiling stats (PM_PROFILING) are only exposed by esp_pm_dump_locks(). Its
+ *  mode table has a row per mode, such as "SLEEP     40 M        123456      12%".
+*/
+static int64_t get_sleep_time_us() {
+    char *buffer = NULL;
+    size_t size = 0;
+    FILE *stream = open_memstream(&buffer, &size);
+    if (!stream)
+        return -1;
+    esp_pm_dump_locks(stream);
+    fclose(stream);
+
+    long long sleep_us;
+    char *row = buffer ? strstr(buffer, "\nSLEEP ") : NULL;
+    if (!row || sscanf(row, " SLEEP %*d%*[ M]%lld", &sleep_us) != 1)
+        sleep_us = -1;
+    free(buffer);
+    return sleep_us;
+}
+
+/**
+ * @brief Roll the awake time over to a new hour if the current one has elapsed
+*/
+static void update_hour_bucket(int64_t now, int64_t sleep_us) {
+    if ((now - hour_start_time) < US_PER_HOUR)
+        return;
+
+    last_hour_awake_ms = (now - hour_start_time - (sleep_us - hour_start_sleep_us)) / 1000;
+    hour_completed = true;
+    hour_start_time = now;
+    hour_start_sleep_us = sleep_us;
+}
+
+esp_err_t power_init() {
+#if DEBUG_POWER
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+#else
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+#endif
+
+    esp_pm_config_esp32_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_POWER_MGMT_MIN_CPU_FREQ_MHZ,
+        .light_sleep_enable = true,
+    };
+    esp_err_t result = esp_pm_configure(&pm_config);
+    if (result != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(result));
+        return result;
+    }
+
+    result = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "wake_window", &wake_window_lock);
+    if (result != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create wake window lock: %s", esp_err_to_name(result));
+        return result;
+    }
+
+    hour_start_time = esp_timer_get_time();
+    hour_start_sleep_us = get_sleep_time_us();
+    if (hour_start_sleep_us < 0) {
+        ESP_LOGW(TAG, "Light sleep time not available. Awake time is reported as wall time");
+        hour_start_sleep_us = 0;
+    }
+    ESP_LOGI(TAG, "Power management enabled. CPU: %d-%d MHz, light sleep enabled",
+                    CONFIG_POWER_MGMT_MIN_CPU_FREQ_MHZ, CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+    return ESP_OK;
+}
+
+/**
+ * @brief Hold the CPU at full speed and out of light sleep until power_wake_window_end() is called
+*/
+void power_wake_window_begin() {
+    esp_pm_lock_acquire(wake_window_lock);
+    window_start_time = esp_timer_get_time();
+}
+
+void power_wake_window_end() {
+    ESP_LOGD(TAG, "Wake window took %lld us", esp_timer_get_time() - window_start_time);
+    esp_pm_lock_release(wake_window_lock);
+}
+
+/**
+ * @brief Get the time the chip was awake, rather than in light sleep, during the last completed
+ * hour in ms
+ *
+ *  Awake time is wall time less the light sleep time kept by power management profiling, so time
+ *  awake outside wake windows, for Wi-Fi beacons, MQTT traffic or timers, is included. Until the
+ *  first hour has completed, the awake time of the current hour is projected over a full hour.
+*/
+uint32_t power_get_awake_ms_per_hour() {
+    int64_t now = esp_timer_get_time();
+    int64_t sleep_us = get_sleep_time_us();
+    if (sleep_us < 0)
+        sleep_us = hour_start_sleep_us;
+    update_hour_bucket(now, sleep_us);
+    if (hour_completed)
+        return last_hour_awake_ms;
+
+    int64_t elapsed = now - hour_start_time;
+    if (elapsed <= 0)
+        return 0;
+    uint64_t awake_us = elapsed - (sleep_us - hour_start_sleep_us);
+    return (uint32_t)((awake_us * US_PER_HOUR / elapsed) / 1000);
+}
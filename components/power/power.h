@@ -0,0 +1,19 @@
+/**! @file power.h
+ * 
+*/
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t power_init();
+void power_wake_window_begin();
+void power_wake_window_end();
+uint32_t power_get_awake_ms_per_hour();
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
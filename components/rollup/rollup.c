@@ -0,0 +1,113 @@
+// ESP-IDF Components
+#include <math.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "rollup.h"
+
+#define DEBUG_ROLLUP 0
+
+static const char *TAG = "rollup";
+static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+static const char *stat_name[ROLLUP_STAT_CNT] = {
+    "Min",
+    "Max",
+    "Mean",
+    "Stddev",
+};
+
+static int64_t get_window(rollup_t *rollup) {
+    return esp_timer_get_time() / 1000 / rollup->period_ms;
+}
+
+/**
+ * @brief Create the aggregate metrics of a rollup in a metric buffer
+ *
+ *  Metrics are named <source>/Rollup <period>s/<stat> and must be part of the device's birth.
+ *
+ * @param metric_buffer Buffer for ROLLUP_STAT_CNT metrics
+*/
+esp_err_t rollup_init(rollup_t *rollup, char *device_id, const char *source_name, uint32_t period_s, esp_tahu_metric_t *metric_buffer) {
+#if DEBUG_ROLLUP
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+#else
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+#endif
+
+    *rollup = (rollup_t) {
+        .period_ms = period_s * 1000,
+        .metrics = metric_buffer,
+    };
+    rollup->window = get_window(rollup);
+
+    for (int i = 0; i < ROLLUP_STAT_CNT; i++) {
+        char *metric_name = rollup->metric_names[i];
+        snprintf(metric_name, ROLLUP_METRIC_NAME_MAX, "%s/Rollup %ds/%s", source_name, period_s, stat_name[i]);
+        esp_tahu_metric_t new_metric = { 0 };
+        esp_tahu_create_metric(device_id, &new_metric, metric_name, ESP_TAHU_METRIC_TYPE_FLOAT, NULL);
+        metric_buffer[i] = new_metric;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Add a sample to the current window in O(1) using Welford's algorithm
+*/
+void rollup_add_sample(rollup_t *rollup, float value) {
+    portENTER_CRITICAL(&mux);
+    rollup->samples++;
+    double delta = value - rollup->mean;
+    rollup->mean += delta / rollup->samples;
+    rollup->m2 += delta * (value - rollup->mean);
+    if (rollup->samples == 1 || value < rollup->min)
+        rollup->min = value;
+    if (rollup->samples == 1 || value > rollup->max)
+        rollup->max = value;
+    portEXIT_CRITICAL(&mux);
+}
+
+/**
+ * @brief Close the current window once its period has elapsed
+ *
+ *  The aggregates of the closed window are set on the rollup metrics, stamped with the close time.
+ *
+ * @return True if a window with samples was closed and its metrics should be published
+*/
+bool rollup_close_due(rollup_t *rollup) {
+    int64_t window = get_window(rollup);
+    if (window == rollup->window)
+        return false;
+
+    portENTER_CRITICAL(&mux);
+    uint32_t samples = rollup->samples;
+    float values[ROLLUP_STAT_CNT] = {
+        [ROLLUP_STAT_MIN] = rollup->min,
+        [ROLLUP_STAT_MAX] = rollup->max,
+        [ROLLUP_STAT_MEAN] = rollup->mean,
+    };
+    double m2 = rollup->m2;
+    rollup->window = window;
+    rollup->samples = 0;
+    rollup->mean = 0;
+    rollup->m2 = 0;
+    portEXIT_CRITICAL(&mux);
+
+    // Sample standard deviation
+    values[ROLLUP_STAT_STDDEV] = samples > 1 ? sqrt(m2 / (samples - 1)) : 0;
+
+    if (!samples) {
+        ESP_LOGD(TAG, "No samples in window of %s", rollup->metrics[0].metric_name);
+        return false;
+    }
+
+    for (int i = 0; i < ROLLUP_STAT_CNT; i++)
+        esp_tahu_set_metric_data(&rollup->metrics[i], false, &values[i]);
+    ESP_LOGD(TAG, "Closed window of %d samples: min=%f, max=%f, mean=%f, stddev=%f", samples,
+                    values[ROLLUP_STAT_MIN], values[ROLLUP_STAT_MAX], values[ROLLUP_STAT_MEAN], values[ROLLUP_STAT_STDDEV]);
+    return true;
+}
@@ -0,0 +1,40 @@
+/**! @file rollup.h
+ * 
+*/
+#pragma once
+
+#include "esp_tahu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ROLLUP_METRIC_NAME_MAX 64
+
+typedef enum {
+    ROLLUP_STAT_MIN,
+    ROLLUP_STAT_MAX,
+    ROLLUP_STAT_MEAN,
+    ROLLUP_STAT_STDDEV,
+    ROLLUP_STAT_CNT
+} rollup_stat_t;
+
+typedef struct {
+    uint32_t period_ms;
+    esp_tahu_metric_t *metrics;     // ROLLUP_STAT_CNT float metrics, in the metric array of the device
+    char metric_names[ROLLUP_STAT_CNT][ROLLUP_METRIC_NAME_MAX];
+    int64_t window;                 // Index of the current window since boot
+    uint32_t samples;
+    double mean;
+    double m2;                      // Sum of squared differences from the mean
+    float min;
+    float max;
+} rollup_t;
+
+esp_err_t rollup_init(rollup_t *rollup, char *device_id, const char *source_name, uint32_t period_s, esp_tahu_metric_t *metric_buffer);
+void rollup_add_sample(rollup_t *rollup, float value);
+bool rollup_close_due(rollup_t *rollup);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
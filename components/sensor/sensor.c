@@ -0,0 +1,218 @@
+// ESP-IDF Components
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Project Components
+#include "app_tasks.h"
+#include "dlog.h"
+
+// Project Files
+#include "sensor.h"
+#include "sensor_driver.h"
+
+#define DEBUG_SENSOR 0
+
+typedef struct {
+    const sensor_driver_t *driver;
+    sensor_channel_t first_channel;
+    bool ready;                 // Initialized successfully. Initialization is retried each round until it is
+    bool triggered;
+    int64_t last_trigger_time;  // us since boot. 0 if never triggered
+} sensor_t;
+
+typedef struct {
+    const char *name;
+    bool temperature;
+} sensor_channel_info_t;
+
+static const char *TAG = "sensor";
+static sensor_sample_callback_t sample_callback;
+static sensor_sample_t sample;
+static sensor_t sensors[SENSOR_COUNT] = {
+#if CONFIG_SENSOR_DHT_ENABLE
+    [SENSOR_DHT] = { .driver = &sensor_dht_driver, .first_channel = SENSOR_CHANNEL_DHT_TEMPERATURE },
+#endif
+#if CONFIG_SENSOR_SHT_ENABLE
+    [SENSOR_SHT] = { .driver = &sensor_sht_driver, .first_channel = SENSOR_CHANNEL_SHT_TEMPERATURE },
+#endif
+#if CONFIG_SENSOR_DS18B20_ENABLE
+    [SENSOR_DS18B20] = { .driver = &sensor_ds18b20_driver, .first_channel = SENSOR_CHANNEL_DS18B20_TEMPERATURE },
+#endif
+};
+static const sensor_channel_info_t channel_info[SENSOR_CHANNEL_COUNT] = {
+#if CONFIG_SENSOR_DHT_ENABLE
+    [SENSOR_CHANNEL_DHT_TEMPERATURE] = { "dht/temperature", true },
+    [SENSOR_CHANNEL_DHT_HUMIDITY] = { "dht/humidity", false },
+#endif
+#if CONFIG_SENSOR_SHT_ENABLE
+    [SENSOR_CHANNEL_SHT_TEMPERATURE] = { "sht/temperature", true },
+    [SENSOR_CHANNEL_SHT_HUMIDITY] = { "sht/humidity", false },
+#endif
+#if CONFIG_SENSOR_DS18B20_ENABLE
+    [SENSOR_CHANNEL_DS18B20_TEMPERATURE] = { "ds18b20/temperature", true },
+#endif
+};
+
+static void sensor_read_task() {
+    TickType_t last_wake_time = xTaskGetTickCount();
+    for ( ;; ) {
+        sensor_read();
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(CONFIG_SENSOR_SAMPLE_PERIOD));
+    }
+}
+
+static esp_err_t init_sensor(sensor_t *sensor) {
+    esp_err_t result = sensor->driver->init();
+    if (result != ESP_OK) {
+        ESP_LOGW(TAG, "%s sensor not responding: %s", sensor->driver->name, esp_err_to_name(result));
+        return result;
+    }
+    sensor->ready = true;
+    return ESP_OK;
+}
+
+/**
+ * @brief Initialize every enabled sensor
+ *
+ *  Sensors that don't respond are retried each round, so one missing sensor doesn't stop the others.
+ *
+ * @param enable_read_task Sample every CONFIG_SENSOR_SAMPLE_PERIOD ms. Otherwise sensor_read() is
+ * called by the application
+*/
+esp_err_t sensor_init(bool enable_read_task) {
+#if DEBUG_SENSOR
+    dlog_level_set(TAG, ESP_LOG_DEBUG);
+#else
+    dlog_level_set(TAG, ESP_LOG_INFO);
+#endif
+
+    // Placeholders until the first sample, out of range of any alarm or control threshold. They are
+    // never published: sensor_has_value() is false until a round collects the channel
+    for (int i = 0; i < SENSOR_CHANNEL_COUNT; i++)
+        sample.value[i] = channel_info[i].temperature ? -99.0 : 0.0;
+
+    for (int i = 0; i < SENSOR_COUNT; i++)
+        init_sensor(sensors + i);
+
+    if (enable_read_task)
+        return app_task_create(APP_TASK_SENSOR_READ, sensor_read_task, NULL, NULL);
+    return ESP_OK;
+}
+
+/**
+ * @brief Run a sampling round: trigger every sensor that is due, wait for the slowest conversion,
+ * then collect them all
+ *
+ *  Conversions run concurrently, so a round takes as long as the slowest sensor rather than the
+ *  sum of all of them. The sample callback is called if any channel was collected.
+ *
+ * @return ESP_OK if any sensor was collected
+*/
+esp_err_t sensor_read() {
+    esp_err_t result = ESP_ERR_NOT_FOUND;
+    uint32_t wait_ms = 0;
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        sensor_t *sensor = sensors + i;
+        if (!sensor->ready && init_sensor(sensor) != ESP_OK)
+            continue;
+        // A tick of slack, so a sensor whose minimum interval equals the sample period isn't skipped on jitter
+        int64_t min_interval = (sensor->driver->min_interval_ms - portTICK_PERIOD_MS) * 1000LL;
+        if (sensor->last_trigger_time && now - sensor->last_trigger_time < min_interval)
+            continue;
+
+        uint32_t ready_ms = 0;
+        sensor->last_trigger_time = now;
+        result = sensor->driver->trigger(&ready_ms);
+        if (result != ESP_OK) {
+            DLOGW(TAG, "%s trigger failed: %s", sensor->driver->name, esp_err_to_name(result));
+            continue;
+        }
+        sensor->triggered = true;
+        if (ready_ms > wait_ms)
+            wait_ms = ready_ms;
+    }
+
+    if (wait_ms)
+        vTaskDelay(pdMS_TO_TICKS(wait_ms) + 1);
+
+    sample.updated = 0;
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        sensor_t *sensor = sensors + i;
+        if (!sensor->triggered)
+            continue;
+        sensor->triggered = false;
+
+        float values[SENSOR_CHANNEL_COUNT];
+        result = sensor->driver->collect(values);
+        if (result != ESP_OK) {
+            DLOGW(TAG, "%s read failed: %s", sensor->driver->name, esp_err_to_name(result));
+            continue;
+        }
+        for (int j = 0; j < sensor->driver->channel_count; j++) {
+            sample.value[sensor->first_channel + j] = values[j];
+            sample.updated |= SENSOR_CHANNEL_BIT(sensor->first_channel + j);
+        }
+    }
+    sample.valid |= sample.updated;
+
+    if (!sample.updated)
+        return result;
+
+    DLOGD(TAG, "Sampled channels 0x%x in %d ms", sample.updated, (int)((esp_timer_get_time() - now) / 1000));
+    if (sample_callback)
+        sample_callback(&sample);
+    return ESP_OK;
+}
+
+/**
+ * @brief Get the latest value of a channel, in °C or %RH
+*/
+float sensor_get_value(sensor_channel_t channel) {
+    return sample.value[channel];
+}
+
+/**
+ * @brief Check whether a channel has been collected since boot. Until then its value is a placeholder
+*/
+bool sensor_has_value(sensor_channel_t channel) {
+    return sample.valid & SENSOR_CHANNEL_BIT(channel);
+}
+
+/**
+ * @brief Get the latest values of all channels and which of them the last round collected
+*/
+const sensor_sample_t *sensor_get_sample() {
+    return &sample;
+}
+
+const char *sensor_get_channel_name(sensor_channel_t channel) {
+    return channel_info[channel].name;
+}
+
+/**
+ * @brief Look up a channel by name, such as "sht/temperature"
+*/
+esp_err_t sensor_find_channel(const char *name, sensor_channel_t *out_channel) {
+    for (int i = 0; i < SENSOR_CHANNEL_COUNT; i++) {
+        if (strcmp(channel_info[i].name, name) == 0) {
+            *out_channel = i;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+bool sensor_channel_is_temperature(sensor_channel_t channel) {
+    return channel_info[channel].temperature;
+}
+
+/**
+ * @brief Register a callback called after each round that collected any channel
+*/
+void sensor_register_sample_callback(sensor_sample_callback_t callback) {
+    sample_callback = callback;
+}
@@ -0,0 +1,85 @@
+/**! @file sensor.h
+ *
+ * Sensors are sampled in rounds. Each round triggers every sensor that is due, waits for the
+ * slowest conversion and collects all of them. Each sensor provides one or more channels.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if !CONFIG_SENSOR_DHT_ENABLE && !CONFIG_SENSOR_SHT_ENABLE
+#error "A humidity sensor is required. Enable the DHT or SHT sensor"
+#endif
+
+typedef enum {
+#if CONFIG_SENSOR_DHT_ENABLE
+    SENSOR_DHT,
+#endif
+#if CONFIG_SENSOR_SHT_ENABLE
+    SENSOR_SHT,
+#endif
+#if CONFIG_SENSOR_DS18B20_ENABLE
+    SENSOR_DS18B20,
+#endif
+    SENSOR_COUNT
+} sensor_id_t;
+
+// The channels of a sensor are consecutive, in the order its driver collects them
+typedef enum {
+#if CONFIG_SENSOR_DHT_ENABLE
+    SENSOR_CHANNEL_DHT_TEMPERATURE,
+    SENSOR_CHANNEL_DHT_HUMIDITY,
+#endif
+#if CONFIG_SENSOR_SHT_ENABLE
+    SENSOR_CHANNEL_SHT_TEMPERATURE,
+    SENSOR_CHANNEL_SHT_HUMIDITY,
+#endif
+#if CONFIG_SENSOR_DS18B20_ENABLE
+    SENSOR_CHANNEL_DS18B20_TEMPERATURE,
+#endif
+    SENSOR_CHANNEL_COUNT
+} sensor_channel_t;
+
+#if CONFIG_SENSOR_PRIMARY_TEMPERATURE_SHT
+#define SENSOR_CHANNEL_TEMPERATURE SENSOR_CHANNEL_SHT_TEMPERATURE
+#elif CONFIG_SENSOR_PRIMARY_TEMPERATURE_DS18B20
+#define SENSOR_CHANNEL_TEMPERATURE SENSOR_CHANNEL_DS18B20_TEMPERATURE
+#else
+#define SENSOR_CHANNEL_TEMPERATURE SENSOR_CHANNEL_DHT_TEMPERATURE
+#endif
+
+#if CONFIG_SENSOR_PRIMARY_HUMIDITY_SHT
+#define SENSOR_CHANNEL_HUMIDITY SENSOR_CHANNEL_SHT_HUMIDITY
+#else
+#define SENSOR_CHANNEL_HUMIDITY SENSOR_CHANNEL_DHT_HUMIDITY
+#endif
+
+#define SENSOR_CHANNEL_BIT(channel) (1UL << (channel))
+
+typedef struct {
+    float value[SENSOR_CHANNEL_COUNT];      // Latest value of every channel
+    uint32_t updated;                       // Bit per channel collected in this round
+    uint32_t valid;                         // Bit per channel collected at least once
+} sensor_sample_t;
+
+typedef void (*sensor_sample_callback_t)(const sensor_sample_t *sample);
+
+esp_err_t sensor_init(bool enable_read_task);
+esp_err_t sensor_read();
+float sensor_get_value(sensor_channel_t channel);
+bool sensor_has_value(sensor_channel_t channel);
+const sensor_sample_t *sensor_get_sample();
+const char *sensor_get_channel_name(sensor_channel_t channel);
+esp_err_t sensor_find_channel(const char *name, sensor_channel_t *out_channel);
+bool sensor_channel_is_temperature(sensor_channel_t channel);
+void sensor_register_sample_callback(sensor_sample_callback_t callback);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
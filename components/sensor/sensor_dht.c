@@ -0,0 +1,38 @@
+// ESP-IDF Components
+// None
+
+// Project Components
+#include "dht.h"
+
+// Project Files
+#include "sensor_driver.h"
+
+static dht_data_t dht_data;
+
+static esp_err_t dht_sensor_init() {
+    return dht_init();
+}
+
+/**
+ * @brief Capture a frame. The single-wire protocol is bit-banged, so the whole read happens here
+ * and the frame is ready to collect immediately
+*/
+static esp_err_t dht_sensor_trigger(uint32_t *out_ready_ms) {
+    *out_ready_ms = 0;
+    return dht_read(&dht_data);
+}
+
+static esp_err_t dht_sensor_collect(float *out_values) {
+    out_values[0] = dht_data.temperature;
+    out_values[1] = dht_data.humidity;
+    return ESP_OK;
+}
+
+const sensor_driver_t sensor_dht_driver = {
+    .name = "DHT",
+    .channel_count = 2,
+    .min_interval_ms = DHT_MIN_INTERVAL_MS,
+    .init = dht_sensor_init,
+    .trigger = dht_sensor_trigger,
+    .collect = dht_sensor_collect,
+};
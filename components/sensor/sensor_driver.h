@@ -0,0 +1,43 @@
+/**! @file sensor_driver.h
+ *
+ * Interface implemented by each sensor driver. Drivers are only called from the sampling round,
+ * so they don't need to be thread-safe.
+*/
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *name;
+    uint8_t channel_count;
+    uint32_t min_interval_ms;   // Shortest time between triggers the sensor supports
+    /**
+     * @brief Configure the bus and check that the sensor responds
+    */
+    esp_err_t (*init)();
+    /**
+     * @brief Start a conversion without waiting for it
+     *
+     * @param out_ready_ms Time until the conversion can be collected
+    */
+    esp_err_t (*trigger)(uint32_t *out_ready_ms);
+    /**
+     * @brief Read the result of the triggered conversion
+     *
+     * @param out_values One value per channel of the sensor
+    */
+    esp_err_t (*collect)(float *out_values);
+} sensor_driver_t;
+
+extern const sensor_driver_t sensor_dht_driver;
+extern const sensor_driver_t sensor_sht_driver;
+extern const sensor_driver_t sensor_ds18b20_driver;
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,157 @@
+// ESP-IDF Components
+#include "driver/gpio.h"
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "sensor_driver.h"
+
+#define CMD_SKIP_ROM 0xCC
+#define CMD_CONVERT 0x44
+#define CMD_READ_SCRATCHPAD 0xBE
+#define CMD_WRITE_SCRATCHPAD 0x4E
+#define SCRATCHPAD_SIZE 9
+#define CONVERT_TIME_MS (750 >> (12 - CONFIG_SENSOR_DS18B20_RESOLUTION))
+#define CRC_POLYNOMIAL 0x8C     // Dallas/Maxim, reflected
+
+static const gpio_num_t gpio_pin = CONFIG_SENSOR_DS18B20_GPIO;
+static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*  1-Wire time slots, bit-banged on an open-drain pin
+ *
+ *  Only the timing critical part of each slot runs with interrupts disabled, at most ~70 us at a
+ *  time, so the bus doesn't hold off the Wi-Fi stack for a whole transaction. Between slots the
+ *  line idles high and the gap can be arbitrarily long.
+ *
+ *  Reset: master holds the line low 480 us, releases it, and the sensor answers with a presence
+ *  pulse 15-60 us later.
+ *  Write 1: low 6 us, release for the rest of the 70 us slot. Write 0: low 60 us, release 10 us.
+ *  Read: low 6 us, release, sample 9 us later, then wait out the slot.
+*/
+
+static esp_err_t bus_reset() {
+    gpio_set_level(gpio_pin, 0);
+    esp_rom_delay_us(480);
+
+    portENTER_CRITICAL(&mux);
+    gpio_set_level(gpio_pin, 1);
+    esp_rom_delay_us(70);
+    bool presence = gpio_get_level(gpio_pin) == 0;
+    portEXIT_CRITICAL(&mux);
+
+    esp_rom_delay_us(410);
+    return presence ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static void write_bit(bool bit) {
+    portENTER_CRITICAL(&mux);
+    gpio_set_level(gpio_pin, 0);
+    esp_rom_delay_us(bit ? 6 : 60);
+    gpio_set_level(gpio_pin, 1);
+    portEXIT_CRITICAL(&mux);
+    esp_rom_delay_us(bit ? 64 : 10);
+}
+
+static bool read_bit() {
+    portENTER_CRITICAL(&mux);
+    gpio_set_level(gpio_pin, 0);
+    esp_rom_delay_us(6);
+    gpio_set_level(gpio_pin, 1);
+    esp_rom_delay_us(9);
+    bool bit = gpio_get_level(gpio_pin);
+    portEXIT_CRITICAL(&mux);
+    esp_rom_delay_us(55);
+    return bit;
+}
+
+static void write_byte(uint8_t byte) {
+    for (int i = 0; i < 8; i++)
+        write_bit(byte & (1 << i));
+}
+
+static uint8_t read_byte() {
+    uint8_t byte = 0;
+    for (int i = 0; i < 8; i++)
+        byte |= read_bit() << i;
+    return byte;
+}
+
+static uint8_t crc8(const uint8_t *data, size_t size) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ CRC_POLYNOMIAL : crc >> 1;
+    }
+    return crc;
+}
+
+/**
+ * @brief Send a command to the only device on the bus
+*/
+static esp_err_t send_command(uint8_t command) {
+    esp_err_t result = bus_reset();
+    if (result != ESP_OK)
+        return result;
+    write_byte(CMD_SKIP_ROM);
+    write_byte(command);
+    return ESP_OK;
+}
+
+static esp_err_t ds18b20_init() {
+    gpio_config_t config = {
+        .mode = GPIO_MODE_INPUT_OUTPUT_OD,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .pin_bit_mask = 1ULL << CONFIG_SENSOR_DS18B20_GPIO,
+    };
+    gpio_config(&config);
+    gpio_set_level(gpio_pin, 1);
+
+    // Alarm thresholds are unused. The configuration register only holds the resolution
+    esp_err_t result = send_command(CMD_WRITE_SCRATCHPAD);
+    if (result != ESP_OK)
+        return result;
+    write_byte(0);
+    write_byte(0);
+    write_byte((CONFIG_SENSOR_DS18B20_RESOLUTION - 9) << 5 | 0x1F);
+    return ESP_OK;
+}
+
+/**
+ * @brief Start a conversion. The sensor converts on its own, so the bus is idle until collect
+*/
+static esp_err_t ds18b20_trigger(uint32_t *out_ready_ms) {
+    *out_ready_ms = CONVERT_TIME_MS;
+    return send_command(CMD_CONVERT);
+}
+
+static esp_err_t ds18b20_collect(float *out_values) {
+    esp_err_t result = send_command(CMD_READ_SCRATCHPAD);
+    if (result != ESP_OK)
+        return result;
+
+    uint8_t scratchpad[SCRATCHPAD_SIZE];
+    for (int i = 0; i < SCRATCHPAD_SIZE; i++)
+        scratchpad[i] = read_byte();
+    // An all-zero scratchpad has a valid CRC but means the line is stuck low
+    if (crc8(scratchpad, SCRATCHPAD_SIZE - 1) != scratchpad[SCRATCHPAD_SIZE - 1] || !scratchpad[4])
+        return ESP_ERR_INVALID_CRC;
+
+    int16_t raw = scratchpad[1] << 8 | scratchpad[0];
+    out_values[0] = raw / 16.0f;
+    return ESP_OK;
+}
+
+const sensor_driver_t sensor_ds18b20_driver = {
+    .name = "DS18B20",
+    .channel_count = 1,
+    .min_interval_ms = CONVERT_TIME_MS,
+    .init = ds18b20_init,
+    .trigger = ds18b20_trigger,
+    .collect = ds18b20_collect,
+};
@@ -0,0 +1,110 @@
+// ESP-IDF Components
+#include "driver/i2c.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "sensor_driver.h"
+
+#define I2C_TIMEOUT_MS 20
+#define RESET_TIME_MS 2
+#define CRC_POLYNOMIAL 0x31
+#define CRC_INIT 0xFF
+
+#if CONFIG_SENSOR_SHT_TYPE_4X
+static const uint8_t reset_command[] = { 0x94 };
+static const uint8_t measure_command[] = { 0xFD };     // High precision
+#define MEASURE_TIME_MS 9
+#else
+static const uint8_t reset_command[] = { 0x30, 0xA2 };
+static const uint8_t measure_command[] = { 0x24, 0x00 };       // Single shot, high repeatability, no clock stretching
+#define MEASURE_TIME_MS 16
+#endif
+
+static uint8_t crc8(const uint8_t *data, size_t size) {
+    uint8_t crc = CRC_INIT;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 0x80 ? (crc << 1) ^ CRC_POLYNOMIAL : crc << 1;
+    }
+    return crc;
+}
+
+static esp_err_t write_command(const uint8_t *command, size_t size) {
+    return i2c_master_write_to_device(CONFIG_SENSOR_I2C_PORT, CONFIG_SENSOR_SHT_ADDRESS, command, size,
+                                      pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+}
+
+static esp_err_t sht_init() {
+    static bool driver_installed = false;
+    if (!driver_installed) {
+        i2c_config_t config = {
+            .mode = I2C_MODE_MASTER,
+            .sda_io_num = CONFIG_SENSOR_I2C_SDA_GPIO,
+            .scl_io_num = CONFIG_SENSOR_I2C_SCL_GPIO,
+            .sda_pullup_en = GPIO_PULLUP_ENABLE,
+            .scl_pullup_en = GPIO_PULLUP_ENABLE,
+            .master.clk_speed = CONFIG_SENSOR_I2C_FREQUENCY,
+        };
+        esp_err_t result = i2c_param_config(CONFIG_SENSOR_I2C_PORT, &config);
+        if (result == ESP_OK)
+            result = i2c_driver_install(CONFIG_SENSOR_I2C_PORT, I2C_MODE_MASTER, 0, 0, 0);
+        if (result != ESP_OK)
+            return result;
+        driver_installed = true;
+    }
+
+    esp_err_t result = write_command(reset_command, sizeof(reset_command));
+    vTaskDelay(pdMS_TO_TICKS(RESET_TIME_MS) + 1);
+    return result;
+}
+
+/**
+ * @brief Start a single-shot measurement. The bus is released during the conversion, so other
+ * sensors on the bus can be triggered meanwhile
+*/
+static esp_err_t sht_trigger(uint32_t *out_ready_ms) {
+    *out_ready_ms = MEASURE_TIME_MS;
+    return write_command(measure_command, sizeof(measure_command));
+}
+
+/**
+ * @brief Read the temperature and humidity words, each followed by its CRC
+*/
+static esp_err_t sht_collect(float *out_values) {
+    uint8_t data[6];
+    esp_err_t result = i2c_master_read_from_device(CONFIG_SENSOR_I2C_PORT, CONFIG_SENSOR_SHT_ADDRESS, data, sizeof(data),
+                                                   pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    if (result != ESP_OK)
+        return result;
+    if (crc8(data, 2) != data[2] || crc8(data + 3, 2) != data[5])
+        return ESP_ERR_INVALID_CRC;
+
+    uint16_t raw_temperature = data[0] << 8 | data[1];
+    uint16_t raw_humidity = data[3] << 8 | data[4];
+    out_values[0] = -45.0f + 175.0f * raw_temperature / 65535.0f;
+#if CONFIG_SENSOR_SHT_TYPE_4X
+    float humidity = -6.0f + 125.0f * raw_humidity / 65535.0f;
+    out_values[1] = humidity < 0.0f ? 0.0f : humidity > 100.0f ? 100.0f : humidity;
+#else
+    out_values[1] = 100.0f * raw_humidity / 65535.0f;
+#endif
+    return ESP_OK;
+}
+
+const sensor_driver_t sensor_sht_driver = {
+#if CONFIG_SENSOR_SHT_TYPE_4X
+    .name = "SHT4x",
+#else
+    .name = "SHT3x",
+#endif
+    .channel_count = 2,
+    .min_interval_ms = MEASURE_TIME_MS,
+    .init = sht_init,
+    .trigger = sht_trigger,
+    .collect = sht_collect,
+};
@@ -1,67 +1,367 @@
 // ESP-IDF Components
+#include <stdio.h>
+#include <stdlib.h>
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "nvs.h"
 
 // Project Components
-#include "dht.h"
+#include "app_tasks.h"
+#include "dlog.h"
+#include "sensor.h"
 
 // Project Files
 #include "temp_controller.h"
 
-#define DEBUG_TEMP_CONTROLLER 1
-#define DHT_PIN_MASKED (1ULL<<CONFIG_TC_OUT_GPIO_PIN)
-static gpio_num_t gpio_pin = CONFIG_TC_OUT_GPIO_PIN;
-static gpio_config_t gpio_tc_config = {
-    .mode = GPIO_MODE_OUTPUT,
-    .pull_up_en = GPIO_PULLUP_DISABLE,
-    .pull_down_en = GPIO_PULLDOWN_DISABLE,
-    .pin_bit_mask = DHT_PIN_MASKED,
-};
+#define DEBUG_TEMP_CONTROLLER 0
+#define TC_LOOP_PERIOD_MS 5000
+
+#define NVS_NAMESPACE "tc"
+#define HOUR_US (3600 * 1000000LL)
+
+// Analytics accumulators persisted in NVS
+typedef struct {
+    uint64_t on_ms;             // Completed on periods
+    uint64_t off_ms;            // Completed off periods
+    uint64_t above_ms;          // Time above setpoint plus deadband
+    uint32_t on_periods;
+    uint32_t off_periods;
+    uint32_t cycles;            // Output starts
+} tc_totals_t;
+
+typedef struct {
+    gpio_num_t gpio_pin;
+    const char *sensor;         // Configured channel name. Empty for the primary temperature channel
+    sensor_channel_t channel;
+    float setpoint;
+    bool demand;                // Reached the setpoint and not yet cooled through the deadband
+    bool running;               // Output on
+    int64_t demand_time;        // When the demand was raised. Waiting zones start in this order
+#if CONFIG_TC_ANALYTICS_ENABLE
+    tc_totals_t totals;
+    int64_t output_change_time; // Last start or stop since boot. 0 if none yet
+    uint32_t hour_cycles;       // Starts in the current hour
+    uint32_t cycles_per_hour;   // Starts in the last full hour
+    char nvs_key[8];
+#endif
+} tc_zone_t;
 
 static const char *TAG = "temp-controller";
 
-static void temp_controller_task() {
-    bool cooling = false;
-    for ( ;; ) {
-        float temperature = dht_get_data()->temperature;
-        ESP_LOGD(TAG, "Temperature: %f, Setpoint: %f", temperature, temp_controller_setpoint);
+static tc_zone_t zones[TC_ZONE_COUNT] = {
+    { .gpio_pin = CONFIG_TC_OUT_GPIO_PIN, .sensor = CONFIG_TC_ZONE1_SENSOR },
+#if CONFIG_TC_ZONE_COUNT >= 2
+    { .gpio_pin = CONFIG_TC_ZONE2_OUT_GPIO, .sensor = CONFIG_TC_ZONE2_SENSOR },
+#endif
+#if CONFIG_TC_ZONE_COUNT >= 3
+    { .gpio_pin = CONFIG_TC_ZONE3_OUT_GPIO, .sensor = CONFIG_TC_ZONE3_SENSOR },
+#endif
+#if CONFIG_TC_ZONE_COUNT >= 4
+    { .gpio_pin = CONFIG_TC_ZONE4_OUT_GPIO, .sensor = CONFIG_TC_ZONE4_SENSOR },
+#endif
+};
+static int running_count = 0;
+static int64_t last_start_time = 0;
+static int64_t jitter_max_us = 0;
+static int64_t jitter_sum_us = 0;
+static uint32_t jitter_samples = 0;
+#if CONFIG_TC_ANALYTICS_ENABLE
+static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t last_evaluate_time = 0;
+static int64_t hour_start_time;
+static int64_t last_save_time;
+
+static void load_totals(tc_zone_t *zone) {
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return;
+
+    tc_totals_t totals;
+    size_t length = sizeof(totals);
+    esp_err_t result = nvs_get_blob(handle, zone->nvs_key, &totals, &length);
+    nvs_close(handle);
+    if (result == ESP_OK && length == sizeof(totals))
+        zone->totals = totals;
+}
+
+static esp_err_t save_totals() {
+    nvs_handle_t handle;
+    esp_err_t result = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (result != ESP_OK)
+        return result;
+
+    for (int i = 0; i < TC_ZONE_COUNT && result == ESP_OK; i++) {
+        portENTER_CRITICAL(&mux);
+        tc_totals_t totals = zones[i].totals;
+        portEXIT_CRITICAL(&mux);
+        result = nvs_set_blob(handle, zones[i].nvs_key, &totals, sizeof(totals));
+    }
+    if (result == ESP_OK)
+        result = nvs_commit(handle);
+    nvs_close(handle);
+    return result;
+}
+
+/**
+ * @brief Count a start or stop of a zone output and close the period it ends
+*/
+static void record_output_change(tc_zone_t *zone, bool running, int64_t now) {
+    uint64_t duration_ms = (now - zone->output_change_time) / 1000;
+    portENTER_CRITICAL(&mux);
+    if (running) {
+        zone->totals.cycles++;
+        zone->hour_cycles++;
+        // The off period before the first start since boot has no known beginning
+        if (zone->output_change_time) {
+            zone->totals.off_ms += duration_ms;
+            zone->totals.off_periods++;
+        }
+    } else {
+        zone->totals.on_ms += duration_ms;
+        zone->totals.on_periods++;
+    }
+    zone->output_change_time = now;
+    portEXIT_CRITICAL(&mux);
+}
+
+/**
+ * @brief Accumulate the time each zone spent above setpoint plus deadband since the last
+ * evaluation, roll the hourly cycle counts and persist the accumulators when due
+*/
+static void update_analytics(int64_t now) {
+    portENTER_CRITICAL(&mux);
+    for (int i = 0; i < TC_ZONE_COUNT; i++) {
+        tc_zone_t *zone = zones + i;
+        if (last_evaluate_time && sensor_get_value(zone->channel) > zone->setpoint + CONFIG_TC_DEADBAND)
+            zone->totals.above_ms += (now - last_evaluate_time) / 1000;
+        if (now - hour_start_time >= HOUR_US) {
+            zone->cycles_per_hour = zone->hour_cycles;
+            zone->hour_cycles = 0;
+        }
+    }
+    portEXIT_CRITICAL(&mux);
+    if (now - hour_start_time >= HOUR_US)
+        hour_start_time = now;
+    last_evaluate_time = now;
+
+    if (now - last_save_time >= CONFIG_TC_ANALYTICS_SAVE_PERIOD * 60 * 1000000LL) {
+        temp_controller_save();
+        last_save_time = now;
+    }
+}
+#endif
+
+static void set_output(tc_zone_t *zone, bool running, int64_t now) {
+    gpio_set_level(zone->gpio_pin, running);
+#if CONFIG_TC_ANALYTICS_ENABLE
+    // Recorded before the state changes, so a concurrent read never counts the new period twice
+    record_output_change(zone, running, now);
+#endif
+    zone->running = running;
+    running_count += running ? 1 : -1;
+    DLOGD(TAG, "%s cooling of zone %d", running ? "Enabling" : "Disabling", (int)(zone - zones) + 1);
+}
+
+/**
+ * @brief Whether the output scheduler lets another compressor start now
+*/
+static bool start_allowed(int64_t now) {
+    if (running_count >= CONFIG_TC_MAX_RUNNING)
+        return false;
+    return !last_start_time || now - last_start_time >= CONFIG_TC_START_SPACING * 1000000LL;
+}
+
+/**
+ * @brief Run the control loop of every zone, then start waiting zones as the scheduler allows
+ *
+ *  A zone's demand follows its own setpoint and deadband. Outputs are switched off as soon as
+ *  the demand drops, but only started one at a time, at least CONFIG_TC_START_SPACING apart and
+ *  with no more than CONFIG_TC_MAX_RUNNING running, longest waiting first.
+*/
+void temp_controller_evaluate() {
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < TC_ZONE_COUNT; i++) {
+        tc_zone_t *zone = zones + i;
+        float temperature = sensor_get_value(zone->channel);
+        DLOGD(TAG, "Zone %d temperature: %f, Setpoint: %f", i + 1, temperature, zone->setpoint);
+
+        if (!zone->demand && temperature >= zone->setpoint) {
+            zone->demand = true;
+            zone->demand_time = now;
+        }
+        if (zone->demand && temperature < zone->setpoint - CONFIG_TC_DEADBAND)
+            zone->demand = false;
 
-        if(!cooling && temperature >= temp_controller_setpoint) {
-            gpio_set_level(gpio_pin, 1);
-            cooling = true;
-            ESP_LOGD(TAG, "Enabling cooling functionality");
+        if (!zone->demand && zone->running)
+            set_output(zone, false, now);
+    }
+
+    for ( ;; ) {
+        tc_zone_t *next = NULL;
+        for (int i = 0; i < TC_ZONE_COUNT; i++) {
+            tc_zone_t *zone = zones + i;
+            if (zone->demand && !zone->running && (!next || zone->demand_time < next->demand_time))
+                next = zone;
         }
+        if (!next || !start_allowed(now))
+            break;
+        set_output(next, true, now);
+        last_start_time = now;
+    }
+
+#if CONFIG_TC_ANALYTICS_ENABLE
+    update_analytics(now);
+#endif
+}
 
-        if(cooling && temperature < (temp_controller_setpoint - CONFIG_TC_DEADBAND)) {
-            gpio_set_level(gpio_pin, 0);
-            cooling = false;
-            ESP_LOGD(TAG, "Disabling cooling functionality");
+static void temp_controller_task() {
+    TickType_t last_wake_time = xTaskGetTickCount();
+    int64_t last_run_time = 0;
+    for ( ;; ) {
+        // Record deviation of the actual loop period from the nominal period
+        int64_t now = esp_timer_get_time();
+        if (last_run_time) {
+            int64_t jitter = llabs((now - last_run_time) - (int64_t)TC_LOOP_PERIOD_MS * 1000);
+            if (jitter > jitter_max_us)
+                jitter_max_us = jitter;
+            jitter_sum_us += jitter;
+            jitter_samples++;
         }
-        vTaskDelay(pdMS_TO_TICKS(5000));
+        last_run_time = now;
+
+        temp_controller_evaluate();
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(TC_LOOP_PERIOD_MS));
     }
 }
 
 void temp_controller_init(bool enable) {
 #if DEBUG_TEMP_CONTROLLER
-    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+    dlog_level_set(TAG, ESP_LOG_DEBUG);
 #else
-    esp_log_level_set(TAG, ESP_LOG_INFO);
+    dlog_level_set(TAG, ESP_LOG_INFO);
 #endif
 
-    gpio_config(&gpio_tc_config);
-    temp_controller_setpoint = (float)CONFIG_TC_DEFAULT_SETPOINT;
+    for (int i = 0; i < TC_ZONE_COUNT; i++) {
+        tc_zone_t *zone = zones + i;
+        gpio_config_t gpio_tc_config = {
+            .mode = GPIO_MODE_OUTPUT,
+            .pull_up_en = GPIO_PULLUP_DISABLE,
+            .pull_down_en = GPIO_PULLDOWN_DISABLE,
+            .pin_bit_mask = 1ULL << zone->gpio_pin,
+        };
+        gpio_config(&gpio_tc_config);
+        zone->setpoint = (float)CONFIG_TC_DEFAULT_SETPOINT;
+
+        zone->channel = SENSOR_CHANNEL_TEMPERATURE;
+        sensor_channel_t channel;
+        if (zone->sensor[0] && (sensor_find_channel(zone->sensor, &channel) != ESP_OK || temp_controller_bind(i, channel) != ESP_OK))
+            ESP_LOGW(TAG, "Zone %d: no temperature channel '%s'. Using %s", i + 1, zone->sensor, sensor_get_channel_name(zone->channel));
+
+#if CONFIG_TC_ANALYTICS_ENABLE
+        snprintf(zone->nvs_key, sizeof(zone->nvs_key), "zone%d", i + 1);
+        load_totals(zone);
+#endif
+    }
+#if CONFIG_TC_ANALYTICS_ENABLE
+    hour_start_time = last_save_time = esp_timer_get_time();
+#endif
     if (enable)
         temp_controller_enable();
 }
 
-static TaskHandle_t tcTask;
+/**
+ * @brief Control a zone on a different temperature channel
+ *
+ * @return ESP_ERR_INVALID_ARG if the zone doesn't exist or the channel isn't a temperature channel
+*/
+esp_err_t temp_controller_bind(int zone, sensor_channel_t channel) {
+    if (zone < 0 || zone >= TC_ZONE_COUNT || channel >= SENSOR_CHANNEL_COUNT || !sensor_channel_is_temperature(channel))
+        return ESP_ERR_INVALID_ARG;
+
+    zones[zone].channel = channel;
+    ESP_LOGI(TAG, "Zone %d controlling on %s", zone + 1, sensor_get_channel_name(channel));
+    return ESP_OK;
+}
+
+sensor_channel_t temp_controller_get_channel(int zone) {
+    return zones[zone].channel;
+}
+
+void temp_controller_set_setpoint(int zone, float setpoint) {
+    zones[zone].setpoint = setpoint;
+}
+
+float temp_controller_get_setpoint(int zone) {
+    return zones[zone].setpoint;
+}
+
+/**
+ * @brief Whether the output of a zone is on. A zone waiting for the scheduler is not running
+*/
+bool temp_controller_is_running(int zone) {
+    return zones[zone].running;
+}
+
 void temp_controller_enable() {
-    xTaskCreate(temp_controller_task, "temp_controller_task", 2048, NULL, 1, &tcTask);
+    app_task_create(APP_TASK_TEMP_CONTROLLER, temp_controller_task, NULL, NULL);
 }
 
 void temp_controller_disable() {
-    if(tcTask)
-        vTaskDelete(tcTask);
-}
\ No newline at end of file
+    app_task_delete(APP_TASK_TEMP_CONTROLLER);
+}
+
+/**
+ * @brief Get the control loop period jitter since the last reset
+ *
+ * @param out_max_us Largest deviation from the nominal loop period
+ * @param out_mean_us Mean deviation from the nominal loop period
+*/
+void temp_controller_get_jitter(int64_t *out_max_us, int64_t *out_mean_us) {
+    *out_max_us = jitter_max_us;
+    *out_mean_us = jitter_samples ? jitter_sum_us / jitter_samples : 0;
+}
+
+void temp_controller_reset_jitter() {
+    jitter_max_us = 0;
+    jitter_sum_us = 0;
+    jitter_samples = 0;
+}
+
+#if CONFIG_TC_ANALYTICS_ENABLE
+/**
+ * @brief Get the runtime analytics of a zone, accumulated across reboots
+*/
+void temp_controller_get_analytics(int zone, tc_analytics_t *out_analytics) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&mux);
+    tc_totals_t totals = zones[zone].totals;
+    bool running = zones[zone].running;
+    int64_t output_change_time = zones[zone].output_change_time;
+    uint32_t cycles_per_hour = zones[zone].cycles_per_hour;
+    portEXIT_CRITICAL(&mux);
+
+    uint64_t on_ms = totals.on_ms + (running ? (now - output_change_time) / 1000 : 0);
+    *out_analytics = (tc_analytics_t) {
+        .on_time_s = on_ms / 1000,
+        .cycle_count = totals.cycles,
+        .cycles_per_hour = cycles_per_hour,
+        .mean_on_s = totals.on_periods ? totals.on_ms / totals.on_periods / 1000 : 0,
+        .mean_off_s = totals.off_periods ? totals.off_ms / totals.off_periods / 1000 : 0,
+        .above_setpoint_s = totals.above_ms / 1000,
+    };
+}
+
+/**
+ * @brief Persist the analytics accumulators now rather than at the next save period, such as
+ * before a restart
+*/
+esp_err_t temp_controller_save() {
+    esp_err_t result = save_totals();
+    if (result != ESP_OK)
+        ESP_LOGW(TAG, "Failed to save analytics: %s", esp_err_to_name(result));
+    return result;
+}
+#endif
@@ -3,14 +3,43 @@
 */
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sensor.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-float temp_controller_setpoint;
+#define TC_ZONE_COUNT CONFIG_TC_ZONE_COUNT
+
+#if CONFIG_TC_ANALYTICS_ENABLE
+typedef struct {
+    uint32_t on_time_s;         // Total output on time, including the running cycle
+    uint32_t cycle_count;       // Output starts
+    uint32_t cycles_per_hour;   // Output starts in the last full hour since boot
+    uint32_t mean_on_s;         // Mean duration of all completed on periods, not only recent ones
+    uint32_t mean_off_s;        // Mean duration of all completed off periods
+    uint32_t above_setpoint_s;  // Time above setpoint plus deadband
+} tc_analytics_t;
+#endif
+
 void temp_controller_init(bool enable);
+esp_err_t temp_controller_bind(int zone, sensor_channel_t channel);
+sensor_channel_t temp_controller_get_channel(int zone);
+void temp_controller_set_setpoint(int zone, float setpoint);
+float temp_controller_get_setpoint(int zone);
+bool temp_controller_is_running(int zone);
 void temp_controller_enable();
 void temp_controller_disable();
+void temp_controller_evaluate();
+void temp_controller_get_jitter(int64_t *out_max_us, int64_t *out_mean_us);
+void temp_controller_reset_jitter();
+#if CONFIG_TC_ANALYTICS_ENABLE
+void temp_controller_get_analytics(int zone, tc_analytics_t *out_analytics);
+esp_err_t temp_controller_save();
+#endif
 
 #ifdef __cplusplus
 } /* extern "C" */
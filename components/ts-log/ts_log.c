@@ -0,0 +1,489 @@
+// ESP-IDF Components
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Project Components
+// None
+
+// Project Files
+#include "ts_log.h"
+
+#define DEBUG_TS_LOG 0
+
+#define BLOCK_SIZE 4096             // Flash sector. Blocks are erased one at a time, oldest first
+#define BLOCK_MAGIC 0x314C5354      // "TSL1"
+#define RECORD_MARKER 0xA5
+#define ERASED_TIME UINT64_MAX
+#define VARINT_MAX_SIZE 10
+#define RECORD_MAX_SIZE (1 + VARINT_MAX_SIZE * (1 + TS_LOG_CHANNELS_MAX))
+#define QUANTIZED_MAX (1 << 30)     // Keeps the difference of two quantized values within an int32_t
+
+/**
+ * @brief Header at the start of each block
+ *
+ *  Records follow the header until the first byte that isn't RECORD_MARKER. Each record is
+ *  RECORD_MARKER, a varint of the ms since the previous record, then a zigzag varint per channel
+ *  of the change in quantized value since the previous record. The first record of a block is
+ *  relative to the start time and zero values, so every block decodes on its own.
+*/
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // Increments with each block opened. Orders the blocks from oldest to newest
+    uint64_t start_time;    // Timestamp of the first record
+    uint64_t end_time;      // Timestamp of the last record. Programmed when the block is sealed, erased until then
+    uint8_t channel_count;
+    uint8_t reserved[7];
+} block_header_t;
+
+typedef struct {
+    uint32_t seq;           // 0 if the block holds no records
+    uint64_t start_time;
+    uint64_t end_time;
+} block_index_t;
+
+static const char *TAG = "ts-log";
+static const esp_partition_t *partition = NULL;
+static SemaphoreHandle_t lock;
+#if CONFIG_APP_STATIC_ALLOCATION
+static block_index_t blocks[CONFIG_TS_LOG_MAX_BLOCKS];
+static uint8_t block_buffer[BLOCK_SIZE];    // Scans the blocks on init, then buffers the single open cursor
+static bool block_buffer_used = false;
+static StaticSemaphore_t lock_buffer;
+#else
+static block_index_t *blocks;       // Time range of every block, rebuilt from the block headers on init
+#endif
+static uint32_t block_count;
+static int head = -1;               // Block being appended to. -1 if the log is empty
+static uint32_t head_offset;        // First free byte of the head block
+static uint64_t head_time;          // Timestamp of the last record
+static int32_t head_values[TS_LOG_CHANNELS_MAX];    // Quantized values of the last record
+static uint8_t channel_count;
+static float resolution[TS_LOG_CHANNELS_MAX];
+
+static size_t encode_varint(uint8_t *buffer, uint64_t value) {
+    size_t size = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        buffer[size++] = value ? byte | 0x80 : byte;
+    } while (value);
+    return size;
+}
+
+static bool decode_varint(const uint8_t *buffer, uint32_t size, uint32_t *offset, uint64_t *out_value) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64 && *offset < size; shift += 7) {
+        uint8_t byte = buffer[(*offset)++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *out_value = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t zigzag_encode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t zigzag_decode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static int32_t quantize(float value, float step) {
+    float quantized = roundf(value / step);
+    if (isnan(quantized))
+        return 0;
+    if (quantized > QUANTIZED_MAX)
+        return QUANTIZED_MAX;
+    if (quantized < -QUANTIZED_MAX)
+        return -QUANTIZED_MAX;
+    return (int32_t)quantized;
+}
+
+/**
+ * @brief Encode a record relative to the last record of the head block
+ *
+ * @return Size of the record
+*/
+static size_t encode_record(uint8_t *buffer, uint64_t timestamp, const int32_t *values) {
+    size_t size = 0;
+    buffer[size++] = RECORD_MARKER;
+    size += encode_varint(buffer + size, timestamp - head_time);
+    for (int i = 0; i < channel_count; i++)
+        size += encode_varint(buffer + size, zigzag_encode(values[i] - head_values[i]));
+    return size;
+}
+
+/**
+ * @brief Decode the record at offset, applying it to the time and values of the previous record in place
+ *
+ * @return Offset of the next record. 0 if there's no complete record at offset
+*/
+static uint32_t decode_record(const uint8_t *block, uint32_t size, uint32_t offset, uint64_t *time, int32_t *values) {
+    if (offset >= size || block[offset] != RECORD_MARKER)
+        return 0;
+    offset++;
+
+    uint64_t delta;
+    if (!decode_varint(block, size, &offset, &delta))
+        return 0;
+    int32_t decoded[TS_LOG_CHANNELS_MAX];
+    for (int i = 0; i < channel_count; i++) {
+        uint64_t value;
+        if (!decode_varint(block, size, &offset, &value))
+            return 0;
+        decoded[i] = values[i] + zigzag_decode((uint32_t)value);
+    }
+
+    *time += delta;
+    memcpy(values, decoded, sizeof(int32_t) * channel_count);
+    return offset;
+}
+
+static bool read_header(uint32_t block, block_header_t *header) {
+    if (esp_partition_read(partition, block * BLOCK_SIZE, header, sizeof(*header)) != ESP_OK)
+        return false;
+    return header->magic == BLOCK_MAGIC && header->seq != UINT32_MAX && header->channel_count == channel_count;
+}
+
+/**
+ * @brief Decode every record of a block to find its end
+ *
+ * @return Offset past the last record. BLOCK_SIZE if anything was programmed after it, so a block
+ * holding a record torn by a reset is never appended to again
+*/
+static uint32_t scan_block(uint32_t block, uint8_t *buffer, uint64_t *out_time, int32_t *out_values) {
+    *out_time = blocks[block].start_time;
+    memset(out_values, 0, sizeof(int32_t) * TS_LOG_CHANNELS_MAX);
+    if (esp_partition_read(partition, block * BLOCK_SIZE, buffer, BLOCK_SIZE) != ESP_OK)
+        return BLOCK_SIZE;
+
+    uint32_t offset = sizeof(block_header_t);
+    uint32_t next;
+    while ((next = decode_record(buffer, BLOCK_SIZE, offset, out_time, out_values)))
+        offset = next;
+    for (uint32_t i = offset; i < BLOCK_SIZE; i++) {
+        if (buffer[i] != 0xFF)
+            return BLOCK_SIZE;
+    }
+    return offset;
+}
+
+/**
+ * @brief Seal the head block and erase the oldest block to continue the log on
+ *
+ *  Blocks are reused in a fixed rotation, so every block of the partition wears evenly.
+*/
+static esp_err_t open_block(uint64_t timestamp) {
+    uint32_t seq = 1;
+    if (head >= 0) {
+        seq = blocks[head].seq + 1;
+        esp_partition_write(partition, head * BLOCK_SIZE + offsetof(block_header_t, end_time), &head_time, sizeof(head_time));
+    }
+
+    uint32_t block = (uint32_t)(head + 1) % block_count;
+    blocks[block] = (block_index_t) { 0 };
+    esp_err_t result = esp_partition_erase_range(partition, block * BLOCK_SIZE, BLOCK_SIZE);
+    if (result != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase block %d: %s", block, esp_err_to_name(result));
+        return result;
+    }
+
+    block_header_t header;
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = BLOCK_MAGIC;
+    header.seq = seq;
+    header.start_time = timestamp;
+    header.channel_count = channel_count;
+    result = esp_partition_write(partition, block * BLOCK_SIZE, &header, sizeof(header));
+    if (result != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write block %d header: %s", block, esp_err_to_name(result));
+        return result;
+    }
+
+    blocks[block] = (block_index_t) { .seq = seq, .start_time = timestamp, .end_time = timestamp };
+    head = block;
+    head_offset = sizeof(header);
+    head_time = timestamp;
+    memset(head_values, 0, sizeof(head_values));
+    ESP_LOGD(TAG, "Opened block %d, seq %d", block, seq);
+    return ESP_OK;
+}
+
+/**
+ * @brief Find the block with the lowest sequence number at or above min_seq
+ *
+ * @return -1 if there is none
+*/
+static int find_block(uint32_t min_seq) {
+    int found = -1;
+    for (uint32_t i = 0; i < block_count; i++) {
+        if (blocks[i].seq && blocks[i].seq >= min_seq && (found < 0 || blocks[i].seq < blocks[found].seq))
+            found = i;
+    }
+    return found;
+}
+
+static void set_cursor_block(ts_log_cursor_t *cursor, int block) {
+    cursor->block = block;
+    cursor->seq = block >= 0 ? blocks[block].seq : 0;
+    cursor->offset = 0;
+}
+
+/**
+ * @brief Buffer the next block of the cursor that may hold records in its time range
+ *
+ *  Blocks outside the range are skipped using the index, without reading them. Blocks erased
+ *  since the cursor reached them are skipped too.
+ *
+ * @return False once past the newest block
+*/
+static bool load_block(ts_log_cursor_t *cursor) {
+    bool loaded = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    while (cursor->block >= 0 && !loaded) {
+        block_index_t *entry = &blocks[cursor->block];
+        if (entry->seq != cursor->seq || entry->end_time < cursor->start || entry->start_time > cursor->end) {
+            set_cursor_block(cursor, find_block(cursor->seq + 1));
+            continue;
+        }
+
+        cursor->size = cursor->block == head ? head_offset : BLOCK_SIZE;
+        if (esp_partition_read(partition, cursor->block * BLOCK_SIZE, cursor->buffer, cursor->size) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to read block %d", cursor->block);
+            set_cursor_block(cursor, find_block(cursor->seq + 1));
+            continue;
+        }
+        cursor->offset = sizeof(block_header_t);
+        cursor->time = entry->start_time;
+        memset(cursor->values, 0, sizeof(cursor->values));
+        loaded = true;
+    }
+    xSemaphoreGive(lock);
+    return loaded;
+}
+
+/**
+ * @brief Mount the log partition and rebuild the block index from the block headers
+ *
+ * @param channels Number of values in each record
+ * @param channel_resolution Quantization step of each channel. Values are stored as multiples of it
+*/
+esp_err_t ts_log_init(uint8_t channels, const float *channel_resolution) {
+#if DEBUG_TS_LOG
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+#else
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+#endif
+
+    if (channels == 0 || channels > TS_LOG_CHANNELS_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    const esp_partition_t *log_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, CONFIG_TS_LOG_PARTITION_LABEL);
+    if (!log_partition) {
+        ESP_LOGE(TAG, "Partition '%s' not found", CONFIG_TS_LOG_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (log_partition->size / BLOCK_SIZE < 2) {
+        ESP_LOGE(TAG, "Partition '%s' must hold at least 2 blocks", CONFIG_TS_LOG_PARTITION_LABEL);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    partition = log_partition;
+    block_count = partition->size / BLOCK_SIZE;
+    channel_count = channels;
+    memcpy(resolution, channel_resolution, sizeof(float) * channels);
+#if CONFIG_APP_STATIC_ALLOCATION
+    if (block_count > CONFIG_TS_LOG_MAX_BLOCKS) {
+        ESP_LOGW(TAG, "Partition holds %d blocks. Only the first %d are used", block_count, CONFIG_TS_LOG_MAX_BLOCKS);
+        block_count = CONFIG_TS_LOG_MAX_BLOCKS;
+    }
+    uint8_t *buffer = block_buffer;
+#else
+    blocks = calloc(block_count, sizeof(block_index_t));
+    uint8_t *buffer = malloc(BLOCK_SIZE);
+    if (!blocks || !buffer) {
+        free(blocks);
+        free(buffer);
+        partition = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
+    for (uint32_t i = 0; i < block_count; i++) {
+        block_header_t header;
+        if (!read_header(i, &header))
+            continue;
+        blocks[i] = (block_index_t) { .seq = header.seq, .start_time = header.start_time, .end_time = header.end_time };
+        if (head < 0 || header.seq > blocks[head].seq)
+            head = i;
+    }
+
+    // A block left unsealed by a reset is scanned for its end time
+    uint64_t time;
+    int32_t values[TS_LOG_CHANNELS_MAX];
+    for (uint32_t i = 0; i < block_count; i++) {
+        if (!blocks[i].seq || (int)i == head || blocks[i].end_time != ERASED_TIME)
+            continue;
+        scan_block(i, buffer, &time, values);
+        blocks[i].end_time = time;
+    }
+    if (head >= 0) {
+        bool sealed = blocks[head].end_time != ERASED_TIME;
+        head_offset = scan_block(head, buffer, &head_time, head_values);
+        blocks[head].end_time = head_time;
+        // Sealed before a reset, but the next block wasn't opened. The end time can't be programmed again
+        if (sealed)
+            head_offset = BLOCK_SIZE;
+    }
+#if CONFIG_APP_STATIC_ALLOCATION
+    lock = xSemaphoreCreateMutexStatic(&lock_buffer);
+#else
+    free(buffer);
+    lock = xSemaphoreCreateMutex();
+#endif
+    ESP_LOGI(TAG, "Mounted %d blocks. Newest block: %d, %d bytes used", block_count, head, head < 0 ? 0 : head_offset);
+    return ESP_OK;
+}
+
+/**
+ * @brief Append a record. Timestamps should not decrease. A timestamp earlier than the last record's,
+ * such as after the clock is corrected, starts a new block
+ *
+ * @param timestamp ms since epoch
+ * @param values One value per channel
+*/
+esp_err_t ts_log_append(uint64_t timestamp, const float *values) {
+    if (!partition)
+        return ESP_ERR_INVALID_STATE;
+
+    int32_t quantized[TS_LOG_CHANNELS_MAX];
+    for (int i = 0; i < channel_count; i++)
+        quantized[i] = quantize(values[i], resolution[i]);
+
+    uint8_t record[RECORD_MAX_SIZE];
+    esp_err_t result = ESP_OK;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (head < 0 || timestamp < head_time)
+        result = open_block(timestamp);
+    size_t size = encode_record(record, timestamp, quantized);
+    if (result == ESP_OK && head_offset + size > BLOCK_SIZE) {
+        result = open_block(timestamp);
+        size = encode_record(record, timestamp, quantized);
+    }
+
+    if (result == ESP_OK) {
+        // The marker is programmed last, so a record torn by a reset is never decoded
+        uint32_t address = head * BLOCK_SIZE + head_offset;
+        result = esp_partition_write(partition, address + 1, record + 1, size - 1);
+        if (result == ESP_OK)
+            result = esp_partition_write(partition, address, record, 1);
+    }
+
+    if (result == ESP_OK) {
+        head_offset += size;
+        head_time = timestamp;
+        memcpy(head_values, quantized, sizeof(head_values));
+        blocks[head].end_time = timestamp;
+    } else if (head >= 0) {
+        // Never program over a partially written record. Continue on the next block
+        head_offset = BLOCK_SIZE;
+        ESP_LOGW(TAG, "Failed to append record: %s", esp_err_to_name(result));
+    }
+    xSemaphoreGive(lock);
+    return result;
+}
+
+/**
+ * @brief Position a cursor at the oldest block that may hold records between start and end, inclusive
+ *
+ *  Records are appended while a cursor is open. Free the cursor with ts_log_cursor_free(). With static
+ *  allocation only one cursor can be open at a time.
+*/
+esp_err_t ts_log_seek(ts_log_cursor_t *cursor, uint64_t start, uint64_t end) {
+    if (!partition)
+        return ESP_ERR_INVALID_STATE;
+
+    *cursor = (ts_log_cursor_t) { .start = start, .end = end, .block = -1 };
+    xSemaphoreTake(lock, portMAX_DELAY);
+#if CONFIG_APP_STATIC_ALLOCATION
+    if (!block_buffer_used) {
+        cursor->buffer = block_buffer;
+        block_buffer_used = true;
+    }
+#else
+    cursor->buffer = malloc(BLOCK_SIZE);
+#endif
+    if (!cursor->buffer) {
+        xSemaphoreGive(lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    set_cursor_block(cursor, find_block(1));
+    xSemaphoreGive(lock);
+    return ESP_OK;
+}
+
+/**
+ * @brief Read the next records of the cursor's time range, oldest first
+ *
+ *  The log lock is only held while a block is buffered, so appends aren't held up by slow readers.
+ *  Records erased to make room for new ones before the cursor reaches them are skipped.
+ *
+ * @return Number of records read. 0 once all records of the range have been read
+*/
+size_t ts_log_read(ts_log_cursor_t *cursor, ts_log_record_t *records, size_t max_count) {
+    size_t count = 0;
+    while (count < max_count && cursor->block >= 0) {
+        if (!cursor->offset && !load_block(cursor))
+            break;
+
+        uint32_t next = decode_record(cursor->buffer, cursor->size, cursor->offset, &cursor->time, cursor->values);
+        if (!next) {
+            xSemaphoreTake(lock, portMAX_DELAY);
+            set_cursor_block(cursor, find_block(cursor->seq + 1));
+            xSemaphoreGive(lock);
+            continue;
+        }
+        cursor->offset = next;
+        if (cursor->time < cursor->start || cursor->time > cursor->end)
+            continue;
+
+        ts_log_record_t *record = &records[count++];
+        record->timestamp = cursor->time;
+        for (int i = 0; i < channel_count; i++)
+            record->values[i] = cursor->values[i] * resolution[i];
+    }
+    return count;
+}
+
+void ts_log_cursor_free(ts_log_cursor_t *cursor) {
+#if CONFIG_APP_STATIC_ALLOCATION
+    if (cursor->buffer) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        block_buffer_used = false;
+        xSemaphoreGive(lock);
+    }
+#else
+    free(cursor->buffer);
+#endif
+    cursor->buffer = NULL;
+    cursor->block = -1;
+}
+
+#if CONFIG_APP_STATIC_ALLOCATION
+/**
+ * @brief Get the size of the static block index and block buffer
+*/
+size_t ts_log_get_static_size() {
+    return sizeof(blocks) + sizeof(block_buffer) + sizeof(lock_buffer);
+}
+#endif
@@ -0,0 +1,47 @@
+/**! @file ts_log.h
+ * 
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TS_LOG_CHANNELS_MAX 4
+
+typedef struct {
+    uint64_t timestamp;     // ms since epoch
+    float values[TS_LOG_CHANNELS_MAX];
+} ts_log_record_t;
+
+/**
+ * @brief Read position of a time range query. Only valid between ts_log_seek() and ts_log_cursor_free()
+*/
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    int block;              // Block being read. -1 once past the newest block
+    uint32_t seq;           // Sequence number of the block being read
+    uint32_t offset;        // Next record in the buffered block. 0 if the block hasn't been buffered
+    uint32_t size;          // Bytes of the block buffered
+    uint64_t time;          // Timestamp of the last decoded record
+    int32_t values[TS_LOG_CHANNELS_MAX];    // Quantized values of the last decoded record
+    uint8_t *buffer;
+} ts_log_cursor_t;
+
+esp_err_t ts_log_init(uint8_t channel_count, const float *resolution);
+esp_err_t ts_log_append(uint64_t timestamp, const float *values);
+esp_err_t ts_log_seek(ts_log_cursor_t *cursor, uint64_t start, uint64_t end);
+size_t ts_log_read(ts_log_cursor_t *cursor, ts_log_record_t *records, size_t max_count);
+void ts_log_cursor_free(ts_log_cursor_t *cursor);
+#if CONFIG_APP_STATIC_ALLOCATION
+size_t ts_log_get_static_size();
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -3,6 +3,7 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
@@ -42,6 +43,9 @@
 
 /* FreeRTOS event group to signal when we are connected*/
 static EventGroupHandle_t s_wifi_event_group;
+#if CONFIG_APP_STATIC_ALLOCATION
+static StaticEventGroup_t s_wifi_event_group_buffer;
+#endif
 
 /* The event group allows multiple bits for each event, but we only care about two events:
  * - we are connected to the AP with an IP
@@ -52,7 +56,32 @@ static EventGroupHandle_t s_wifi_event_group;
 static const char *TAG = "wifi";
 
 static int s_retry_num = 0;
+static int s_backoff_step = 0;
+static bool s_retry_forever = false;   // Set by wifi_start(). Keep retrying with backoff instead of failing
+static bool s_connected = false;
+static esp_timer_handle_t s_retry_timer;
+static wifi_connected_callback_t s_connected_callback;
+static wifi_disconnected_callback_t s_disconnected_callback;
+
+static void retry_timer_callback(void *arg) {
+    ESP_LOGI(TAG, "retry to connect to the AP");
+    esp_wifi_connect();
+}
 
+/**
+ * @brief Schedule the next connection attempt after an exponentially increasing delay
+*/
+static void schedule_retry() {
+    uint32_t delay_s = CONFIG_WIFI_RETRY_BACKOFF_MIN << s_backoff_step;
+    if (delay_s >= CONFIG_WIFI_RETRY_BACKOFF_MAX)
+        delay_s = CONFIG_WIFI_RETRY_BACKOFF_MAX;
+    else
+        s_backoff_step++;
+
+    ESP_LOGI(TAG, "Retrying in %d s", delay_s);
+    esp_timer_stop(s_retry_timer);
+    esp_timer_start_once(s_retry_timer, (uint64_t)delay_s * 1000 * 1000);
+}
 
 static void event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
@@ -60,10 +89,18 @@ static void event_handler(void* arg, esp_event_base_t event_base,
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        if (s_connected) {
+            s_connected = false;
+            xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+            if (s_disconnected_callback)
+                s_disconnected_callback();
+        }
         if (s_retry_num < WIFI_MAXIMUM_RETRY) {
             esp_wifi_connect();
             s_retry_num++;
             ESP_LOGI(TAG, "retry to connect to the AP");
+        } else if (s_retry_forever) {
+            schedule_retry();
         } else {
             xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
         }
@@ -72,11 +109,18 @@ static void event_handler(void* arg, esp_event_base_t event_base,
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
         s_retry_num = 0;
+        s_backoff_step = 0;
+        s_connected = true;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        if (s_connected_callback)
+            s_connected_callback();
     }
 }
 
-esp_err_t wifi_connect() {
+/**
+ * @brief Initialize the station interface and start connecting. Returns without waiting for the connection
+*/
+static void wifi_init_sta() {
 
 #if DEBUG_WIFI
     esp_log_level_set(TAG, ESP_LOG_DEBUG);
@@ -84,7 +128,16 @@ esp_err_t wifi_connect() {
     esp_log_level_set(TAG, ESP_LOG_INFO);
 #endif
 
+#if CONFIG_APP_STATIC_ALLOCATION
+    s_wifi_event_group = xEventGroupCreateStatic(&s_wifi_event_group_buffer);
+#else
     s_wifi_event_group = xEventGroupCreate();
+#endif
+    esp_timer_create_args_t retry_timer_args = {
+        .callback = retry_timer_callback,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_timer_args, &s_retry_timer));
     ESP_ERROR_CHECK(esp_netif_init());
     esp_netif_create_default_wifi_sta();
 
@@ -114,13 +167,46 @@ esp_err_t wifi_connect() {
 	     * WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK standards.
              */
             .threshold.authmode = WIFI_SCAN_AUTH_MODE_THRESHOLD,
+#if CONFIG_POWER_MGMT_ENABLE
+            // Only wake the radio on every Nth DTIM beacon
+            .listen_interval = CONFIG_POWER_MGMT_LISTEN_INTERVAL,
+#endif
         },
     };
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
+#if CONFIG_POWER_MGMT_ENABLE
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MAX_MODEM));
+#endif
 
     ESP_LOGD(TAG, "Wifi Configured");
+}
+
+/**
+ * @brief Start connecting to the AP in the background and keep reconnecting for the rest of uptime
+ *
+ *  After WIFI_MAXIMUM_RETRY immediate retries, attempts back off exponentially from
+ *  WIFI_RETRY_BACKOFF_MIN to WIFI_RETRY_BACKOFF_MAX seconds. The callbacks are called from
+ *  the default event loop task each time the connection is established or lost.
+*/
+esp_err_t wifi_start(wifi_connected_callback_t connected_callback, wifi_disconnected_callback_t disconnected_callback) {
+    s_connected_callback = connected_callback;
+    s_disconnected_callback = disconnected_callback;
+    s_retry_forever = true;
+    wifi_init_sta();
+    return ESP_OK;
+}
+
+bool wifi_is_connected() {
+    return s_connected;
+}
+
+/**
+ * @brief Connect to the AP, blocking until connected or WIFI_MAXIMUM_RETRY attempts have failed
+*/
+esp_err_t wifi_connect() {
+    wifi_init_sta();
 
     /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
      * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
@@ -147,5 +233,10 @@ esp_err_t wifi_connect() {
 }
 
 esp_err_t wifi_disconnect() {
+    s_retry_forever = false;
+    s_connected_callback = NULL;
+    s_disconnected_callback = NULL;
+    if (s_retry_timer)
+        esp_timer_stop(s_retry_timer);
     return esp_wifi_stop() & esp_wifi_deinit();
 }
\ No newline at end of file
@@ -3,10 +3,18 @@
 */
 #pragma once
 
+#include <stdbool.h>
+#include "esp_err.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef void (*wifi_connected_callback_t)(void);
+typedef void (*wifi_disconnected_callback_t)(void);
+
+esp_err_t wifi_start(wifi_connected_callback_t connected_callback, wifi_disconnected_callback_t disconnected_callback);
+bool wifi_is_connected();
 esp_err_t wifi_connect();
 esp_err_t wifi_disconnect();
 
@@ -2,61 +2,319 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "nvs_flash.h"
 
 // Project Components
-#include "dht.h"
+#include "app_tasks.h"
 #include "mqtt_app.h"
+#include "mqtt_util.h"
 #include "esp_tahu.h"
+#include "sensor.h"
 #include "wifi.h"
 
 #if CONFIG_APP_IMPL_TEMP_CONTROLLER
 #include "temp_controller.h"
 #endif
 
+#if CONFIG_POWER_MGMT_ENABLE
+#include "power.h"
+#endif
+
+#if CONFIG_APP_IMPL_DEEP_SLEEP_BATCH
+#include "batch_node.h"
+#endif
+
+#if CONFIG_ROLLUP_ENABLE
+#include "rollup.h"
+#endif
+
+#if CONFIG_DERIVED_ENABLE
+#include "derived.h"
+#endif
+
+#if CONFIG_ALARM_ENABLE
+#include "alarm.h"
+#endif
+
+#if CONFIG_TS_LOG_ENABLE
+#include <sys/time.h>
+#include "esp_sntp.h"
+#include "ts_log.h"
+#endif
+
+#if CONFIG_BENCH_ENABLE
+#include "bench.h"
+#endif
+
+#if CONFIG_DLOG_ENABLE
+#include "dlog.h"
+#endif
+
+#if CONFIG_OTA_ENABLE
+#include "ota.h"
+#endif
+
 // Project Files
-// None
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+#include "tc_metrics.h"
+#endif
 
 #define DEBUG_APP 0
 
+#define LWT_TOPIC_MAX 64
+#define LWT_MSG_MAX 256
+
+#if CONFIG_ROLLUP_ENABLE
+typedef enum {
+    SP_ROLLUP_TEMPERATURE_SHORT,
+    SP_ROLLUP_HUMIDITY_SHORT,
+#if CONFIG_ROLLUP_LONG_PERIOD > 0
+    SP_ROLLUP_TEMPERATURE_LONG,
+    SP_ROLLUP_HUMIDITY_LONG,
+#endif
+    SP_ROLLUP_COUNT
+} sp_rollups_t;
+#define SP_ROLLUP_METRIC_COUNT (SP_ROLLUP_COUNT * ROLLUP_STAT_CNT)
+#else
+#define SP_ROLLUP_METRIC_COUNT 0
+#endif
+
+#if CONFIG_ALARM_ENABLE
+typedef enum {
+    SP_ALARM_TEMPERATURE_HIGH,
+    SP_ALARM_TEMPERATURE_LOW,
+    SP_ALARM_HUMIDITY_HIGH,
+    SP_ALARM_COUNT
+} sp_alarms_t;
+#define SP_ALARM_METRIC_COUNT (SP_ALARM_COUNT * ALARM_METRIC_CNT)
+#else
+#define SP_ALARM_METRIC_COUNT 0
+#endif
+
+#if CONFIG_TS_LOG_ENABLE
+typedef enum {
+    SP_HISTORY_START,
+    SP_HISTORY_END,
+    SP_HISTORY_REQUEST,
+    SP_HISTORY_METRIC_COUNT
+} sp_history_metrics_t;
+
+typedef enum {
+    TS_LOG_CHANNEL_TEMPERATURE,
+    TS_LOG_CHANNEL_HUMIDITY,
+    TS_LOG_CHANNEL_COUNT
+} ts_log_channel_t;
+#else
+#define SP_HISTORY_METRIC_COUNT 0
+#endif
+
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+#define SP_TC_METRIC_COUNT (TC_ZONE_COUNT * SP_ZONE_METRIC_COUNT)
+#define TC_ANALYTICS_PUBLISH_PERIOD_MS 60000
+#else
+#define SP_TC_METRIC_COUNT 0
+#endif
+
+// With a single sensor, its channels are the temperature and humidity metrics
+#define SP_CHANNEL_METRIC_COUNT (SENSOR_COUNT > 1 ? SENSOR_CHANNEL_COUNT : 0)
+
 typedef enum {
     SP_METRIC_DHT_TEMPERATURE,
     SP_METRIC_DHT_HUMIDITY,
-    SP_METRIC_TC_SETPOINT,
-    SP_METRIC_COUNT
+#if CONFIG_DERIVED_ENABLE
+    SP_METRIC_DHT_DEW_POINT,
+    SP_METRIC_DHT_HEAT_INDEX,
+    SP_METRIC_DHT_ABSOLUTE_HUMIDITY,
+#endif
+    SP_METRIC_DHT_CHANNEL,      // First of the SP_CHANNEL_METRIC_COUNT metrics with a value per sensor channel
+    SP_METRIC_DHT_ROLLUP = SP_METRIC_DHT_CHANNEL + SP_CHANNEL_METRIC_COUNT,    // First of the SP_ROLLUP_METRIC_COUNT rollup metrics of the DHT device
+    SP_METRIC_DHT_ALARM = SP_METRIC_DHT_ROLLUP + SP_ROLLUP_METRIC_COUNT,  // First of the SP_ALARM_METRIC_COUNT alarm metrics
+    SP_METRIC_DHT_HISTORY = SP_METRIC_DHT_ALARM + SP_ALARM_METRIC_COUNT,   // First of the SP_HISTORY_METRIC_COUNT backfill request metrics
+    SP_METRIC_TC_ZONE = SP_METRIC_DHT_HISTORY + SP_HISTORY_METRIC_COUNT,   // First of the SP_ZONE_METRIC_COUNT metrics of each zone
+    SP_METRIC_COUNT = SP_METRIC_TC_ZONE + SP_TC_METRIC_COUNT
 } sp_metrics_t;
 
+typedef enum {
+    SP_BOOT_PHASE_CONTROL_READY,
+    SP_BOOT_PHASE_WIFI_CONNECTED,
+    SP_BOOT_PHASE_MQTT_CONNECTED,
+    SP_BOOT_PHASE_BIRTH,
+    SP_BOOT_PHASE_COUNT
+} sp_boot_phase_t;
+
+#if CONFIG_DLOG_ENABLE
+typedef enum {
+    SP_LOG_LEVEL,
+    SP_LOG_DUMP,
+    SP_LOG_TEXT,
+    SP_LOG_METRIC_COUNT
+} sp_log_metrics_t;
+#else
+#define SP_LOG_METRIC_COUNT 0
+#endif
+
+#if CONFIG_OTA_ENABLE
+typedef enum {
+    SP_OTA_VERSION,
+    SP_OTA_URL,
+    SP_OTA_UPDATE,
+    SP_OTA_STATUS,
+    SP_OTA_METRIC_COUNT
+} sp_ota_metrics_t;
+#else
+#define SP_OTA_METRIC_COUNT 0
+#endif
+
+typedef enum {
+    SP_NODE_METRIC_ACK_RTT,
+    SP_NODE_METRIC_CONNECT_TIME,
+    SP_NODE_METRIC_CONNECT_COUNT,
+    SP_NODE_METRIC_SESSION_PRESENT,
+    SP_NODE_METRIC_BROKER,
+#if CONFIG_POWER_MGMT_ENABLE
+    SP_NODE_METRIC_AWAKE_TIME,
+#endif
+#if CONFIG_APP_IMPL_DEEP_SLEEP_BATCH
+    SP_NODE_METRIC_UPLOAD_WAKE_TIME,
+    SP_NODE_METRIC_SAMPLE_WAKE_TIME,
+#endif
+#if CONFIG_ALARM_ENABLE
+    SP_NODE_METRIC_ALARM_LATENCY,
+#endif
+    SP_NODE_METRIC_BOOT,        // First of the SP_BOOT_PHASE_COUNT boot phase times. Only published in the NBIRTH
+    SP_NODE_METRIC_LOG = SP_NODE_METRIC_BOOT + SP_BOOT_PHASE_COUNT,     // First of the SP_LOG_METRIC_COUNT log metrics. Only published in the NBIRTH and on request
+    SP_NODE_METRIC_OTA = SP_NODE_METRIC_LOG + SP_LOG_METRIC_COUNT,      // First of the SP_OTA_METRIC_COUNT OTA metrics. Only published in the NBIRTH and on request
+    SP_NODE_METRIC_COUNT = SP_NODE_METRIC_OTA + SP_OTA_METRIC_COUNT
+} sp_node_metrics_t;
+
 // Function Prototypes
 static char *get_wifi_mac_id();
 static void loop_panic_msg();
 static void shutdown_handler();
-static bool string_starts_with(char *prefix, char *str);
+static void boot_phase_record(sp_boot_phase_t phase);
+static void wifi_connect_handler();
+static void wifi_disconnect_handler();
 static void mqtt_update_lwt();
+static void mqtt_update_standby_lwt(mqtt_app_lwt_info_t *lwt_info);
+static void mqtt_set_connection_metrics();
 static void mqtt_connect_handler();
 static void mqtt_disconnect_handler();
 static void mqtt_data_handler(char *topic, int topic_len, char *data, int data_len);
+static bool mqtt_idle_handler();
+static void tahu_publish_data();
 static void tahu_data_publish_task();
+#if CONFIG_POWER_MGMT_ENABLE
+static void wake_window_task();
+#endif
 static void tahu_initialize();
+static void tahu_mqtt_start();
 static void tahu_build_metrics();
+static void sensor_set_metric(esp_tahu_metric_t *metric, sensor_channel_t channel);
+static void sensor_update_metrics();
+static void tahu_ncmd_next_server();
 static void tahu_ncmd_reboot();
 static void tahu_ncmd_rebirth();
-static void tc_setpoint_change();
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+static void tc_update_metrics();
+#endif
+#if CONFIG_APP_IMPL_DEEP_SLEEP_BATCH
+static void batch_upload_cycle();
+#endif
+#if CONFIG_APP_TASK_JITTER_STRESS
+static void jitter_stress_task();
+#endif
+#if CONFIG_DERIVED_ENABLE
+static void derived_build_metrics();
+static void derived_update_metrics();
+#endif
+#if CONFIG_ROLLUP_ENABLE
+static void rollup_build_metrics();
+static void rollup_sample_handler(float temperature, float humidity);
+static void rollup_publish_closed();
+#endif
+#if CONFIG_ALARM_ENABLE
+static void alarm_build_metrics();
+static void alarm_sample_handler(float temperature, float humidity);
+static void alarm_publish_task();
+#endif
+#if CONFIG_TS_LOG_ENABLE
+static void time_sync_handler(struct timeval *tv);
+static void history_build_metrics();
+static void history_sample_handler(float temperature, float humidity);
+static void history_request_change();
+static void history_backfill_task();
+#endif
+#if CONFIG_ROLLUP_ENABLE || CONFIG_ALARM_ENABLE || CONFIG_TS_LOG_ENABLE
+static void sensor_sample_handler(const sensor_sample_t *sample);
+#endif
+#if CONFIG_DLOG_ENABLE
+static void log_build_metrics();
+static void log_level_change();
+static void log_dump_change();
+#endif
+#if CONFIG_OTA_ENABLE
+static void ota_build_metrics();
+static void ota_update_change();
+static void ota_status_handler(const char *status);
+#endif
+#if CONFIG_APP_STATIC_ALLOCATION
+static void static_budget_report();
+#endif
 
 static const char *TAG = "app-main";
 static bool wifi_connected;
 static bool sp_initialized = false;
-static const int SP_METRIC_COUNT_DHT = 2;
-static const int SP_METRIC_COUNT_TC = 1;
-static esp_tahu_metric_t *sp_metrics;
+static const int SP_METRIC_COUNT_DHT = SP_METRIC_DHT_HISTORY + SP_HISTORY_METRIC_COUNT;
+static esp_tahu_metric_t sp_metrics[SP_METRIC_COUNT];
+static esp_tahu_metric_t sp_node_metrics[SP_NODE_METRIC_COUNT];
+static char lwt_topic[LWT_TOPIC_MAX];
+static char lwt_msg[LWT_MSG_MAX];
+static char standby_lwt_topic[LWT_TOPIC_MAX];
+static char standby_lwt_msg[LWT_MSG_MAX];
+static uint32_t boot_phase_time[SP_BOOT_PHASE_COUNT];     // ms since boot each phase was first reached. 0 if not yet
+static const char *boot_phase_name[SP_BOOT_PHASE_COUNT] = {
+    "Boot/Control Ready",
+    "Boot/WiFi Connected",
+    "Boot/MQTT Connected",
+    "Boot/Birth",
+};
+#if CONFIG_ROLLUP_ENABLE
+static rollup_t sp_rollups[SP_ROLLUP_COUNT];
+#endif
+#if CONFIG_DERIVED_ENABLE
+static derived_metric_t sp_derived[SP_METRIC_DHT_CHANNEL - SP_METRIC_DHT_DEW_POINT];
+#endif
+#if CONFIG_ALARM_ENABLE
+static alarm_t sp_alarms[SP_ALARM_COUNT];
+static TaskHandle_t alarm_task_handle;
+#endif
+#if CONFIG_TS_LOG_ENABLE
+static bool time_synced = false;
+static bool ts_log_ready = false;
+static uint64_t ts_log_last_time;
+static TaskHandle_t history_task_handle;
+static ts_log_record_t history_records[CONFIG_TS_LOG_BACKFILL_CHUNK];
+static esp_tahu_metric_t history_metrics[CONFIG_TS_LOG_BACKFILL_CHUNK * TS_LOG_CHANNEL_COUNT];
+#endif
+#if CONFIG_DLOG_ENABLE
+static char log_dump_text[CONFIG_DLOG_DUMP_SIZE];
+#endif
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+static char tc_device_id[TC_ZONE_COUNT][TC_DEVICE_ID_MAX];
+#if CONFIG_TC_ANALYTICS_ENABLE
+static int64_t tc_analytics_publish_time;
+#endif
+#endif
 
 static char *get_wifi_mac_id()
 {
+    static char id_string[8];
     uint8_t mac[6];
-    char *id_string = calloc(1, 32);
     esp_read_mac(mac, ESP_MAC_WIFI_STA);
-    sprintf(id_string, "%02X%02X%02X", mac[3], mac[4], mac[5]);
+    snprintf(id_string, sizeof(id_string), "%02X%02X%02X", mac[3], mac[4], mac[5]);
     return id_string;
 }
 
@@ -68,28 +326,88 @@ static void loop_panic_msg() {
 }
 
 static void shutdown_handler() {
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER && CONFIG_TC_ANALYTICS_ENABLE
+    // Planned restarts, such as NCMD reboots and OTA updates, keep the analytics since the last save
+    temp_controller_save();
+#endif
     mqtt_app_stop();
 
     if (wifi_connected)
         wifi_disconnect();
 }
 
-static bool string_starts_with(char *prefix, char *str) {
-    return strncmp(prefix, str, strlen(prefix)) == 0;
+/**
+ * @brief Record the time since boot at which a boot phase was first reached
+*/
+static void boot_phase_record(sp_boot_phase_t phase) {
+    if (!boot_phase_time[phase])
+        boot_phase_time[phase] = esp_timer_get_time() / 1000;
+}
+
+static void wifi_connect_handler() {
+    wifi_connected = true;
+    boot_phase_record(SP_BOOT_PHASE_WIFI_CONNECTED);
+#if CONFIG_TS_LOG_ENABLE
+    // Logged samples need wall clock timestamps. SNTP keeps polling for the rest of uptime
+    if (!sntp_enabled()) {
+        sntp_setoperatingmode(SNTP_OPMODE_POLL);
+        sntp_setservername(0, CONFIG_TS_LOG_SNTP_SERVER);
+        sntp_set_time_sync_notification_cb(time_sync_handler);
+        sntp_init();
+    }
+#endif
+    mqtt_app_start();
 }
 
+static void wifi_disconnect_handler() {
+    wifi_connected = false;
+}
+
+/**
+ * @brief Reserve a bdSeq for the NDEATH registered as the LWT of the next connection
+ *
+ *  The client copies the LWT when it connects, so the buffers are reused for every connection.
+*/
 static void mqtt_update_lwt() {
     mqtt_app_lwt_info_t lwt_info = {
-            .topic = (char *)malloc(sizeof(char) * 64),
-            .msg = (char *)malloc(sizeof(char) * 256),
+            .topic = lwt_topic,
+            .msg = lwt_msg,
             .msg_len = 0,
     };
-    esp_tahu_get_lwt_data(lwt_info.topic, lwt_info.msg, 256, &lwt_info.msg_len);
+    lwt_info.id = esp_tahu_get_lwt_data(lwt_topic, lwt_msg, sizeof(lwt_msg), &lwt_info.msg_len);
     mqtt_app_lwt_info = lwt_info;
 }
 
+/**
+ * @brief Reserve a bdSeq for the NDEATH registered by the warm standby connection
+*/
+static void mqtt_update_standby_lwt(mqtt_app_lwt_info_t *lwt_info) {
+    lwt_info->topic = standby_lwt_topic;
+    lwt_info->msg = standby_lwt_msg;
+    lwt_info->id = esp_tahu_get_standby_lwt_data(standby_lwt_topic, standby_lwt_msg, sizeof(standby_lwt_msg), &lwt_info->msg_len);
+}
+
+/**
+ * @brief Set the connection cost metrics of the last MQTT connection
+*/
+static void mqtt_set_connection_metrics() {
+    uint32_t connect_time = mqtt_app_get_connect_time_ms();
+    uint32_t connect_count = mqtt_app_get_connect_count();
+    bool session_present = mqtt_app_session_present();
+    esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_CONNECT_TIME, false, (void *) &connect_time);
+    esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_CONNECT_COUNT, false, (void *) &connect_count);
+    esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_SESSION_PRESENT, false, (void *) &session_present);
+    esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_BROKER, false, (void *) mqtt_app_get_broker_uri());
+}
+
 static void mqtt_connect_handler() {
-    tahu_initialize();
+    boot_phase_record(SP_BOOT_PHASE_MQTT_CONNECTED);
+    // A promoted standby continues the session under its own LWT
+    esp_tahu_set_session_bdseq(mqtt_app_get_lwt_id());
+    // With a primary host configured, the node births once the host STATE reports online
+    esp_tahu_connected(mqtt_app_session_present());
+    if (esp_tahu_host_online())
+        tahu_initialize();
 }
 
 static void mqtt_disconnect_handler() {
@@ -98,47 +416,145 @@ static void mqtt_disconnect_handler() {
 }
 
 static void mqtt_data_handler(char *topic, int topic_len, char *data, int data_len) {
-    if (string_starts_with("spBv1.0", topic)) {
-        esp_err_t result = esp_tahu_data_received(data, data_len, sp_metrics, SP_METRIC_COUNT);
-        if(result != ESP_OK)
-            ESP_LOGW(TAG, "Error interpreting command from topic: %.*s", topic_len, topic);
+    esp_err_t result = esp_tahu_message_received(topic, topic_len, data, data_len);
+    if(result != ESP_OK)
+        ESP_LOGW(TAG, "Error interpreting message from topic: %.*s", topic_len, topic);
+}
+
+static bool mqtt_idle_handler() {
+    return esp_tahu_apply_pending();
+}
+
+static void tahu_publish_data() {
+#if CONFIG_ROLLUP_ENABLE
+    rollup_publish_closed();
+#endif
+
+    if(!mqtt_app_connected || !sp_initialized)
+        return;
+
+#if !CONFIG_ROLLUP_ENABLE || CONFIG_ROLLUP_PUBLISH_RAW
+    sensor_update_metrics();
+
+    esp_tahu_publish_ddata(sp_metrics, SP_METRIC_DHT_ROLLUP);
+#endif
+
+    uint32_t ack_rtt = mqtt_app_get_ack_rtt_ms();
+    esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_ACK_RTT, false, (void *) &ack_rtt);
+#if CONFIG_POWER_MGMT_ENABLE
+    uint32_t awake_time = power_get_awake_ms_per_hour();
+    esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_AWAKE_TIME, false, (void *) &awake_time);
+#endif
+    esp_tahu_publish_ndata(sp_node_metrics, SP_NODE_METRIC_BOOT);
+
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+    // Analytics change slowly. They are only published every TC_ANALYTICS_PUBLISH_PERIOD_MS
+    int tc_publish_count = SP_ZONE_COOLING + 1 - SP_ZONE_TEMPERATURE;
+#if CONFIG_TC_ANALYTICS_ENABLE
+    int64_t now = esp_timer_get_time();
+    if (now - tc_analytics_publish_time >= TC_ANALYTICS_PUBLISH_PERIOD_MS * 1000LL) {
+        tc_publish_count = SP_ZONE_METRIC_COUNT - SP_ZONE_TEMPERATURE;
+        tc_analytics_publish_time = now;
     }
+#endif
+    tc_update_metrics();
+    for(int i = 0; i < TC_ZONE_COUNT; i++)
+        esp_tahu_publish_ddata(sp_metrics + SP_METRIC_TC_ZONE + i * SP_ZONE_METRIC_COUNT + SP_ZONE_TEMPERATURE, tc_publish_count);
+#endif
 }
 
 static void tahu_data_publish_task() {
     for ( ;; ) {
         vTaskDelay(pdMS_TO_TICKS(3000));
-        if(mqtt_app_connected) {
-            if(!sp_initialized)
-                continue;
+        mqtt_app_inflight_sweep();
+        esp_tahu_service();
+        tahu_publish_data();
+    }
+}
 
-            esp_tahu_set_metric_data(sp_metrics + SP_METRIC_DHT_TEMPERATURE, false, (void *) &dht_get_data()->temperature);
-            esp_tahu_set_metric_data(sp_metrics + SP_METRIC_DHT_HUMIDITY, false, (void *) &dht_get_data()->humidity);
+#if CONFIG_POWER_MGMT_ENABLE
+/**
+ * @brief Align sensor read, control evaluation and publishing into a single wake window
+ *
+ *  The CPU is allowed to scale down and enter light sleep between windows.
+*/
+static void wake_window_task() {
+    TickType_t last_wake_time = xTaskGetTickCount();
+    for ( ;; ) {
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(CONFIG_POWER_MGMT_WAKE_PERIOD));
+        power_wake_window_begin();
 
-            esp_tahu_publish_ddata(sp_metrics, SP_METRIC_COUNT_DHT);
-        }
+        esp_err_t read_result = sensor_read();
+        if (read_result != ESP_OK)
+            ESP_LOGD(TAG, "Sensor read failed: %s", esp_err_to_name(read_result));
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+        temp_controller_evaluate();
+#endif
+        esp_tahu_service();
+        tahu_publish_data();
+
+        power_wake_window_end();
     }
 }
+#endif
 
 static void tahu_initialize() {
-    esp_tahu_init_node();
+#if CONFIG_APP_IMPL_DEEP_SLEEP_BATCH
+    uint32_t upload_wake_time = batch_node_get_last_upload_wake_ms();
+    uint32_t sample_wake_time = batch_node_get_last_sample_wake_ms();
+    esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_UPLOAD_WAKE_TIME, false, (void *) &upload_wake_time);
+    esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_SAMPLE_WAKE_TIME, false, (void *) &sample_wake_time);
+#endif
+    boot_phase_record(SP_BOOT_PHASE_BIRTH);
+    mqtt_set_connection_metrics();
+    for(int i = 0; i < SP_BOOT_PHASE_COUNT; i++)
+        esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_BOOT + i, false, (void *) &boot_phase_time[i]);
+    esp_tahu_init_node(sp_node_metrics, SP_NODE_METRIC_COUNT);
+
+    // Birth with the latest sensor values rather than the values of the last publish
+    sensor_update_metrics();
     esp_tahu_init_device(CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, sp_metrics, SP_METRIC_COUNT_DHT);
 
-    if(CONFIG_APP_IMPL_TEMP_CONTROLLER)
-        esp_tahu_init_device(CONFIG_APP_SPARKPLUG_DEVICE_ID_TEMP_CONTROLLER, sp_metrics+SP_METRIC_COUNT_DHT, 
-                        SP_METRIC_COUNT_TC);
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+    tc_update_metrics();
+    for(int i = 0; i < TC_ZONE_COUNT; i++)
+        esp_tahu_init_device(tc_device_id[i], sp_metrics + SP_METRIC_TC_ZONE + i * SP_ZONE_METRIC_COUNT, SP_ZONE_METRIC_COUNT);
+#endif
+#if CONFIG_APP_STATIC_ALLOCATION
+    // Births are the largest payloads built
+    ESP_LOGI(TAG, "Payload heap peak: %d of %d bytes", esp_tahu_get_heap_peak(), CONFIG_SPARKPLUG_HEAP_SIZE);
+#endif
     sp_initialized = true;
+#if CONFIG_OTA_ENABLE
+    // Reaching BIRTH is what makes a new image good. Cancels its rollback
+    ota_confirm();
+#endif
 }
 
-static void tahu_build_metrics() {
-    int active_metric_count = 0;
-    if(!CONFIG_APP_IMPL_TEMP_CONTROLLER)
-        active_metric_count = SP_METRIC_COUNT_DHT;
-    else
-        active_metric_count = SP_METRIC_COUNT;
+/**
+ * @brief Configure Sparkplug and the MQTT client. The client connects once mqtt_app_start() is called
+ * and Sparkplug is initialized once it has connected
+*/
+static void tahu_mqtt_start() {
+    // Configure sparkplug and get LWT info
+    esp_tahu_configure(get_wifi_mac_id());
+    mqtt_update_lwt();
+    esp_tahu_register_next_server_callback_handler(tahu_ncmd_next_server);
+    esp_tahu_register_rebirth_callback_handler(tahu_ncmd_rebirth);
+    esp_tahu_register_reboot_callback_handler(tahu_ncmd_reboot);
+    tahu_build_metrics();
 
-    sp_metrics = (esp_tahu_metric_t *) malloc(sizeof(esp_tahu_metric_t) * active_metric_count);
-    for(int i = 0; i < SP_METRIC_COUNT_DHT; i++) {
+    // Connect MQTT client
+    mqtt_app_connected_callback_register(mqtt_connect_handler);
+    mqtt_app_disconnected_callback_register(mqtt_disconnect_handler);
+    mqtt_app_standby_lwt_callback_register(mqtt_update_standby_lwt);
+    mqtt_app_data_callback_register(mqtt_data_handler);
+    mqtt_app_idle_callback_register(mqtt_idle_handler);
+    mqtt_app_init();
+}
+
+static void tahu_build_metrics() {
+    for(int i = 0; i < SP_METRIC_DHT_CHANNEL; i++) {
         esp_tahu_metric_t new_metric = { 0 };
         switch((sp_metrics_t)i) {
             case SP_METRIC_DHT_TEMPERATURE:
@@ -147,26 +563,130 @@ static void tahu_build_metrics() {
             case SP_METRIC_DHT_HUMIDITY:
                 esp_tahu_create_metric(CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, &new_metric, "humidity", ESP_TAHU_METRIC_TYPE_FLOAT, NULL);
                 break;
+#if CONFIG_DERIVED_ENABLE
+            case SP_METRIC_DHT_DEW_POINT:
+                esp_tahu_create_metric(CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, &new_metric, "dew_point", ESP_TAHU_METRIC_TYPE_FLOAT, NULL);
+                break;
+            case SP_METRIC_DHT_HEAT_INDEX:
+                esp_tahu_create_metric(CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, &new_metric, "heat_index", ESP_TAHU_METRIC_TYPE_FLOAT, NULL);
+                break;
+            case SP_METRIC_DHT_ABSOLUTE_HUMIDITY:
+                esp_tahu_create_metric(CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, &new_metric, "absolute_humidity", ESP_TAHU_METRIC_TYPE_FLOAT, NULL);
+                break;
+#endif
             default:
                 ESP_LOGW(TAG, "Undefined metric. Index: %d", i);
                 break;
         }
         memcpy(sp_metrics+i, &new_metric, sizeof(new_metric));
     }
-    if(CONFIG_APP_IMPL_TEMP_CONTROLLER) {
-        for(int i = SP_METRIC_COUNT_DHT; i < SP_METRIC_COUNT; i++) {
-            esp_tahu_metric_t new_metric = { 0 };
-            switch((sp_metrics_t)i) {
-                case SP_METRIC_TC_SETPOINT:
-                    esp_tahu_create_metric(CONFIG_APP_SPARKPLUG_DEVICE_ID_TEMP_CONTROLLER, &new_metric, "setpoint", ESP_TAHU_METRIC_TYPE_FLOAT, tc_setpoint_change);
-                    break;
-                default:
-                    ESP_LOGW(TAG, "Undefined metric. Index: %d", i);
-                    break;
-            }
-            memcpy(sp_metrics+i, &new_metric, sizeof(new_metric));
+    for(int i = 0; i < SP_CHANNEL_METRIC_COUNT; i++) {
+        esp_tahu_metric_t new_metric = { 0 };
+        esp_tahu_create_metric(CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, &new_metric, (char *) sensor_get_channel_name(i), ESP_TAHU_METRIC_TYPE_FLOAT, NULL);
+        memcpy(sp_metrics + SP_METRIC_DHT_CHANNEL + i, &new_metric, sizeof(new_metric));
+    }
+#if CONFIG_DERIVED_ENABLE
+    derived_build_metrics();
+#endif
+#if CONFIG_ROLLUP_ENABLE
+    rollup_build_metrics();
+#endif
+#if CONFIG_ALARM_ENABLE
+    alarm_build_metrics();
+#endif
+#if CONFIG_TS_LOG_ENABLE
+    history_build_metrics();
+#endif
+#if CONFIG_ROLLUP_ENABLE || CONFIG_ALARM_ENABLE || CONFIG_TS_LOG_ENABLE
+    sensor_register_sample_callback(sensor_sample_handler);
+#endif
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+    tc_metrics_build(sp_metrics + SP_METRIC_TC_ZONE, tc_device_id);
+#endif
+
+    for(int i = 0; i < SP_NODE_METRIC_BOOT; i++) {
+        esp_tahu_metric_t new_metric = { 0 };
+        switch((sp_node_metrics_t)i) {
+            case SP_NODE_METRIC_ACK_RTT:
+                esp_tahu_create_metric(NULL, &new_metric, "MQTT/Ack RTT", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                break;
+            case SP_NODE_METRIC_CONNECT_TIME:
+                esp_tahu_create_metric(NULL, &new_metric, "MQTT/Connect Time", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                break;
+            case SP_NODE_METRIC_CONNECT_COUNT:
+                esp_tahu_create_metric(NULL, &new_metric, "MQTT/Connect Count", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                break;
+            case SP_NODE_METRIC_SESSION_PRESENT:
+                esp_tahu_create_metric(NULL, &new_metric, "MQTT/Session Present", ESP_TAHU_METRIC_TYPE_BOOLEAN, NULL);
+                break;
+            case SP_NODE_METRIC_BROKER:
+                esp_tahu_create_metric(NULL, &new_metric, "MQTT/Broker", ESP_TAHU_METRIC_TYPE_STRING, NULL);
+                break;
+#if CONFIG_POWER_MGMT_ENABLE
+            case SP_NODE_METRIC_AWAKE_TIME:
+                esp_tahu_create_metric(NULL, &new_metric, "Power/Awake Time Per Hour", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                break;
+#endif
+#if CONFIG_APP_IMPL_DEEP_SLEEP_BATCH
+            case SP_NODE_METRIC_UPLOAD_WAKE_TIME:
+                esp_tahu_create_metric(NULL, &new_metric, "Batch/Upload Wake Time", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                break;
+            case SP_NODE_METRIC_SAMPLE_WAKE_TIME:
+                esp_tahu_create_metric(NULL, &new_metric, "Batch/Sample Wake Time", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                break;
+#endif
+#if CONFIG_ALARM_ENABLE
+            case SP_NODE_METRIC_ALARM_LATENCY:
+                esp_tahu_create_metric(NULL, &new_metric, "Alarms/Publish Latency", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                break;
+#endif
+            default:
+                ESP_LOGW(TAG, "Undefined node metric. Index: %d", i);
+                break;
         }
+        memcpy(sp_node_metrics+i, &new_metric, sizeof(new_metric));
     }
+    for(int i = 0; i < SP_BOOT_PHASE_COUNT; i++) {
+        esp_tahu_metric_t new_metric = { 0 };
+        esp_tahu_create_metric(NULL, &new_metric, (char *) boot_phase_name[i], ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+        memcpy(sp_node_metrics + SP_NODE_METRIC_BOOT + i, &new_metric, sizeof(new_metric));
+    }
+#if CONFIG_DLOG_ENABLE
+    log_build_metrics();
+#endif
+#if CONFIG_OTA_ENABLE
+    ota_build_metrics();
+#endif
+}
+
+/**
+ * @brief Set a metric to the latest value of a sensor channel, or to null until the channel is first collected
+*/
+static void sensor_set_metric(esp_tahu_metric_t *metric, sensor_channel_t channel) {
+    float value = sensor_get_value(channel);
+    if (sensor_has_value(channel))
+        esp_tahu_set_metric_data(metric, false, (void *) &value);
+    else
+        metric->is_null = true;
+}
+
+/**
+ * @brief Set the sensor metrics of the DHT device to the latest sample
+*/
+static void sensor_update_metrics() {
+    sensor_set_metric(sp_metrics + SP_METRIC_DHT_TEMPERATURE, SENSOR_CHANNEL_TEMPERATURE);
+    sensor_set_metric(sp_metrics + SP_METRIC_DHT_HUMIDITY, SENSOR_CHANNEL_HUMIDITY);
+    for(int i = 0; i < SP_CHANNEL_METRIC_COUNT; i++)
+        sensor_set_metric(sp_metrics + SP_METRIC_DHT_CHANNEL + i, i);
+#if CONFIG_DERIVED_ENABLE
+    derived_update_metrics();
+#endif
+}
+
+static void tahu_ncmd_next_server() {
+    // The broker doesn't deliver the LWT on an intentional disconnect
+    esp_tahu_deinit_node();
+    mqtt_app_next_server();
 }
 
 static void tahu_ncmd_reboot() {
@@ -174,16 +694,575 @@ static void tahu_ncmd_reboot() {
 }
 
 static void tahu_ncmd_rebirth() {
+    // The registered LWT is unchanged, so the rebirth keeps the bdSeq of the current session
     sp_initialized = false;
-    mqtt_update_lwt();
     tahu_initialize();
+}
+
+#if CONFIG_DERIVED_ENABLE
+static void derived_build_metrics() {
+    esp_tahu_metric_t *inputs[] = { sp_metrics + SP_METRIC_DHT_TEMPERATURE, sp_metrics + SP_METRIC_DHT_HUMIDITY };
+    for(int i = SP_METRIC_DHT_DEW_POINT; i < SP_METRIC_DHT_CHANNEL; i++) {
+        derived_formula_t formula = NULL;
+        switch((sp_metrics_t)i) {
+            case SP_METRIC_DHT_DEW_POINT:
+                formula = derived_dew_point;
+                break;
+            case SP_METRIC_DHT_HEAT_INDEX:
+                formula = derived_heat_index;
+                break;
+            case SP_METRIC_DHT_ABSOLUTE_HUMIDITY:
+                formula = derived_absolute_humidity;
+                break;
+            default:
+                ESP_LOGW(TAG, "Undefined derived metric. Index: %d", i);
+                break;
+        }
+        derived_init(sp_derived + i - SP_METRIC_DHT_DEW_POINT, sp_metrics + i, formula, inputs, 2);
+    }
+}
+
+/**
+ * @brief Recompute the derived metrics whose temperature or humidity input changed
+*/
+static void derived_update_metrics() {
+    for(int i = 0; i < SP_METRIC_DHT_CHANNEL - SP_METRIC_DHT_DEW_POINT; i++)
+        derived_update(sp_derived + i);
+}
+#endif
+
+#if CONFIG_ROLLUP_ENABLE
+static void rollup_build_metrics() {
+    for(int i = 0; i < SP_ROLLUP_COUNT; i++) {
+        esp_tahu_metric_t *metric_buffer = sp_metrics + SP_METRIC_DHT_ROLLUP + i * ROLLUP_STAT_CNT;
+        switch((sp_rollups_t)i) {
+            case SP_ROLLUP_TEMPERATURE_SHORT:
+                rollup_init(sp_rollups + i, CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, "temperature", CONFIG_ROLLUP_SHORT_PERIOD, metric_buffer);
+                break;
+            case SP_ROLLUP_HUMIDITY_SHORT:
+                rollup_init(sp_rollups + i, CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, "humidity", CONFIG_ROLLUP_SHORT_PERIOD, metric_buffer);
+                break;
+#if CONFIG_ROLLUP_LONG_PERIOD > 0
+            case SP_ROLLUP_TEMPERATURE_LONG:
+                rollup_init(sp_rollups + i, CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, "temperature", CONFIG_ROLLUP_LONG_PERIOD, metric_buffer);
+                break;
+            case SP_ROLLUP_HUMIDITY_LONG:
+                rollup_init(sp_rollups + i, CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, "humidity", CONFIG_ROLLUP_LONG_PERIOD, metric_buffer);
+                break;
+#endif
+            default:
+                ESP_LOGW(TAG, "Undefined rollup. Index: %d", i);
+                break;
+        }
+    }
+}
+
+static void rollup_sample_handler(float temperature, float humidity) {
+    for(int i = 0; i < SP_ROLLUP_COUNT; i++) {
+        bool is_humidity = i == SP_ROLLUP_HUMIDITY_SHORT;
+#if CONFIG_ROLLUP_LONG_PERIOD > 0
+        is_humidity |= i == SP_ROLLUP_HUMIDITY_LONG;
+#endif
+        rollup_add_sample(sp_rollups + i, is_humidity ? humidity : temperature);
+    }
+}
+
+/**
+ * @brief Publish the aggregates of all rollup windows that closed since the last call in a single DDATA
+ *
+ *  Windows are closed while offline too, so a window never aggregates samples of a later period.
+*/
+static void rollup_publish_closed() {
+    esp_tahu_metric_t closed_metrics[SP_ROLLUP_METRIC_COUNT];
+    size_t closed_count = 0;
+    for(int i = 0; i < SP_ROLLUP_COUNT; i++) {
+        if (!rollup_close_due(sp_rollups + i))
+            continue;
+        memcpy(closed_metrics + closed_count, sp_rollups[i].metrics, sizeof(esp_tahu_metric_t) * ROLLUP_STAT_CNT);
+        closed_count += ROLLUP_STAT_CNT;
+    }
+
+    if (closed_count > 0 && mqtt_app_connected && sp_initialized)
+        esp_tahu_publish_ddata(closed_metrics, closed_count);
+}
+#endif
+
+#if CONFIG_ALARM_ENABLE
+static void alarm_build_metrics() {
+    alarm_rule_t rule = {
+        .deadband = CONFIG_ALARM_DEADBAND,
+        .delay_on_ms = CONFIG_ALARM_DELAY_ON,
+        .delay_off_ms = CONFIG_ALARM_DELAY_OFF,
+        .enabled = true,
+    };
+    for(int i = 0; i < SP_ALARM_COUNT; i++) {
+        esp_tahu_metric_t *metric_buffer = sp_metrics + SP_METRIC_DHT_ALARM + i * ALARM_METRIC_CNT;
+        switch((sp_alarms_t)i) {
+            case SP_ALARM_TEMPERATURE_HIGH:
+                rule.setpoint = CONFIG_ALARM_TEMPERATURE_HIGH;
+                alarm_init(sp_alarms + i, CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, "Alarms/Temperature High", "temp_high",
+                                ALARM_DIRECTION_HIGH, &rule, metric_buffer);
+                break;
+            case SP_ALARM_TEMPERATURE_LOW:
+                rule.setpoint = CONFIG_ALARM_TEMPERATURE_LOW;
+                alarm_init(sp_alarms + i, CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, "Alarms/Temperature Low", "temp_low",
+                                ALARM_DIRECTION_LOW, &rule, metric_buffer);
+                break;
+            case SP_ALARM_HUMIDITY_HIGH:
+                rule.setpoint = CONFIG_ALARM_HUMIDITY_HIGH;
+                alarm_init(sp_alarms + i, CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, "Alarms/Humidity High", "hum_high",
+                                ALARM_DIRECTION_HIGH, &rule, metric_buffer);
+                break;
+            default:
+                ESP_LOGW(TAG, "Undefined alarm. Index: %d", i);
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Evaluate all alarm rules against a new sample and wake the alarm publish task on any state change
+*/
+static void alarm_sample_handler(float temperature, float humidity) {
+    bool changed = false;
+    for(int i = 0; i < SP_ALARM_COUNT; i++)
+        changed |= alarm_evaluate(sp_alarms + i, i == SP_ALARM_HUMIDITY_HIGH ? humidity : temperature);
+
+    if (changed && alarm_task_handle)
+        xTaskNotifyGive(alarm_task_handle);
+}
+
+/**
+ * @brief Publish alarm state changes as soon as they are detected, ahead of the periodic data publish
+ *
+ *  Changes detected while offline are not queued. The current alarm states are part of the next DBIRTH.
+ *  The time from detection of the earliest change to its publish is reported as a node metric.
+*/
+static void alarm_publish_task() {
+    for ( ;; ) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        esp_tahu_metric_t changed_metrics[SP_ALARM_COUNT];
+        size_t changed_count = 0;
+        int64_t detection_time = 0;
+        for(int i = 0; i < SP_ALARM_COUNT; i++) {
+            int64_t alarm_detection_time;
+            if (!alarm_take_pending(sp_alarms + i, &alarm_detection_time))
+                continue;
+            changed_metrics[changed_count++] = sp_alarms[i].metrics[ALARM_METRIC_ACTIVE];
+            if (!detection_time || alarm_detection_time < detection_time)
+                detection_time = alarm_detection_time;
+        }
+
+        if(!changed_count || !mqtt_app_connected || !sp_initialized)
+            continue;
+
+        esp_tahu_publish_alarm(changed_metrics, changed_count);
+        uint32_t latency = esp_timer_get_time() - detection_time;
+        esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_ALARM_LATENCY, false, (void *) &latency);
+        ESP_LOGI(TAG, "Published %d alarm changes. Detection to publish: %d us", changed_count, latency);
+    }
+}
+#endif
+
+#if CONFIG_TS_LOG_ENABLE
+static void time_sync_handler(struct timeval *tv) {
+    time_synced = true;
+}
+
+static void history_build_metrics() {
+    for(int i = 0; i < SP_HISTORY_METRIC_COUNT; i++) {
+        esp_tahu_metric_t new_metric = { 0 };
+        switch((sp_history_metrics_t)i) {
+            case SP_HISTORY_START:
+                esp_tahu_create_metric(CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, &new_metric, "History/Start", ESP_TAHU_METRIC_TYPE_DATETIME, NULL);
+                break;
+            case SP_HISTORY_END:
+                esp_tahu_create_metric(CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, &new_metric, "History/End", ESP_TAHU_METRIC_TYPE_DATETIME, NULL);
+                break;
+            case SP_HISTORY_REQUEST:
+                esp_tahu_create_metric(CONFIG_APP_SPARKPLUG_DEVICE_ID_DHT, &new_metric, "History/Request", ESP_TAHU_METRIC_TYPE_BOOLEAN, history_request_change);
+                break;
+            default:
+                ESP_LOGW(TAG, "Undefined history metric. Index: %d", i);
+                break;
+        }
+        memcpy(sp_metrics + SP_METRIC_DHT_HISTORY + i, &new_metric, sizeof(new_metric));
+    }
+}
+
+/**
+ * @brief Log a sample to flash every CONFIG_TS_LOG_INTERVAL seconds, once the clock has been synchronized
+*/
+static void history_sample_handler(float temperature, float humidity) {
+    if (!ts_log_ready || !time_synced)
+        return;
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    uint64_t now = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    if (ts_log_last_time && now >= ts_log_last_time && now - ts_log_last_time < CONFIG_TS_LOG_INTERVAL * 1000ULL)
+        return;
+
+    float values[TS_LOG_CHANNEL_COUNT] = {
+        [TS_LOG_CHANNEL_TEMPERATURE] = temperature,
+        [TS_LOG_CHANNEL_HUMIDITY] = humidity,
+    };
+    if (ts_log_append(now, values) == ESP_OK)
+        ts_log_last_time = now;
+}
+
+static void history_request_change(bool *new_value) {
+    if (*new_value && history_task_handle)
+        xTaskNotifyGive(history_task_handle);
+}
+
+/**
+ * @brief Republish the logged samples between History/Start and History/End as historical DDATA
+ *
+ *  Triggered by a DCMD setting History/Request, which is cleared once the backfill completes.
+ *  Payloads are spaced by CONFIG_TS_LOG_BACKFILL_INTERVAL so a backfill doesn't crowd out live data.
+ *  A backfill interrupted by a disconnect is abandoned and must be requested again.
+*/
+static void history_backfill_task() {
+    ts_log_record_t *records = history_records;
+    esp_tahu_metric_t *history = history_metrics;
+    esp_tahu_metric_t *channel_metrics[TS_LOG_CHANNEL_COUNT] = {
+        [TS_LOG_CHANNEL_TEMPERATURE] = sp_metrics + SP_METRIC_DHT_TEMPERATURE,
+        [TS_LOG_CHANNEL_HUMIDITY] = sp_metrics + SP_METRIC_DHT_HUMIDITY,
+    };
+
+    for ( ;; ) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        esp_tahu_metric_t *request_metrics = sp_metrics + SP_METRIC_DHT_HISTORY;
+        uint64_t start = *(uint64_t *) esp_tahu_get_metric_data(request_metrics + SP_HISTORY_START);
+        uint64_t end = *(uint64_t *) esp_tahu_get_metric_data(request_metrics + SP_HISTORY_END);
+        ts_log_cursor_t cursor;
+        if (ts_log_seek(&cursor, start, end) != ESP_OK) {
+            ESP_LOGW(TAG, "Time-series log unavailable. Backfill request ignored");
+            continue;
+        }
+
+        ESP_LOGI(TAG, "Backfilling history from %llu to %llu", start, end);
+        uint32_t sent = 0;
+        size_t count;
+        while ((count = ts_log_read(&cursor, records, CONFIG_TS_LOG_BACKFILL_CHUNK)) > 0) {
+            if (!mqtt_app_connected || !sp_initialized)
+                break;
+
+            size_t metrics_count = 0;
+            for (int i = 0; i < count; i++) {
+                for (int channel = 0; channel < TS_LOG_CHANNEL_COUNT; channel++) {
+                    esp_tahu_metric_t *metric = history + metrics_count++;
+                    *metric = *channel_metrics[channel];
+                    esp_tahu_set_metric_data(metric, false, &records[i].values[channel]);
+                    metric->is_historical = true;
+                    metric->timestamp = records[i].timestamp;
+                }
+            }
+            esp_tahu_publish_ddata(history, metrics_count);
+            sent += count;
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_TS_LOG_BACKFILL_INTERVAL));
+        }
+        ts_log_cursor_free(&cursor);
+        ESP_LOGI(TAG, "Backfilled %d samples", sent);
+
+        bool request = false;
+        esp_tahu_set_metric_data(request_metrics + SP_HISTORY_REQUEST, false, &request);
+        if (mqtt_app_connected && sp_initialized)
+            esp_tahu_publish_ddata(request_metrics + SP_HISTORY_REQUEST, 1);
+    }
+}
+#endif
+
+#if CONFIG_ROLLUP_ENABLE || CONFIG_ALARM_ENABLE || CONFIG_TS_LOG_ENABLE
+/**
+ * @brief Feed the primary temperature and humidity to rollups, alarms and history. Rounds that
+ * didn't collect both, such as those between DHT reads, are skipped so no sample is counted twice
+*/
+static void sensor_sample_handler(const sensor_sample_t *sample) {
+    uint32_t required = SENSOR_CHANNEL_BIT(SENSOR_CHANNEL_TEMPERATURE) | SENSOR_CHANNEL_BIT(SENSOR_CHANNEL_HUMIDITY);
+    if ((sample->updated & required) != required)
+        return;
+
+    float temperature = sample->value[SENSOR_CHANNEL_TEMPERATURE];
+    float humidity = sample->value[SENSOR_CHANNEL_HUMIDITY];
+#if CONFIG_ROLLUP_ENABLE
+    rollup_sample_handler(temperature, humidity);
+#endif
+#if CONFIG_ALARM_ENABLE
+    alarm_sample_handler(temperature, humidity);
+#endif
+#if CONFIG_TS_LOG_ENABLE
+    history_sample_handler(temperature, humidity);
+#endif
+}
+#endif
+
+#if CONFIG_DLOG_ENABLE
+static void log_build_metrics() {
+    for(int i = 0; i < SP_LOG_METRIC_COUNT; i++) {
+        esp_tahu_metric_t new_metric = { 0 };
+        switch((sp_log_metrics_t)i) {
+            case SP_LOG_LEVEL:
+                esp_tahu_create_metric(NULL, &new_metric, "Log/Level", ESP_TAHU_METRIC_TYPE_STRING, log_level_change);
+                break;
+            case SP_LOG_DUMP:
+                esp_tahu_create_metric(NULL, &new_metric, "Log/Dump", ESP_TAHU_METRIC_TYPE_BOOLEAN, log_dump_change);
+                break;
+            case SP_LOG_TEXT:
+                esp_tahu_create_metric(NULL, &new_metric, "Log/Text", ESP_TAHU_METRIC_TYPE_STRING, NULL);
+                break;
+            default:
+                ESP_LOGW(TAG, "Undefined log metric. Index: %d", i);
+                break;
+        }
+        memcpy(sp_node_metrics + SP_NODE_METRIC_LOG + i, &new_metric, sizeof(new_metric));
+    }
+    esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_LOG + SP_LOG_LEVEL, false, "");
+    esp_tahu_set_metric_data(sp_node_metrics + SP_NODE_METRIC_LOG + SP_LOG_TEXT, false, "");
+}
+
+/**
+ * @brief Apply log levels written by an NCMD, such as "mqtt-app=D,esp-tahu=W"
+*/
+static void log_level_change(char *new_value) {
+    if (dlog_level_parse(new_value) != ESP_OK)
+        ESP_LOGW(TAG, "Invalid log levels: %s", new_value);
+}
+
+/**
+ * @brief Publish the most recent log records in Log/Text when an NCMD sets Log/Dump
+*/
+static void log_dump_change(bool *new_value) {
+    if (!*new_value)
+        return;
+
+    dlog_dump(log_dump_text, sizeof(log_dump_text));
+    bool dump = false;
+    esp_tahu_metric_t *log_metrics = sp_node_metrics + SP_NODE_METRIC_LOG;
+    esp_tahu_set_metric_data(log_metrics + SP_LOG_TEXT, false, log_dump_text);
+    esp_tahu_set_metric_data(log_metrics + SP_LOG_DUMP, false, &dump);
+    if (mqtt_app_connected && sp_initialized)
+        esp_tahu_publish_ndata(log_metrics + SP_LOG_DUMP, 2);
+}
+#endif
+
+#if CONFIG_OTA_ENABLE
+static void ota_build_metrics() {
+    for(int i = 0; i < SP_OTA_METRIC_COUNT; i++) {
+        esp_tahu_metric_t new_metric = { 0 };
+        switch((sp_ota_metrics_t)i) {
+            case SP_OTA_VERSION:
+                esp_tahu_create_metric(NULL, &new_metric, "OTA/Version", ESP_TAHU_METRIC_TYPE_STRING, NULL);
+                break;
+            case SP_OTA_URL:
+                esp_tahu_create_metric(NULL, &new_metric, "OTA/URL", ESP_TAHU_METRIC_TYPE_STRING, NULL);
+                break;
+            case SP_OTA_UPDATE:
+                esp_tahu_create_metric(NULL, &new_metric, "OTA/Update", ESP_TAHU_METRIC_TYPE_BOOLEAN, ota_update_change);
+                break;
+            case SP_OTA_STATUS:
+                esp_tahu_create_metric(NULL, &new_metric, "OTA/Status", ESP_TAHU_METRIC_TYPE_STRING, NULL);
+                break;
+            default:
+                ESP_LOGW(TAG, "Undefined OTA metric. Index: %d", i);
+                break;
+        }
+        memcpy(sp_node_metrics + SP_NODE_METRIC_OTA + i, &new_metric, sizeof(new_metric));
+    }
+    esp_tahu_metric_t *ota_metrics = sp_node_metrics + SP_NODE_METRIC_OTA;
+    esp_tahu_set_metric_data(ota_metrics + SP_OTA_VERSION, false, (void *) ota_get_version());
+    esp_tahu_set_metric_data(ota_metrics + SP_OTA_URL, false, "");
+    esp_tahu_set_metric_data(ota_metrics + SP_OTA_STATUS, false, (void *) ota_get_status());
+}
+
+/**
+ * @brief Start an update from the URL in OTA/URL when an NCMD sets OTA/Update. Both can be
+ * written by the same NCMD, as long as OTA/URL comes first
+*/
+static void ota_update_change(bool *new_value) {
+    if (!*new_value)
+        return;
+
+    esp_tahu_metric_t *ota_metrics = sp_node_metrics + SP_NODE_METRIC_OTA;
+    bool update = false;
+    esp_tahu_set_metric_data(ota_metrics + SP_OTA_UPDATE, false, &update);
+    esp_err_t result = ota_start(ota_metrics[SP_OTA_URL].value.string_value);
+    if (result != ESP_OK) {
+        ESP_LOGW(TAG, "OTA update not started: %s", esp_err_to_name(result));
+        ota_status_handler(result == ESP_ERR_INVALID_STATE ? "Busy" : "Invalid URL");
+    }
+}
+
+/**
+ * @brief Publish each change of the update status, so progress and failures are visible to the host
+*/
+static void ota_status_handler(const char *status) {
+    esp_tahu_metric_t *ota_metrics = sp_node_metrics + SP_NODE_METRIC_OTA;
+    esp_tahu_set_metric_data(ota_metrics + SP_OTA_STATUS, false, (void *) status);
+    if (mqtt_app_connected && sp_initialized)
+        esp_tahu_publish_ndata(ota_metrics + SP_OTA_STATUS, 1);
+}
+#endif
 
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+static void tc_update_metrics() {
+    for(int zone = 0; zone < TC_ZONE_COUNT; zone++) {
+        esp_tahu_metric_t *zone_metrics = sp_metrics + SP_METRIC_TC_ZONE + zone * SP_ZONE_METRIC_COUNT;
+        bool cooling = temp_controller_is_running(zone);
+        sensor_set_metric(zone_metrics + SP_ZONE_TEMPERATURE, temp_controller_get_channel(zone));
+        esp_tahu_set_metric_data(zone_metrics + SP_ZONE_COOLING, false, (void *) &cooling);
+
+#if CONFIG_TC_ANALYTICS_ENABLE
+        tc_analytics_t analytics;
+        temp_controller_get_analytics(zone, &analytics);
+        esp_tahu_set_metric_data(zone_metrics + SP_ZONE_ON_TIME, false, (void *) &analytics.on_time_s);
+        esp_tahu_set_metric_data(zone_metrics + SP_ZONE_CYCLES, false, (void *) &analytics.cycle_count);
+        esp_tahu_set_metric_data(zone_metrics + SP_ZONE_CYCLES_PER_HOUR, false, (void *) &analytics.cycles_per_hour);
+        esp_tahu_set_metric_data(zone_metrics + SP_ZONE_MEAN_ON_TIME, false, (void *) &analytics.mean_on_s);
+        esp_tahu_set_metric_data(zone_metrics + SP_ZONE_MEAN_OFF_TIME, false, (void *) &analytics.mean_off_s);
+        esp_tahu_set_metric_data(zone_metrics + SP_ZONE_ABOVE_SETPOINT_TIME, false, (void *) &analytics.above_setpoint_s);
+#endif
+    }
 }
 
-static void tc_setpoint_change(float *new_value) {
-    ESP_LOGI(TAG, "Received new setpoint value: %f", *new_value);
-    temp_controller_setpoint = *new_value;
+#endif
+
+#if CONFIG_APP_TASK_JITTER_STRESS
+/**
+ * @brief Saturate the MQTT client with publishes and periodically log the control loop jitter
+*/
+static void jitter_stress_task() {
+    static char stress_payload[512];
+    memset(stress_payload, 'x', sizeof(stress_payload));
+    int64_t report_time = esp_timer_get_time();
+    uint32_t publish_count = 0;
+
+    for ( ;; ) {
+        if (mqtt_app_connected) {
+            mqtt_util_publish("env-controller/stress", stress_payload, sizeof(stress_payload), 0, 0);
+            publish_count++;
+        }
+
+        // Yield a tick periodically so the idle task on this core still feeds the watchdog
+        if (!mqtt_app_connected || publish_count % 10 == 0)
+            vTaskDelay(1);
+
+        if (esp_timer_get_time() - report_time >= 10 * 1000 * 1000) {
+            int64_t jitter_max, jitter_mean;
+            temp_controller_get_jitter(&jitter_max, &jitter_mean);
+            ESP_LOGI(TAG, "Stress: %d publishes. Control loop jitter max: %lld us, mean: %lld us",
+                            publish_count, jitter_max, jitter_mean);
+            temp_controller_reset_jitter();
+            publish_count = 0;
+            report_time = esp_timer_get_time();
+        }
+    }
 }
+#endif
+
+#if CONFIG_APP_IMPL_DEEP_SLEEP_BATCH
+/**
+ * @brief Run a single deep-sleep wake cycle. Never returns
+ *
+ *  Samples are collected into RTC memory on every wake. Once an upload is due the node connects,
+ *  births, publishes the retained samples as historical DDATA and disconnects cleanly with NDEATH.
+ *  The samples are only cleared once the broker has acknowledged all of them.
+*/
+static void batch_upload_cycle() {
+    sensor_init(false);
+    batch_node_record_sample();
+    boot_phase_record(SP_BOOT_PHASE_CONTROL_READY);
+    if (!batch_node_upload_due())
+        batch_node_sleep(false);
+
+    ESP_ERROR_CHECK(nvs_flash_init());
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    wifi_connected = wifi_connect() == ESP_OK;
+    if (!wifi_connected)
+        batch_node_sleep(true);
+    boot_phase_record(SP_BOOT_PHASE_WIFI_CONNECTED);
+
+    batch_node_sync_time();
+    tahu_mqtt_start();
+    mqtt_app_start();
+
+    int waited = 0;
+    while (!sp_initialized && waited < CONFIG_BATCH_NODE_CONNECT_TIMEOUT * 1000) {
+        esp_tahu_service();
+        vTaskDelay(pdMS_TO_TICKS(100));
+        waited += 100;
+    }
+
+    if (!sp_initialized) {
+        ESP_LOGW(TAG, "Timed out waiting for MQTT session. Samples retained for next upload");
+    } else if (batch_node_publish_history(sp_metrics + SP_METRIC_DHT_TEMPERATURE, sp_metrics + SP_METRIC_DHT_HUMIDITY) != ESP_OK) {
+        ESP_LOGW(TAG, "Upload not acknowledged. Samples retained for next upload");
+        esp_tahu_deinit_node();
+    } else {
+        esp_tahu_deinit_node();
+        batch_node_clear();
+    }
+
+    mqtt_app_stop();
+    wifi_disconnect();
+    batch_node_sleep(true);
+}
+#endif
+
+#if CONFIG_APP_STATIC_ALLOCATION
+/**
+ * @brief Log the static memory reserved by each component. Sizes are fixed at compile time
+*/
+static void static_budget_report() {
+    size_t app_size = sizeof(sp_metrics) + sizeof(sp_node_metrics) + sizeof(lwt_topic) + sizeof(lwt_msg)
+                        + sizeof(standby_lwt_topic) + sizeof(standby_lwt_msg);
+#if CONFIG_ROLLUP_ENABLE
+    app_size += sizeof(sp_rollups);
+#endif
+#if CONFIG_DERIVED_ENABLE
+    app_size += sizeof(sp_derived);
+#endif
+#if CONFIG_ALARM_ENABLE
+    app_size += sizeof(sp_alarms);
+#endif
+#if CONFIG_TS_LOG_ENABLE
+    app_size += sizeof(history_records) + sizeof(history_metrics);
+#endif
+#if CONFIG_DLOG_ENABLE
+    app_size += sizeof(log_dump_text);
+#endif
+
+    const struct {
+        const char *component;
+        size_t size;
+    } budget[] = {
+        { "app-tasks", app_task_get_static_size() },
+        { "esp-tahu", esp_tahu_get_static_size() },
+        { "mqtt-app", mqtt_app_get_static_size() },
+#if CONFIG_TS_LOG_ENABLE
+        { "ts-log", ts_log_get_static_size() },
+#endif
+#if CONFIG_OTA_ENABLE
+        { "ota", ota_get_static_size() },
+#endif
+        { "main", app_size },
+    };
+
+    size_t total = 0;
+    ESP_LOGI(TAG, "Static memory budget:");
+    for (int i = 0; i < sizeof(budget) / sizeof(budget[0]); i++) {
+        ESP_LOGI(TAG, "  %-10s %7d bytes", budget[i].component, budget[i].size);
+        total += budget[i].size;
+    }
+    ESP_LOGI(TAG, "  %-10s %7d bytes", "total", total);
+    ESP_LOGI(TAG, "System heap: %d bytes free, %d bytes minimum", esp_get_free_heap_size(), esp_get_minimum_free_heap_size());
+}
+#endif
 
 /**
  * @brief Initialize and start all app functionality
@@ -195,48 +1274,82 @@ void app_main() {
     esp_log_level_set(TAG, ESP_LOG_INFO);
 #endif
 
+#if CONFIG_DLOG_ENABLE
+    // First, so the records retained from before a panic are printed even though the application doesn't run
+    dlog_init(true);
+#endif
+#if CONFIG_OTA_ENABLE
+    // Before the panic check, so a new image that panics is still rolled back
+    ESP_ERROR_CHECK(ota_init(ota_status_handler));
+#endif
     if(esp_reset_reason() == ESP_RST_PANIC)
         loop_panic_msg();
 
+#if CONFIG_APP_IMPL_DEEP_SLEEP_BATCH
+    // Keep the sample-only wake path as short as possible
+    batch_upload_cycle();
+#endif
+
     ESP_LOGI(TAG, "Free memory: %d bytes", esp_get_free_heap_size());
     ESP_LOGI(TAG, "IDF version: %s", esp_get_idf_version());
 
     ESP_ERROR_CHECK(nvs_flash_init());
+#if CONFIG_BENCH_ENABLE
+    // Runs before any other task is started so the measurements aren't disturbed
+    if (bench_run() != ESP_OK)
+        ESP_LOGE(TAG, "Benchmark regression detected");
+#endif
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     esp_register_shutdown_handler(shutdown_handler);
 
-    dht_init();
+    // Sensing and control come up first. They don't depend on the network
+#if CONFIG_POWER_MGMT_ENABLE
+    // Sensor reads and control evaluation are driven by the wake window task
+    ESP_ERROR_CHECK(power_init());
+    sensor_init(false);
+#if CONFIG_APP_IMPL_TEMP_CONTROLLER
+    temp_controller_init(false);
+#endif
+#else
+    sensor_init(true);
 #if CONFIG_APP_IMPL_TEMP_CONTROLLER
     temp_controller_init(true);
+#endif
 #endif
 
-    // Connect WiFi interface
-    wifi_connected = wifi_connect() == ESP_OK;
+    boot_phase_record(SP_BOOT_PHASE_CONTROL_READY);
 
-    if (wifi_connected)
-    {
-        // Configure sparkplug and get LWT info
-        mqtt_app_lwt_info_t lwt_info = {
-            .topic = (char *)malloc(sizeof(char) * 64),
-            .msg = (char *)malloc(sizeof(char) * 256),
-            .msg_len = 0,
-        };
-        esp_tahu_configure(get_wifi_mac_id());
-        esp_tahu_get_lwt_data(lwt_info.topic, lwt_info.msg, 256, &lwt_info.msg_len);
-        esp_tahu_register_rebirth_callback_handler(tahu_ncmd_rebirth);
-        esp_tahu_register_reboot_callback_handler(tahu_ncmd_reboot);
-        tahu_build_metrics();
-
-        // Connect MQTT client
-        mqtt_app_lwt_info = (mqtt_app_lwt_info_t) {};
-        memcpy(&mqtt_app_lwt_info, &lwt_info, sizeof(lwt_info));
-        mqtt_app_connected_callback_register(mqtt_connect_handler);
-        mqtt_app_disconnected_callback_register(mqtt_disconnect_handler);
-        mqtt_app_data_callback_register(mqtt_data_handler);
-        mqtt_app_init();
-    }
-
-    xTaskCreate(tahu_data_publish_task, "tahu_data_publish_task", 2500, NULL, 1, NULL);
+#if CONFIG_TS_LOG_ENABLE
+    const float ts_log_resolution[TS_LOG_CHANNEL_COUNT] = {
+        [TS_LOG_CHANNEL_TEMPERATURE] = 0.1,
+        [TS_LOG_CHANNEL_HUMIDITY] = 0.1,
+    };
+    ts_log_ready = ts_log_init(TS_LOG_CHANNEL_COUNT, ts_log_resolution) == ESP_OK;
+#endif
+
+    tahu_mqtt_start();
+
+#if CONFIG_POWER_MGMT_ENABLE
+    app_task_create(APP_TASK_WAKE_WINDOW, wake_window_task, NULL, NULL);
+#else
+    app_task_create(APP_TASK_TAHU_PUBLISH, tahu_data_publish_task, NULL, NULL);
+#endif
+#if CONFIG_ALARM_ENABLE
+    app_task_create(APP_TASK_ALARM_PUBLISH, alarm_publish_task, NULL, &alarm_task_handle);
+#endif
+#if CONFIG_TS_LOG_ENABLE
+    app_task_create(APP_TASK_HISTORY_BACKFILL, history_backfill_task, NULL, &history_task_handle);
+#endif
+#if CONFIG_APP_TASK_JITTER_STRESS
+    app_task_create(APP_TASK_JITTER_STRESS, jitter_stress_task, NULL, NULL);
+#endif
+
+    // Wi-Fi retries in the background for the rest of uptime. MQTT (re)starts each time it connects
+    wifi_start(wifi_connect_handler, wifi_disconnect_handler);
+    app_task_monitor_start();
+#if CONFIG_APP_STATIC_ALLOCATION
+    static_budget_report();
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,120 @@
+// ESP-IDF Components
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+
+// Project Components
+#include "esp_tahu.h"
+#include "sensor.h"
+#include "temp_controller.h"
+
+// Project Files
+#include "tc_metrics.h"
+
+static const char *TAG = "tc-metrics";
+
+static esp_tahu_metric_t *tc_metrics;       // Metrics of the first zone
+
+/**
+ * @brief Get the zone whose device a metric belongs to
+*/
+static int tc_metric_zone(esp_tahu_metric_t *metric) {
+    return (metric - tc_metrics) / SP_ZONE_METRIC_COUNT;
+}
+
+/**
+ * @brief Apply a setpoint written to a zone device
+*/
+static void tc_setpoint_change(void *new_value, esp_tahu_metric_t *metric) {
+    int zone = tc_metric_zone(metric);
+    float setpoint = *(float *) new_value;
+    if (setpoint == temp_controller_get_setpoint(zone))
+        return;
+    ESP_LOGI(TAG, "Received new setpoint value for zone %d: %f", zone + 1, setpoint);
+    temp_controller_set_setpoint(zone, setpoint);
+}
+
+/**
+ * @brief Rebind a zone to the sensor channel written to its device. Unknown and non-temperature
+ * channels are rejected and the metric reverts to the current channel
+*/
+static void tc_sensor_change(void *new_value, esp_tahu_metric_t *metric) {
+    int zone = tc_metric_zone(metric);
+    const char *name = (const char *) new_value;
+    const char *current = sensor_get_channel_name(temp_controller_get_channel(zone));
+    if (strcmp(name, current) == 0)
+        return;
+
+    sensor_channel_t channel;
+    if (sensor_find_channel(name, &channel) == ESP_OK && temp_controller_bind(zone, channel) == ESP_OK)
+        return;
+    ESP_LOGW(TAG, "Zone %d: invalid sensor channel '%s'", zone + 1, name);
+    esp_tahu_set_metric_data(metric, false, (void *) current);
+}
+
+/**
+ * @brief Build the metrics of each zone device, seeded with the current setpoint and sensor channel
+ *
+ *  A single zone keeps the configured device ID, further zones are numbered from 1.
+ *
+ * @param metrics SP_ZONE_METRIC_COUNT metrics per zone
+ * @param device_ids Filled with the device ID of each zone
+*/
+void tc_metrics_build(esp_tahu_metric_t *metrics, char device_ids[][TC_DEVICE_ID_MAX]) {
+    tc_metrics = metrics;
+    for(int zone = 0; zone < TC_ZONE_COUNT; zone++) {
+        char *device_id = device_ids[zone];
+        if (TC_ZONE_COUNT == 1)
+            snprintf(device_id, TC_DEVICE_ID_MAX, "%s", CONFIG_APP_SPARKPLUG_DEVICE_ID_TEMP_CONTROLLER);
+        else
+            snprintf(device_id, TC_DEVICE_ID_MAX, "%s_%d", CONFIG_APP_SPARKPLUG_DEVICE_ID_TEMP_CONTROLLER, zone + 1);
+
+        esp_tahu_metric_t *zone_metrics = metrics + zone * SP_ZONE_METRIC_COUNT;
+        for(int i = 0; i < SP_ZONE_METRIC_COUNT; i++) {
+            esp_tahu_metric_t new_metric = { 0 };
+            switch((sp_zone_metrics_t)i) {
+                case SP_ZONE_SETPOINT:
+                    esp_tahu_create_metric(device_id, &new_metric, "setpoint", ESP_TAHU_METRIC_TYPE_FLOAT, tc_setpoint_change);
+                    break;
+                case SP_ZONE_SENSOR:
+                    esp_tahu_create_metric(device_id, &new_metric, "sensor", ESP_TAHU_METRIC_TYPE_STRING, tc_sensor_change);
+                    break;
+                case SP_ZONE_TEMPERATURE:
+                    esp_tahu_create_metric(device_id, &new_metric, "temperature", ESP_TAHU_METRIC_TYPE_FLOAT, NULL);
+                    break;
+                case SP_ZONE_COOLING:
+                    esp_tahu_create_metric(device_id, &new_metric, "cooling", ESP_TAHU_METRIC_TYPE_BOOLEAN, NULL);
+                    break;
+#if CONFIG_TC_ANALYTICS_ENABLE
+                // Durations in seconds
+                case SP_ZONE_ON_TIME:
+                    esp_tahu_create_metric(device_id, &new_metric, "Analytics/On Time", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                    break;
+                case SP_ZONE_CYCLES:
+                    esp_tahu_create_metric(device_id, &new_metric, "Analytics/Cycles", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                    break;
+                case SP_ZONE_CYCLES_PER_HOUR:
+                    esp_tahu_create_metric(device_id, &new_metric, "Analytics/Cycles Per Hour", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                    break;
+                case SP_ZONE_MEAN_ON_TIME:
+                    esp_tahu_create_metric(device_id, &new_metric, "Analytics/Mean On Time", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                    break;
+                case SP_ZONE_MEAN_OFF_TIME:
+                    esp_tahu_create_metric(device_id, &new_metric, "Analytics/Mean Off Time", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                    break;
+                case SP_ZONE_ABOVE_SETPOINT_TIME:
+                    esp_tahu_create_metric(device_id, &new_metric, "Analytics/Time Above Setpoint", ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                    break;
+#endif
+                default:
+                    ESP_LOGW(TAG, "Undefined metric. Index: %d", i);
+                    break;
+            }
+            memcpy(zone_metrics + i, &new_metric, sizeof(new_metric));
+        }
+
+        float setpoint = temp_controller_get_setpoint(zone);
+        esp_tahu_set_metric_data(zone_metrics + SP_ZONE_SETPOINT, false, (void *) &setpoint);
+        esp_tahu_set_metric_data(zone_metrics + SP_ZONE_SENSOR, false, (void *) sensor_get_channel_name(temp_controller_get_channel(zone)));
+    }
+}
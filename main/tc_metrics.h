@@ -0,0 +1,38 @@
+/**! @file tc_metrics.h
+ *
+ * Sparkplug metrics of the temperature controller. Each zone is its own device. The metrics of all
+ * zones are consecutive, SP_ZONE_METRIC_COUNT per zone.
+*/
+#pragma once
+
+#include "esp_tahu.h"
+#include "temp_controller.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TC_DEVICE_ID_MAX 32
+
+// Metrics of each temperature controller zone
+typedef enum {
+    SP_ZONE_SETPOINT,
+    SP_ZONE_SENSOR,
+    SP_ZONE_TEMPERATURE,
+    SP_ZONE_COOLING,
+#if CONFIG_TC_ANALYTICS_ENABLE
+    SP_ZONE_ON_TIME,            // First of the analytics metrics, published every TC_ANALYTICS_PUBLISH_PERIOD_MS
+    SP_ZONE_CYCLES,
+    SP_ZONE_CYCLES_PER_HOUR,
+    SP_ZONE_MEAN_ON_TIME,
+    SP_ZONE_MEAN_OFF_TIME,
+    SP_ZONE_ABOVE_SETPOINT_TIME,
+#endif
+    SP_ZONE_METRIC_COUNT
+} sp_zone_metrics_t;
+
+void tc_metrics_build(esp_tahu_metric_t *metrics, char device_ids[][TC_DEVICE_ID_MAX]);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,71 @@
+/**! @file pb_writer.h
+ *
+ * Minimal protobuf writer for hand-built Sparkplug payloads, including malformed ones that
+ * nanopb would refuse to encode
+*/
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    uint8_t *buffer;
+    size_t size;
+    size_t length;
+} pb_writer_t;
+
+enum {
+    PB_WRITER_VARINT = 0,
+    PB_WRITER_64BIT = 1,
+    PB_WRITER_BYTES = 2,
+    PB_WRITER_32BIT = 5
+};
+
+static inline void pb_writer_raw(pb_writer_t *writer, const void *data, size_t length) {
+    if (writer->length + length <= writer->size)
+        memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+}
+
+static inline void pb_writer_varint(pb_writer_t *writer, uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value)
+            byte |= 0x80;
+        pb_writer_raw(writer, &byte, 1);
+    } while (value);
+}
+
+static inline void pb_writer_tag(pb_writer_t *writer, uint32_t field, int wire_type) {
+    pb_writer_varint(writer, (field << 3) | wire_type);
+}
+
+static inline void pb_writer_uint(pb_writer_t *writer, uint32_t field, uint64_t value) {
+    pb_writer_tag(writer, field, PB_WRITER_VARINT);
+    pb_writer_varint(writer, value);
+}
+
+static inline void pb_writer_float(pb_writer_t *writer, uint32_t field, float value) {
+    pb_writer_tag(writer, field, PB_WRITER_32BIT);
+    pb_writer_raw(writer, &value, sizeof(value));
+}
+
+static inline void pb_writer_double(pb_writer_t *writer, uint32_t field, double value) {
+    pb_writer_tag(writer, field, PB_WRITER_64BIT);
+    pb_writer_raw(writer, &value, sizeof(value));
+}
+
+static inline void pb_writer_bytes(pb_writer_t *writer, uint32_t field, const void *data, size_t length) {
+    pb_writer_tag(writer, field, PB_WRITER_BYTES);
+    pb_writer_varint(writer, length);
+    pb_writer_raw(writer, data, length);
+}
+
+static inline void pb_writer_string(pb_writer_t *writer, uint32_t field, const char *string) {
+    pb_writer_bytes(writer, field, string, strlen(string));
+}
+
+static inline void pb_writer_message(pb_writer_t *writer, uint32_t field, const pb_writer_t *message) {
+    pb_writer_bytes(writer, field, message->buffer, message->length);
+}
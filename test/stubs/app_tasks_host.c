@@ -0,0 +1,22 @@
+// Host Stand-Ins
+#include "app_tasks.h"
+
+static const app_task_config_t host_task_config = {
+    .name = "host",
+    .stack_size = 4096,
+    .priority = 5,
+    .core_id = tskNO_AFFINITY,
+};
+
+const app_task_config_t *app_task_get_config(app_task_id_t task_id) {
+    return &host_task_config;
+}
+
+/**
+ * @brief Tasks aren't run on the host. Tests call the work the task would do directly
+*/
+esp_err_t app_task_create(app_task_id_t task_id, TaskFunction_t task_function, void *arg, TaskHandle_t *out_handle) {
+    if (out_handle)
+        *out_handle = NULL;
+    return ESP_OK;
+}
@@ -0,0 +1,38 @@
+// Host Stand-Ins
+#include <stddef.h>
+
+// Counts heap allocations for components/bench on the host. The device build wraps malloc and newlib's
+// reentrant functions with --wrap. glibc's own allocations, such as strdup(), call malloc through the
+// PLT instead, so malloc is replaced here and forwards to bench.c's wrappers
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+void *__real_malloc(size_t size) {
+    return __libc_malloc(size);
+}
+
+void *__real_calloc(size_t count, size_t size) {
+    return __libc_calloc(count, size);
+}
+
+void *__real_realloc(void *ptr, size_t size) {
+    return __libc_realloc(ptr, size);
+}
+
+void *malloc(size_t size) {
+    return __wrap_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    return __wrap_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    return __wrap_realloc(ptr, size);
+}
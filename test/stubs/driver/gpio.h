@@ -0,0 +1,66 @@
+/**! @file gpio.h
+ *
+ * Host stand-in for the ESP-IDF GPIO driver. Outputs are discarded and inputs read low
+*/
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int gpio_num_t;
+
+typedef enum {
+    GPIO_MODE_DISABLE,
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT,
+    GPIO_MODE_INPUT_OUTPUT_OD,
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_PULLUP_DISABLE,
+    GPIO_PULLUP_ENABLE,
+} gpio_pullup_t;
+
+typedef enum {
+    GPIO_PULLDOWN_DISABLE,
+    GPIO_PULLDOWN_ENABLE,
+} gpio_pulldown_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE,
+} gpio_int_type_t;
+
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+static inline esp_err_t gpio_config(const gpio_config_t *config) {
+    return ESP_OK;
+}
+
+static inline esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    return ESP_OK;
+}
+
+static inline int gpio_get_level(gpio_num_t gpio_num) {
+    return 0;
+}
+
+// Reached through the driver headers on the device
+static inline void ets_delay_us(uint32_t us) {
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
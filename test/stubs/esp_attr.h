@@ -0,0 +1,12 @@
+/**! @file esp_attr.h
+ *
+ * Host stand-in for the ESP-IDF section attributes. RTC and IRAM placement have no meaning on the host
+*/
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_IRAM_ATTR
+#define EXT_RAM_ATTR
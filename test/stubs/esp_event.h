@@ -0,0 +1,21 @@
+/**! @file esp_event.h
+ *
+ * Host stand-in for the ESP-IDF event loop types
+*/
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+
+#define ESP_EVENT_ANY_ID -1
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,111 @@
+// Host Stand-Ins
+#include <stdlib.h>
+#include <string.h>
+#include "esp_http_client.h"
+#include "esp_system.h"
+
+// Project Files
+#include "host_stubs.h"
+
+#define URL_MAX 256
+
+struct esp_http_client {
+    char url[URL_MAX];
+    bool open;
+    size_t position;
+};
+
+static char served_url[URL_MAX];
+static int served_status = 404;
+static const uint8_t *served_body = NULL;
+static size_t served_size = 0;
+static size_t drop_after = SIZE_MAX;
+static int open_clients = 0;
+
+/**
+ * @brief Serve a body at a URL. Any other URL gets a 404. The body isn't copied
+*/
+void host_http_serve(const char *url, int status, const void *body, size_t size) {
+    strncpy(served_url, url, sizeof(served_url) - 1);
+    served_status = status;
+    served_body = body;
+    served_size = size;
+    drop_after = SIZE_MAX;
+}
+
+/**
+ * @brief Drop connections after a number of body bytes, as if the network went away
+*/
+void host_http_drop_after(size_t bytes) {
+    drop_after = bytes;
+}
+
+/**
+ * @brief Get the number of clients opened and not yet closed
+*/
+int host_http_open_clients(void) {
+    return open_clients;
+}
+
+static bool served(esp_http_client_handle_t client) {
+    return strcmp(client->url, served_url) == 0;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+    if (!config->url || strlen(config->url) >= URL_MAX)
+        return NULL;
+    esp_http_client_handle_t client = calloc(1, sizeof(struct esp_http_client));
+    strcpy(client->url, config->url);
+    return client;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len) {
+    client->open = true;
+    client->position = 0;
+    open_clients++;
+    return ESP_OK;
+}
+
+int esp_http_client_fetch_headers(esp_http_client_handle_t client) {
+    return served(client) ? served_size : 0;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+    return served(client) ? served_status : 404;
+}
+
+/**
+ * @brief Read up to len bytes. Returns 0 at the end of the body or once the connection is dropped
+*/
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len) {
+    if (!client->open || !served(client))
+        return -1;
+    size_t end = served_size < drop_after ? served_size : drop_after;
+    size_t available = end > client->position ? end - client->position : 0;
+    if (!available || len <= 0)
+        return 0;
+
+    size_t size = 1 + esp_random() % len;
+    if (size > available)
+        size = available;
+    memcpy(buffer, served_body + client->position, size);
+    client->position += size;
+    return size;
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client) {
+    return served(client) && client->position == served_size;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+    if (client->open)
+        open_clients--;
+    client->open = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+    esp_http_client_close(client);
+    free(client);
+    return ESP_OK;
+}
@@ -0,0 +1,182 @@
+// Host Stand-Ins
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+
+// Project Files
+#include "host_stubs.h"
+
+// Emulates partitions_ota.csv. Each app partition is a file in the working directory, so a test
+// can inspect the images with other tools. Not linked together with esp_partition_host.c
+
+#define APP_PARTITIONS 2
+#define IMAGE_MAGIC 0xE9            // First byte of an ESP app image
+#define HANDLE 1                    // One update at a time
+
+static const esp_partition_t partitions[APP_PARTITIONS] = {
+    { .type = ESP_PARTITION_TYPE_APP, .address = 0x20000, .size = 0xE0000, .label = "ota_0" },
+    { .type = ESP_PARTITION_TYPE_APP, .address = 0x100000, .size = 0xE0000, .label = "ota_1" },
+};
+static const esp_app_desc_t app_description = { .version = "host", .project_name = "env-controller" };
+static FILE *files[APP_PARTITIONS];
+static int running = 0;
+static int boot = 0;
+static int update = -1;             // Partition being written through the open handle. -1 if none
+static size_t written = 0;
+
+static int partition_index(const esp_partition_t *partition) {
+    for (int i = 0; i < APP_PARTITIONS; i++) {
+        if (partition == &partitions[i])
+            return i;
+    }
+    return -1;
+}
+
+static esp_err_t erase(int index) {
+    static uint8_t erased[4096];
+    memset(erased, 0xFF, sizeof(erased));
+    fseek(files[index], 0, SEEK_SET);
+    for (uint32_t offset = 0; offset < partitions[index].size; offset += sizeof(erased)) {
+        if (fwrite(erased, sizeof(erased), 1, files[index]) != 1)
+            return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Create erased partition files and boot from ota_0
+*/
+void host_ota_init(void) {
+    for (int i = 0; i < APP_PARTITIONS; i++) {
+        char path[32];
+        snprintf(path, sizeof(path), "%s.bin", partitions[i].label);
+        if (files[i])
+            fclose(files[i]);
+        files[i] = fopen(path, "w+b");
+        HOST_ASSERT(files[i] && erase(i) == ESP_OK, "Can't create %s", path);
+    }
+    running = boot = 0;
+    update = -1;
+    written = 0;
+}
+
+/**
+ * @brief Program an image into the running partition, as if it had been flashed over serial
+*/
+void host_ota_flash_running(const void *image, size_t size) {
+    HOST_ASSERT(size <= partitions[running].size && erase(running) == ESP_OK, "Can't flash %zu bytes", size);
+    fseek(files[running], 0, SEEK_SET);
+    HOST_ASSERT(fwrite(image, size, 1, files[running]) == 1, "Can't flash %zu bytes", size);
+    fflush(files[running]);
+}
+
+/**
+ * @brief Get the label of the partition the next boot starts from
+*/
+const char *host_ota_boot_label(void) {
+    return partitions[boot].label;
+}
+
+/**
+ * @brief Get the bytes written through the last OTA handle
+*/
+size_t host_ota_written(void) {
+    return written;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    int index = partition_index(partition);
+    if (index < 0 || src_offset + size > partition->size)
+        return ESP_ERR_INVALID_ARG;
+    fseek(files[index], src_offset, SEEK_SET);
+    return fread(dst, 1, size, files[index]) == size ? ESP_OK : ESP_FAIL;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void) {
+    return &partitions[running];
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from) {
+    return &partitions[(running + 1) % APP_PARTITIONS];
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *out_state) {
+    *out_state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle) {
+    int index = partition_index(partition);
+    if (index < 0)
+        return ESP_ERR_INVALID_ARG;
+    if (index == running)
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    if (update >= 0)
+        return ESP_ERR_INVALID_STATE;
+
+    esp_err_t result = erase(index);
+    if (result != ESP_OK)
+        return result;
+    update = index;
+    written = 0;
+    *out_handle = HANDLE;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size) {
+    if (handle != HANDLE || update < 0)
+        return ESP_ERR_INVALID_ARG;
+    if (written + size > partitions[update].size)
+        return ESP_ERR_INVALID_SIZE;
+    fseek(files[update], written, SEEK_SET);
+    if (fwrite(data, 1, size, files[update]) != size)
+        return ESP_FAIL;
+    written += size;
+    return ESP_OK;
+}
+
+/**
+ * @brief Close the handle. The image is only checked for the app image magic byte
+*/
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    if (handle != HANDLE || update < 0)
+        return ESP_ERR_INVALID_ARG;
+    uint8_t magic = 0;
+    fflush(files[update]);
+    esp_err_t result = esp_partition_read(&partitions[update], 0, &magic, 1);
+    update = -1;
+    if (result != ESP_OK || !written || magic != IMAGE_MAGIC)
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    if (handle != HANDLE || update < 0)
+        return ESP_ERR_INVALID_ARG;
+    update = -1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition) {
+    int index = partition_index(partition);
+    if (index < 0)
+        return ESP_ERR_INVALID_ARG;
+    boot = index;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void) {
+    boot = (running + 1) % APP_PARTITIONS;
+    esp_restart();
+    return ESP_FAIL;
+}
+
+const esp_app_desc_t *esp_ota_get_app_description(void) {
+    return &app_description;
+}
@@ -0,0 +1,88 @@
+// Host Stand-Ins
+#include <stdlib.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "esp_system.h"
+
+// Project Files
+#include "host_stubs.h"
+
+#define SECTOR_SIZE 4096
+
+static esp_partition_t partition = { .type = ESP_PARTITION_TYPE_DATA };
+static uint8_t *flash = NULL;
+static uint32_t *erase_counts = NULL;
+static int writes_left = -1;        // Writes until power is lost. -1 while power stays on
+static bool torn = false;           // The write power was lost during has been programmed
+
+/**
+ * @brief Create an erased data partition, replacing any previous one
+*/
+void host_flash_init(const char *label, uint32_t size) {
+    free(flash);
+    free(erase_counts);
+    flash = malloc(size);
+    erase_counts = calloc(size / SECTOR_SIZE, sizeof(uint32_t));
+    memset(flash, 0xFF, size);
+    partition.size = size;
+    strncpy(partition.label, label, sizeof(partition.label) - 1);
+    host_flash_power_loss_after(-1);
+}
+
+/**
+ * @brief Lose power after a number of writes. The next write is torn, programming a random part of
+ * its bytes, and later writes and erases fail. A negative count restores power
+*/
+void host_flash_power_loss_after(int writes) {
+    writes_left = writes;
+    torn = false;
+}
+
+uint32_t host_flash_erase_count(uint32_t sector) {
+    return erase_counts[sector];
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label) {
+    if (!flash || (type != ESP_PARTITION_TYPE_ANY && type != partition.type) || (label && strcmp(label, partition.label) != 0))
+        return NULL;
+    return &partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    if (src_offset + size > partition->size)
+        return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, flash + src_offset, size);
+    return ESP_OK;
+}
+
+/**
+ * @brief Program bytes. As on NOR flash, bits can only be cleared until the sector is erased
+*/
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+    if (dst_offset + size > partition->size)
+        return ESP_ERR_INVALID_SIZE;
+    // The write power is lost during only programs part of its bytes
+    size_t programmed = size;
+    if (writes_left == 0)
+        programmed = torn ? 0 : esp_random() % (size + 1);
+    for (size_t i = 0; i < programmed; i++)
+        flash[dst_offset + i] &= ((const uint8_t *)src)[i];
+    if (writes_left == 0) {
+        torn = true;
+        return ESP_FAIL;
+    }
+    if (writes_left > 0)
+        writes_left--;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    if (offset % SECTOR_SIZE || size % SECTOR_SIZE || offset + size > partition->size)
+        return ESP_ERR_INVALID_ARG;
+    if (writes_left == 0)
+        return ESP_FAIL;
+    memset(flash + offset, 0xFF, size);
+    for (size_t sector = offset / SECTOR_SIZE; sector < (offset + size) / SECTOR_SIZE; sector++)
+        erase_counts[sector]++;
+    return ESP_OK;
+}
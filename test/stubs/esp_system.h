@@ -0,0 +1,24 @@
+/**! @file esp_system.h
+ *
+ * Host stand-in for the ESP-IDF system functions
+*/
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*shutdown_handler_t)(void);
+
+uint32_t esp_random(void);
+void esp_restart(void);
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
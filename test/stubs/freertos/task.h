@@ -0,0 +1,11 @@
+/**! @file task.h
+ *
+ * Host stand-in for FreeRTOS tasks. Delays advance the virtual clock of the host stand-ins
+*/
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait);
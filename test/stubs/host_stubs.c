@@ -0,0 +1,271 @@
+// Host Stand-Ins
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+// Project Files
+#include "host_stubs.h"
+
+#define TIMERS_MAX 16
+#define HOST_HEAP_SIZE (320 * 1024)
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    bool in_use;
+    bool active;
+    int64_t due_time;
+    uint64_t period;
+};
+
+static esp_log_level_t log_level = ESP_LOG_WARN;
+static int64_t now_us = 0;
+static bool realtime = false;
+static uint32_t random_state = 0x2545F491;
+struct host_queue {
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+static struct esp_timer timers[TIMERS_MAX];
+static int mutex_dummy;
+
+void host_log_level_set(esp_log_level_t level) {
+    log_level = level;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    static const char level_letter[] = "NEWIDV";
+    if (level > log_level)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%c (%lld) %s: ", level_letter[level], (long long)(now_us / 1000), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+uint32_t esp_log_timestamp(void) {
+    return now_us / 1000;
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+void host_random_seed(uint32_t seed) {
+    random_state = seed ? seed : 1;
+}
+
+uint32_t esp_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+void esp_restart(void) {
+    fprintf(stderr, "esp_restart() called\n");
+    exit(1);
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+    return ESP_OK;
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return HOST_HEAP_SIZE;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return HOST_HEAP_SIZE;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return &mutex_dummy;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+    return buffer;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    QueueHandle_t queue = calloc(1, sizeof(struct host_queue));
+    queue->items = calloc(length, item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buffer) {
+    QueueHandle_t queue = calloc(1, sizeof(struct host_queue));
+    queue->items = storage;
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    if (queue->count == queue->length)
+        return pdFALSE;
+    memcpy(queue->items + ((queue->head + queue->count) % queue->length) * queue->item_size, item, queue->item_size);
+    queue->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    if (!queue->count)
+        return pdFALSE;
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->count;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    host_time_advance((int64_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+/**
+ * @brief Tasks aren't run on the host, so notifications are dropped and a wait returns at once
+*/
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait) {
+    return 0;
+}
+
+int64_t esp_timer_get_time(void) {
+    if (realtime) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    }
+    return now_us;
+}
+
+/**
+ * @brief Read the monotonic clock from esp_timer_get_time() rather than the virtual clock, for benchmarks.
+ * Timers still only fire from host_time_advance()
+*/
+void host_time_realtime(bool enable) {
+    realtime = enable;
+}
+
+/**
+ * @brief Advance the clock, firing due timers in order of their due time
+*/
+void host_time_advance(int64_t us) {
+    int64_t end = now_us + us;
+    while (true) {
+        struct esp_timer *next = NULL;
+        for (int i = 0; i < TIMERS_MAX; i++) {
+            if (timers[i].active && timers[i].due_time <= end && (!next || timers[i].due_time < next->due_time))
+                next = &timers[i];
+        }
+        if (!next)
+            break;
+
+        if (next->due_time > now_us)
+            now_us = next->due_time;
+        if (next->period)
+            next->due_time += next->period;
+        else
+            next->active = false;
+        next->args.callback(next->args.arg);
+    }
+    now_us = end;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    for (int i = 0; i < TIMERS_MAX; i++) {
+        if (!timers[i].in_use) {
+            timers[i] = (struct esp_timer) { .args = *create_args, .in_use = true };
+            *out_handle = &timers[i];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->active = true;
+    timer->due_time = now_us + timeout_us;
+    timer->period = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->active = true;
+    timer->due_time = now_us + period;
+    timer->period = period;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    timer->in_use = false;
+    timer->active = false;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    return timer->active;
+}
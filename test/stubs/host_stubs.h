@@ -0,0 +1,66 @@
+/**! @file host_stubs.h
+ *
+ * Controls for the host stand-ins of ESP-IDF services
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void host_log_level_set(esp_log_level_t level);
+void host_time_advance(int64_t us);
+void host_time_realtime(bool enable);
+void host_random_seed(uint32_t seed);
+
+typedef struct {
+    char topic[96];
+    uint8_t *data;
+    int data_len;
+    int qos;
+} host_publish_t;
+
+int host_publish_count(void);
+const host_publish_t *host_publish_get(int index);
+void host_publish_clear(void);
+
+void host_flash_init(const char *label, uint32_t size);
+void host_flash_power_loss_after(int writes);
+uint32_t host_flash_erase_count(uint32_t sector);
+
+void host_http_serve(const char *url, int status, const void *body, size_t size);
+void host_http_drop_after(size_t bytes);
+int host_http_open_clients(void);
+
+void host_ota_init(void);
+void host_ota_flash_running(const void *image, size_t size);
+const char *host_ota_boot_label(void);
+size_t host_ota_written(void);
+
+struct esp_mqtt_client;
+
+void host_mqtt_broker_set(const char *uri, bool up);
+int host_mqtt_connect_attempts(const char *uri);
+const char *host_mqtt_client_broker(struct esp_mqtt_client *client);
+const char *host_mqtt_client_lwt_topic(struct esp_mqtt_client *client);
+void host_mqtt_run(void);
+
+/**
+ * @brief Fail the test with a message if the condition is false
+*/
+#define HOST_ASSERT(condition, format, ...) do {                                    \
+        if (!(condition)) {                                                         \
+            fprintf(stderr, "%s:%d: " format "\n", __FILE__, __LINE__, ##__VA_ARGS__); \
+            exit(1);                                                                \
+        }                                                                           \
+    } while (0)
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
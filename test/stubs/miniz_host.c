@@ -0,0 +1,33 @@
+// Host Stand-Ins
+#include <zlib.h>
+#include "esp32/rom/miniz.h"
+
+/**
+ * @brief Inflate a complete stream in one call with zlib, as the ROM inflater does with a non-wrapping
+ * output buffer
+*/
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next, size_t *pIn_buf_size, mz_uint8 *pOut_buf_start,
+                                mz_uint8 *pOut_buf_next, size_t *pOut_buf_size, const mz_uint32 decomp_flags) {
+    z_stream stream = { 0 };
+    int window_bits = (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? MAX_WBITS : -MAX_WBITS;
+    if (inflateInit2(&stream, window_bits) != Z_OK)
+        return TINFL_STATUS_BAD_PARAM;
+
+    stream.next_in = (Bytef *)pIn_buf_next;
+    stream.avail_in = *pIn_buf_size;
+    stream.next_out = pOut_buf_next;
+    stream.avail_out = *pOut_buf_size;
+    int result = inflate(&stream, Z_FINISH);
+    *pIn_buf_size = stream.total_in;
+    *pOut_buf_size = stream.total_out;
+    inflateEnd(&stream);
+
+    switch (result) {
+        case Z_STREAM_END:
+            return TINFL_STATUS_DONE;
+        case Z_BUF_ERROR:
+            return stream.avail_out ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_HAS_MORE_OUTPUT;
+        default:
+            return TINFL_STATUS_FAILED;
+    }
+}
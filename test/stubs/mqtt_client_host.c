@@ -0,0 +1,190 @@
+// Host Stand-Ins
+#include <stdlib.h>
+#include <string.h>
+#include "mqtt_client.h"
+
+// Project Files
+#include "host_stubs.h"
+
+#define BROKERS_MAX 4
+#define CLIENTS_MAX 4
+#define URI_MAX 96
+
+typedef struct {
+    char uri[URI_MAX];
+    bool up;
+    int connect_attempts;
+} host_broker_t;
+
+struct esp_mqtt_client {
+    char uri[URI_MAX];
+    char lwt_topic[URI_MAX];
+    esp_event_handler_t event_handler;
+    void *event_handler_arg;
+    bool started;
+    bool connect_pending;       // Started or reconnected, connects on the next host_mqtt_run()
+    host_broker_t *broker;      // Broker of the established connection
+};
+
+static host_broker_t brokers[BROKERS_MAX];
+static esp_mqtt_client_handle_t clients[CLIENTS_MAX];
+
+static host_broker_t *find_broker(const char *uri) {
+    for (int i = 0; i < BROKERS_MAX; i++) {
+        if (brokers[i].uri[0] && strcmp(brokers[i].uri, uri) == 0)
+            return &brokers[i];
+    }
+    return NULL;
+}
+
+static void dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event_id, esp_mqtt_error_codes_t *error_handle) {
+    esp_mqtt_event_t event = {
+        .event_id = event_id,
+        .client = client,
+        .error_handle = error_handle,
+    };
+    if (client->event_handler)
+        client->event_handler(client->event_handler_arg, "MQTT_EVENTS", event_id, &event);
+}
+
+static void drop_connection(esp_mqtt_client_handle_t client) {
+    client->broker = NULL;
+    dispatch(client, MQTT_EVENT_DISCONNECTED, NULL);
+}
+
+/**
+ * @brief Add a broker, or bring a known one up or down. Connections to a broker going down are dropped
+*/
+void host_mqtt_broker_set(const char *uri, bool up) {
+    host_broker_t *broker = find_broker(uri);
+    for (int i = 0; !broker && i < BROKERS_MAX; i++) {
+        if (!brokers[i].uri[0]) {
+            broker = &brokers[i];
+            strncpy(broker->uri, uri, URI_MAX - 1);
+        }
+    }
+    HOST_ASSERT(broker, "Too many brokers");
+    broker->up = up;
+    for (int i = 0; !up && i < CLIENTS_MAX; i++) {
+        if (clients[i] && clients[i]->broker == broker)
+            drop_connection(clients[i]);
+    }
+}
+
+/**
+ * @brief Connection attempts made to a broker since it was added
+*/
+int host_mqtt_connect_attempts(const char *uri) {
+    host_broker_t *broker = find_broker(uri);
+    return broker ? broker->connect_attempts : 0;
+}
+
+/**
+ * @brief Get the broker a client is connected to, or NULL if it isn't connected
+*/
+const char *host_mqtt_client_broker(esp_mqtt_client_handle_t client) {
+    return client && client->broker ? client->broker->uri : NULL;
+}
+
+/**
+ * @brief Get the LWT topic a client registered with its broker on its last connection
+*/
+const char *host_mqtt_client_lwt_topic(esp_mqtt_client_handle_t client) {
+    return client->lwt_topic;
+}
+
+/**
+ * @brief Run pending connection attempts, as the client tasks would
+*/
+void host_mqtt_run(void) {
+    for (int i = 0; i < CLIENTS_MAX; i++) {
+        esp_mqtt_client_handle_t client = clients[i];
+        if (!client || !client->started || !client->connect_pending)
+            continue;
+
+        client->connect_pending = false;
+        dispatch(client, MQTT_EVENT_BEFORE_CONNECT, NULL);
+        host_broker_t *broker = find_broker(client->uri);
+        if (broker)
+            broker->connect_attempts++;
+        if (broker && broker->up) {
+            client->broker = broker;
+            dispatch(client, MQTT_EVENT_CONNECTED, NULL);
+            continue;
+        }
+
+        esp_mqtt_error_codes_t error = { .error_type = MQTT_ERROR_TYPE_TCP_TRANSPORT, .esp_transport_sock_errno = 111 };
+        dispatch(client, MQTT_EVENT_ERROR, &error);
+        dispatch(client, MQTT_EVENT_DISCONNECTED, NULL);
+    }
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config) {
+    for (int i = 0; i < CLIENTS_MAX; i++) {
+        if (!clients[i]) {
+            clients[i] = calloc(1, sizeof(struct esp_mqtt_client));
+            esp_mqtt_set_config(clients[i], config);
+            return clients[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t *config) {
+    if (config->uri)
+        strncpy(client->uri, config->uri, URI_MAX - 1);
+    if (config->lwt_topic)
+        strncpy(client->lwt_topic, config->lwt_topic, URI_MAX - 1);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                            esp_event_handler_t event_handler, void *event_handler_arg) {
+    client->event_handler = event_handler;
+    client->event_handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+    if (client->started)
+        return ESP_FAIL;
+    client->started = true;
+    client->connect_pending = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client) {
+    if (!client->started || client->broker)
+        return ESP_FAIL;
+    client->connect_pending = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client) {
+    if (client->broker)
+        drop_connection(client);
+    return ESP_OK;
+}
+
+/**
+ * @brief Stop the client task. The connection is closed without a disconnect event
+*/
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client) {
+    client->started = false;
+    client->connect_pending = false;
+    client->broker = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client) {
+    for (int i = 0; i < CLIENTS_MAX; i++) {
+        if (clients[i] == client)
+            clients[i] = NULL;
+    }
+    free(client);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client) {
+    return 0;
+}
@@ -0,0 +1,59 @@
+// Host Stand-Ins
+#include <stdlib.h>
+#include <string.h>
+
+// Project Components
+#include "mqtt_util.h"
+
+// Project Files
+#include "host_stubs.h"
+
+#define PUBLISHES_MAX 256
+
+// Publishes are recorded instead of sent. Tracked publishes are never acknowledged
+static host_publish_t publishes[PUBLISHES_MAX];
+static int publish_count = 0;
+static int next_msg_id = 1;
+
+int mqtt_util_publish(char *topic, char *data, int data_len, int qos, int retain) {
+    if (publish_count == PUBLISHES_MAX)
+        return -1;
+
+    host_publish_t *publish = &publishes[publish_count++];
+    strncpy(publish->topic, topic, sizeof(publish->topic) - 1);
+    publish->data = malloc(data_len ? data_len : 1);
+    memcpy(publish->data, data, data_len);
+    publish->data_len = data_len;
+    publish->qos = qos;
+    return next_msg_id++;
+}
+
+int mqtt_util_publish_tracked(char *topic, char *data, int data_len, int qos, int retain,
+                                mqtt_app_ack_callback_handler_t callback_handler, void *ctx) {
+    return mqtt_util_publish(topic, data, data_len, qos, retain);
+}
+
+void mqtt_util_subscribe(char *topic, int qos) {
+}
+
+void mqtt_util_unsubscribe(char *topic) {
+}
+
+bool mqtt_app_outbox_empty() {
+    return true;
+}
+
+int host_publish_count(void) {
+    return publish_count;
+}
+
+const host_publish_t *host_publish_get(int index) {
+    return index < publish_count ? &publishes[index] : NULL;
+}
+
+void host_publish_clear(void) {
+    for (int i = 0; i < publish_count; i++)
+        free(publishes[i].data);
+    memset(publishes, 0, sizeof(publishes));
+    publish_count = 0;
+}
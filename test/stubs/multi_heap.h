@@ -0,0 +1,24 @@
+/**! @file multi_heap.h
+ *
+ * Host stand-in for the ESP-IDF multi heap API
+*/
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct multi_heap_info *multi_heap_handle_t;
+
+multi_heap_handle_t multi_heap_register(void *start, size_t size);
+void multi_heap_set_lock(multi_heap_handle_t heap, void *lock);
+void *multi_heap_malloc(multi_heap_handle_t heap, size_t size);
+void *multi_heap_realloc(multi_heap_handle_t heap, void *p, size_t size);
+void multi_heap_free(multi_heap_handle_t heap, void *p);
+size_t multi_heap_minimum_free_size(multi_heap_handle_t heap);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,101 @@
+// Host Stand-Ins
+#include <stdlib.h>
+#include <string.h>
+#include "nvs.h"
+
+// Project Files
+#include "host_stubs.h"
+
+#define NAMESPACES_MAX 8
+#define ENTRIES_MAX 64
+#define NAME_SIZE 16                // NVS keys and namespaces are limited to 15 characters
+
+typedef struct {
+    nvs_handle_t handle;
+    char key[NAME_SIZE];
+    uint8_t *value;
+    size_t length;
+} nvs_entry_t;
+
+static char namespaces[NAMESPACES_MAX][NAME_SIZE];
+static nvs_entry_t entries[ENTRIES_MAX];
+
+static nvs_entry_t *find_entry(nvs_handle_t handle, const char *key) {
+    for (int i = 0; i < ENTRIES_MAX; i++) {
+        if (entries[i].value && entries[i].handle == handle && strcmp(entries[i].key, key) == 0)
+            return &entries[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Open a namespace. Handles are namespace indexes + 1, so reopening a namespace finds its entries
+*/
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (strlen(name) >= NAME_SIZE)
+        return ESP_ERR_INVALID_ARG;
+    for (int i = 0; i < NAMESPACES_MAX; i++) {
+        if (!namespaces[i][0])
+            strcpy(namespaces[i], name);
+        if (strcmp(namespaces[i], name) == 0) {
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+/**
+ * @brief Read a blob as NVS does: a buffer at least as long as the blob gets the blob and its length
+*/
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    nvs_entry_t *entry = find_entry(handle, key);
+    if (!entry)
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (!out_value) {
+        *length = entry->length;
+        return ESP_OK;
+    }
+    if (*length < entry->length) {
+        *length = entry->length;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, entry->value, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    if (strlen(key) >= NAME_SIZE)
+        return ESP_ERR_INVALID_ARG;
+    nvs_entry_t *entry = find_entry(handle, key);
+    for (int i = 0; !entry && i < ENTRIES_MAX; i++) {
+        if (!entries[i].value)
+            entry = &entries[i];
+    }
+    if (!entry)
+        return ESP_ERR_NO_MEM;
+
+    uint8_t *copy = malloc(length ? length : 1);
+    memcpy(copy, value, length);
+    free(entry->value);
+    *entry = (nvs_entry_t) { .handle = handle, .value = copy, .length = length };
+    strcpy(entry->key, key);
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    nvs_entry_t *entry = find_entry(handle, key);
+    if (!entry)
+        return ESP_ERR_NVS_NOT_FOUND;
+    free(entry->value);
+    entry->value = NULL;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
@@ -0,0 +1,142 @@
+/**! @file sdkconfig.h
+ *
+ * Kconfig defaults for host builds. A test overrides an option with a compile definition
+*/
+#pragma once
+
+#ifndef CONFIG_LOG_MAXIMUM_LEVEL
+#define CONFIG_LOG_MAXIMUM_LEVEL 3
+#endif
+
+// Sparkplug
+#ifndef CONFIG_SPARKPLUG_GROUP_ID
+#define CONFIG_SPARKPLUG_GROUP_ID "env_sensors"
+#endif
+#ifndef CONFIG_SPARKPLUG_PAYLOAD_MAX_SIZE
+#define CONFIG_SPARKPLUG_PAYLOAD_MAX_SIZE 4096
+#endif
+#ifndef CONFIG_SPARKPLUG_DATA_SPLIT_SIZE
+#define CONFIG_SPARKPLUG_DATA_SPLIT_SIZE 1024
+#endif
+#ifndef CONFIG_SPARKPLUG_MAX_DEVICES
+#define CONFIG_SPARKPLUG_MAX_DEVICES 8
+#endif
+#ifndef CONFIG_SPARKPLUG_CMD_MAX_PAYLOAD_SIZE
+#define CONFIG_SPARKPLUG_CMD_MAX_PAYLOAD_SIZE 1024
+#endif
+#ifndef CONFIG_SPARKPLUG_PENDING_WRITES_MAX
+#define CONFIG_SPARKPLUG_PENDING_WRITES_MAX 8
+#endif
+#ifndef CONFIG_SPARKPLUG_HEAP_SIZE
+#define CONFIG_SPARKPLUG_HEAP_SIZE 24576
+#endif
+#ifndef CONFIG_SPARKPLUG_CONTROL_DRAIN_TIMEOUT
+#define CONFIG_SPARKPLUG_CONTROL_DRAIN_TIMEOUT 5000
+#endif
+#ifndef CONFIG_SPARKPLUG_COMPRESSION_THRESHOLD
+#define CONFIG_SPARKPLUG_COMPRESSION_THRESHOLD 512
+#endif
+#ifndef CONFIG_SPARKPLUG_COMPRESSION_CHAIN_DEPTH
+#define CONFIG_SPARKPLUG_COMPRESSION_CHAIN_DEPTH 16
+#endif
+#ifndef CONFIG_SPARKPLUG_PRIMARY_HOST_ID
+#define CONFIG_SPARKPLUG_PRIMARY_HOST_ID ""
+#endif
+#ifndef CONFIG_SPARKPLUG_REBIRTH_JITTER_MAX
+#define CONFIG_SPARKPLUG_REBIRTH_JITTER_MAX 5000
+#endif
+#ifndef CONFIG_SPARKPLUG_REBIRTH_MIN_INTERVAL
+#define CONFIG_SPARKPLUG_REBIRTH_MIN_INTERVAL 10000
+#endif
+#ifndef CONFIG_SPARKPLUG_QOS_BIRTH
+#define CONFIG_SPARKPLUG_QOS_BIRTH 1
+#endif
+#ifndef CONFIG_SPARKPLUG_QOS_DEATH
+#define CONFIG_SPARKPLUG_QOS_DEATH 1
+#endif
+#ifndef CONFIG_SPARKPLUG_QOS_DATA
+#define CONFIG_SPARKPLUG_QOS_DATA 0
+#endif
+#ifndef CONFIG_SPARKPLUG_QOS_READBACK
+#define CONFIG_SPARKPLUG_QOS_READBACK 1
+#endif
+#ifndef CONFIG_SPARKPLUG_QOS_ALARM
+#define CONFIG_SPARKPLUG_QOS_ALARM 1
+#endif
+#ifndef CONFIG_SPARKPLUG_QOS_COMMAND
+#define CONFIG_SPARKPLUG_QOS_COMMAND 1
+#endif
+
+// MQTT
+#ifndef CONFIG_MQTT_BROKER_URI
+#define CONFIG_MQTT_BROKER_URI "mqtt://broker-a"
+#endif
+#ifndef CONFIG_MQTT_BROKER_FAILOVER_URIS
+#define CONFIG_MQTT_BROKER_FAILOVER_URIS "mqtt://broker-b"
+#endif
+#ifndef CONFIG_MQTT_MAX_ATTEMPTS
+#define CONFIG_MQTT_MAX_ATTEMPTS 3
+#endif
+#ifndef CONFIG_MQTT_RECONNECT_DELAY
+#define CONFIG_MQTT_RECONNECT_DELAY 10
+#endif
+#ifndef CONFIG_MQTT_INFLIGHT_MAX
+#define CONFIG_MQTT_INFLIGHT_MAX 8
+#endif
+#ifndef CONFIG_MQTT_INFLIGHT_TIMEOUT
+#define CONFIG_MQTT_INFLIGHT_TIMEOUT 15000
+#endif
+#ifndef CONFIG_MQTT_RETRANSMIT_TIMEOUT
+#define CONFIG_MQTT_RETRANSMIT_TIMEOUT 3000
+#endif
+#ifndef CONFIG_MQTT_INBOUND_QUEUE_LEN
+#define CONFIG_MQTT_INBOUND_QUEUE_LEN 8
+#endif
+#ifndef CONFIG_MQTT_INBOUND_MAX_SIZE
+#define CONFIG_MQTT_INBOUND_MAX_SIZE 2048
+#endif
+#ifndef CONFIG_MQTT_KEEPALIVE_PERIOD
+#define CONFIG_MQTT_KEEPALIVE_PERIOD 15
+#endif
+#ifndef CONFIG_MQTT_AUTO_KEEPALIVE_ENABLED
+#define CONFIG_MQTT_AUTO_KEEPALIVE_ENABLED 1
+#endif
+
+// Time-series log
+#ifndef CONFIG_TS_LOG_PARTITION_LABEL
+#define CONFIG_TS_LOG_PARTITION_LABEL "tslog"
+#endif
+#ifndef CONFIG_TS_LOG_MAX_BLOCKS
+#define CONFIG_TS_LOG_MAX_BLOCKS 16
+#endif
+
+// DHT
+#ifndef CONFIG_DHT_GPIO
+#define CONFIG_DHT_GPIO 14
+#endif
+#if !defined(CONFIG_DHT_SENSOR_TYPE_11) && !defined(CONFIG_DHT_SENSOR_TYPE_12) && !defined(CONFIG_DHT_SENSOR_TYPE_21) \
+        && !defined(CONFIG_DHT_SENSOR_TYPE_AM2301)
+#define CONFIG_DHT_SENSOR_TYPE_22 1
+#endif
+#ifndef CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+#endif
+
+// Benchmarks
+#ifndef CONFIG_BENCH_DURATION
+#define CONFIG_BENCH_DURATION 200
+#endif
+#ifndef CONFIG_BENCH_REGRESSION_THRESHOLD
+#define CONFIG_BENCH_REGRESSION_THRESHOLD 10
+#endif
+
+// OTA
+#ifndef CONFIG_OTA_VERIFY_TIMEOUT
+#define CONFIG_OTA_VERIFY_TIMEOUT 300
+#endif
+#ifndef CONFIG_OTA_HTTP_TIMEOUT
+#define CONFIG_OTA_HTTP_TIMEOUT 10000
+#endif
+#ifndef CONFIG_OTA_BUFFER_SIZE
+#define CONFIG_OTA_BUFFER_SIZE 1024
+#endif
@@ -0,0 +1,48 @@
+// Host Stand-Ins
+#include <stdio.h>
+#include <string.h>
+#include "host_stubs.h"
+#include "nvs.h"
+
+// Project Components
+#include "bench.h"
+
+// Runs the on-device benchmarks on the host. Build with -DHOST_TEST_SANITIZE=OFF for meaningful timings.
+// Allocations are counted through stubs/bench_heap_host.c
+
+#define NVS_NAMESPACE "bench"
+#define RESULT_FIELDS 3             // ns/op, allocs/op in tenths and bytes/op, as bench.c stores them
+
+static size_t read_result(const char *key, uint32_t *result) {
+    nvs_handle_t handle;
+    size_t length = sizeof(uint32_t) * RESULT_FIELDS;
+    HOST_ASSERT(nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK, "NVS open failed");
+    HOST_ASSERT(nvs_get_blob(handle, key, result, &length) == ESP_OK, "No result stored for %s", key);
+    nvs_close(handle);
+    return length;
+}
+
+int main() {
+    host_log_level_set(ESP_LOG_INFO);
+    host_time_realtime(true);
+
+    // A baseline stored before the allocation fields were added has only ns/op. It still loads, and
+    // the fields it lacks are not compared
+    nvs_handle_t handle;
+    uint32_t old_baseline = UINT32_MAX / 200;
+    HOST_ASSERT(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK, "NVS open failed");
+    HOST_ASSERT(nvs_set_blob(handle, "set_u32", &old_baseline, sizeof(old_baseline)) == ESP_OK, "NVS write failed");
+    nvs_close(handle);
+
+    HOST_ASSERT(bench_run() == ESP_OK, "Benchmark failed");
+
+    uint32_t result[RESULT_FIELDS];
+    HOST_ASSERT(read_result("set_u32", result) == sizeof(old_baseline), "Old baseline replaced");
+
+    // Cases without a baseline stored their results. Setting a string metric copies the string with strdup()
+    HOST_ASSERT(read_result("set_float", result) == sizeof(result) && result[1] == 0, "Setting a float metric allocates");
+    HOST_ASSERT(read_result("set_str", result) == sizeof(result) && result[1] >= 10, "%u.%u allocations per string metric set",
+                    result[1] / 10, result[1] % 10);
+    HOST_ASSERT(read_result("enc_100", result) == sizeof(result) && result[0] > 0, "Encode not timed");
+    return 0;
+}
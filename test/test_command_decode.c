@@ -0,0 +1,222 @@
+// Host Stand-Ins
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_system.h"
+#include "host_stubs.h"
+
+// Project Components
+#include "esp_tahu.h"
+
+// Project Files
+#include "pb_writer.h"
+
+// Fuzz harness and throughput benchmark for the streaming NCMD/DCMD decoder. Mutations of a valid
+// command and random buffers are decoded and applied. Run with an iteration count as argument for a
+// longer fuzz, and build with HOST_TEST_SANITIZE=OFF for meaningful timings
+
+#define DEFAULT_ITERATIONS 200000
+#define BENCH_ITERATIONS 100000
+#define CMD_STRING_MAX 128
+
+#define PAYLOAD_METRICS_TAG org_eclipse_tahu_protobuf_Payload_metrics_tag
+#define METRIC_NAME_TAG org_eclipse_tahu_protobuf_Payload_Metric_name_tag
+#define METRIC_ALIAS_TAG org_eclipse_tahu_protobuf_Payload_Metric_alias_tag
+
+enum {
+    METRIC_SETPOINT,
+    METRIC_ENABLE,
+    METRIC_MODE,
+    METRIC_COUNT,
+    METRIC_TOTAL,
+    METRIC_NUM
+};
+
+static char node_id[] = "node";
+static char device_id[] = "dev";
+static char dcmd_topic[] = "spBv1.0/" CONFIG_SPARKPLUG_GROUP_ID "/DCMD/node/dev";
+static esp_tahu_metric_t metrics[METRIC_NUM];
+static esp_tahu_metric_t *setpoint_changed;     // Metric passed to the last setpoint change callback
+
+static void setpoint_change(float *new_value, esp_tahu_metric_t *metric) {
+    // Compared bitwise, as fuzzed commands write NaN
+    HOST_ASSERT(memcmp(new_value, &metric->value.float_value, sizeof(float)) == 0, "Callback value differs from the metric");
+    setpoint_changed = metric;
+}
+
+static void create_metrics() {
+    esp_tahu_create_metric(device_id, &metrics[METRIC_SETPOINT], "Setpoint", ESP_TAHU_METRIC_TYPE_FLOAT,
+                            (esp_tahu_metric_change_callback_t) setpoint_change);
+    esp_tahu_create_metric(device_id, &metrics[METRIC_ENABLE], "Enable", ESP_TAHU_METRIC_TYPE_BOOLEAN, NULL);
+    esp_tahu_create_metric(device_id, &metrics[METRIC_MODE], "Mode", ESP_TAHU_METRIC_TYPE_STRING, NULL);
+    esp_tahu_create_metric(device_id, &metrics[METRIC_COUNT], "Count", ESP_TAHU_METRIC_TYPE_INT32, NULL);
+    esp_tahu_create_metric(device_id, &metrics[METRIC_TOTAL], "Total", ESP_TAHU_METRIC_TYPE_UINT64, NULL);
+}
+
+/**
+ * @brief Build a DCMD writing every metric, by alias and by name, with an unknown metric and
+ * unknown fields in between
+*/
+static size_t build_seed(uint8_t *buffer, size_t size) {
+    pb_writer_t payload = { .buffer = buffer, .size = size };
+    uint8_t metric_buffer[256];
+    pb_writer_t metric;
+
+    pb_writer_uint(&payload, org_eclipse_tahu_protobuf_Payload_timestamp_tag, 1700000000000ULL);
+
+    metric = (pb_writer_t) { .buffer = metric_buffer, .size = sizeof(metric_buffer) };
+    pb_writer_uint(&metric, METRIC_ALIAS_TAG, metrics[METRIC_SETPOINT].alias);
+    pb_writer_uint(&metric, org_eclipse_tahu_protobuf_Payload_Metric_datatype_tag, METRIC_DATA_TYPE_FLOAT);
+    pb_writer_float(&metric, org_eclipse_tahu_protobuf_Payload_Metric_float_value_tag, 21.5f);
+    pb_writer_message(&payload, PAYLOAD_METRICS_TAG, &metric);
+
+    metric = (pb_writer_t) { .buffer = metric_buffer, .size = sizeof(metric_buffer) };
+    pb_writer_string(&metric, METRIC_NAME_TAG, "Enable");
+    pb_writer_uint(&metric, org_eclipse_tahu_protobuf_Payload_Metric_boolean_value_tag, 1);
+    pb_writer_message(&payload, PAYLOAD_METRICS_TAG, &metric);
+
+    metric = (pb_writer_t) { .buffer = metric_buffer, .size = sizeof(metric_buffer) };
+    pb_writer_string(&metric, METRIC_NAME_TAG, "Unknown");
+    uint8_t blob[64];
+    memset(blob, 0xEE, sizeof(blob));
+    pb_writer_bytes(&metric, org_eclipse_tahu_protobuf_Payload_Metric_bytes_value_tag, blob, sizeof(blob));
+    pb_writer_message(&payload, PAYLOAD_METRICS_TAG, &metric);
+
+    metric = (pb_writer_t) { .buffer = metric_buffer, .size = sizeof(metric_buffer) };
+    pb_writer_string(&metric, METRIC_NAME_TAG, "Mode");
+    pb_writer_string(&metric, org_eclipse_tahu_protobuf_Payload_Metric_string_value_tag, "auto");
+    pb_writer_message(&payload, PAYLOAD_METRICS_TAG, &metric);
+
+    metric = (pb_writer_t) { .buffer = metric_buffer, .size = sizeof(metric_buffer) };
+    pb_writer_uint(&metric, METRIC_ALIAS_TAG, metrics[METRIC_COUNT].alias);
+    pb_writer_double(&metric, 99, 1.0);     // Unknown field
+    pb_writer_uint(&metric, org_eclipse_tahu_protobuf_Payload_Metric_int_value_tag, 7);
+    pb_writer_message(&payload, PAYLOAD_METRICS_TAG, &metric);
+
+    metric = (pb_writer_t) { .buffer = metric_buffer, .size = sizeof(metric_buffer) };
+    pb_writer_uint(&metric, METRIC_ALIAS_TAG, metrics[METRIC_TOTAL].alias);
+    pb_writer_uint(&metric, org_eclipse_tahu_protobuf_Payload_Metric_long_value_tag, 1ULL << 40);
+    pb_writer_message(&payload, PAYLOAD_METRICS_TAG, &metric);
+
+    pb_writer_uint(&payload, org_eclipse_tahu_protobuf_Payload_seq_tag, 3);
+    HOST_ASSERT(payload.length <= size, "Seed of %zu bytes doesn't fit", payload.length);
+    return payload.length;
+}
+
+static esp_err_t decode(uint8_t *payload, size_t length) {
+    esp_err_t result = esp_tahu_message_received(dcmd_topic, strlen(dcmd_topic), (char *)payload, length);
+    esp_tahu_apply_pending();
+    // Readbacks are recorded by the MQTT stand-in and never acknowledged
+    host_publish_clear();
+    return result;
+}
+
+static void check_seed(uint8_t *seed, size_t seed_length) {
+    setpoint_changed = NULL;
+    HOST_ASSERT(decode(seed, seed_length) == ESP_OK, "Valid command rejected");
+    HOST_ASSERT(metrics[METRIC_SETPOINT].value.float_value == 21.5f, "Setpoint not written by alias");
+    HOST_ASSERT(setpoint_changed == &metrics[METRIC_SETPOINT], "Change callback not given the written metric");
+    HOST_ASSERT(metrics[METRIC_ENABLE].value.boolean_value, "Enable not written by name");
+    HOST_ASSERT(strcmp(metrics[METRIC_MODE].value.string_value, "auto") == 0, "Mode not written");
+    HOST_ASSERT(metrics[METRIC_COUNT].value.int_value == 7, "Count not written past an unknown field");
+    HOST_ASSERT(metrics[METRIC_TOTAL].value.long_value == 1ULL << 40, "Total not written");
+}
+
+static void check_metrics_sane() {
+    char *mode = metrics[METRIC_MODE].value.string_value;
+    HOST_ASSERT(mode && strnlen(mode, CMD_STRING_MAX) < CMD_STRING_MAX, "Mode string not terminated within bounds");
+}
+
+static size_t mutate(uint8_t *buffer, size_t length, size_t size) {
+    int mutations = 1 + esp_random() % 4;
+    for (int i = 0; i < mutations; i++) {
+        size_t pos = length ? esp_random() % length : 0;
+        switch (esp_random() % 5) {
+            case 0:
+                if (length)
+                    buffer[pos] ^= 1 << (esp_random() % 8);
+                break;
+            case 1:
+                if (length)
+                    buffer[pos] = esp_random();
+                break;
+            case 2:
+                if (length < size) {
+                    memmove(buffer + pos + 1, buffer + pos, length - pos);
+                    buffer[pos] = esp_random();
+                    length++;
+                }
+                break;
+            case 3:
+                if (length) {
+                    memmove(buffer + pos, buffer + pos + 1, length - pos - 1);
+                    length--;
+                }
+                break;
+            default:
+                // Varint continuation bytes stress length and tag decoding
+                if (length)
+                    buffer[pos] |= 0x80;
+                break;
+        }
+    }
+    return length;
+}
+
+static double elapsed_ns(struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+    host_log_level_set(ESP_LOG_NONE);
+    host_random_seed(12345);
+
+    create_metrics();
+    esp_tahu_configure(node_id);
+    esp_tahu_init_node(NULL, 0);
+    esp_tahu_init_device(device_id, metrics, METRIC_NUM);
+    host_publish_clear();
+
+    uint8_t seed[512];
+    size_t seed_length = build_seed(seed, sizeof(seed));
+    check_seed(seed, seed_length);
+
+    // Every truncation must be handled, most of them as malformed
+    for (size_t length = 0; length < seed_length; length++)
+        decode(seed, length);
+    check_metrics_sane();
+
+    uint8_t buffer[CONFIG_SPARKPLUG_CMD_MAX_PAYLOAD_SIZE + 16];
+    for (long i = 0; i < iterations; i++) {
+        size_t length;
+        if (i % 8 == 0) {
+            length = esp_random() % sizeof(buffer);
+            for (size_t j = 0; j < length; j++)
+                buffer[j] = esp_random();
+        } else {
+            memcpy(buffer, seed, seed_length);
+            length = mutate(buffer, seed_length, sizeof(buffer));
+        }
+        decode(buffer, length);
+        check_metrics_sane();
+    }
+
+    // The decoder must still work after the fuzz
+    check_seed(seed, seed_length);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // Repeated writes coalesce into the staged slots, so only the last one is applied
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+        esp_tahu_decode_command((char *)seed, seed_length, metrics, METRIC_NUM);
+    double decode_ns = elapsed_ns(&start) / BENCH_ITERATIONS;
+    esp_tahu_apply_pending();
+    host_publish_clear();
+    printf("Fuzzed %ld inputs. Decoded a %zu byte command with %d metrics in %.0f ns/op\n",
+            iterations, seed_length, METRIC_NUM + 1, decode_ns);
+    return 0;
+}
@@ -0,0 +1,266 @@
+// Host Stand-Ins
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+#include "esp_err.h"
+#include "host_stubs.h"
+
+// Project Components
+#include "esp_tahu_compress.h"
+
+// Project Files
+#include "pb_writer.h"
+
+// Compression ratio and CPU time of the payload compressor on Sparkplug payloads shaped like the
+// node's DBIRTHs and historical replays. Streams are checked against zlib in both directions.
+// Build with HOST_TEST_SANITIZE=OFF for meaningful timings. Decompression on the host uses zlib
+// in place of the ROM inflater, so only compression is timed
+
+#define BENCH_ITERATIONS 200
+#define PAYLOAD_SIZE_MAX 8192
+#define BIRTH_ZONES 8
+#define HISTORY_SAMPLES 24
+
+// Sparkplug B field numbers
+#define PAYLOAD_TIMESTAMP 1
+#define PAYLOAD_METRICS 2
+#define PAYLOAD_SEQ 3
+#define METRIC_NAME 1
+#define METRIC_ALIAS 2
+#define METRIC_TIMESTAMP 3
+#define METRIC_DATATYPE 4
+#define METRIC_IS_HISTORICAL 5
+#define METRIC_PROPERTIES 9
+#define METRIC_INT_VALUE 10
+#define METRIC_FLOAT_VALUE 12
+#define METRIC_BOOLEAN_VALUE 14
+#define PROPERTY_SET_KEYS 1
+#define PROPERTY_SET_VALUES 2
+#define PROPERTY_VALUE_TYPE 1
+#define PROPERTY_VALUE_FLOAT 5
+#define PROPERTY_VALUE_STRING 8
+
+#define DATATYPE_UINT32 7
+#define DATATYPE_FLOAT 9
+#define DATATYPE_BOOLEAN 11
+#define DATATYPE_STRING 12
+
+#define BASE_TIMESTAMP 1700000000000ULL
+
+typedef struct {
+    const char *name;
+    size_t (*build)(uint8_t *buffer, size_t size);
+    double max_ratio;       // Largest compressed to raw ratio accepted
+} payload_case_t;
+
+static void add_properties(pb_writer_t *metric, const char *unit, float low, float high) {
+    uint8_t buffer[128];
+    pb_writer_t properties = { .buffer = buffer, .size = sizeof(buffer) };
+    pb_writer_string(&properties, PROPERTY_SET_KEYS, "engUnit");
+    pb_writer_string(&properties, PROPERTY_SET_KEYS, "engLow");
+    pb_writer_string(&properties, PROPERTY_SET_KEYS, "engHigh");
+
+    uint8_t value_buffer[32];
+    pb_writer_t value = { .buffer = value_buffer, .size = sizeof(value_buffer) };
+    pb_writer_uint(&value, PROPERTY_VALUE_TYPE, DATATYPE_STRING);
+    pb_writer_string(&value, PROPERTY_VALUE_STRING, unit);
+    pb_writer_message(&properties, PROPERTY_SET_VALUES, &value);
+    value.length = 0;
+    pb_writer_uint(&value, PROPERTY_VALUE_TYPE, DATATYPE_FLOAT);
+    pb_writer_float(&value, PROPERTY_VALUE_FLOAT, low);
+    pb_writer_message(&properties, PROPERTY_SET_VALUES, &value);
+    value.length = 0;
+    pb_writer_uint(&value, PROPERTY_VALUE_TYPE, DATATYPE_FLOAT);
+    pb_writer_float(&value, PROPERTY_VALUE_FLOAT, high);
+    pb_writer_message(&properties, PROPERTY_SET_VALUES, &value);
+
+    pb_writer_message(metric, METRIC_PROPERTIES, &properties);
+}
+
+static void add_metric(pb_writer_t *payload, const char *name, uint64_t alias, uint64_t timestamp, uint32_t datatype,
+                        bool is_historical, const void *value, bool with_properties) {
+    uint8_t buffer[256];
+    pb_writer_t metric = { .buffer = buffer, .size = sizeof(buffer) };
+    if (name)
+        pb_writer_string(&metric, METRIC_NAME, name);
+    pb_writer_uint(&metric, METRIC_ALIAS, alias);
+    pb_writer_uint(&metric, METRIC_TIMESTAMP, timestamp);
+    pb_writer_uint(&metric, METRIC_DATATYPE, datatype);
+    if (is_historical)
+        pb_writer_uint(&metric, METRIC_IS_HISTORICAL, 1);
+    if (with_properties)
+        add_properties(&metric, datatype == DATATYPE_FLOAT ? "degF" : "", 0.0f, 100.0f);
+    switch (datatype) {
+        case DATATYPE_FLOAT:
+            pb_writer_float(&metric, METRIC_FLOAT_VALUE, *(const float *)value);
+            break;
+        case DATATYPE_BOOLEAN:
+            pb_writer_uint(&metric, METRIC_BOOLEAN_VALUE, *(const bool *)value);
+            break;
+        default:
+            pb_writer_uint(&metric, METRIC_INT_VALUE, *(const uint32_t *)value);
+            break;
+    }
+    pb_writer_message(payload, PAYLOAD_METRICS, &metric);
+}
+
+/**
+ * @brief DBIRTH of a multi-zone controller. Every zone has the same metrics with engineering unit properties
+*/
+static size_t build_birth(uint8_t *buffer, size_t size) {
+    pb_writer_t payload = { .buffer = buffer, .size = size };
+    pb_writer_uint(&payload, PAYLOAD_TIMESTAMP, BASE_TIMESTAMP);
+    uint64_t alias = 10;
+    for (int zone = 1; zone <= BIRTH_ZONES; zone++) {
+        char name[64];
+        float setpoint = 38.0f + zone;
+        float temperature = 40.25f + zone * 0.75f;
+        bool cooling = zone & 1;
+        uint32_t cycles = 120 + zone * 7;
+        snprintf(name, sizeof(name), "Zone %d/Setpoint", zone);
+        add_metric(&payload, name, alias++, BASE_TIMESTAMP, DATATYPE_FLOAT, false, &setpoint, true);
+        snprintf(name, sizeof(name), "Zone %d/Temperature", zone);
+        add_metric(&payload, name, alias++, BASE_TIMESTAMP, DATATYPE_FLOAT, false, &temperature, true);
+        snprintf(name, sizeof(name), "Zone %d/Cooling", zone);
+        add_metric(&payload, name, alias++, BASE_TIMESTAMP, DATATYPE_BOOLEAN, false, &cooling, true);
+        snprintf(name, sizeof(name), "Zone %d/Analytics/Cycles", zone);
+        add_metric(&payload, name, alias++, BASE_TIMESTAMP, DATATYPE_UINT32, false, &cycles, true);
+    }
+    pb_writer_uint(&payload, PAYLOAD_SEQ, 1);
+    return payload.length;
+}
+
+/**
+ * @brief Historical replay of temperature and humidity samples taken once a minute, published by alias
+*/
+static size_t build_history(uint8_t *buffer, size_t size) {
+    pb_writer_t payload = { .buffer = buffer, .size = size };
+    pb_writer_uint(&payload, PAYLOAD_TIMESTAMP, BASE_TIMESTAMP);
+    for (int sample = 0; sample < HISTORY_SAMPLES; sample++) {
+        uint64_t timestamp = BASE_TIMESTAMP - (HISTORY_SAMPLES - sample) * 60000ULL;
+        float temperature = 41.5f + (sample % 5) * 0.1f;
+        float humidity = 63.0f + (sample % 3) * 0.5f;
+        add_metric(&payload, NULL, 11, timestamp, DATATYPE_FLOAT, true, &temperature, false);
+        add_metric(&payload, NULL, 12, timestamp, DATATYPE_FLOAT, true, &humidity, false);
+    }
+    pb_writer_uint(&payload, PAYLOAD_SEQ, 2);
+    return payload.length;
+}
+
+/**
+ * @brief Periodic DDATA of a single zone, too small and varied to compress well
+*/
+static size_t build_ddata(uint8_t *buffer, size_t size) {
+    pb_writer_t payload = { .buffer = buffer, .size = size };
+    pb_writer_uint(&payload, PAYLOAD_TIMESTAMP, BASE_TIMESTAMP);
+    float temperature = 40.75f;
+    bool cooling = true;
+    add_metric(&payload, NULL, 11, BASE_TIMESTAMP, DATATYPE_FLOAT, false, &temperature, false);
+    add_metric(&payload, NULL, 12, BASE_TIMESTAMP, DATATYPE_BOOLEAN, false, &cooling, false);
+    pb_writer_uint(&payload, PAYLOAD_SEQ, 3);
+    return payload.length;
+}
+
+static double elapsed_ns(struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * @brief Inflate with zlib. GZIP streams are detected from their header
+*/
+static ssize_t zlib_inflate(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len) {
+    z_stream stream = { 0 };
+    if (inflateInit2(&stream, MAX_WBITS + 32) != Z_OK)
+        return -1;
+    stream.next_in = (Bytef *)in;
+    stream.avail_in = in_len;
+    stream.next_out = out;
+    stream.avail_out = out_len;
+    int result = inflate(&stream, Z_FINISH);
+    ssize_t length = stream.total_out;
+    inflateEnd(&stream);
+    return result == Z_STREAM_END ? length : -1;
+}
+
+static void check_round_trip(const char *name, const uint8_t *raw, size_t raw_len, esp_tahu_compression_t algorithm) {
+    static uint8_t compressed[PAYLOAD_SIZE_MAX * 2];
+    static uint8_t decompressed[PAYLOAD_SIZE_MAX];
+    const char *algorithm_name = algorithm == ESP_TAHU_COMPRESSION_GZIP ? "GZIP" : "DEFLATE";
+
+    ssize_t compressed_len = esp_tahu_compress(raw, raw_len, compressed, sizeof(compressed), algorithm);
+    HOST_ASSERT(compressed_len > 0, "%s: %s compression failed", name, algorithm_name);
+
+    ssize_t length = esp_tahu_decompress(compressed, compressed_len, decompressed, sizeof(decompressed), algorithm);
+    HOST_ASSERT(length == raw_len && memcmp(decompressed, raw, raw_len) == 0, "%s: %s round trip mismatch", name, algorithm_name);
+    length = zlib_inflate(compressed, compressed_len, decompressed, sizeof(decompressed));
+    HOST_ASSERT(length == raw_len && memcmp(decompressed, raw, raw_len) == 0, "%s: %s stream rejected by zlib", name, algorithm_name);
+
+    // Streams from other implementations are accepted too
+    uLongf zlib_len = sizeof(compressed);
+    HOST_ASSERT(compress2(compressed, &zlib_len, raw, raw_len, Z_BEST_COMPRESSION) == Z_OK, "%s: zlib compression failed", name);
+    length = esp_tahu_decompress(compressed, zlib_len, decompressed, sizeof(decompressed), ESP_TAHU_COMPRESSION_DEFLATE);
+    HOST_ASSERT(length == raw_len && memcmp(decompressed, raw, raw_len) == 0, "%s: zlib stream not decompressed", name);
+}
+
+static void check_failures(const uint8_t *raw, size_t raw_len) {
+    static uint8_t compressed[PAYLOAD_SIZE_MAX * 2];
+    static uint8_t decompressed[PAYLOAD_SIZE_MAX];
+
+    for (int algorithm = ESP_TAHU_COMPRESSION_DEFLATE; algorithm <= ESP_TAHU_COMPRESSION_GZIP; algorithm++) {
+        ssize_t compressed_len = esp_tahu_compress(raw, raw_len, compressed, sizeof(compressed), algorithm);
+        HOST_ASSERT(esp_tahu_compress(raw, raw_len, compressed, compressed_len - 1, algorithm) < 0, "Compression into a short buffer succeeded");
+        HOST_ASSERT(esp_tahu_decompress(compressed, compressed_len, decompressed, raw_len - 1, algorithm) < 0, "Decompression into a short buffer succeeded");
+
+        // A corrupted checksum must be caught
+        compressed[compressed_len - 5] ^= 0x01;
+        HOST_ASSERT(esp_tahu_decompress(compressed, compressed_len, decompressed, sizeof(decompressed), algorithm) < 0, "Corrupted checksum accepted");
+        HOST_ASSERT(esp_tahu_decompress(compressed, compressed_len / 2, decompressed, sizeof(decompressed), algorithm) < 0, "Truncated stream accepted");
+    }
+}
+
+static void measure(const payload_case_t *payload_case) {
+    static uint8_t raw[PAYLOAD_SIZE_MAX];
+    static uint8_t compressed[PAYLOAD_SIZE_MAX * 2];
+    size_t raw_len = payload_case->build(raw, sizeof(raw));
+    HOST_ASSERT(raw_len <= sizeof(raw), "%s payload of %zu bytes doesn't fit", payload_case->name, raw_len);
+
+    check_round_trip(payload_case->name, raw, raw_len, ESP_TAHU_COMPRESSION_DEFLATE);
+    check_round_trip(payload_case->name, raw, raw_len, ESP_TAHU_COMPRESSION_GZIP);
+
+    ssize_t compressed_len = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+        compressed_len = esp_tahu_compress(raw, raw_len, compressed, sizeof(compressed), ESP_TAHU_COMPRESSION_DEFLATE);
+    double compress_ns = elapsed_ns(&start) / BENCH_ITERATIONS;
+
+    uLongf zlib_len = sizeof(compressed);
+    compress2(compressed, &zlib_len, raw, raw_len, Z_BEST_COMPRESSION);
+
+    double ratio = (double)compressed_len / raw_len;
+    printf("%-8s %5zu -> %5zd bytes (%.2f, zlib -9 %.2f), compressed in %6.1f us (%.1f MB/s)\n", payload_case->name, raw_len,
+            compressed_len, ratio, (double)zlib_len / raw_len, compress_ns / 1000, raw_len / compress_ns * 1000);
+    HOST_ASSERT(ratio <= payload_case->max_ratio, "%s compressed to %.2f of its size, expected at most %.2f",
+                payload_case->name, ratio, payload_case->max_ratio);
+}
+
+int main() {
+    static const payload_case_t cases[] = {
+        { "DBIRTH", build_birth, 0.25 },
+        { "History", build_history, 0.40 },
+        { "DDATA", build_ddata, 1.10 },
+    };
+
+    host_log_level_set(ESP_LOG_NONE);
+    HOST_ASSERT(esp_tahu_compress_init() == ESP_OK, "Compressor init failed");
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        measure(&cases[i]);
+
+    static uint8_t raw[PAYLOAD_SIZE_MAX];
+    check_failures(raw, build_birth(raw, sizeof(raw)));
+    return 0;
+}
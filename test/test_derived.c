@@ -0,0 +1,147 @@
+// Host Stand-Ins
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_system.h"
+#include "host_stubs.h"
+
+// Project Components
+#include "derived.h"
+
+// Accuracy of the fast exp() and log() against double precision libm, their range limits, and
+// the derived formulas against reference implementations using libm
+
+#define EXP_MAX_RELATIVE_ERROR (3 * FLT_EPSILON)
+#define LOG_MAX_RELATIVE_ERROR (3 * FLT_EPSILON)
+#define RANDOM_SAMPLES 1000000
+#define LOG_BITS_STRIDE 997         // Step through positive normal floats, prime so every mantissa region is hit
+
+typedef struct {
+    double max_error;
+    float worst_x;
+} error_stats_t;
+
+static float random_float(float low, float high) {
+    return low + (high - low) * (esp_random() / 4294967296.0);
+}
+
+static void record_error(error_stats_t *stats, float x, float value, double reference) {
+    double error = reference == 0 ? fabs(value) : fabs((value - reference) / reference);
+    if (error > stats->max_error || isnan(value)) {
+        stats->max_error = isnan(value) ? INFINITY : error;
+        stats->worst_x = x;
+    }
+}
+
+static void test_exp_accuracy() {
+    error_stats_t stats = { 0 };
+    // Whole normal range, then the sensor range of the Magnus exponent at a finer density
+    for (float x = -87.3f; x <= 88.7f; x += 0.001f)
+        record_error(&stats, x, derived_fast_exp(x), exp(x));
+    for (int i = 0; i < RANDOM_SAMPLES; i++) {
+        float x = random_float(-10, 10);
+        record_error(&stats, x, derived_fast_exp(x), exp(x));
+    }
+    printf("exp max relative error %.3g (%.2f eps) at x = %.9g\n", stats.max_error, stats.max_error / FLT_EPSILON, stats.worst_x);
+    HOST_ASSERT(stats.max_error <= EXP_MAX_RELATIVE_ERROR, "exp relative error %.3g at x = %.9g", stats.max_error, stats.worst_x);
+}
+
+static void test_exp_limits() {
+    float x = nextafterf(logf(FLT_MIN), 0);
+    float value = derived_fast_exp(x);
+    HOST_ASSERT(value >= FLT_MIN && fabs((value - exp(x)) / exp(x)) <= EXP_MAX_RELATIVE_ERROR, "exp(%.9g) = %g", x, value);
+    HOST_ASSERT(derived_fast_exp(-87.34f) == 0, "exp below ln(FLT_MIN) not flushed to 0");
+    HOST_ASSERT(derived_fast_exp(-1000) == 0, "exp(-1000) not 0");
+
+    x = 88.72f;
+    value = derived_fast_exp(x);
+    HOST_ASSERT(isfinite(value) && fabs((value - exp(x)) / exp(x)) <= EXP_MAX_RELATIVE_ERROR, "exp(%.9g) = %g", x, value);
+    HOST_ASSERT(isinf(derived_fast_exp(88.73f)), "exp above ln(FLT_MAX) not infinite");
+    HOST_ASSERT(derived_fast_exp(0) == 1, "exp(0) = %g", derived_fast_exp(0));
+}
+
+static void test_log_accuracy() {
+    error_stats_t stats = { 0 };
+    for (uint32_t bits = 0x00800000; bits < 0x7F800000; bits += LOG_BITS_STRIDE) {
+        float x;
+        memcpy(&x, &bits, sizeof(x));
+        record_error(&stats, x, derived_fast_log(x), log(x));
+    }
+    // Relative humidity fractions, where log() is near 0
+    for (int i = 0; i < RANDOM_SAMPLES; i++) {
+        float x = random_float(0.01f, 1.0f);
+        record_error(&stats, x, derived_fast_log(x), log(x));
+    }
+    printf("log max relative error %.3g (%.2f eps) at x = %.9g\n", stats.max_error, stats.max_error / FLT_EPSILON, stats.worst_x);
+    HOST_ASSERT(stats.max_error <= LOG_MAX_RELATIVE_ERROR, "log relative error %.3g at x = %.9g", stats.max_error, stats.worst_x);
+}
+
+static void test_log_limits() {
+    HOST_ASSERT(derived_fast_log(1) == 0, "log(1) = %g", derived_fast_log(1));
+    HOST_ASSERT(isinf(derived_fast_log(0)) && derived_fast_log(0) < 0, "log(0) not -inf");
+    HOST_ASSERT(isnan(derived_fast_log(-1)), "log(-1) not NaN");
+    HOST_ASSERT(isinf(derived_fast_log(INFINITY)) && derived_fast_log(INFINITY) > 0, "log(inf) not inf");
+}
+
+static void test_formulas() {
+    double max_dew_point = 0, max_absolute_humidity = 0;
+    for (float temperature = -40; temperature <= 60; temperature += 0.5f) {
+        for (float humidity = 1; humidity <= 100; humidity += 1) {
+            float inputs[] = { temperature, humidity };
+            double gamma = log(humidity / 100.0) + 17.62 * temperature / (243.12 + temperature);
+            double dew_point = 243.12 * gamma / (17.62 - gamma);
+            double absolute_humidity = 6.112 * exp(17.67 * temperature / (temperature + 243.5)) * humidity * 2.1674 / (273.15 + temperature);
+            max_dew_point = fmax(max_dew_point, fabs(derived_dew_point(inputs) - dew_point));
+            max_absolute_humidity = fmax(max_absolute_humidity, fabs(derived_absolute_humidity(inputs) - absolute_humidity) / absolute_humidity);
+        }
+    }
+    printf("Dew point max error %.3g C, absolute humidity max relative error %.3g\n", max_dew_point, max_absolute_humidity);
+    HOST_ASSERT(max_dew_point < 0.001, "Dew point off by %.3g C", max_dew_point);
+    HOST_ASSERT(max_absolute_humidity < 1e-5, "Absolute humidity off by %.3g", max_absolute_humidity);
+
+    float zero_humidity[] = { 20, 0 };
+    HOST_ASSERT(isnan(derived_dew_point(zero_humidity)), "Dew point at 0 %%RH not NaN");
+}
+
+/**
+ * @brief A derived metric is published as null until every input has a value
+*/
+static void test_null_inputs() {
+    static char temperature_name[] = "temperature", humidity_name[] = "humidity", dew_point_name[] = "dew point";
+    esp_tahu_metric_t temperature, humidity, dew_point;
+    esp_tahu_create_metric(NULL, &temperature, temperature_name, ESP_TAHU_METRIC_TYPE_FLOAT, NULL);
+    esp_tahu_create_metric(NULL, &humidity, humidity_name, ESP_TAHU_METRIC_TYPE_FLOAT, NULL);
+    esp_tahu_create_metric(NULL, &dew_point, dew_point_name, ESP_TAHU_METRIC_TYPE_FLOAT, NULL);
+    temperature.is_null = true;
+    humidity.is_null = true;
+
+    derived_metric_t derived;
+    esp_tahu_metric_t *inputs[] = { &temperature, &humidity };
+    HOST_ASSERT(derived_init(&derived, &dew_point, derived_dew_point, inputs, 2) == ESP_OK, "Init failed");
+    HOST_ASSERT(!derived_update(&derived) && dew_point.is_null, "Dew point computed without inputs");
+
+    float value = 20;
+    esp_tahu_set_metric_data(&temperature, false, &value);
+    HOST_ASSERT(!derived_update(&derived) && dew_point.is_null, "Dew point computed without humidity");
+
+    value = 50;
+    esp_tahu_set_metric_data(&humidity, false, &value);
+    HOST_ASSERT(derived_update(&derived) && !dew_point.is_null, "Dew point not computed once both inputs have values");
+    HOST_ASSERT(fabsf(dew_point.value.float_value - 9.26f) < 0.01f, "Dew point %g", dew_point.value.float_value);
+}
+
+int main() {
+    host_log_level_set(ESP_LOG_NONE);
+    host_random_seed(12345);
+
+    test_exp_accuracy();
+    test_exp_limits();
+    test_log_accuracy();
+    test_log_limits();
+    test_formulas();
+    test_null_inputs();
+    return 0;
+}
@@ -0,0 +1,213 @@
+// Host Stand-Ins
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "host_stubs.h"
+
+// Project Components
+#include "mqtt_app.h"
+
+// Broker failover, Next Server and warm standby promotion of mqtt-app against two emulated brokers.
+// Built once with and once without MQTT_WARM_STANDBY
+
+#define BROKER_A CONFIG_MQTT_BROKER_URI
+#define BROKER_B CONFIG_MQTT_BROKER_FAILOVER_URIS
+#define RECONNECT_DELAY_MS (CONFIG_MQTT_RECONNECT_DELAY * 1000)
+#define PRIMARY_LWT_ID 1
+
+static int connected_calls = 0;
+static int disconnected_calls = 0;
+static char primary_lwt_topic[] = "lwt/primary";
+static char primary_lwt_msg[] = "death";
+#if CONFIG_MQTT_WARM_STANDBY
+static char standby_lwt_topics[8][32];
+static char standby_lwt_msg[] = "standby death";
+static int standby_lwt_count = 0;
+#endif
+
+static void connected() {
+    connected_calls++;
+}
+
+static void disconnected() {
+    disconnected_calls++;
+}
+
+#if CONFIG_MQTT_WARM_STANDBY
+static void standby_lwt(mqtt_app_lwt_info_t *lwt_info) {
+    char *topic = standby_lwt_topics[standby_lwt_count % 8];
+    snprintf(topic, sizeof(standby_lwt_topics[0]), "lwt/standby-%d", standby_lwt_count);
+    lwt_info->topic = topic;
+    lwt_info->msg = standby_lwt_msg;
+    lwt_info->msg_len = strlen(standby_lwt_msg);
+    lwt_info->id = 100 + standby_lwt_count++;
+}
+#endif
+
+static void advance_ms(int64_t ms) {
+    host_time_advance(ms * 1000);
+    host_mqtt_run();
+}
+
+static void check_primary(const char *uri) {
+    HOST_ASSERT(mqtt_app_connected, "Not connected");
+    HOST_ASSERT(strcmp(mqtt_app_get_broker_uri(), uri) == 0, "Broker is %s, not %s", mqtt_app_get_broker_uri(), uri);
+    const char *connected_uri = host_mqtt_client_broker(mqtt_app_client);
+    HOST_ASSERT(connected_uri && strcmp(connected_uri, uri) == 0, "Primary client connected to %s, not %s", connected_uri, uri);
+}
+
+static void start() {
+    host_mqtt_broker_set(BROKER_A, true);
+    host_mqtt_broker_set(BROKER_B, true);
+    mqtt_app_lwt_info = (mqtt_app_lwt_info_t) {
+        .topic = primary_lwt_topic,
+        .msg = primary_lwt_msg,
+        .msg_len = strlen(primary_lwt_msg),
+        .id = PRIMARY_LWT_ID,
+    };
+    mqtt_app_connected_callback_register(connected);
+    mqtt_app_disconnected_callback_register(disconnected);
+#if CONFIG_MQTT_WARM_STANDBY
+    mqtt_app_standby_lwt_callback_register(standby_lwt);
+#endif
+    mqtt_app_init();
+    mqtt_app_start();
+    host_mqtt_run();
+
+    check_primary(BROKER_A);
+    HOST_ASSERT(mqtt_app_get_connect_count() == 1 && connected_calls == 1, "%d connections reported", connected_calls);
+    HOST_ASSERT(mqtt_app_get_lwt_id() == PRIMARY_LWT_ID, "Primary LWT id %d", mqtt_app_get_lwt_id());
+}
+
+#if !CONFIG_MQTT_WARM_STANDBY
+/**
+ * @brief A lost broker is retried every reconnect delay from a timer, then the client fails over
+*/
+static void test_failover() {
+    int64_t drop_time = esp_timer_get_time();
+    int attempts = host_mqtt_connect_attempts(BROKER_A);
+    host_mqtt_broker_set(BROKER_A, false);
+    HOST_ASSERT(!mqtt_app_connected && disconnected_calls == 1, "Disconnect not reported");
+    // The event handler must return right away rather than delay the client task
+    HOST_ASSERT(esp_timer_get_time() == drop_time, "Event handler blocked for %lld us", (long long)(esp_timer_get_time() - drop_time));
+    host_mqtt_run();
+    HOST_ASSERT(host_mqtt_connect_attempts(BROKER_A) == attempts, "Reconnected without delay");
+
+    for (int i = 1; i <= CONFIG_MQTT_MAX_ATTEMPTS; i++) {
+        advance_ms(RECONNECT_DELAY_MS - 1);
+        HOST_ASSERT(host_mqtt_connect_attempts(BROKER_A) == attempts + i - 1, "Attempt %d made before the reconnect delay", i);
+        advance_ms(1);
+        HOST_ASSERT(host_mqtt_connect_attempts(BROKER_A) == attempts + i, "Attempt %d not made after the reconnect delay", i);
+    }
+    HOST_ASSERT(!mqtt_app_connected, "Connected to a broker that is down");
+    HOST_ASSERT(host_mqtt_connect_attempts(BROKER_B) == 0, "Failed over before the attempts were used up");
+
+    advance_ms(RECONNECT_DELAY_MS);
+    check_primary(BROKER_B);
+    HOST_ASSERT(host_mqtt_connect_attempts(BROKER_A) == attempts + CONFIG_MQTT_MAX_ATTEMPTS, "Broker A retried after failover");
+    HOST_ASSERT(mqtt_app_get_connect_count() == 2 && connected_calls == 2, "Failover connection not reported");
+}
+
+/**
+ * @brief Next Server moves the session to the other broker right away
+*/
+static void test_next_server() {
+    int disconnects = disconnected_calls;
+    host_mqtt_broker_set(BROKER_A, true);
+    mqtt_app_next_server();
+    HOST_ASSERT(!mqtt_app_connected && disconnected_calls == disconnects + 1, "Next server disconnect not reported");
+    host_mqtt_run();
+    check_primary(BROKER_A);
+}
+
+/**
+ * @brief Once every broker has used up its attempts the client waits for mqtt_app_start()
+*/
+static void test_give_up() {
+    int attempts_a = host_mqtt_connect_attempts(BROKER_A);
+    int attempts_b = host_mqtt_connect_attempts(BROKER_B);
+    host_mqtt_broker_set(BROKER_B, false);
+    host_mqtt_broker_set(BROKER_A, false);
+    for (int i = 0; i < 4 * CONFIG_MQTT_MAX_ATTEMPTS; i++)
+        advance_ms(RECONNECT_DELAY_MS);
+
+    HOST_ASSERT(host_mqtt_connect_attempts(BROKER_A) == attempts_a + CONFIG_MQTT_MAX_ATTEMPTS, "%d attempts to broker A",
+                    host_mqtt_connect_attempts(BROKER_A) - attempts_a);
+    HOST_ASSERT(host_mqtt_connect_attempts(BROKER_B) == attempts_b + CONFIG_MQTT_MAX_ATTEMPTS, "%d attempts to broker B",
+                    host_mqtt_connect_attempts(BROKER_B) - attempts_b);
+
+    host_mqtt_broker_set(BROKER_B, true);
+    mqtt_app_start();
+    host_mqtt_run();
+    check_primary(BROKER_B);
+
+    // A reconnect still pending from before mqtt_app_start() must not disturb the connection
+    advance_ms(RECONNECT_DELAY_MS * 2);
+    check_primary(BROKER_B);
+}
+#else
+/**
+ * @brief The standby takes over the session under its own LWT as soon as the primary connection drops
+*/
+static void test_standby_promotion() {
+    HOST_ASSERT(host_mqtt_connect_attempts(BROKER_B) == 1 && standby_lwt_count == 1, "Standby not connected to broker B");
+
+    int64_t drop_time = esp_timer_get_time();
+    int attempts_a = host_mqtt_connect_attempts(BROKER_A);
+    host_mqtt_broker_set(BROKER_A, false);
+    HOST_ASSERT(esp_timer_get_time() == drop_time, "Event handler blocked for %lld us", (long long)(esp_timer_get_time() - drop_time));
+    check_primary(BROKER_B);
+    HOST_ASSERT(disconnected_calls == 1 && connected_calls == 2, "Promotion reported as %d disconnects and %d connects",
+                    disconnected_calls, connected_calls);
+    HOST_ASSERT(mqtt_app_get_connect_count() == 2 && mqtt_app_get_connect_time_ms() == 0, "Promotion counted as a handshake");
+    HOST_ASSERT(mqtt_app_get_lwt_id() == 100, "Session continues under LWT %d, not the standby's", mqtt_app_get_lwt_id());
+    HOST_ASSERT(strcmp(host_mqtt_client_lwt_topic(mqtt_app_client), standby_lwt_topics[0]) == 0, "Promoted client registered LWT %s",
+                    host_mqtt_client_lwt_topic(mqtt_app_client));
+
+    // The old primary becomes the standby and keeps retrying broker A from its timer
+    host_mqtt_run();
+    HOST_ASSERT(host_mqtt_connect_attempts(BROKER_A) == attempts_a, "Standby reconnected without delay");
+    advance_ms(RECONNECT_DELAY_MS);
+    HOST_ASSERT(host_mqtt_connect_attempts(BROKER_A) == attempts_a + 1, "Standby didn't retry broker A");
+    HOST_ASSERT(standby_lwt_count == 2, "Standby LWT not renewed for its connection");
+
+    host_mqtt_broker_set(BROKER_A, true);
+    advance_ms(RECONNECT_DELAY_MS);
+    HOST_ASSERT(host_mqtt_connect_attempts(BROKER_A) == attempts_a + 2, "Standby didn't reconnect to broker A");
+    check_primary(BROKER_B);
+}
+
+/**
+ * @brief Next Server promotes the connected standby, and the old primary reconnects as the standby
+*/
+static void test_next_server_promotes_standby() {
+    int attempts_b = host_mqtt_connect_attempts(BROKER_B);
+    int standby_lwt_id = 100 + standby_lwt_count - 1;
+    mqtt_app_next_server();
+    check_primary(BROKER_A);
+    HOST_ASSERT(mqtt_app_get_lwt_id() == standby_lwt_id, "Session continues under LWT %d, not %d", mqtt_app_get_lwt_id(), standby_lwt_id);
+
+    host_mqtt_run();
+    HOST_ASSERT(host_mqtt_connect_attempts(BROKER_B) == attempts_b + 1, "Old primary didn't reconnect to broker B as the standby");
+    check_primary(BROKER_A);
+
+    // With the standby on broker B, losing broker A promotes it again
+    host_mqtt_broker_set(BROKER_A, false);
+    check_primary(BROKER_B);
+}
+#endif
+
+int main() {
+    host_log_level_set(ESP_LOG_NONE);
+    start();
+#if CONFIG_MQTT_WARM_STANDBY
+    test_standby_promotion();
+    test_next_server_promotes_standby();
+#else
+    test_failover();
+    test_next_server();
+    test_give_up();
+#endif
+    mqtt_app_stop();
+    return 0;
+}
@@ -0,0 +1,272 @@
+// Host Stand-Ins
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_http_client.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "host_stubs.h"
+
+// Project Components
+// ota.c is included so the download can be run without the update task
+#include "ota.c"
+
+// Delta updates end to end: images are diffed by tools/ota_delta.py, downloaded from an HTTP stand-in
+// in reads of random length and applied to file-backed OTA partitions. Pass the Python interpreter
+// and the path of ota_delta.py
+
+#define URL "http://updates/env-controller.odl"
+#define SOURCE_SIZE (192 * 1024)
+#define TARGET_SIZE_MAX (SOURCE_SIZE + 16 * 1024)
+#define IMAGE_MAGIC 0xE9
+#define WORDS 4096                  // Vocabulary of the generated code
+#define WORD_SIZE 8
+#define RELOCATION_STRIDE 2048      // Bytes between addresses changed in place by the new image
+#define INSERT_SIZE 3000
+#define DELETE_SIZE 2000
+#define APPEND_SIZE 4096
+#define MAX_DELTA_PERCENT 10
+#define CORRUPTION_ROUNDS 300
+
+static uint8_t source[SOURCE_SIZE];
+static uint8_t target[TARGET_SIZE_MAX];
+static size_t target_size;
+static uint8_t *delta_file;
+static size_t delta_size;
+
+// Target in memory. Starts with the running partition, so ota.c's read_running() can read the source
+typedef struct {
+    ota_target_t running;
+    uint8_t *buffer;
+    size_t size;
+} memory_target_t;
+
+static void random_bytes(uint8_t *buffer, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        buffer[i] = esp_random();
+}
+
+/**
+ * @brief Fill the source with code-like content: words from a vocabulary, with a 4 byte address
+ * after every few words
+*/
+static void make_source() {
+    static uint8_t words[WORDS][WORD_SIZE];
+    random_bytes(words[0], sizeof(words));
+    size_t position = 1;
+    source[0] = IMAGE_MAGIC;
+    while (position + WORD_SIZE + 4 <= SOURCE_SIZE) {
+        memcpy(source + position, words[esp_random() % WORDS], WORD_SIZE);
+        position += WORD_SIZE;
+        if (esp_random() % 4 == 0) {
+            random_bytes(source + position, 4);
+            position += 4;
+        }
+    }
+    random_bytes(source + position, SOURCE_SIZE - position);
+}
+
+/**
+ * @brief Derive the new image: addresses changed in place, a block of new code inserted, one
+ * removed, and more appended
+*/
+static void make_target() {
+    size_t insert_at = SOURCE_SIZE * 2 / 5;
+    size_t delete_at = SOURCE_SIZE * 7 / 10;
+    memcpy(target, source, insert_at);
+    random_bytes(target + insert_at, INSERT_SIZE);
+    memcpy(target + insert_at + INSERT_SIZE, source + insert_at, delete_at - insert_at);
+    size_t position = delete_at + INSERT_SIZE;
+    memcpy(target + position, source + delete_at + DELETE_SIZE, SOURCE_SIZE - delete_at - DELETE_SIZE);
+    position += SOURCE_SIZE - delete_at - DELETE_SIZE;
+    random_bytes(target + position, APPEND_SIZE);
+    target_size = position + APPEND_SIZE;
+
+    for (size_t offset = RELOCATION_STRIDE; offset + 4 <= target_size; offset += RELOCATION_STRIDE)
+        random_bytes(target + offset, 4);
+}
+
+static void write_file(const char *path, const uint8_t *data, size_t size) {
+    FILE *file = fopen(path, "wb");
+    HOST_ASSERT(file && fwrite(data, 1, size, file) == size, "Can't write %s", path);
+    fclose(file);
+}
+
+static uint8_t *read_file(const char *path, size_t *out_size) {
+    FILE *file = fopen(path, "rb");
+    HOST_ASSERT(file, "Can't read %s", path);
+    fseek(file, 0, SEEK_END);
+    *out_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = malloc(*out_size);
+    HOST_ASSERT(fread(data, 1, *out_size, file) == *out_size, "Can't read %s", path);
+    fclose(file);
+    return data;
+}
+
+static void generate_delta(const char *python, const char *script) {
+    write_file("ota_source.bin", source, SOURCE_SIZE);
+    write_file("ota_target.bin", target, target_size);
+    char command[1024];
+    snprintf(command, sizeof(command), "\"%s\" \"%s\" ota_source.bin ota_target.bin ota_update.odl", python, script);
+    HOST_ASSERT(system(command) == 0, "%s failed", command);
+    delta_file = read_file("ota_update.odl", &delta_size);
+    HOST_ASSERT(ota_delta_detect(delta_file, delta_size), "Delta not detected");
+    HOST_ASSERT(delta_size * 100 < target_size * MAX_DELTA_PERCENT, "%zu byte delta of a %zu byte image", delta_size, target_size);
+}
+
+/**
+ * @brief Boot from a freshly flashed source image
+*/
+static void flash_source() {
+    host_ota_init();
+    host_ota_flash_running(source, SOURCE_SIZE);
+}
+
+static esp_err_t run_update(const uint8_t *body, size_t size) {
+    host_http_serve(URL, 200, body, size);
+    strcpy(url, URL);
+    esp_err_t result = download(esp_ota_get_next_update_partition(NULL));
+    HOST_ASSERT(host_http_open_clients() == 0, "Connection left open");
+    return result;
+}
+
+static void check_updated(const uint8_t *image, size_t size) {
+    HOST_ASSERT(strcmp(host_ota_boot_label(), "ota_1") == 0, "Booting from %s", host_ota_boot_label());
+    HOST_ASSERT(host_ota_written() == size, "%zu bytes written, not %zu", host_ota_written(), size);
+    uint8_t *written = malloc(size);
+    HOST_ASSERT(esp_partition_read(esp_ota_get_next_update_partition(NULL), 0, written, size) == ESP_OK, "Read failed");
+    HOST_ASSERT(memcmp(written, image, size) == 0, "Update partition doesn't hold the new image");
+    free(written);
+}
+
+static void check_not_updated() {
+    HOST_ASSERT(strcmp(host_ota_boot_label(), "ota_0") == 0, "Boot partition changed to %s", host_ota_boot_label());
+}
+
+static void test_delta_round_trip() {
+    flash_source();
+    esp_err_t result = run_update(delta_file, delta_size);
+    HOST_ASSERT(result == ESP_OK, "Delta update failed: %s", esp_err_to_name(result));
+    check_updated(target, target_size);
+    printf("%zu byte delta for a %zu byte image (%.1f%%)\n", delta_size, target_size, 100.0 * delta_size / target_size);
+}
+
+static void test_full_image() {
+    flash_source();
+    esp_err_t result = run_update(target, target_size);
+    HOST_ASSERT(result == ESP_OK, "Full image update failed: %s", esp_err_to_name(result));
+    check_updated(target, target_size);
+}
+
+static esp_err_t write_memory(void *ctx, const void *data, size_t size) {
+    memory_target_t *memory = (memory_target_t *) ctx;
+    if (memory->size + size > TARGET_SIZE_MAX)
+        return ESP_ERR_INVALID_SIZE;
+    memcpy(memory->buffer + memory->size, data, size);
+    memory->size += size;
+    return ESP_OK;
+}
+
+/**
+ * @brief Feed the delta one byte at a time. Every op and varint is split
+*/
+static void test_byte_at_a_time() {
+    flash_source();
+    memory_target_t memory = {
+        .running = { .running = esp_ota_get_running_partition() },
+        .buffer = malloc(TARGET_SIZE_MAX),
+    };
+    ota_delta_t decoder;
+    ota_delta_begin(&decoder, read_running, write_memory, &memory);
+    for (size_t i = 0; i < delta_size; i++)
+        HOST_ASSERT(ota_delta_feed(&decoder, delta_file + i, 1) == ESP_OK, "Feed failed at byte %zu", i);
+    HOST_ASSERT(ota_delta_finish(&decoder) == ESP_OK, "Finish failed");
+    HOST_ASSERT(memory.size == target_size && memcmp(memory.buffer, target, target_size) == 0, "Wrong image decoded");
+    free(memory.buffer);
+}
+
+/**
+ * @brief Every corrupted byte, in the header or the ops, fails the update before it can be booted
+*/
+static void test_corrupted_delta() {
+    flash_source();
+    uint8_t *corrupted = malloc(delta_size);
+    int failures[4] = { 0 };        // Source mismatch, malformed, size, CRC
+    for (int round = 0; round < CORRUPTION_ROUNDS; round++) {
+        memcpy(corrupted, delta_file, delta_size);
+        size_t position = esp_random() % delta_size;
+        corrupted[position] ^= 1 + esp_random() % 255;
+
+        esp_err_t result = run_update(corrupted, delta_size);
+        HOST_ASSERT(result != ESP_OK, "Delta corrupted at byte %zu applied", position);
+        check_not_updated();
+        failures[0] += result == ESP_ERR_INVALID_VERSION;
+        failures[1] += result == ESP_ERR_INVALID_ARG;
+        failures[2] += result == ESP_ERR_INVALID_SIZE;
+        failures[3] += result == ESP_ERR_INVALID_CRC;
+    }
+    free(corrupted);
+    printf("Corrupted deltas rejected: %d source mismatch, %d malformed, %d size, %d CRC\n", failures[0], failures[1],
+            failures[2], failures[3]);
+
+    // Each failed update was aborted, so the next one can start
+    HOST_ASSERT(run_update(delta_file, delta_size) == ESP_OK, "Update after corrupted deltas failed");
+    check_updated(target, target_size);
+}
+
+static void test_truncated_download() {
+    flash_source();
+    host_http_serve(URL, 200, delta_file, delta_size);
+    host_http_drop_after(delta_size / 2);
+    strcpy(url, URL);
+    esp_err_t result = download(esp_ota_get_next_update_partition(NULL));
+    HOST_ASSERT(result == ESP_ERR_TIMEOUT, "Truncated download returned %s", esp_err_to_name(result));
+    check_not_updated();
+}
+
+/**
+ * @brief A delta made against another image is rejected before anything is written
+*/
+static void test_wrong_source() {
+    host_ota_init();
+    uint8_t *other = malloc(SOURCE_SIZE);
+    memcpy(other, source, SOURCE_SIZE);
+    other[SOURCE_SIZE / 2] ^= 0x01;
+    host_ota_flash_running(other, SOURCE_SIZE);
+    free(other);
+
+    esp_err_t result = run_update(delta_file, delta_size);
+    HOST_ASSERT(result == ESP_ERR_INVALID_VERSION, "Delta for another image returned %s", esp_err_to_name(result));
+    HOST_ASSERT(host_ota_written() == 0, "%zu bytes written", host_ota_written());
+    check_not_updated();
+}
+
+static void test_not_found() {
+    flash_source();
+    host_http_serve("http://updates/other.odl", 200, delta_file, delta_size);
+    strcpy(url, URL);
+    HOST_ASSERT(download(esp_ota_get_next_update_partition(NULL)) == ESP_ERR_NOT_FOUND, "Missing image not reported");
+    HOST_ASSERT(host_http_open_clients() == 0, "Connection left open");
+    check_not_updated();
+}
+
+int main(int argc, char **argv) {
+    HOST_ASSERT(argc == 3, "Usage: %s <python> <ota_delta.py>", argv[0]);
+    host_log_level_set(ESP_LOG_NONE);
+    host_random_seed(47);
+
+    make_source();
+    make_target();
+    generate_delta(argv[1], argv[2]);
+
+    test_delta_round_trip();
+    test_full_image();
+    test_byte_at_a_time();
+    test_corrupted_delta();
+    test_truncated_download();
+    test_wrong_source();
+    test_not_found();
+    free(delta_file);
+    return 0;
+}
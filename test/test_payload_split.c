@@ -0,0 +1,192 @@
+// Host Stand-Ins
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "host_stubs.h"
+
+// Project Components
+#include "esp_tahu.h"
+#include "pb_decode.h"
+
+// Sizing, splitting and BIRTH limits of esp-tahu with metric sets larger than a single payload
+
+#define METRICS_MAX 150
+#define BIRTH_METRICS 60
+#define NAME_MAX 40
+#define LARGE_STRING_LENGTH (CONFIG_SPARKPLUG_DATA_SPLIT_SIZE + 500)
+
+typedef struct {
+    int metrics_count;
+    char first_name[NAME_MAX];
+    char last_name[NAME_MAX];
+    bool has_seq;
+    uint64_t seq;
+} parsed_payload_t;
+
+static char node_id[] = "node";
+static char device_id[] = "dev";
+static char names[METRICS_MAX][NAME_MAX];
+static esp_tahu_metric_t metrics[METRICS_MAX];
+
+static void create_metrics() {
+    for (int i = 0; i < METRICS_MAX; i++) {
+        snprintf(names[i], NAME_MAX, "Zone %03d/Sensor Temperature", i);
+        switch (i % 4) {
+            case 0: {
+                float value = i * 0.5f;
+                esp_tahu_create_metric(device_id, &metrics[i], names[i], ESP_TAHU_METRIC_TYPE_FLOAT, NULL);
+                esp_tahu_set_metric_data(&metrics[i], false, &value);
+                break;
+            }
+            case 1: {
+                uint32_t value = i * 1000;
+                esp_tahu_create_metric(device_id, &metrics[i], names[i], ESP_TAHU_METRIC_TYPE_UINT32, NULL);
+                esp_tahu_set_metric_data(&metrics[i], false, &value);
+                break;
+            }
+            case 2: {
+                bool value = i & 1;
+                esp_tahu_create_metric(device_id, &metrics[i], names[i], ESP_TAHU_METRIC_TYPE_BOOLEAN, NULL);
+                esp_tahu_set_metric_data(&metrics[i], false, &value);
+                break;
+            }
+            default:
+                esp_tahu_create_metric(device_id, &metrics[i], names[i], ESP_TAHU_METRIC_TYPE_STRING, NULL);
+                esp_tahu_set_metric_data(&metrics[i], false, "cooling");
+                break;
+        }
+    }
+}
+
+static bool read_string(pb_istream_t *stream, char *buffer, size_t size) {
+    uint32_t length;
+    if (!pb_decode_varint32(stream, &length))
+        return false;
+    if (length >= size)
+        return pb_read(stream, NULL, length);
+    buffer[length] = '\0';
+    return pb_read(stream, (uint8_t *)buffer, length);
+}
+
+/**
+ * @brief Count the metrics of an encoded payload and get its seq and first and last metric names
+*/
+static void parse_payload(const host_publish_t *publish, parsed_payload_t *parsed) {
+    memset(parsed, 0, sizeof(*parsed));
+    pb_istream_t stream = pb_istream_from_buffer(publish->data, publish->data_len);
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof;
+
+    while (pb_decode_tag(&stream, &wire_type, &tag, &eof)) {
+        if (tag == org_eclipse_tahu_protobuf_Payload_seq_tag) {
+            HOST_ASSERT(pb_decode_varint(&stream, &parsed->seq), "Bad seq in %s", publish->topic);
+            parsed->has_seq = true;
+            continue;
+        }
+        if (tag != org_eclipse_tahu_protobuf_Payload_metrics_tag) {
+            HOST_ASSERT(pb_skip_field(&stream, wire_type), "Bad field %u in %s", tag, publish->topic);
+            continue;
+        }
+
+        pb_istream_t metric_stream;
+        HOST_ASSERT(pb_make_string_substream(&stream, &metric_stream), "Bad metric in %s", publish->topic);
+        char *name = parsed->metrics_count ? parsed->last_name : parsed->first_name;
+        while (pb_decode_tag(&metric_stream, &wire_type, &tag, &eof)) {
+            bool ok = tag == org_eclipse_tahu_protobuf_Payload_Metric_name_tag ? read_string(&metric_stream, name, NAME_MAX)
+                                                                               : pb_skip_field(&metric_stream, wire_type);
+            HOST_ASSERT(ok, "Bad metric field %u in %s", tag, publish->topic);
+        }
+        HOST_ASSERT(eof, "Truncated metric in %s", publish->topic);
+        pb_close_string_substream(&stream, &metric_stream);
+        if (parsed->metrics_count == 0)
+            strcpy(parsed->last_name, parsed->first_name);
+        parsed->metrics_count++;
+    }
+    HOST_ASSERT(eof, "Truncated payload in %s", publish->topic);
+}
+
+static void test_ddata_split() {
+    host_publish_clear();
+    esp_tahu_publish_ddata(metrics, METRICS_MAX);
+    int count = host_publish_count();
+    HOST_ASSERT(count > 1, "%d metrics were not split", METRICS_MAX);
+
+    int total = 0;
+    parsed_payload_t previous = { 0 };
+    for (int i = 0; i < count; i++) {
+        const host_publish_t *publish = host_publish_get(i);
+        parsed_payload_t parsed;
+        parse_payload(publish, &parsed);
+        HOST_ASSERT(strcmp(publish->topic, "spBv1.0/" CONFIG_SPARKPLUG_GROUP_ID "/DDATA/node/dev") == 0, "Unexpected topic %s", publish->topic);
+        HOST_ASSERT(publish->data_len <= CONFIG_SPARKPLUG_DATA_SPLIT_SIZE, "Part %d of %d bytes exceeds the split size", i, publish->data_len);
+        HOST_ASSERT(parsed.has_seq, "Part %d has no seq", i);
+        HOST_ASSERT(i == 0 || parsed.seq == (previous.seq + 1) % 256, "Part %d has seq %llu after %llu", i,
+                        (unsigned long long)parsed.seq, (unsigned long long)previous.seq);
+        // Parts carry consecutive runs of the metrics in order
+        HOST_ASSERT(strcmp(parsed.first_name, names[total]) == 0, "Part %d starts with '%s', not '%s'", i, parsed.first_name, names[total]);
+        total += parsed.metrics_count;
+        HOST_ASSERT(strcmp(parsed.last_name, names[total - 1]) == 0, "Part %d ends with '%s'", i, parsed.last_name);
+        previous = parsed;
+    }
+    HOST_ASSERT(total == METRICS_MAX, "%d of %d metrics published", total, METRICS_MAX);
+    printf("DDATA of %d metrics split into %d payloads\n", METRICS_MAX, count);
+}
+
+static void test_birth_limit() {
+    host_publish_clear();
+    esp_tahu_init_device(device_id, metrics, BIRTH_METRICS);
+    HOST_ASSERT(host_publish_count() == 1, "DBIRTH of %d metrics published as %d payloads", BIRTH_METRICS, host_publish_count());
+    const host_publish_t *publish = host_publish_get(0);
+    parsed_payload_t parsed;
+    parse_payload(publish, &parsed);
+    HOST_ASSERT(parsed.metrics_count == BIRTH_METRICS, "DBIRTH carries %d of %d metrics", parsed.metrics_count, BIRTH_METRICS);
+    HOST_ASSERT(publish->data_len > CONFIG_SPARKPLUG_DATA_SPLIT_SIZE, "DBIRTH of %d bytes doesn't exercise the large pool class", publish->data_len);
+
+    // A BIRTH can't be split, so one over the maximum payload size is dropped rather than truncated
+    host_publish_clear();
+    esp_tahu_init_device(device_id, metrics, METRICS_MAX);
+    HOST_ASSERT(host_publish_count() == 0, "Oversize DBIRTH published");
+}
+
+static void test_unsplittable_metric() {
+    static char large_string[LARGE_STRING_LENGTH + 1];
+    memset(large_string, 'x', LARGE_STRING_LENGTH);
+    esp_tahu_metric_t metric = { 0 };
+    esp_tahu_create_metric(device_id, &metric, "Log", ESP_TAHU_METRIC_TYPE_STRING, NULL);
+    esp_tahu_set_metric_data(&metric, false, large_string);
+
+    host_publish_clear();
+    esp_tahu_publish_ddata(&metric, 1);
+    HOST_ASSERT(host_publish_count() == 1, "Single metric over the split size published as %d payloads", host_publish_count());
+    HOST_ASSERT(host_publish_get(0)->data_len > LARGE_STRING_LENGTH, "Single metric truncated");
+    free(metric.value.string_value);
+}
+
+static void test_exact_size() {
+    static uint8_t buffer[CONFIG_SPARKPLUG_PAYLOAD_MAX_SIZE * 4];
+    ssize_t size = esp_tahu_encode_data(metrics, METRICS_MAX, buffer, sizeof(buffer));
+    HOST_ASSERT(size > 0, "Failed to encode %d metrics", METRICS_MAX);
+    HOST_ASSERT(esp_tahu_encode_data(metrics, METRICS_MAX, buffer, size) == size, "Encode into an exact size buffer failed");
+    HOST_ASSERT(esp_tahu_encode_data(metrics, METRICS_MAX, buffer, size - 1) < 0, "Encode into a short buffer succeeded");
+}
+
+int main() {
+    host_log_level_set(ESP_LOG_NONE);
+    create_metrics();
+    esp_tahu_configure(node_id);
+    esp_tahu_init_node(NULL, 0);
+
+    test_ddata_split();
+    test_birth_limit();
+    test_unsplittable_metric();
+    test_exact_size();
+
+    host_publish_clear();
+    for (int i = 0; i < METRICS_MAX; i++) {
+        if (metrics[i].data_type == ESP_TAHU_METRIC_TYPE_STRING)
+            free(metrics[i].value.string_value);
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+// Host Stand-Ins
+#include <stdio.h>
+#include <string.h>
+#include "esp_err.h"
+#include "host_stubs.h"
+
+// Project Components
+#include "esp_tahu.h"
+#include "sensor.h"
+#include "temp_controller.h"
+
+// Project Files
+#include "tc_metrics.h"
+
+// Zone device metrics of the temperature controller against a stand-in controller. Setpoint and
+// sensor writes must only reach the zone they were written to
+
+#define ZONE_COUNT CONFIG_TC_ZONE_COUNT
+#define RESTORED_SETPOINT 10.0f     // A non-default setpoint the zone had before its metrics were built
+
+static const char *channel_names[SENSOR_CHANNEL_COUNT] = {
+    [SENSOR_CHANNEL_DHT_TEMPERATURE] = "dht/temperature",
+    [SENSOR_CHANNEL_DHT_HUMIDITY] = "dht/humidity",
+    [SENSOR_CHANNEL_DS18B20_TEMPERATURE] = "ds18b20/temperature",
+};
+static float setpoints[ZONE_COUNT];
+static sensor_channel_t channels[ZONE_COUNT];
+static esp_tahu_metric_t metrics[ZONE_COUNT * SP_ZONE_METRIC_COUNT];
+static char device_ids[ZONE_COUNT][TC_DEVICE_ID_MAX];
+
+void temp_controller_set_setpoint(int zone, float setpoint) {
+    setpoints[zone] = setpoint;
+}
+
+float temp_controller_get_setpoint(int zone) {
+    return setpoints[zone];
+}
+
+sensor_channel_t temp_controller_get_channel(int zone) {
+    return channels[zone];
+}
+
+esp_err_t temp_controller_bind(int zone, sensor_channel_t channel) {
+    if (channel == SENSOR_CHANNEL_DHT_HUMIDITY)
+        return ESP_ERR_INVALID_ARG;
+    channels[zone] = channel;
+    return ESP_OK;
+}
+
+const char *sensor_get_channel_name(sensor_channel_t channel) {
+    return channel_names[channel];
+}
+
+esp_err_t sensor_find_channel(const char *name, sensor_channel_t *out_channel) {
+    for (int i = 0; i < SENSOR_CHANNEL_COUNT; i++) {
+        if (strcmp(channel_names[i], name) == 0) {
+            *out_channel = i;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+static esp_tahu_metric_t *zone_metric(int zone, sp_zone_metrics_t metric) {
+    return metrics + zone * SP_ZONE_METRIC_COUNT + metric;
+}
+
+/**
+ * @brief Check every zone against the expected setpoints and channels
+*/
+static void check_zones(const float *expected_setpoints, const sensor_channel_t *expected_channels) {
+    for (int zone = 0; zone < ZONE_COUNT; zone++) {
+        HOST_ASSERT(setpoints[zone] == expected_setpoints[zone], "Zone %d setpoint is %f, not %f", zone + 1, setpoints[zone],
+                        expected_setpoints[zone]);
+        HOST_ASSERT(zone_metric(zone, SP_ZONE_SETPOINT)->value.float_value == setpoints[zone], "Zone %d setpoint metric is %f",
+                        zone + 1, zone_metric(zone, SP_ZONE_SETPOINT)->value.float_value);
+        HOST_ASSERT(channels[zone] == expected_channels[zone], "Zone %d bound to %s", zone + 1, channel_names[channels[zone]]);
+        HOST_ASSERT(strcmp(zone_metric(zone, SP_ZONE_SENSOR)->value.string_value, channel_names[channels[zone]]) == 0,
+                        "Zone %d sensor metric is %s", zone + 1, zone_metric(zone, SP_ZONE_SENSOR)->value.string_value);
+    }
+}
+
+/**
+ * @brief Building the metrics seeds each zone from its controller and leaves every controller unchanged
+*/
+static void test_build() {
+    float expected_setpoints[ZONE_COUNT];
+    sensor_channel_t expected_channels[ZONE_COUNT];
+    for (int zone = 0; zone < ZONE_COUNT; zone++) {
+        setpoints[zone] = expected_setpoints[zone] = zone == ZONE_COUNT - 1 ? RESTORED_SETPOINT : CONFIG_TC_DEFAULT_SETPOINT;
+        channels[zone] = expected_channels[zone] = SENSOR_CHANNEL_DHT_TEMPERATURE;
+    }
+    tc_metrics_build(metrics, device_ids);
+    check_zones(expected_setpoints, expected_channels);
+    HOST_ASSERT(strcmp(device_ids[1], CONFIG_APP_SPARKPLUG_DEVICE_ID_TEMP_CONTROLLER "_2") == 0, "Zone 2 device ID is %s", device_ids[1]);
+}
+
+static void test_setpoint_write() {
+    float expected_setpoints[ZONE_COUNT];
+    sensor_channel_t expected_channels[ZONE_COUNT];
+    memcpy(expected_setpoints, setpoints, sizeof(setpoints));
+    memcpy(expected_channels, channels, sizeof(channels));
+
+    float setpoint = 33.5f;
+    esp_tahu_set_metric_data(zone_metric(1, SP_ZONE_SETPOINT), false, &setpoint);
+    expected_setpoints[1] = setpoint;
+    check_zones(expected_setpoints, expected_channels);
+}
+
+static void test_sensor_write() {
+    float expected_setpoints[ZONE_COUNT];
+    sensor_channel_t expected_channels[ZONE_COUNT];
+    memcpy(expected_setpoints, setpoints, sizeof(setpoints));
+    memcpy(expected_channels, channels, sizeof(channels));
+
+    esp_tahu_set_metric_data(zone_metric(0, SP_ZONE_SENSOR), false, (void *) channel_names[SENSOR_CHANNEL_DS18B20_TEMPERATURE]);
+    expected_channels[0] = SENSOR_CHANNEL_DS18B20_TEMPERATURE;
+    check_zones(expected_setpoints, expected_channels);
+
+    // Rejected channels revert the metric and leave every zone bound as before
+    esp_tahu_set_metric_data(zone_metric(2, SP_ZONE_SENSOR), false, (void *) channel_names[SENSOR_CHANNEL_DHT_HUMIDITY]);
+    check_zones(expected_setpoints, expected_channels);
+    esp_tahu_set_metric_data(zone_metric(2, SP_ZONE_SENSOR), false, "unknown");
+    check_zones(expected_setpoints, expected_channels);
+}
+
+int main() {
+    host_log_level_set(ESP_LOG_NONE);
+    test_build();
+    test_setpoint_write();
+    test_sensor_write();
+    return 0;
+}
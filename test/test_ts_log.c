@@ -0,0 +1,228 @@
+// Host Stand-Ins
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_system.h"
+#include "host_stubs.h"
+
+// Project Components
+// ts_log.c is included so a reboot can be emulated by resetting its state
+#include "ts_log.c"
+
+// Appends, wraparound, time range queries, remounting and power loss of the time-series log on an
+// emulated NOR flash partition
+
+#define BLOCKS 8
+#define INTERVAL_MS 60000
+#define T0 1700000000000ULL
+#define CHANNELS 2
+#define POWER_LOSS_ROUNDS 500
+
+static const float channel_resolution[CHANNELS] = { 0.1f, 0.5f };
+static uint64_t next_index = 0;    // Index of the next record. Record i is logged at T0 + i * INTERVAL_MS
+
+typedef struct {
+    size_t count;
+    uint64_t first;
+    uint64_t last;
+} read_result_t;
+
+static void expected_values(uint64_t index, float *values) {
+    values[0] = 20 + (index % 50) * 0.1f;
+    values[1] = 40 - (index % 30) * 0.5f;
+}
+
+static uint64_t record_index(const ts_log_record_t *record) {
+    HOST_ASSERT(record->timestamp >= T0 && (record->timestamp - T0) % INTERVAL_MS == 0, "Unexpected timestamp %llu",
+                    (unsigned long long)record->timestamp);
+    return (record->timestamp - T0) / INTERVAL_MS;
+}
+
+static void check_record(const ts_log_record_t *record) {
+    float values[CHANNELS];
+    expected_values(record_index(record), values);
+    for (int i = 0; i < CHANNELS; i++) {
+        HOST_ASSERT(fabsf(record->values[i] - values[i]) <= channel_resolution[i] / 2 + 1e-4f, "Record %llu channel %d is %f, not %f",
+                        (unsigned long long)record_index(record), i, record->values[i], values[i]);
+    }
+}
+
+static void reboot() {
+    free(blocks);
+    blocks = NULL;
+    partition = NULL;
+    head = -1;
+    host_flash_power_loss_after(-1);
+    HOST_ASSERT(ts_log_init(CHANNELS, channel_resolution) == ESP_OK, "Mount failed");
+}
+
+static esp_err_t append(uint64_t count) {
+    for (uint64_t i = 0; i < count; i++) {
+        float values[CHANNELS];
+        expected_values(next_index, values);
+        esp_err_t result = ts_log_append(T0 + next_index * INTERVAL_MS, values);
+        if (result != ESP_OK)
+            return result;
+        next_index++;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Read a time range and check that it holds consecutive records, oldest first
+*/
+static read_result_t read_range(uint64_t start, uint64_t end) {
+    read_result_t result = { 0 };
+    ts_log_cursor_t cursor;
+    ts_log_record_t records[16];
+    size_t count;
+    HOST_ASSERT(ts_log_seek(&cursor, start, end) == ESP_OK, "Seek failed");
+    while ((count = ts_log_read(&cursor, records, 16))) {
+        for (size_t i = 0; i < count; i++) {
+            HOST_ASSERT(records[i].timestamp >= start && records[i].timestamp <= end, "Record outside of the range read");
+            check_record(&records[i]);
+            uint64_t index = record_index(&records[i]);
+            HOST_ASSERT(!result.count || index == result.last + 1, "Record %llu read after %llu", (unsigned long long)index,
+                            (unsigned long long)result.last);
+            if (!result.count)
+                result.first = index;
+            result.last = index;
+            result.count++;
+        }
+    }
+    ts_log_cursor_free(&cursor);
+    return result;
+}
+
+static read_result_t read_all() {
+    return read_range(0, UINT64_MAX);
+}
+
+static void test_wraparound() {
+    HOST_ASSERT(append(20000) == ESP_OK, "Append failed");
+    read_result_t result = read_all();
+    HOST_ASSERT(result.last == next_index - 1, "Newest record %llu, not %llu", (unsigned long long)result.last,
+                    (unsigned long long)next_index - 1);
+    HOST_ASSERT(result.first > 0, "Oldest records not erased");
+    // Only the oldest block is erased to make room
+    HOST_ASSERT(result.count * 8 > (BLOCKS - 1) * BLOCK_SIZE, "Only %zu records retained", result.count);
+    printf("%zu records retained in %d blocks, %.2f bytes per record\n", result.count, BLOCKS,
+            (double)(BLOCKS - 1) * BLOCK_SIZE / result.count);
+
+    uint32_t min_erases = UINT32_MAX, max_erases = 0;
+    for (int i = 0; i < BLOCKS; i++) {
+        min_erases = host_flash_erase_count(i) < min_erases ? host_flash_erase_count(i) : min_erases;
+        max_erases = host_flash_erase_count(i) > max_erases ? host_flash_erase_count(i) : max_erases;
+    }
+    HOST_ASSERT(max_erases - min_erases <= 1, "Uneven wear. Blocks erased %u to %u times", min_erases, max_erases);
+}
+
+static void test_range_query() {
+    uint64_t first = next_index - 1000;
+    read_result_t result = read_range(T0 + first * INTERVAL_MS, T0 + (first + 10) * INTERVAL_MS);
+    HOST_ASSERT(result.count == 11 && result.first == first, "Range read %zu records from %llu", result.count,
+                    (unsigned long long)result.first);
+
+    // Between two records
+    result = read_range(T0 + first * INTERVAL_MS + 1, T0 + (first + 1) * INTERVAL_MS - 1);
+    HOST_ASSERT(result.count == 0, "Empty range read %zu records", result.count);
+    result = read_range(0, T0 - 1);
+    HOST_ASSERT(result.count == 0, "Range before the log read %zu records", result.count);
+}
+
+static void test_remount() {
+    read_result_t before = read_all();
+    reboot();
+    read_result_t after = read_all();
+    HOST_ASSERT(after.count == before.count && after.first == before.first && after.last == before.last, "Records changed by remount");
+
+    HOST_ASSERT(append(10) == ESP_OK, "Append after remount failed");
+    after = read_all();
+    HOST_ASSERT(after.last == next_index - 1, "Records appended after remount not read");
+}
+
+/**
+ * @brief Lose power at random points of appending. Every acknowledged record survives, a torn record is
+ * never read, and the log continues after the reboot. Values are checked by read_range()
+*/
+static void test_power_loss() {
+    host_random_seed(2024);
+    for (int round = 0; round < POWER_LOSS_ROUNDS; round++) {
+        host_flash_power_loss_after(esp_random() % 40);
+        esp_err_t result = append(100);
+        HOST_ASSERT(result != ESP_OK, "Power loss not reported");
+
+        reboot();
+        read_result_t records = read_all();
+        // A record whose write failed only after it was fully programmed is kept
+        if (records.last == next_index)
+            next_index++;
+        HOST_ASSERT(records.last == next_index - 1, "Round %d: newest record %llu, last acknowledged %llu", round,
+                        (unsigned long long)records.last, (unsigned long long)next_index - 1);
+    }
+    HOST_ASSERT(append(100) == ESP_OK, "Append after power loss failed");
+    HOST_ASSERT(read_all().last == next_index - 1, "Records appended after power loss not read");
+}
+
+/**
+ * @brief A cursor whose blocks are erased while it reads skips the erased records
+*/
+static void test_read_during_wrap() {
+    ts_log_cursor_t cursor;
+    ts_log_record_t records[16];
+    HOST_ASSERT(ts_log_seek(&cursor, 0, UINT64_MAX) == ESP_OK, "Seek failed");
+    size_t count = ts_log_read(&cursor, records, 16);
+    HOST_ASSERT(count == 16, "Read %zu records", count);
+    uint64_t last = record_index(&records[count - 1]);
+
+    HOST_ASSERT(append(BLOCKS * 1000) == ESP_OK, "Append failed");
+    while ((count = ts_log_read(&cursor, records, 16))) {
+        for (size_t i = 0; i < count; i++) {
+            check_record(&records[i]);
+            HOST_ASSERT(record_index(&records[i]) > last, "Record %llu read after %llu", (unsigned long long)record_index(&records[i]),
+                            (unsigned long long)last);
+            last = record_index(&records[i]);
+        }
+    }
+    ts_log_cursor_free(&cursor);
+    HOST_ASSERT(last == next_index - 1, "Cursor stopped at %llu", (unsigned long long)last);
+}
+
+/**
+ * @brief A clock set back starts a new block. The earlier timestamp is still found by a range query
+*/
+static void test_clock_set_back() {
+    uint64_t timestamp = T0 - 1000ULL * INTERVAL_MS;
+    float values[CHANNELS] = { 1.0f, 2.0f };
+    HOST_ASSERT(ts_log_append(timestamp, values) == ESP_OK, "Append failed");
+
+    ts_log_cursor_t cursor;
+    ts_log_record_t records[4];
+    HOST_ASSERT(ts_log_seek(&cursor, timestamp, timestamp) == ESP_OK, "Seek failed");
+    size_t count = ts_log_read(&cursor, records, 4);
+    ts_log_cursor_free(&cursor);
+    HOST_ASSERT(count == 1 && records[0].timestamp == timestamp && records[0].values[0] == 1.0f && records[0].values[1] == 2.0f,
+                    "Record before a clock correction not read");
+
+    reboot();
+    HOST_ASSERT(ts_log_seek(&cursor, timestamp, timestamp) == ESP_OK, "Seek failed");
+    count = ts_log_read(&cursor, records, 4);
+    ts_log_cursor_free(&cursor);
+    HOST_ASSERT(count == 1, "Record before a clock correction lost by remount");
+}
+
+int main() {
+    host_log_level_set(ESP_LOG_NONE);
+    host_flash_init(CONFIG_TS_LOG_PARTITION_LABEL, BLOCKS * BLOCK_SIZE);
+    HOST_ASSERT(ts_log_init(CHANNELS, channel_resolution) == ESP_OK, "Mount failed");
+    HOST_ASSERT(read_all().count == 0, "Erased log not empty");
+
+    test_wraparound();
+    test_range_query();
+    test_remount();
+    test_power_loss();
+    test_read_during_wrap();
+    test_clock_set_back();
+    return 0;
+}
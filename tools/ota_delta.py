@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Generate a delta between two firmware images for components/ota.
+
+The device applies the delta to its running image as it downloads it, so the
+source must be the exact image the device is running. See ota_delta.h for the
+format.
+
+    tools/ota_delta.py build/old.bin build/new.bin update.odl
+"""
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"ODL1"
+OP_COPY = 0x01
+OP_INSERT = 0x02
+GRAM = 16           # Bytes hashed to find matches
+MIN_COPY = 12       # Shorter matches cost more than inserting the bytes
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return (value << 1) ^ (value >> 63) if value < 0 else value << 1
+
+
+def match_length(source, s, target, t):
+    length = 0
+    limit = min(len(source) - s, len(target) - t)
+    while length < limit and source[s + length] == target[t + length]:
+        length += 1
+    return length
+
+
+def diff(source, target):
+    index = {}
+    for offset in range(len(source) - GRAM + 1):
+        index.setdefault(source[offset:offset + GRAM], offset)
+
+    out = bytearray()
+    literal = bytearray()
+    source_offset = 0   # End of the previous copy
+    predicted = 0       # Source offset aligned with the target position, for code that only changed in place
+    t = 0
+
+    def flush_literal():
+        if literal:
+            out.append(OP_INSERT)
+            out.extend(varint(len(literal)))
+            out.extend(literal)
+            literal.clear()
+
+    while t < len(target):
+        best_offset, best_length = 0, 0
+        for candidate in (predicted, index.get(target[t:t + GRAM])):
+            if candidate is None or candidate >= len(source):
+                continue
+            length = match_length(source, candidate, target, t)
+            if length > best_length:
+                best_offset, best_length = candidate, length
+
+        if best_length < MIN_COPY:
+            literal.append(target[t])
+            t += 1
+            predicted += 1
+            continue
+
+        flush_literal()
+        out.append(OP_COPY)
+        out.extend(varint(zigzag(best_offset - source_offset)))
+        out.extend(varint(best_length))
+        source_offset = best_offset + best_length
+        predicted = source_offset
+        t += best_length
+    flush_literal()
+
+    header = MAGIC + struct.pack("<IIII", len(source), zlib.crc32(source), len(target), zlib.crc32(target))
+    return header + bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", help="image running on the device")
+    parser.add_argument("target", help="new image")
+    parser.add_argument("output", help="delta to serve to the device")
+    args = parser.parse_args()
+
+    with open(args.source, "rb") as f:
+        source = f.read()
+    with open(args.target, "rb") as f:
+        target = f.read()
+
+    delta = diff(source, target)
+    with open(args.output, "wb") as f:
+        f.write(delta)
+    print("%d byte delta, %.1f%% of the %d byte image" % (len(delta), 100.0 * len(delta) / len(target), len(target)),
+          file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()